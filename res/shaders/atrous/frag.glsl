@@ -0,0 +1,64 @@
+#version 330 core
+
+/*
+ * One pass of the edge-aware a-trous filter, mirrors src/trace/denoise.c.
+ * Keep the two in sync.
+ */
+
+const float EPSILON = 1e-4f;
+
+/* taps weighted below e^-20 are skipped */
+const float MAX_EXPONENT = 20.0f;
+
+/* B3 spline taps by distance from the center */
+const float kernel[ 3 ] = float[ 3 ]( 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f );
+
+uniform sampler2D color;
+uniform sampler2D guide;	/* normal and depth, see raytracer/frag.glsl */
+
+uniform int step;			/* pixels between the taps */
+uniform float inv_color;	/* 1 / sigma^2 */
+uniform float inv_normal;
+uniform float sigma_depth;
+
+out vec4 out_color;
+
+float weight( vec3 c, vec4 g, vec3 qc, vec4 qg )
+{
+	vec3 dc = c - qc;
+	vec3 dn = g.xyz - qg.xyz;
+	float dz = ( g.w - qg.w ) / ( sigma_depth * g.w + EPSILON );
+	float e = dot( dc, dc ) * inv_color + dot( dn, dn ) * inv_normal + dz * dz;
+
+	return e < MAX_EXPONENT ? exp( -e ) : 0.0f;
+}
+
+void main()
+{
+	ivec2 p = ivec2( gl_FragCoord.xy );
+	ivec2 size = textureSize( color, 0 );
+	vec3 c = texelFetch( color, p, 0 ).rgb;
+	vec4 g = texelFetch( guide, p, 0 );
+
+	vec3 sum = vec3( 0.0f );
+	float weights = 0.0f;
+
+	for ( int ky = -2; ky <= 2; ky++ )
+	{
+		for ( int kx = -2; kx <= 2; kx++ )
+		{
+			ivec2 q = p + ivec2( kx, ky ) * step;
+			if ( any( lessThan( q, ivec2( 0 ) ) ) || any( greaterThanEqual( q, size ) ) )
+				continue;
+
+			vec3 qc = texelFetch( color, q, 0 ).rgb;
+			float w = kernel[ abs( kx ) ] * kernel[ abs( ky ) ] * weight( c, g, qc, texelFetch( guide, q, 0 ) );
+
+			sum += qc * w;
+			weights += w;
+		}
+	}
+
+	/* the center always has some weight */
+	out_color = vec4( sum / weights, 1.0f );
+}
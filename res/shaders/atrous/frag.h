@@ -0,0 +1,143 @@
+/*
+ * Made with xxd -i
+ */
+
+unsigned char atrous_frag_glsl[] = {
+  0x23, 0x76, 0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0x20, 0x33, 0x33, 0x30,
+  0x20, 0x63, 0x6f, 0x72, 0x65, 0x0a, 0x0a, 0x2f, 0x2a, 0x0a, 0x20, 0x2a,
+  0x20, 0x4f, 0x6e, 0x65, 0x20, 0x70, 0x61, 0x73, 0x73, 0x20, 0x6f, 0x66,
+  0x20, 0x74, 0x68, 0x65, 0x20, 0x65, 0x64, 0x67, 0x65, 0x2d, 0x61, 0x77,
+  0x61, 0x72, 0x65, 0x20, 0x61, 0x2d, 0x74, 0x72, 0x6f, 0x75, 0x73, 0x20,
+  0x66, 0x69, 0x6c, 0x74, 0x65, 0x72, 0x2c, 0x20, 0x6d, 0x69, 0x72, 0x72,
+  0x6f, 0x72, 0x73, 0x20, 0x73, 0x72, 0x63, 0x2f, 0x74, 0x72, 0x61, 0x63,
+  0x65, 0x2f, 0x64, 0x65, 0x6e, 0x6f, 0x69, 0x73, 0x65, 0x2e, 0x63, 0x2e,
+  0x0a, 0x20, 0x2a, 0x20, 0x4b, 0x65, 0x65, 0x70, 0x20, 0x74, 0x68, 0x65,
+  0x20, 0x74, 0x77, 0x6f, 0x20, 0x69, 0x6e, 0x20, 0x73, 0x79, 0x6e, 0x63,
+  0x2e, 0x0a, 0x20, 0x2a, 0x2f, 0x0a, 0x0a, 0x63, 0x6f, 0x6e, 0x73, 0x74,
+  0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x45, 0x50, 0x53, 0x49, 0x4c,
+  0x4f, 0x4e, 0x20, 0x3d, 0x20, 0x31, 0x65, 0x2d, 0x34, 0x66, 0x3b, 0x0a,
+  0x0a, 0x2f, 0x2a, 0x20, 0x74, 0x61, 0x70, 0x73, 0x20, 0x77, 0x65, 0x69,
+  0x67, 0x68, 0x74, 0x65, 0x64, 0x20, 0x62, 0x65, 0x6c, 0x6f, 0x77, 0x20,
+  0x65, 0x5e, 0x2d, 0x32, 0x30, 0x20, 0x61, 0x72, 0x65, 0x20, 0x73, 0x6b,
+  0x69, 0x70, 0x70, 0x65, 0x64, 0x20, 0x2a, 0x2f, 0x0a, 0x63, 0x6f, 0x6e,
+  0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x4d, 0x41, 0x58,
+  0x5f, 0x45, 0x58, 0x50, 0x4f, 0x4e, 0x45, 0x4e, 0x54, 0x20, 0x3d, 0x20,
+  0x32, 0x30, 0x2e, 0x30, 0x66, 0x3b, 0x0a, 0x0a, 0x2f, 0x2a, 0x20, 0x42,
+  0x33, 0x20, 0x73, 0x70, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x74, 0x61, 0x70,
+  0x73, 0x20, 0x62, 0x79, 0x20, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63,
+  0x65, 0x20, 0x66, 0x72, 0x6f, 0x6d, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63,
+  0x65, 0x6e, 0x74, 0x65, 0x72, 0x20, 0x2a, 0x2f, 0x0a, 0x63, 0x6f, 0x6e,
+  0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6b, 0x65, 0x72,
+  0x6e, 0x65, 0x6c, 0x5b, 0x20, 0x33, 0x20, 0x5d, 0x20, 0x3d, 0x20, 0x66,
+  0x6c, 0x6f, 0x61, 0x74, 0x5b, 0x20, 0x33, 0x20, 0x5d, 0x28, 0x20, 0x33,
+  0x2e, 0x30, 0x66, 0x20, 0x2f, 0x20, 0x38, 0x2e, 0x30, 0x66, 0x2c, 0x20,
+  0x31, 0x2e, 0x30, 0x66, 0x20, 0x2f, 0x20, 0x34, 0x2e, 0x30, 0x66, 0x2c,
+  0x20, 0x31, 0x2e, 0x30, 0x66, 0x20, 0x2f, 0x20, 0x31, 0x36, 0x2e, 0x30,
+  0x66, 0x20, 0x29, 0x3b, 0x0a, 0x0a, 0x75, 0x6e, 0x69, 0x66, 0x6f, 0x72,
+  0x6d, 0x20, 0x73, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x72, 0x32, 0x44, 0x20,
+  0x63, 0x6f, 0x6c, 0x6f, 0x72, 0x3b, 0x0a, 0x75, 0x6e, 0x69, 0x66, 0x6f,
+  0x72, 0x6d, 0x20, 0x73, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x72, 0x32, 0x44,
+  0x20, 0x67, 0x75, 0x69, 0x64, 0x65, 0x3b, 0x09, 0x2f, 0x2a, 0x20, 0x6e,
+  0x6f, 0x72, 0x6d, 0x61, 0x6c, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x64, 0x65,
+  0x70, 0x74, 0x68, 0x2c, 0x20, 0x73, 0x65, 0x65, 0x20, 0x72, 0x61, 0x79,
+  0x74, 0x72, 0x61, 0x63, 0x65, 0x72, 0x2f, 0x66, 0x72, 0x61, 0x67, 0x2e,
+  0x67, 0x6c, 0x73, 0x6c, 0x20, 0x2a, 0x2f, 0x0a, 0x0a, 0x75, 0x6e, 0x69,
+  0x66, 0x6f, 0x72, 0x6d, 0x20, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x74, 0x65,
+  0x70, 0x3b, 0x09, 0x09, 0x09, 0x2f, 0x2a, 0x20, 0x70, 0x69, 0x78, 0x65,
+  0x6c, 0x73, 0x20, 0x62, 0x65, 0x74, 0x77, 0x65, 0x65, 0x6e, 0x20, 0x74,
+  0x68, 0x65, 0x20, 0x74, 0x61, 0x70, 0x73, 0x20, 0x2a, 0x2f, 0x0a, 0x75,
+  0x6e, 0x69, 0x66, 0x6f, 0x72, 0x6d, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74,
+  0x20, 0x69, 0x6e, 0x76, 0x5f, 0x63, 0x6f, 0x6c, 0x6f, 0x72, 0x3b, 0x09,
+  0x2f, 0x2a, 0x20, 0x31, 0x20, 0x2f, 0x20, 0x73, 0x69, 0x67, 0x6d, 0x61,
+  0x5e, 0x32, 0x20, 0x2a, 0x2f, 0x0a, 0x75, 0x6e, 0x69, 0x66, 0x6f, 0x72,
+  0x6d, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x69, 0x6e, 0x76, 0x5f,
+  0x6e, 0x6f, 0x72, 0x6d, 0x61, 0x6c, 0x3b, 0x0a, 0x75, 0x6e, 0x69, 0x66,
+  0x6f, 0x72, 0x6d, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x69,
+  0x67, 0x6d, 0x61, 0x5f, 0x64, 0x65, 0x70, 0x74, 0x68, 0x3b, 0x0a, 0x0a,
+  0x6f, 0x75, 0x74, 0x20, 0x76, 0x65, 0x63, 0x34, 0x20, 0x6f, 0x75, 0x74,
+  0x5f, 0x63, 0x6f, 0x6c, 0x6f, 0x72, 0x3b, 0x0a, 0x0a, 0x66, 0x6c, 0x6f,
+  0x61, 0x74, 0x20, 0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 0x28, 0x20, 0x76,
+  0x65, 0x63, 0x33, 0x20, 0x63, 0x2c, 0x20, 0x76, 0x65, 0x63, 0x34, 0x20,
+  0x67, 0x2c, 0x20, 0x76, 0x65, 0x63, 0x33, 0x20, 0x71, 0x63, 0x2c, 0x20,
+  0x76, 0x65, 0x63, 0x34, 0x20, 0x71, 0x67, 0x20, 0x29, 0x0a, 0x7b, 0x0a,
+  0x09, 0x76, 0x65, 0x63, 0x33, 0x20, 0x64, 0x63, 0x20, 0x3d, 0x20, 0x63,
+  0x20, 0x2d, 0x20, 0x71, 0x63, 0x3b, 0x0a, 0x09, 0x76, 0x65, 0x63, 0x33,
+  0x20, 0x64, 0x6e, 0x20, 0x3d, 0x20, 0x67, 0x2e, 0x78, 0x79, 0x7a, 0x20,
+  0x2d, 0x20, 0x71, 0x67, 0x2e, 0x78, 0x79, 0x7a, 0x3b, 0x0a, 0x09, 0x66,
+  0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x7a, 0x20, 0x3d, 0x20, 0x28, 0x20,
+  0x67, 0x2e, 0x77, 0x20, 0x2d, 0x20, 0x71, 0x67, 0x2e, 0x77, 0x20, 0x29,
+  0x20, 0x2f, 0x20, 0x28, 0x20, 0x73, 0x69, 0x67, 0x6d, 0x61, 0x5f, 0x64,
+  0x65, 0x70, 0x74, 0x68, 0x20, 0x2a, 0x20, 0x67, 0x2e, 0x77, 0x20, 0x2b,
+  0x20, 0x45, 0x50, 0x53, 0x49, 0x4c, 0x4f, 0x4e, 0x20, 0x29, 0x3b, 0x0a,
+  0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x65, 0x20, 0x3d, 0x20, 0x64,
+  0x6f, 0x74, 0x28, 0x20, 0x64, 0x63, 0x2c, 0x20, 0x64, 0x63, 0x20, 0x29,
+  0x20, 0x2a, 0x20, 0x69, 0x6e, 0x76, 0x5f, 0x63, 0x6f, 0x6c, 0x6f, 0x72,
+  0x20, 0x2b, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x20, 0x64, 0x6e, 0x2c, 0x20,
+  0x64, 0x6e, 0x20, 0x29, 0x20, 0x2a, 0x20, 0x69, 0x6e, 0x76, 0x5f, 0x6e,
+  0x6f, 0x72, 0x6d, 0x61, 0x6c, 0x20, 0x2b, 0x20, 0x64, 0x7a, 0x20, 0x2a,
+  0x20, 0x64, 0x7a, 0x3b, 0x0a, 0x0a, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72,
+  0x6e, 0x20, 0x65, 0x20, 0x3c, 0x20, 0x4d, 0x41, 0x58, 0x5f, 0x45, 0x58,
+  0x50, 0x4f, 0x4e, 0x45, 0x4e, 0x54, 0x20, 0x3f, 0x20, 0x65, 0x78, 0x70,
+  0x28, 0x20, 0x2d, 0x65, 0x20, 0x29, 0x20, 0x3a, 0x20, 0x30, 0x2e, 0x30,
+  0x66, 0x3b, 0x0a, 0x7d, 0x0a, 0x0a, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6d,
+  0x61, 0x69, 0x6e, 0x28, 0x29, 0x0a, 0x7b, 0x0a, 0x09, 0x69, 0x76, 0x65,
+  0x63, 0x32, 0x20, 0x70, 0x20, 0x3d, 0x20, 0x69, 0x76, 0x65, 0x63, 0x32,
+  0x28, 0x20, 0x67, 0x6c, 0x5f, 0x46, 0x72, 0x61, 0x67, 0x43, 0x6f, 0x6f,
+  0x72, 0x64, 0x2e, 0x78, 0x79, 0x20, 0x29, 0x3b, 0x0a, 0x09, 0x69, 0x76,
+  0x65, 0x63, 0x32, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x20, 0x3d, 0x20, 0x74,
+  0x65, 0x78, 0x74, 0x75, 0x72, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x28, 0x20,
+  0x63, 0x6f, 0x6c, 0x6f, 0x72, 0x2c, 0x20, 0x30, 0x20, 0x29, 0x3b, 0x0a,
+  0x09, 0x76, 0x65, 0x63, 0x33, 0x20, 0x63, 0x20, 0x3d, 0x20, 0x74, 0x65,
+  0x78, 0x65, 0x6c, 0x46, 0x65, 0x74, 0x63, 0x68, 0x28, 0x20, 0x63, 0x6f,
+  0x6c, 0x6f, 0x72, 0x2c, 0x20, 0x70, 0x2c, 0x20, 0x30, 0x20, 0x29, 0x2e,
+  0x72, 0x67, 0x62, 0x3b, 0x0a, 0x09, 0x76, 0x65, 0x63, 0x34, 0x20, 0x67,
+  0x20, 0x3d, 0x20, 0x74, 0x65, 0x78, 0x65, 0x6c, 0x46, 0x65, 0x74, 0x63,
+  0x68, 0x28, 0x20, 0x67, 0x75, 0x69, 0x64, 0x65, 0x2c, 0x20, 0x70, 0x2c,
+  0x20, 0x30, 0x20, 0x29, 0x3b, 0x0a, 0x0a, 0x09, 0x76, 0x65, 0x63, 0x33,
+  0x20, 0x73, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x76, 0x65, 0x63, 0x33, 0x28,
+  0x20, 0x30, 0x2e, 0x30, 0x66, 0x20, 0x29, 0x3b, 0x0a, 0x09, 0x66, 0x6c,
+  0x6f, 0x61, 0x74, 0x20, 0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 0x73, 0x20,
+  0x3d, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x3b, 0x0a, 0x0a, 0x09, 0x66, 0x6f,
+  0x72, 0x20, 0x28, 0x20, 0x69, 0x6e, 0x74, 0x20, 0x6b, 0x79, 0x20, 0x3d,
+  0x20, 0x2d, 0x32, 0x3b, 0x20, 0x6b, 0x79, 0x20, 0x3c, 0x3d, 0x20, 0x32,
+  0x3b, 0x20, 0x6b, 0x79, 0x2b, 0x2b, 0x20, 0x29, 0x0a, 0x09, 0x7b, 0x0a,
+  0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x20, 0x69, 0x6e, 0x74, 0x20,
+  0x6b, 0x78, 0x20, 0x3d, 0x20, 0x2d, 0x32, 0x3b, 0x20, 0x6b, 0x78, 0x20,
+  0x3c, 0x3d, 0x20, 0x32, 0x3b, 0x20, 0x6b, 0x78, 0x2b, 0x2b, 0x20, 0x29,
+  0x0a, 0x09, 0x09, 0x7b, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x76, 0x65, 0x63,
+  0x32, 0x20, 0x71, 0x20, 0x3d, 0x20, 0x70, 0x20, 0x2b, 0x20, 0x69, 0x76,
+  0x65, 0x63, 0x32, 0x28, 0x20, 0x6b, 0x78, 0x2c, 0x20, 0x6b, 0x79, 0x20,
+  0x29, 0x20, 0x2a, 0x20, 0x73, 0x74, 0x65, 0x70, 0x3b, 0x0a, 0x09, 0x09,
+  0x09, 0x69, 0x66, 0x20, 0x28, 0x20, 0x61, 0x6e, 0x79, 0x28, 0x20, 0x6c,
+  0x65, 0x73, 0x73, 0x54, 0x68, 0x61, 0x6e, 0x28, 0x20, 0x71, 0x2c, 0x20,
+  0x69, 0x76, 0x65, 0x63, 0x32, 0x28, 0x20, 0x30, 0x20, 0x29, 0x20, 0x29,
+  0x20, 0x29, 0x20, 0x7c, 0x7c, 0x20, 0x61, 0x6e, 0x79, 0x28, 0x20, 0x67,
+  0x72, 0x65, 0x61, 0x74, 0x65, 0x72, 0x54, 0x68, 0x61, 0x6e, 0x45, 0x71,
+  0x75, 0x61, 0x6c, 0x28, 0x20, 0x71, 0x2c, 0x20, 0x73, 0x69, 0x7a, 0x65,
+  0x20, 0x29, 0x20, 0x29, 0x20, 0x29, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63,
+  0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0a, 0x0a, 0x09, 0x09,
+  0x09, 0x76, 0x65, 0x63, 0x33, 0x20, 0x71, 0x63, 0x20, 0x3d, 0x20, 0x74,
+  0x65, 0x78, 0x65, 0x6c, 0x46, 0x65, 0x74, 0x63, 0x68, 0x28, 0x20, 0x63,
+  0x6f, 0x6c, 0x6f, 0x72, 0x2c, 0x20, 0x71, 0x2c, 0x20, 0x30, 0x20, 0x29,
+  0x2e, 0x72, 0x67, 0x62, 0x3b, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f,
+  0x61, 0x74, 0x20, 0x77, 0x20, 0x3d, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65,
+  0x6c, 0x5b, 0x20, 0x61, 0x62, 0x73, 0x28, 0x20, 0x6b, 0x78, 0x20, 0x29,
+  0x20, 0x5d, 0x20, 0x2a, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x5b,
+  0x20, 0x61, 0x62, 0x73, 0x28, 0x20, 0x6b, 0x79, 0x20, 0x29, 0x20, 0x5d,
+  0x20, 0x2a, 0x20, 0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 0x28, 0x20, 0x63,
+  0x2c, 0x20, 0x67, 0x2c, 0x20, 0x71, 0x63, 0x2c, 0x20, 0x74, 0x65, 0x78,
+  0x65, 0x6c, 0x46, 0x65, 0x74, 0x63, 0x68, 0x28, 0x20, 0x67, 0x75, 0x69,
+  0x64, 0x65, 0x2c, 0x20, 0x71, 0x2c, 0x20, 0x30, 0x20, 0x29, 0x20, 0x29,
+  0x3b, 0x0a, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x20, 0x2b, 0x3d,
+  0x20, 0x71, 0x63, 0x20, 0x2a, 0x20, 0x77, 0x3b, 0x0a, 0x09, 0x09, 0x09,
+  0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 0x73, 0x20, 0x2b, 0x3d, 0x20, 0x77,
+  0x3b, 0x0a, 0x09, 0x09, 0x7d, 0x0a, 0x09, 0x7d, 0x0a, 0x0a, 0x09, 0x2f,
+  0x2a, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6e, 0x74, 0x65, 0x72,
+  0x20, 0x61, 0x6c, 0x77, 0x61, 0x79, 0x73, 0x20, 0x68, 0x61, 0x73, 0x20,
+  0x73, 0x6f, 0x6d, 0x65, 0x20, 0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 0x20,
+  0x2a, 0x2f, 0x0a, 0x09, 0x6f, 0x75, 0x74, 0x5f, 0x63, 0x6f, 0x6c, 0x6f,
+  0x72, 0x20, 0x3d, 0x20, 0x76, 0x65, 0x63, 0x34, 0x28, 0x20, 0x73, 0x75,
+  0x6d, 0x20, 0x2f, 0x20, 0x77, 0x65, 0x69, 0x67, 0x68, 0x74, 0x73, 0x2c,
+  0x20, 0x31, 0x2e, 0x30, 0x66, 0x20, 0x29, 0x3b, 0x0a, 0x7d, 0x0a
+};
+unsigned int atrous_frag_glsl_len = 1631;
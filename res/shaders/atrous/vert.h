@@ -0,0 +1,25 @@
+/*
+ * Made with xxd -i
+ */
+
+unsigned char atrous_vert_glsl[] = {
+  0x23, 0x76, 0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0x20, 0x33, 0x33, 0x30,
+  0x20, 0x63, 0x6f, 0x72, 0x65, 0x0a, 0x0a, 0x2f, 0x2a, 0x20, 0x61, 0x20,
+  0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x63, 0x6f, 0x76,
+  0x65, 0x72, 0x69, 0x6e, 0x67, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x63,
+  0x72, 0x65, 0x65, 0x6e, 0x2c, 0x20, 0x6e, 0x6f, 0x20, 0x76, 0x65, 0x72,
+  0x74, 0x65, 0x78, 0x20, 0x62, 0x75, 0x66, 0x66, 0x65, 0x72, 0x20, 0x6e,
+  0x65, 0x65, 0x64, 0x65, 0x64, 0x20, 0x2a, 0x2f, 0x0a, 0x76, 0x6f, 0x69,
+  0x64, 0x20, 0x6d, 0x61, 0x69, 0x6e, 0x28, 0x29, 0x0a, 0x7b, 0x0a, 0x09,
+  0x76, 0x65, 0x63, 0x32, 0x20, 0x70, 0x6f, 0x73, 0x20, 0x3d, 0x20, 0x76,
+  0x65, 0x63, 0x32, 0x28, 0x20, 0x28, 0x20, 0x67, 0x6c, 0x5f, 0x56, 0x65,
+  0x72, 0x74, 0x65, 0x78, 0x49, 0x44, 0x20, 0x3c, 0x3c, 0x20, 0x31, 0x20,
+  0x29, 0x20, 0x26, 0x20, 0x32, 0x2c, 0x20, 0x67, 0x6c, 0x5f, 0x56, 0x65,
+  0x72, 0x74, 0x65, 0x78, 0x49, 0x44, 0x20, 0x26, 0x20, 0x32, 0x20, 0x29,
+  0x3b, 0x0a, 0x09, 0x67, 0x6c, 0x5f, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69,
+  0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x76, 0x65, 0x63, 0x34, 0x28, 0x20, 0x70,
+  0x6f, 0x73, 0x20, 0x2a, 0x20, 0x32, 0x2e, 0x30, 0x66, 0x20, 0x2d, 0x20,
+  0x31, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20,
+  0x31, 0x2e, 0x30, 0x66, 0x20, 0x29, 0x3b, 0x0a, 0x7d, 0x0a
+};
+unsigned int atrous_vert_glsl_len = 214;
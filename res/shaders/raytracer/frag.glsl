@@ -4,16 +4,43 @@
 #define EPSILON 1e-4f
 #define RENDER_DISTANCE 100000000.0f
 
-const uint MAX_OBJECT_COUNT = 5u;
-const uint MAX_LIGHT_COUNT  = 1u;
-const uint MAX_PLANE_COUNT  = 1u;
-
-const uint OBJECT_TYPE_NONE = 0u;
-const uint OBJECT_TYPE_SPHERE = 1u;
-const uint OBJECT_TYPE_TRIANGLE = 2u;
-const uint OBJECT_TYPE_PLANE = 2u;
-
-out vec4 out_color;
+const uint MAX_MATERIAL_COUNT = 256u;
+const uint MAX_PLANE_COUNT    = 1u;
+const uint MAX_MESH_COUNT     = 4u;
+
+/* max depth of a mesh bvh */
+const int BVH_STACK_SIZE = 32;
+
+/* reflections are skipped below these */
+const float MIN_REFLECTIVENESS = 1e-3f;
+const float MIN_THROUGHPUT = 0.01f;
+
+/* the denoiser's guide follows reflections above this */
+const float GUIDE_REFLECTIVENESS = 0.5f;
+
+/*
+ * Scene features, src/trace/variant.c defines them for the scene at hand so
+ * the loops have constant bounds and unused branches compile away. The
+ * defaults handle any scene through the uniform block.
+ */
+#ifndef MESH_COUNT
+#define MESH_COUNT mesh_count
+#endif
+#ifndef MAX_DEPTH
+#define MAX_DEPTH max_depth
+#endif
+#ifndef HAS_SPHERES
+#define HAS_SPHERES true
+#endif
+#ifndef SHADOWS
+#define SHADOWS ( shadows != 0u )
+#endif
+
+layout( location = 0 ) out vec4 out_color;
+
+/* normal and path length of the surface the pixel shows, guides the denoiser
+   (src/gfx/atrous.h), only kept when accumulating */
+layout( location = 1 ) out vec4 out_guide;
 
 struct material_t
 {
@@ -21,15 +48,6 @@ struct material_t
 	float reflectiveness;
 };
 
-struct object_t
-{
-	uint type;
-	vec3 pos;
-	vec3 norm;
-	float scale;
-	material_t mat;
-};
-
 /* point lighting */
 struct light_t
 {
@@ -64,12 +82,18 @@ struct triangle_t
 	vec3 norm_a, norm_b, norm_c;	/* vertex normal   */
 };
 
+/* bvh and triangles are stored in mesh_nodes and mesh_tris */
+struct mesh_t
+{
+	uint node_offset;
+	uint tri_offset;
+	material_t mat;
+};
+
 struct camera_t
 {
-	vec3 eye;
-	vec3 target;
-	vec3 up;
 	mat4 view;
+	vec3 eye;
 	float fov;
 };
 
@@ -87,12 +111,44 @@ struct hitdata_t
 /* UNIFORM DATA				   */
 /* --------------------------- */
 
-uniform camera_t camera;
-uniform vec2 resolution;
+/* std140, mirrored by struct scene_block in src/trace/scene.h */
+layout( std140 ) uniform scene_block
+{
+	camera_t camera;
+	plane_t plane;
+	vec2 resolution;
+	uint mesh_count;
+	uint max_depth;
+	uint light_count;
+	uint tile_size;
+	uint tiles_x;
+	uint shadows;
+	uint sphere_count;
+	mesh_t meshes[ MAX_MESH_COUNT ];
+	material_t materials[ MAX_MATERIAL_COUNT ];
+};
+
+/* 2 texels per node: ( min, offset ) and ( max, count | axis << 16 ) */
+uniform usamplerBuffer mesh_nodes;
+
+/* 6 texels per triangle: ( pos, u ) and ( v, norm ) per vertex */
+uniform samplerBuffer mesh_tris;
+
+/* a texel per sphere: ( center, radius ), its index into materials in sphere_materials */
+uniform samplerBuffer scene_spheres;
+uniform usamplerBuffer sphere_materials;
+
+/* 3 texels per light: ( pos, radius ), ( color, reach ) and ( power ) */
+uniform samplerBuffer scene_lights;
 
-uniform object_t objects[ MAX_OBJECT_COUNT ];
-uniform light_t lights[ MAX_LIGHT_COUNT ];
-uniform plane_t plane;
+/* light culling (src/trace/light_grid.h): an ( offset, count ) pair per
+   tile_size tile followed by the light indices of every tile */
+uniform usamplerBuffer light_tiles;
+
+/* progressive accumulation (src/gfx/accum.h), accum_frames is 0 when off */
+uniform sampler2D accum;
+uniform uint accum_frames;
+uniform vec2 jitter;
 
 /* ======================================================== */
 
@@ -185,24 +241,152 @@ hitdata_t hit_ray_plane( ray_t ray, plane_t plane )
 	return hitdata; 
 } 
 
-hitdata_t hit_ray_object( ray_t ray, object_t obj )
+sphere_t fetch_sphere( uint i )
+{
+	vec4 texel = texelFetch( scene_spheres, int( i ) );
+	return sphere_t( texel.xyz, texel.w );
+}
+
+triangle_t fetch_tri( uint i )
+{
+	int texel = int( i ) * 6;
+
+	triangle_t tri;
+	tri.pos_a  = texelFetch( mesh_tris, texel + 0 ).xyz;
+	tri.norm_a = texelFetch( mesh_tris, texel + 1 ).yzw;
+	tri.pos_b  = texelFetch( mesh_tris, texel + 2 ).xyz;
+	tri.norm_b = texelFetch( mesh_tris, texel + 3 ).yzw;
+	tri.pos_c  = texelFetch( mesh_tris, texel + 4 ).xyz;
+	tri.norm_c = texelFetch( mesh_tris, texel + 5 ).yzw;
+	return tri;
+}
+
+bool hit_ray_box( vec3 orig, vec3 inv_dir, vec3 box_min, vec3 box_max, float max_dist )
+{
+	vec3 t1 = ( box_min - orig ) * inv_dir;
+	vec3 t2 = ( box_max - orig ) * inv_dir;
+	vec3 tmin = min( t1, t2 );
+	vec3 tmax = max( t1, t2 );
+
+	float t_near = max( max( tmin.x, tmin.y ), tmin.z );
+	float t_far = min( min( tmax.x, tmax.y ), tmax.z );
+
+	return t_far >= max( t_near, 0.0f ) && t_near < max_dist;
+}
+
+hitdata_t hit_ray_mesh( ray_t ray, mesh_t mesh, float max_dist )
 {
 	hitdata_t hitdata;
 	hitdata.hit = false;
-	hitdata.mat.color = vec3( 0.0f, 0.0f, 0.0f );
 
-	if ( obj.type == OBJECT_TYPE_NONE )
+	vec3 inv_dir = 1.0f / ray.dir;
+	uint stack[ BVH_STACK_SIZE ];
+	int sp = 0;
+	uint idx = 0u;
+
+	/* depth first, near child first */
+	while ( true )
 	{
-		return hitdata;
+		int texel = int( mesh.node_offset + idx ) * 2;
+		uvec4 node_a = texelFetch( mesh_nodes, texel );
+		uvec4 node_b = texelFetch( mesh_nodes, texel + 1 );
+
+		if ( hit_ray_box( ray.orig, inv_dir, uintBitsToFloat( node_a.xyz ), uintBitsToFloat( node_b.xyz ), max_dist ) )
+		{
+			uint count = node_b.w & 0xffffu;
+			uint axis = node_b.w >> 16;
+
+			if ( count == 0u )
+			{
+				uint near_child = idx + 1u;
+				uint far_child = node_a.w;
+				if ( ray.dir[ axis ] < 0.0f )
+				{
+					near_child = node_a.w;
+					far_child = idx + 1u;
+				}
+
+				stack[ sp++ ] = far_child;
+				idx = near_child;
+				continue;
+			}
+
+			for ( uint i = node_a.w; i < node_a.w + count; i++ )
+			{
+				hitdata_t tmp = hit_ray_tri( ray, fetch_tri( mesh.tri_offset + i ) );
+				if ( tmp.hit == true && tmp.dist < max_dist )
+				{
+					hitdata = tmp;
+					max_dist = tmp.dist;
+				}
+			}
+		}
+
+		if ( sp == 0 )
+			break;
+		idx = stack[ --sp ];
 	}
-	if ( obj.type == OBJECT_TYPE_SPHERE )
+
+	hitdata.mat = mesh.mat;
+	return hitdata;
+}
+
+/* same traversal as hit_ray_mesh, stops at the first triangle closer than max_dist */
+bool occluded_mesh( ray_t ray, mesh_t mesh, float max_dist )
+{
+	vec3 inv_dir = 1.0f / ray.dir;
+	uint stack[ BVH_STACK_SIZE ];
+	int sp = 0;
+	uint idx = 0u;
+
+	while ( true )
 	{
-		sphere_t sphere = sphere_t( obj.pos, obj.scale );
-		hitdata = hit_ray_sphere( ray, sphere );
-		hitdata.mat = obj.mat;
+		int texel = int( mesh.node_offset + idx ) * 2;
+		uvec4 node_a = texelFetch( mesh_nodes, texel );
+		uvec4 node_b = texelFetch( mesh_nodes, texel + 1 );
+
+		if ( hit_ray_box( ray.orig, inv_dir, uintBitsToFloat( node_a.xyz ), uintBitsToFloat( node_b.xyz ), max_dist ) )
+		{
+			uint count = node_b.w & 0xffffu;
+			uint axis = node_b.w >> 16;
+
+			if ( count == 0u )
+			{
+				uint near_child = idx + 1u;
+				uint far_child = node_a.w;
+				if ( ray.dir[ axis ] < 0.0f )
+				{
+					near_child = node_a.w;
+					far_child = idx + 1u;
+				}
+
+				stack[ sp++ ] = far_child;
+				idx = near_child;
+				continue;
+			}
+
+			for ( uint i = node_a.w; i < node_a.w + count; i++ )
+			{
+				/* only the positions, the normals are not needed */
+				int tri_texel = int( mesh.tri_offset + i ) * 6;
+				triangle_t tri = triangle_t(
+					texelFetch( mesh_tris, tri_texel + 0 ).xyz,
+					texelFetch( mesh_tris, tri_texel + 2 ).xyz,
+					texelFetch( mesh_tris, tri_texel + 4 ).xyz,
+					vec3( 0.0f ), vec3( 0.0f ), vec3( 0.0f ) );
+
+				hitdata_t tmp = hit_ray_tri( ray, tri );
+				if ( tmp.hit == true && tmp.dist < max_dist )
+					return true;
+			}
+		}
+
+		if ( sp == 0 )
+			break;
+		idx = stack[ --sp ];
 	}
 
-	return hitdata;
+	return false;
 }
 
 /* ======================================================== */
@@ -242,21 +426,22 @@ hitdata_t raycast( ray_t ray )
 	hitdata.mat.color = vec3( 0.0f, 0.0f, 0.0f );
 	float min_dist = RENDER_DISTANCE;
 
-	/* object collision */
-	for ( int i = 0; i < objects.length(); i++ )
+	/* sphere collision, the material is only fetched for the closest */
+	int sphere = -1;
+	for ( uint i = 0u; HAS_SPHERES && i < sphere_count; i++ )
 	{
-		object_t obj = objects[ i ];
-		if ( obj.type == OBJECT_TYPE_NONE )
-			continue;
-
-		hitdata_t tmp = hit_ray_object( ray, obj );
+		hitdata_t tmp = hit_ray_sphere( ray, fetch_sphere( i ) );
 		if ( tmp.hit == true && tmp.dist < min_dist )
 		{
 			hitdata = tmp;
 			min_dist = tmp.dist;
+			sphere = int( i );
 		}
 	}
 
+	if ( sphere >= 0 )
+		hitdata.mat = materials[ texelFetch( sphere_materials, sphere ).r ];
+
 	/* plane collision */
 	hitdata_t tmp = hit_ray_plane( ray, plane );
 	if ( tmp.hit == true && tmp.dist < min_dist )
@@ -265,9 +450,43 @@ hitdata_t raycast( ray_t ray )
 		min_dist = tmp.dist;
 	}
 
+	/* mesh collision */
+	for ( uint i = 0u; i < MESH_COUNT; i++ )
+	{
+		tmp = hit_ray_mesh( ray, meshes[ i ], min_dist );
+		if ( tmp.hit == true )
+		{
+			hitdata = tmp;
+			min_dist = tmp.dist;
+		}
+	}
+
 	return hitdata;
 }
 
+/* any hit closer than max_dist, for shadow rays */
+bool occluded( ray_t ray, float max_dist )
+{
+	for ( uint i = 0u; HAS_SPHERES && i < sphere_count; i++ )
+	{
+		hitdata_t tmp = hit_ray_sphere( ray, fetch_sphere( i ) );
+		if ( tmp.hit == true && tmp.dist < max_dist )
+			return true;
+	}
+
+	hitdata_t tmp = hit_ray_plane( ray, plane );
+	if ( tmp.hit == true && tmp.dist < max_dist )
+		return true;
+
+	for ( uint i = 0u; i < MESH_COUNT; i++ )
+	{
+		if ( occluded_mesh( ray, meshes[ i ], max_dist ) )
+			return true;
+	}
+
+	return false;
+}
+
 /* ======================================================== */
 
 /* ======================================================== */
@@ -275,63 +494,109 @@ hitdata_t raycast( ray_t ray )
 /* COMPUTE LIGHT			   */
 /* --------------------------- */
 
-vec3 raycast_to_light( hitdata_t hitdata )
+light_t fetch_light( uint i )
 {
-	vec3 color = vec3( 0.0f );
+	int texel = int( i ) * 3;
+	vec4 a = texelFetch( scene_lights, texel );
+	vec4 b = texelFetch( scene_lights, texel + 1 );
+
+	light_t light;
+	light.pos = a.xyz;
+	light.radius = a.w;
+	light.color = b.xyz;
+	light.reach = b.w;
+	light.power = texelFetch( scene_lights, texel + 2 ).x;
+	return light;
+}
 
-	if ( hitdata.hit == false )
-		return color;
+vec3 shade_light( hitdata_t hitdata, light_t light )
+{
+	float light_dist = distance( light.pos, hitdata.hit_point );
 
-	/* get color from light source */
-	for ( int i = 0; i < lights.length(); i++ )
-	{
-		light_t light = lights[ i ];
+	if ( light_dist > light.reach )
+		return vec3( 0.0f );
 
-		/* ray to light */
-		ray_t rtl;
-		rtl.dir = normalize( light.pos - hitdata.hit_point );
-		rtl.orig = hitdata.hit_point;
+	/* ray to light */
+	ray_t rtl;
+	rtl.dir = normalize( light.pos - hitdata.hit_point );
+	rtl.orig = hitdata.hit_point;
 
-		/* cast ray to light source */
-		hitdata_t rtl_hitdata = raycast( rtl );
+	/* no color if anything is between the hit point and the light */
+	if ( SHADOWS && occluded( rtl, light_dist ) )
+		return vec3( 0.0f );
 
-		/* no color if ray to light source is blocked */
-		if ( rtl_hitdata.hit == true )
-			continue;
+	float diffuse = clamp( dot( hitdata.normal, normalize( light.pos - hitdata.hit_point ) ), 0.0, 1.0 );
+	return light.color * light.power * diffuse * hitdata.mat.color * dot( hitdata.normal, rtl.dir );
+}
 
-		float light_dist = distance( light.pos, hitdata.hit_point );
+vec3 raycast_to_light( hitdata_t hitdata, uint depth )
+{
+	vec3 color = vec3( 0.0f );
+
+	if ( hitdata.hit == false )
+		return color;
+
+	/* primary hits only need the lights of their tile, reflections can reach any */
+	if ( depth == 0u && tile_size > 0u )
+	{
+		ivec2 tile = ivec2( gl_FragCoord.xy ) / int( tile_size );
+		int header = ( tile.y * int( tiles_x ) + tile.x ) * 2;
+		int offset = int( texelFetch( light_tiles, header ).r );
+		int count = int( texelFetch( light_tiles, header + 1 ).r );
 
-		if ( light_dist > light.reach )
-			continue;
+		for ( int i = 0; i < count; i++ )
+			color += shade_light( hitdata, fetch_light( texelFetch( light_tiles, offset + i ).r ) );
 
-		float diffuse = clamp( dot( hitdata.normal, normalize( light.pos - hitdata.hit_point ) ), 0.0, 1.0 );
-		color = light.color * light.power * diffuse * hitdata.mat.color * dot( hitdata.normal, rtl.dir );
+		return color;
 	}
 
+	for ( uint i = 0u; i < light_count; i++ )
+		color += shade_light( hitdata, fetch_light( i ) );
+
 	return color;
 }
 
-vec3 compute_color( ray_t ray )
+vec3 compute_color( ray_t ray, out vec4 guide )
 {
 	vec3 color = vec3( 0.0f );
+	float throughput = 1.0f;
+	float path_length = 0.0f;
+	bool guiding = true;
 
-	/* cast initial ray */
-	hitdata_t hitdata;
-	hitdata = raycast( ray );
+	guide = vec4( 0.0f, 0.0f, 0.0f, RENDER_DISTANCE );
 
-	if ( hitdata.hit == false )
-		return color;
+	for ( uint depth = 0u; depth <= MAX_DEPTH; depth++ )
+	{
+		hitdata_t hitdata = raycast( ray );
 
-	/* reflected ray (single bounce) */
-	ray_t rr;
-	rr.dir = reflect( ray.dir, hitdata.normal );
-	rr.orig = hitdata.hit_point;
-	hitdata_t refldata = raycast( rr );
+		/* mirrors show what they reflect, the guide follows the reflection
+		   unless it leaves the scene */
+		if ( guiding && hitdata.hit )
+		{
+			path_length += hitdata.dist;
+			guide = vec4( hitdata.normal, path_length );
+		}
+		guiding = guiding && hitdata.hit && hitdata.mat.reflectiveness > GUIDE_REFLECTIVENESS;
+
+		if ( hitdata.hit == false )
+			break;
+
+		float r = hitdata.mat.reflectiveness;
+
+		/* the last hit of a path gets all of the direct light */
+		if ( depth >= MAX_DEPTH || r <= MIN_REFLECTIVENESS || throughput * r < MIN_THROUGHPUT )
+		{
+			color += raycast_to_light( hitdata, depth ) * throughput;
+			break;
+		}
 
-	vec3 orig_color = raycast_to_light( hitdata ) * ( 1.0f - hitdata.mat.reflectiveness );
-	vec3 refl_color = raycast_to_light( refldata ) * ( hitdata.mat.reflectiveness );
+		color += raycast_to_light( hitdata, depth ) * ( throughput * ( 1.0f - r ) );
+		throughput *= r;
 
-	color = orig_color + refl_color;
+		/* reflected ray */
+		ray.dir = reflect( ray.dir, hitdata.normal );
+		ray.orig = hitdata.hit_point;
+	}
 
 	return color;
 }
@@ -345,8 +610,19 @@ vec3 compute_color( ray_t ray )
 
 void main()
 {
-	ray_t ray = camera_raycast( gl_FragCoord.xy );
-	out_color = vec4( compute_color( ray ), 1.0f );
+	ray_t ray = camera_raycast( gl_FragCoord.xy + jitter );
+	vec4 guide;
+	vec3 color = compute_color( ray, guide );
+
+	/* blend into the running average of the previous frames */
+	if ( accum_frames > 0u )
+	{
+		vec3 prev = texelFetch( accum, ivec2( gl_FragCoord.xy ), 0 ).rgb;
+		color = mix( prev, color, 1.0f / float( accum_frames + 1u ) );
+	}
+
+	out_color = vec4( color, 1.0f );
+	out_guide = guide;
 }
 
 /* ======================================================== */
@@ -0,0 +1,114 @@
+#include "accum.h"
+#include <util/log.h>
+
+int accum_init( struct accum *self, int w, int h )
+{
+	*self = ( struct accum ){ .w = w, .h = h };
+
+	glGenTextures( 2, self->texture );
+	glGenTextures( 1, &self->guide );
+	glGenFramebuffers( 2, self->fbo );
+
+	// read with texelFetch, no filtering or mips
+	for ( int i = 0; i < 3; i++ )
+	{
+		glBindTexture( GL_TEXTURE_2D, i < 2 ? self->texture[ i ] : self->guide );
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	}
+
+	const GLenum buffers[ 2 ] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	for ( int i = 0; i < 2; i++ )
+	{
+		glBindFramebuffer( GL_FRAMEBUFFER, self->fbo[ i ] );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, self->texture[ i ], 0 );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, self->guide, 0 );
+		glDrawBuffers( 2, buffers );
+
+		if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+		{
+			log_error( "Accumulation framebuffer is incomplete" );
+			glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+			accum_free( self );
+			return ACCUM_ERROR;
+		}
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+	return ACCUM_SUCCESS;
+}
+
+void accum_free( struct accum *self )
+{
+	glDeleteFramebuffers( 2, self->fbo );
+	glDeleteTextures( 2, self->texture );
+	glDeleteTextures( 1, &self->guide );
+	*self = ( struct accum ){ 0 };
+}
+
+int accum_resize( struct accum *self, int w, int h )
+{
+	if ( self->w == w && self->h == h )
+		return ACCUM_SUCCESS;
+
+	struct shader shader = self->shader;
+	accum_free( self );
+	int err = accum_init( self, w, h );
+	accum_attach( self, shader );
+	return err;
+}
+
+void accum_reset( struct accum *self )
+{
+	self->frames = 0;
+}
+
+bool accum_converged( const struct accum *self )
+{
+	return self->frames >= ACCUM_MAX_FRAMES;
+}
+
+void accum_attach( struct accum *self, struct shader shader )
+{
+	self->shader = shader;
+	self->accum_loc = shader_uniform_loc( shader, "accum" );
+	self->frames_loc = shader_uniform_loc( shader, "accum_frames" );
+	self->jitter_loc = shader_uniform_loc( shader, "jitter" );
+}
+
+void accum_begin( struct accum *self, vec2s jitter )
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, self->fbo[ self->current ] );
+	glViewport( 0, 0, self->w, self->h );
+
+	glActiveTexture( GL_TEXTURE0 + ACCUM_UNIT );
+	glBindTexture( GL_TEXTURE_2D, self->texture[ !self->current ] );
+
+	shader_uniform_int_loc( self->shader, self->accum_loc, ACCUM_UNIT );
+	shader_uniform_uint_loc( self->shader, self->frames_loc, self->frames );
+	shader_uniform_vec2_loc( self->shader, self->jitter_loc, jitter );
+}
+
+void accum_end( struct accum *self )
+{
+	self->current = !self->current;
+	self->frames++;
+}
+
+GLuint accum_average( const struct accum *self )
+{
+	return self->texture[ !self->current ];
+}
+
+void accum_present( const struct accum *self, GLuint target, int w, int h )
+{
+	// filter only when upscaling a lower render resolution
+	GLenum filter = self->w == w && self->h == h ? GL_NEAREST : GL_LINEAR;
+
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, self->fbo[ !self->current ] );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, target );
+	glBlitFramebuffer( 0, 0, self->w, self->h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, filter );
+	glBindFramebuffer( GL_FRAMEBUFFER, target );
+}
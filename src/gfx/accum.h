@@ -0,0 +1,69 @@
+#ifndef ACCUM_H
+#define ACCUM_H
+
+/*
+ * Progressive accumulation for the raytracer shader. Two float framebuffers
+ * are ping-ponged: each frame reads the running average from one (bound as
+ * the shader's accum sampler) and writes the blended result to the other,
+ * which is then blitted (and scaled, see dynres.h) to the target framebuffer.
+ * Both also write the shader's denoise guide of the latest frame to a third
+ * texture, see atrous.h.
+ */
+
+#include "shader.h"
+#include <glad/glad.h>
+#include <cglm/struct.h>
+#include <util/types.h>
+#include <stdbool.h>
+
+#define ACCUM_SUCCESS	 0
+#define ACCUM_ERROR		-1
+
+// texture unit of the previous average, after the scene buffers
+#define ACCUM_UNIT			2
+
+// the average stops changing visibly, only present it from then on
+#define ACCUM_MAX_FRAMES	1024
+
+struct accum
+{
+	GLuint fbo[ 2 ];
+	GLuint texture[ 2 ];	/* GL_RGBA32F running averages */
+	GLuint guide;			/* GL_RGBA32F normal and depth, second attachment of both */
+	int w;
+	int h;
+
+	int current;	/* written by the next frame, the other one holds the average */
+	u32 frames;		/* frames blended into the average, 0 after a reset */
+
+	// the raytracer variant drawn with and its uniforms, see accum_attach
+	struct shader shader;
+	GLint accum_loc;
+	GLint frames_loc;
+	GLint jitter_loc;
+};
+
+int  accum_init( struct accum *self, int w, int h );
+void accum_free( struct accum *self );
+
+// recreates the framebuffers if the size changed, resets the average if so
+int  accum_resize( struct accum *self, int w, int h );
+void accum_reset( struct accum *self );
+bool accum_converged( const struct accum *self );
+
+// the raytracer program the frames are drawn with, again whenever it changes
+void accum_attach( struct accum *self, struct shader shader );
+
+// render into the next framebuffer, blending with the average offset by jitter pixels
+void accum_begin( struct accum *self, vec2s jitter );
+
+// swap, the new average is what gets presented from then on
+void accum_end( struct accum *self );
+
+// texture with the average of the frames so far
+GLuint accum_average( const struct accum *self );
+
+// copy the current average to a w x h target (0 for the window)
+void accum_present( const struct accum *self, GLuint target, int w, int h );
+
+#endif
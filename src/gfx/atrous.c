@@ -0,0 +1,148 @@
+#include "atrous.h"
+#include <util/log.h>
+
+#include "../../res/shaders/atrous/vert.h"
+#include "../../res/shaders/atrous/frag.h"
+
+static void atrous_free_targets_( struct atrous *self )
+{
+	glDeleteFramebuffers( 2, self->fbo );
+	glDeleteTextures( 2, self->texture );
+	self->fbo[ 0 ] = self->fbo[ 1 ] = 0;
+	self->texture[ 0 ] = self->texture[ 1 ] = 0;
+}
+
+static int atrous_init_targets_( struct atrous *self, int w, int h )
+{
+	self->w = w;
+	self->h = h;
+	self->last = 0;
+
+	glGenTextures( 2, self->texture );
+	glGenFramebuffers( 2, self->fbo );
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		// read with texelFetch, no filtering or mips
+		glBindTexture( GL_TEXTURE_2D, self->texture[ i ] );
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+
+		glBindFramebuffer( GL_FRAMEBUFFER, self->fbo[ i ] );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, self->texture[ i ], 0 );
+
+		if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+		{
+			log_error( "Denoise framebuffer is incomplete" );
+			glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+			atrous_free_targets_( self );
+			return ATROUS_ERROR;
+		}
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+	return ATROUS_SUCCESS;
+}
+
+int atrous_init( struct atrous *self, int w, int h )
+{
+	*self = ( struct atrous ){ 0 };
+
+	if ( shader_tbuild( &self->shader, ( char * )atrous_vert_glsl, atrous_vert_glsl_len,
+				( char * )atrous_frag_glsl, atrous_frag_glsl_len ) != 0 )
+	{
+		log_error( "Failed to build the denoise shader" );
+		return ATROUS_ERROR;
+	}
+
+	self->color_loc = shader_uniform_loc( self->shader, "color" );
+	self->guide_loc = shader_uniform_loc( self->shader, "guide" );
+	self->inv_normal_loc = shader_uniform_loc( self->shader, "inv_normal" );
+	self->sigma_depth_loc = shader_uniform_loc( self->shader, "sigma_depth" );
+	self->step_loc = shader_uniform_loc( self->shader, "step" );
+	self->inv_color_loc = shader_uniform_loc( self->shader, "inv_color" );
+
+	glGenVertexArrays( 1, &self->vao );
+
+	if ( atrous_init_targets_( self, w, h ) != ATROUS_SUCCESS )
+	{
+		atrous_free( self );
+		return ATROUS_ERROR;
+	}
+
+	return ATROUS_SUCCESS;
+}
+
+void atrous_free( struct atrous *self )
+{
+	atrous_free_targets_( self );
+	glDeleteVertexArrays( 1, &self->vao );
+	if ( self->shader.handle )
+		shader_free( self->shader );
+	*self = ( struct atrous ){ 0 };
+}
+
+int atrous_resize( struct atrous *self, int w, int h )
+{
+	if ( self->w == w && self->h == h )
+		return ATROUS_SUCCESS;
+
+	atrous_free_targets_( self );
+	return atrous_init_targets_( self, w, h );
+}
+
+void atrous_apply( struct atrous *self, GLuint color, GLuint guide, const struct denoise_params *params, u32 frames )
+{
+	if ( params->passes <= 0 )
+		return;
+
+	GLint program, vao;
+	glGetIntegerv( GL_CURRENT_PROGRAM, &program );
+	glGetIntegerv( GL_VERTEX_ARRAY_BINDING, &vao );
+
+	shader_bind( self->shader );
+	glBindVertexArray( self->vao );
+	glViewport( 0, 0, self->w, self->h );
+
+	glActiveTexture( GL_TEXTURE0 + ATROUS_GUIDE_UNIT );
+	glBindTexture( GL_TEXTURE_2D, guide );
+
+	shader_uniform_int_loc( self->shader, self->color_loc, ATROUS_COLOR_UNIT );
+	shader_uniform_int_loc( self->shader, self->guide_loc, ATROUS_GUIDE_UNIT );
+	shader_uniform_float_loc( self->shader, self->inv_normal_loc, 1.0f / ( params->sigma_normal * params->sigma_normal ) );
+	shader_uniform_float_loc( self->shader, self->sigma_depth_loc, params->sigma_depth );
+
+	// same passes as denoise_image, each reads what the one before wrote
+	float sigma_color = denoise_sigma_color( params, frames );
+	for ( int pass = 0; pass < params->passes; pass++ )
+	{
+		int target = pass & 1;
+
+		glActiveTexture( GL_TEXTURE0 + ATROUS_COLOR_UNIT );
+		glBindTexture( GL_TEXTURE_2D, pass == 0 ? color : self->texture[ !target ] );
+		glBindFramebuffer( GL_FRAMEBUFFER, self->fbo[ target ] );
+
+		shader_uniform_int_loc( self->shader, self->step_loc, 1 << pass );
+		shader_uniform_float_loc( self->shader, self->inv_color_loc, 1.0f / ( sigma_color * sigma_color ) );
+		glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+		sigma_color *= 0.5f;
+		self->last = target;
+	}
+
+	glBindVertexArray( ( GLuint )vao );
+	glUseProgram( ( GLuint )program );
+}
+
+void atrous_present( const struct atrous *self, GLuint target, int w, int h )
+{
+	// filter only when upscaling a lower render resolution
+	GLenum filter = self->w == w && self->h == h ? GL_NEAREST : GL_LINEAR;
+
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, self->fbo[ self->last ] );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, target );
+	glBlitFramebuffer( 0, 0, self->w, self->h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, filter );
+	glBindFramebuffer( GL_FRAMEBUFFER, target );
+}
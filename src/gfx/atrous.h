@@ -0,0 +1,58 @@
+#ifndef ATROUS_H
+#define ATROUS_H
+
+/*
+ * GPU version of the edge-aware denoiser in src/trace/denoise.h, a post pass
+ * over the frames accumulated by accum.h and guided by the normal and depth
+ * the raytracer writes next to them. Every pass of the filter draws from one
+ * float framebuffer into the other, the output of the last one is blitted
+ * (and scaled) to the target like accum_present.
+ */
+
+#include "shader.h"
+#include <trace/denoise.h>
+#include <glad/glad.h>
+#include <util/types.h>
+
+#define ATROUS_SUCCESS	 0
+#define ATROUS_ERROR	-1
+
+// texture units of the input, clear of the raytracer's
+#define ATROUS_COLOR_UNIT	7
+#define ATROUS_GUIDE_UNIT	8
+
+struct atrous
+{
+	struct shader shader;
+	GLuint vao;				/* empty, the triangle comes from gl_VertexID */
+
+	// uniforms of the shader, looked up once
+	GLint color_loc;
+	GLint guide_loc;
+	GLint inv_normal_loc;
+	GLint sigma_depth_loc;
+	GLint step_loc;
+	GLint inv_color_loc;
+
+	GLuint fbo[ 2 ];
+	GLuint texture[ 2 ];	/* GL_RGBA32F, written by every other pass */
+	int w;
+	int h;
+
+	int last;				/* texture with the output of the last pass */
+};
+
+int  atrous_init( struct atrous *self, int w, int h );
+void atrous_free( struct atrous *self );
+
+// recreates the framebuffers if the size changed
+int  atrous_resize( struct atrous *self, int w, int h );
+
+// filter a w x h color texture that averages frames samples, guided by the
+// guide texture (see accum.h), keeps the bound program and vertex array
+void atrous_apply( struct atrous *self, GLuint color, GLuint guide, const struct denoise_params *params, u32 frames );
+
+// copy the output of the last atrous_apply to a w x h target (0 for the window)
+void atrous_present( const struct atrous *self, GLuint target, int w, int h );
+
+#endif
@@ -0,0 +1,140 @@
+#include "capture.h"
+#include <util/log.h>
+
+#include <stdio.h>
+#include <string.h>
+
+bool capture_pattern_valid( const char *pattern )
+{
+	int conversions = 0;
+	for ( const char *p = strchr( pattern, '%' ); p; p = strchr( p, '%' ) )
+	{
+		p++;
+		if ( *p == '%' )
+		{
+			p++;
+			continue;
+		}
+
+		p += strspn( p, "-+ #0" );
+		p += strspn( p, "0123456789" );
+		if ( *p == '.' )
+			p += 1 + strspn( p + 1, "0123456789" );
+
+		// the number is passed as an unsigned int, no length modifiers
+		if ( *p == '\0' || strchr( "diouxX", *p ) == NULL )
+			return false;
+		conversions++;
+	}
+
+	return conversions == 1;
+}
+
+int capture_init( struct capture *self, struct encoder *encoder, const char *pattern )
+{
+	*self = ( struct capture ){ .encoder = encoder, .pattern = pattern };
+	if ( !capture_pattern_valid( pattern ) )
+	{
+		log_error( "Capture pattern needs exactly one integer conversion for the frame number: %s", pattern );
+		return CAPTURE_ERROR;
+	}
+
+	glGenBuffers( CAPTURE_BUFFERS, self->pbo );
+
+	if ( glGetError() != GL_NO_ERROR )
+	{
+		log_error( "Unable to create the capture buffers" );
+		capture_free( self );
+		return CAPTURE_ERROR;
+	}
+
+	return CAPTURE_SUCCESS;
+}
+
+// maps the oldest read and queues its pixels, wait or not for its fence
+static bool capture_collect_( struct capture *self, bool wait )
+{
+	u32 i = ( self->head + CAPTURE_BUFFERS - self->pending ) % CAPTURE_BUFFERS;
+	GLenum status = glClientWaitSync( self->fence[ i ], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0 );
+	if ( status == GL_TIMEOUT_EXPIRED )
+		return false;
+
+	glDeleteSync( self->fence[ i ] );
+	self->fence[ i ] = NULL;
+	self->pending--;
+
+	// the encoder counts it as dropped when its queue is full
+	struct encoder_frame *frame = encoder_begin( self->encoder, self->w[ i ], self->h[ i ], 4 );
+	if ( frame == NULL )
+		return true;
+
+	GLsizeiptr size = ( GLsizeiptr )self->w[ i ] * self->h[ i ] * 4;
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, self->pbo[ i ] );
+	const void *pixels = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT );
+	if ( pixels == NULL )
+	{
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		encoder_submit( self->encoder, frame, NULL );
+		return true;
+	}
+
+	memcpy( frame->pixels, pixels, size );
+	glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	char path[ ENCODER_PATH_MAX ];
+	snprintf( path, sizeof( path ), self->pattern, self->number[ i ] );
+	frame->bottom_up = true;
+	encoder_submit( self->encoder, frame, path );
+
+	return true;
+}
+
+void capture_frame( struct capture *self, GLuint fbo, int w, int h )
+{
+	// reads finish in order, stop at the first one still in flight
+	while ( self->pending > 0 && capture_collect_( self, false ) )
+		;
+
+	u32 number = self->frames++;
+	if ( self->pending == CAPTURE_BUFFERS )
+	{
+		self->dropped++;
+		return;
+	}
+
+	u32 i = self->head;
+	GLsizeiptr size = ( GLsizeiptr )w * h * 4;
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, self->pbo[ i ] );
+	if ( size != self->size[ i ] )
+	{
+		glBufferData( GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ );
+		self->size[ i ] = size;
+	}
+
+	// into the buffer, the call returns before the copy is done
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, fbo );
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	glReadPixels( 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	self->fence[ i ] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	self->w[ i ] = w;
+	self->h[ i ] = h;
+	self->number[ i ] = number;
+	self->head = ( i + 1 ) % CAPTURE_BUFFERS;
+	self->pending++;
+}
+
+void capture_flush( struct capture *self )
+{
+	while ( self->pending > 0 )
+		capture_collect_( self, true );
+}
+
+void capture_free( struct capture *self )
+{
+	capture_flush( self );
+	glDeleteBuffers( CAPTURE_BUFFERS, self->pbo );
+	*self = ( struct capture ){ 0 };
+}
@@ -0,0 +1,58 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/*
+ * Frame capture that never waits for the gpu. Every frame is read back into
+ * the next pixel pack buffer of a ring and fenced, the buffers whose fence
+ * has passed are mapped frames later and their pixels handed to the encoder
+ * (system/encoder.h) to be written on its thread. A frame is dropped when
+ * every buffer is still in flight or the encoder queue is full.
+ */
+
+#include <glad/glad.h>
+#include <util/types.h>
+#include <system/encoder.h>
+#include <stdbool.h>
+
+#define CAPTURE_SUCCESS	0
+#define CAPTURE_ERROR  -1
+
+// frames a read back may lag behind before frames are dropped
+#define CAPTURE_BUFFERS	3
+
+struct capture
+{
+	GLuint pbo[ CAPTURE_BUFFERS ];
+	GLsync fence[ CAPTURE_BUFFERS ];
+	GLsizeiptr size[ CAPTURE_BUFFERS ];	/* allocated bytes */
+	int w[ CAPTURE_BUFFERS ];			/* of the frame read into each */
+	int h[ CAPTURE_BUFFERS ];
+	u32 number[ CAPTURE_BUFFERS ];
+	u32 head;		/* buffer of the next read */
+	u32 pending;	/* read and not handed over yet */
+
+	struct encoder *encoder;
+	const char *pattern;	/* printf pattern of the paths, given the frame number */
+	u32 frames;		/* frames captured, numbers the paths */
+	u64 dropped;	/* because every buffer was in flight */
+};
+
+// the encoder and pattern have to outlive the capture, fails on a pattern
+// capture_pattern_valid rejects
+int  capture_init( struct capture *self, struct encoder *encoder, const char *pattern );
+
+// a path pattern has exactly one integer conversion for the frame number
+// (flags and width allowed, like %05u) and no other conversion but %%
+bool capture_pattern_valid( const char *pattern );
+
+// hands over what is still in flight, waiting for it
+void capture_free( struct capture *self );
+
+// starts reading back the w x h framebuffer and hands over the reads that
+// finished since, binds fbo for reading
+void capture_frame( struct capture *self, GLuint fbo, int w, int h );
+
+// waits for every read in flight and hands it over
+void capture_flush( struct capture *self );
+
+#endif
@@ -0,0 +1,60 @@
+#include "dynres.h"
+#include <util/fmath.h>
+
+void dynres_init( struct dynres *self, float min_scale, float max_scale )
+{
+	*self = ( struct dynres ) {
+		.scale = max_scale,
+		.min_scale = min_scale,
+		.max_scale = max_scale
+	};
+}
+
+bool dynres_update( struct dynres *self, float delta_ms, float target_ms )
+{
+	if ( target_ms <= 0.0f || delta_ms <= 0.0f )
+		return false;
+
+	float ratio = delta_ms / target_ms;
+	float scale = self->scale;
+
+	if ( ratio > DYNRES_OVER )
+	{
+		self->under = 0;
+		if ( ++self->over < DYNRES_DOWN_FRAMES )
+			return false;
+
+		// the cost goes with the pixel count, so the square of the scale
+		scale = min( scale * sqrtf( 1.0f / ratio ), scale - DYNRES_STEP );
+	}
+	else if ( ratio < DYNRES_UNDER )
+	{
+		self->over = 0;
+		if ( ++self->under < DYNRES_UP_FRAMES )
+			return false;
+
+		scale += DYNRES_STEP;
+	}
+	else
+	{
+		self->over = 0;
+		self->under = 0;
+		return false;
+	}
+
+	self->over = 0;
+	self->under = 0;
+
+	scale = clamp( scale, self->min_scale, self->max_scale );
+	if ( scale == self->scale )
+		return false;
+
+	self->scale = scale;
+	return true;
+}
+
+void dynres_size( const struct dynres *self, int w, int h, int *out_w, int *out_h )
+{
+	*out_w = max( 1, ( int )( w * self->scale + 0.5f ) );
+	*out_h = max( 1, ( int )( h * self->scale + 0.5f ) );
+}
@@ -0,0 +1,43 @@
+#ifndef DYNRES_H
+#define DYNRES_H
+
+/*
+ * Dynamic resolution: scales the render resolution so the frame time stays
+ * at the target. Drops quickly (proportional to the overshoot) when frames
+ * run long and creeps back up in small steps after a run of frames within
+ * budget. The band in between holds the scale so it does not oscillate.
+ */
+
+#include <stdbool.h>
+
+// frame time relative to the target
+#define DYNRES_OVER			1.15f	/* above this counts as too slow */
+#define DYNRES_UNDER		1.05f	/* below this counts as within budget */
+
+// consecutive frames needed before changing the scale
+#define DYNRES_DOWN_FRAMES	4
+#define DYNRES_UP_FRAMES	60
+
+#define DYNRES_STEP			0.05f
+#define DYNRES_MIN_SCALE	0.25f
+#define DYNRES_MAX_SCALE	1.0f
+
+struct dynres
+{
+	float scale;		/* of each axis of the window */
+	float min_scale;
+	float max_scale;
+
+	int over;			/* consecutive frames above DYNRES_OVER */
+	int under;			/* consecutive frames below DYNRES_UNDER */
+};
+
+void dynres_init( struct dynres *self, float min_scale, float max_scale );
+
+// feed the last frame time, returns true if the scale changed
+bool dynres_update( struct dynres *self, float delta_ms, float target_ms );
+
+// render size for a w x h window, at least one pixel
+void dynres_size( const struct dynres *self, int w, int h, int *out_w, int *out_h );
+
+#endif
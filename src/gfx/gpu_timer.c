@@ -0,0 +1,61 @@
+#include "gpu_timer.h"
+
+void gpu_timer_init( struct gpu_timer *self )
+{
+	*self = ( struct gpu_timer ){ 0 };
+	glGenQueries( GPU_TIMER_QUERIES, self->queries );
+}
+
+void gpu_timer_free( struct gpu_timer *self )
+{
+	if ( self->running )
+		glEndQuery( GL_TIME_ELAPSED );
+
+	glDeleteQueries( GPU_TIMER_QUERIES, self->queries );
+	*self = ( struct gpu_timer ){ 0 };
+}
+
+void gpu_timer_begin( struct gpu_timer *self )
+{
+	if ( self->pending == GPU_TIMER_QUERIES )
+	{
+		self->skipped++;
+		return;
+	}
+
+	glBeginQuery( GL_TIME_ELAPSED, self->queries[ self->head ] );
+	self->running = true;
+}
+
+void gpu_timer_end( struct gpu_timer *self )
+{
+	if ( !self->running )
+		return;
+
+	glEndQuery( GL_TIME_ELAPSED );
+	self->running = false;
+	self->head = ( self->head + 1 ) % GPU_TIMER_QUERIES;
+	self->pending++;
+}
+
+int gpu_timer_poll( struct gpu_timer *self, struct histogram *out )
+{
+	int read = 0;
+	while ( self->pending > 0 )
+	{
+		// results become available in order, stop at the first unfinished one
+		GLuint query = self->queries[ ( self->head + GPU_TIMER_QUERIES - self->pending ) % GPU_TIMER_QUERIES ];
+		GLint available = 0;
+		glGetQueryObjectiv( query, GL_QUERY_RESULT_AVAILABLE, &available );
+		if ( !available )
+			break;
+
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v( query, GL_QUERY_RESULT, &ns );
+		histogram_push( out, ns );
+		self->pending--;
+		read++;
+	}
+
+	return read;
+}
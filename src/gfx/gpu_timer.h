@@ -0,0 +1,40 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+/*
+ * GPU time of a pass with GL_TIME_ELAPSED queries. Queries are kept in a ring
+ * and read back frames later, once the gpu has caught up, so timing never
+ * waits for the pipeline to drain. When every query is still in flight the
+ * frame is not timed rather than stalled.
+ */
+
+#include <glad/glad.h>
+#include <util/types.h>
+#include <util/histogram.h>
+#include <stdbool.h>
+
+// frames a result may lag behind before frames go untimed
+#define GPU_TIMER_QUERIES	4
+
+struct gpu_timer
+{
+	GLuint queries[ GPU_TIMER_QUERIES ];
+	u32 head;		/* query of the next begin */
+	u32 pending;	/* ended and not read yet */
+	bool running;	/* between a begin and its end */
+
+	u64 skipped;	/* frames not timed because the ring was full */
+};
+
+void gpu_timer_init( struct gpu_timer *self );
+void gpu_timer_free( struct gpu_timer *self );
+
+// brackets the gl calls to time, only one pass at a time
+void gpu_timer_begin( struct gpu_timer *self );
+void gpu_timer_end( struct gpu_timer *self );
+
+// pushes the nanoseconds of every finished pass (oldest first) to out without
+// waiting, returns how many were read
+int gpu_timer_poll( struct gpu_timer *self, struct histogram *out );
+
+#endif
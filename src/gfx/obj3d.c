@@ -5,12 +5,21 @@
 #include <util/types.h>
 #include <util/fmath.h>
 #include <data/dynarr.h>
+#include <system/jobs.h>
 
 #include <math.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static inline void obj3d_init_( struct obj3d *obj )
 {
 	obj->fv = NULL;
@@ -19,96 +28,430 @@ static inline void obj3d_init_( struct obj3d *obj )
 	obj->vn = NULL;
 }
 
-static inline void obj3d_append_face_vertex_( struct obj3d *obj, const char *vert )
+// a face has at most this many vertices, the rest are ignored
+#define OBJ3D_MAX_FACE_VERTS 64
+
+enum obj3d_kind_
+{
+	OBJ3D_SKIP_,
+	OBJ3D_V_,
+	OBJ3D_VT_,
+	OBJ3D_VN_,
+	OBJ3D_F_
+};
+
+// a line of the file after its keyword, index is into the array of its kind
+// (the first face vertex for faces) so every line can be parsed on its own
+struct obj3d_line_
+{
+	const char *begin;
+	const char *end;
+	int kind;
+	int verts;		/* of a face */
+	size_t index;
+	u32 seen[ 3 ];	/* v, vt and vn before a face, for relative indices */
+};
+
+struct obj3d_parse_
+{
+	struct obj3d *obj;
+	struct obj3d_line_ *lines;
+};
+
+// the file mapped read only, or read whole where mapping is not available
+struct obj3d_file_
+{
+	const char *data;
+	size_t len;
+};
+
+#ifdef _WIN32
+static int obj3d_map_( struct obj3d_file_ *f, const char *file )
 {
-	struct vert f;
-	int a, b, c;
+	FILE *fp = fopen( file, "rb" );
+	if ( fp == NULL )
+	{
+		return 1;
+	}
 
-	sscanf( vert, "%d/%d/%d", &a, &b, &c );
+	fseek( fp, 0, SEEK_END );
+	long size = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
 
-	f.vp = obj->vp[ a - 1 ];
-	f.vt = obj->vt[ b - 1 ];
-	f.vn = obj->vn[ c - 1 ];
+	char *text = size >= 0 ? malloc( ( size_t )size + 1 ) : NULL;
+	if ( text == NULL || fread( text, 1, ( size_t )size, fp ) != ( size_t )size )
+	{
+		free( text );
+		fclose( fp );
+		return 1;
+	}
 
-	dynarr_push_back( obj->fv, f );
+	fclose( fp );
+	f->data = text;
+	f->len = ( size_t )size;
+	return 0;
 }
 
-static inline int obj3d_load_mesh_( struct obj3d *obj, const char *file )
+static void obj3d_unmap_( struct obj3d_file_ *f )
 {
-	const size_t buffer_size = 1024;
-	char buffer[ buffer_size ];
-	FILE *fp = fopen( file, "r" );
-	
-	if ( fp == NULL )
+	free( ( void * )f->data );
+}
+#else
+static int obj3d_map_( struct obj3d_file_ *f, const char *file )
+{
+	int fd = open( file, O_RDONLY );
+	if ( fd < 0 )
 	{
 		return 1;
 	}
 
-	while( !feof( fp ) )
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 )
 	{
-		// get line and store in buffer (should make proper parser but this is fine for now)
-		if ( !fgets( buffer, buffer_size, fp ) )
-		{
-			break;
-		}
+		close( fd );
+		return 1;
+	}
 
-		if ( strlen( buffer ) - 1 <= 0 )
+	// an empty file cannot be mapped and has nothing to parse anyway
+	f->data = NULL;
+	f->len = ( size_t )st.st_size;
+	if ( f->len > 0 )
+	{
+		void *data = mmap( NULL, f->len, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( data == MAP_FAILED )
 		{
-			continue;
+			close( fd );
+			return 1;
 		}
 
-		char lexeme[ 64 ];
-		sscanf( buffer, "%s", lexeme );
+		f->data = data;
+	}
+
+	// the mapping stays valid without the descriptor
+	close( fd );
+	return 0;
+}
+
+static void obj3d_unmap_( struct obj3d_file_ *f )
+{
+	if ( f->len > 0 )
+		munmap( ( void * )f->data, f->len );
+}
+#endif
+
+static inline bool obj3d_is_space_( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool obj3d_is_digit_( char c )
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline const char *obj3d_skip_space_( const char *p, const char *end )
+{
+	while ( p < end && obj3d_is_space_( *p ) )
+		p++;
+	return p;
+}
+
+// powers of ten a double holds exactly
+static const double obj3d_pow10_[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-		// get a vertex position
-		if ( strcmp( lexeme, "v" ) == 0 )
+// decimal float with an optional exponent, '.' whatever the locale, returns
+// the end of it or NULL if there are no digits
+static const char *obj3d_parse_float_( const char *p, const char *end, float *out )
+{
+	bool neg = p < end && *p == '-';
+	if ( p < end && ( *p == '-' || *p == '+' ) )
+		p++;
+
+	// up to 19 significant digits fit the mantissa, the rest only scale it
+	u64 mant = 0;
+	int digits = 0;
+	int exp = 0;
+	bool any = false;
+	for ( ; p < end && obj3d_is_digit_( *p ); p++ )
+	{
+		any = true;
+		if ( digits < 19 )
 		{
-			vec3s tmp;
-			sscanf( buffer, "%*s %f %f %f", &tmp.x, &tmp.y, &tmp.z );
-			dynarr_push_back( obj->vp, tmp );
+			mant = mant * 10 + ( u64 )( *p - '0' );
+			digits += mant != 0;
 		}
-		// get a texture coordinates
-		else if ( strcmp( lexeme, "vt" ) == 0 )
+		else
+			exp++;
+	}
+
+	if ( p < end && *p == '.' )
+	{
+		for ( p++; p < end && obj3d_is_digit_( *p ); p++ )
 		{
-			vec2s tmp;
-			sscanf( buffer, "%*s %f %f", &tmp.x, &tmp.y );
-			dynarr_push_back( obj->vt, tmp );
+			any = true;
+			if ( digits < 19 )
+			{
+				mant = mant * 10 + ( u64 )( *p - '0' );
+				digits += mant != 0;
+				exp--;
+			}
 		}
-		// get a vertex normal
-		else if ( strcmp( lexeme, "vn" ) == 0 )
+	}
+
+	if ( !any )
+		return NULL;
+
+	if ( p < end && ( *p == 'e' || *p == 'E' ) )
+	{
+		const char *q = p + 1;
+		bool exp_neg = q < end && *q == '-';
+		if ( q < end && ( *q == '-' || *q == '+' ) )
+			q++;
+
+		if ( q < end && obj3d_is_digit_( *q ) )
 		{
-			vec3s tmp;
-			sscanf( buffer, "%*s %f %f %f", &tmp.x, &tmp.y, &tmp.z );
-			dynarr_push_back( obj->vn, tmp );
+			int e = 0;
+			for ( ; q < end && obj3d_is_digit_( *q ); q++ )
+				e = e < 10000 ? e * 10 + ( *q - '0' ) : e;
+			exp += exp_neg ? -e : e;
+			p = q;
 		}
-		// get a face
-		else if ( strcmp( lexeme, "f" ) == 0 )
+	}
+
+	// exact mantissa and power give the correctly rounded double, beyond
+	// that pow is within an ulp or so
+	double v;
+	if ( mant == 0 )
+		v = 0.0;
+	else if ( mant <= ( 1ull << 53 ) && exp >= -22 && exp <= 22 )
+		v = exp < 0 ? ( double )mant / obj3d_pow10_[ -exp ] : ( double )mant * obj3d_pow10_[ exp ];
+	else
+		v = ( double )mant * pow( 10.0, exp );
+
+	*out = ( float )( neg ? -v : v );
+	return p;
+}
+
+// returns the end of the integer or NULL if there are no digits
+static const char *obj3d_parse_int_( const char *p, const char *end, long *out )
+{
+	bool neg = p < end && *p == '-';
+	if ( p < end && ( *p == '-' || *p == '+' ) )
+		p++;
+
+	if ( p == end || !obj3d_is_digit_( *p ) )
+		return NULL;
+
+	long v = 0;
+	for ( ; p < end && obj3d_is_digit_( *p ); p++ )
+		v = v < 100000000 ? v * 10 + ( *p - '0' ) : v;
+
+	*out = neg ? -v : v;
+	return p;
+}
+
+// up to n floats after the keyword, missing ones are zero
+static void obj3d_parse_floats_( const struct obj3d_line_ *line, float *out, int n )
+{
+	const char *p = line->begin;
+	for ( int i = 0; i < n; i++ )
+	{
+		out[ i ] = 0.0f;
+		p = obj3d_skip_space_( p, line->end );
+		const char *next = obj3d_parse_float_( p, line->end, &out[ i ] );
+		if ( next == NULL )
+			return;
+		p = next;
+	}
+}
+
+// 1 based index, negative ones count back from the attributes seen before
+// the face; returns -1 when missing (0) or out of range
+static inline long obj3d_index_( long idx, u32 seen, size_t count )
+{
+	if ( idx == 0 )
+		return -1;
+
+	long i = idx > 0 ? idx - 1 : ( long )seen + idx;
+	return i >= 0 && ( size_t )i < count ? i : -1;
+}
+
+// "v", "v/vt", "v//vn" or "v/vt/vn", attributes that are missing or out of
+// range are zero
+static const char *obj3d_face_vertex_( const struct obj3d *obj, const struct obj3d_line_ *line,
+									   const char *p, struct vert *out )
+{
+	*out = ( struct vert ){ 0 };
+
+	long idx[ 3 ] = { 0, 0, 0 };
+	for ( int k = 0; k < 3; k++ )
+	{
+		const char *next = obj3d_parse_int_( p, line->end, &idx[ k ] );
+		if ( next )
+			p = next;
+		if ( k == 2 || p == line->end || *p != '/' )
+			break;
+		p++;
+	}
+
+	long i = obj3d_index_( idx[ 0 ], line->seen[ 0 ], dynarr_size( obj->vp ) );
+	if ( i >= 0 )
+		out->vp = obj->vp[ i ];
+	i = obj3d_index_( idx[ 1 ], line->seen[ 1 ], dynarr_size( obj->vt ) );
+	if ( i >= 0 )
+		out->vt = obj->vt[ i ];
+	i = obj3d_index_( idx[ 2 ], line->seen[ 2 ], dynarr_size( obj->vn ) );
+	if ( i >= 0 )
+		out->vn = obj->vn[ i ];
+
+	// whatever else is in the token is skipped
+	while ( p < line->end && !obj3d_is_space_( *p ) )
+		p++;
+	return p;
+}
+
+// keyword of the line, begin is moved past it
+static int obj3d_kind_( const char **begin, const char *end )
+{
+	const char *p = obj3d_skip_space_( *begin, end );
+	const char *word = p;
+	while ( p < end && !obj3d_is_space_( *p ) )
+		p++;
+	*begin = p;
+
+	size_t n = ( size_t )( p - word );
+	if ( n == 1 && word[ 0 ] == 'v' )
+		return OBJ3D_V_;
+	if ( n == 2 && word[ 0 ] == 'v' && word[ 1 ] == 't' )
+		return OBJ3D_VT_;
+	if ( n == 2 && word[ 0 ] == 'v' && word[ 1 ] == 'n' )
+		return OBJ3D_VN_;
+	if ( n == 1 && word[ 0 ] == 'f' )
+		return OBJ3D_F_;
+	return OBJ3D_SKIP_;
+}
+
+// whitespace separated tokens, trailing whitespace adds none
+static int obj3d_face_verts_( const char *p, const char *end )
+{
+	int count = 0;
+	for ( ;; )
+	{
+		p = obj3d_skip_space_( p, end );
+		if ( p == end || count == OBJ3D_MAX_FACE_VERTS )
+			return count;
+
+		count++;
+		while ( p < end && !obj3d_is_space_( *p ) )
+			p++;
+	}
+}
+
+static void obj3d_parse_attributes_( size_t begin, size_t end, int slot, void *data )
+{
+	struct obj3d_parse_ *parse = data;
+	struct obj3d *obj = parse->obj;
+	( void )slot;
+
+	for ( size_t i = begin; i < end; i++ )
+	{
+		const struct obj3d_line_ *line = &parse->lines[ i ];
+		if ( line->kind == OBJ3D_V_ )
+			obj3d_parse_floats_( line, obj->vp[ line->index ].raw, 3 );
+		else if ( line->kind == OBJ3D_VT_ )
+			obj3d_parse_floats_( line, obj->vt[ line->index ].raw, 2 );
+		else if ( line->kind == OBJ3D_VN_ )
+			obj3d_parse_floats_( line, obj->vn[ line->index ].raw, 3 );
+	}
+}
+
+// fans every face into triangles, needs every attribute parsed
+static void obj3d_parse_faces_( size_t begin, size_t end, int slot, void *data )
+{
+	struct obj3d_parse_ *parse = data;
+	struct obj3d *obj = parse->obj;
+	( void )slot;
+
+	for ( size_t i = begin; i < end; i++ )
+	{
+		const struct obj3d_line_ *line = &parse->lines[ i ];
+		if ( line->kind != OBJ3D_F_ )
+			continue;
+
+		struct vert verts[ OBJ3D_MAX_FACE_VERTS ];
+		const char *p = line->begin;
+		for ( int j = 0; j < line->verts; j++ )
+			p = obj3d_face_vertex_( obj, line, obj3d_skip_space_( p, line->end ), &verts[ j ] );
+
+		struct vert *out = &obj->fv[ line->index ];
+		for ( int j = 0; j <= line->verts - 3; j++ )
 		{
-			// store and track start address of each face vertex
-			int vert_count = 0;
-			char *vert_idx[ 64 ];
+			*out++ = verts[ 0 ];
+			*out++ = verts[ 1 + j ];
+			*out++ = verts[ 2 + j ];
+		}
+	}
+}
 
-			// count number of vertices
-			for ( char *itr = buffer; *itr != '\n' && *itr != '\0'; itr++ )
-			{
-				if ( *itr == ' ' )
-				{
-					vert_idx[ vert_count ] = itr + 1;
-					vert_count++;
-				}
-			}
+// the mapped file is split into lines and sized up in one pass, then the
+// lines are parsed in parallel straight into place: attributes first, then
+// faces; nothing is copied or written to the file
+static inline int obj3d_load_mesh_( struct obj3d *obj, const char *file )
+{
+	struct obj3d_file_ f;
+	if ( obj3d_map_( &f, file ) != 0 )
+	{
+		return 1;
+	}
 
-			// parse vertex
-			for ( int i = 0; i <= vert_count - 3; i++ )
-			{
-				obj3d_append_face_vertex_( obj, vert_idx[ 0 ] );
-				obj3d_append_face_vertex_( obj, vert_idx[ 1 + i ] );
-				obj3d_append_face_vertex_( obj, vert_idx[ 2 + i ] );
-			}
+	struct obj3d_line_ *lines = NULL;
+	size_t counts[ OBJ3D_F_ + 1 ] = { 0 };
+	const char *text_end = f.data + f.len;
+
+	for ( const char *itr = f.data; itr < text_end; )
+	{
+		const char *eol = memchr( itr, '\n', ( size_t )( text_end - itr ) );
+		if ( eol == NULL )
+			eol = text_end;
+
+		struct obj3d_line_ line = { .begin = itr, .end = eol };
+		line.kind = obj3d_kind_( &line.begin, line.end );
+		if ( line.kind == OBJ3D_F_ )
+		{
+			line.verts = obj3d_face_verts_( line.begin, line.end );
+			line.index = counts[ OBJ3D_F_ ];
+			line.seen[ 0 ] = ( u32 )counts[ OBJ3D_V_ ];
+			line.seen[ 1 ] = ( u32 )counts[ OBJ3D_VT_ ];
+			line.seen[ 2 ] = ( u32 )counts[ OBJ3D_VN_ ];
+			counts[ OBJ3D_F_ ] += line.verts >= 3 ? 3 * ( size_t )( line.verts - 2 ) : 0;
 		}
+		else if ( line.kind != OBJ3D_SKIP_ )
+			line.index = counts[ line.kind ]++;
+
+		if ( line.kind != OBJ3D_SKIP_ )
+			dynarr_push_back( lines, line );
+
+		itr = eol + 1;
 	}
 
-	fclose( fp );
+	if ( counts[ OBJ3D_V_ ] > 0 )
+		dynarr_resize( obj->vp, counts[ OBJ3D_V_ ] );
+	if ( counts[ OBJ3D_VT_ ] > 0 )
+		dynarr_resize( obj->vt, counts[ OBJ3D_VT_ ] );
+	if ( counts[ OBJ3D_VN_ ] > 0 )
+		dynarr_resize( obj->vn, counts[ OBJ3D_VN_ ] );
+	if ( counts[ OBJ3D_F_ ] > 0 )
+		dynarr_resize( obj->fv, counts[ OBJ3D_F_ ] );
+
+	struct obj3d_parse_ parse = { .obj = obj, .lines = lines };
+	parallel_for( dynarr_size( lines ), 1024, obj3d_parse_attributes_, &parse );
+	parallel_for( dynarr_size( lines ), 1024, obj3d_parse_faces_, &parse );
+
+	dynarr_free( lines );
+	obj3d_unmap_( &f );
 
 	return 0;
 }
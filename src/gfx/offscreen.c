@@ -0,0 +1,169 @@
+#include "offscreen.h"
+#include <util/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef __linux__
+
+static EGLDisplay offscreen_display_( void )
+{
+	// prefer a display that does not need a window system
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		( PFNEGLGETPLATFORMDISPLAYEXTPROC )eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+
+	EGLDisplay display = EGL_NO_DISPLAY;
+	if ( get_platform_display )
+		display = get_platform_display( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+	if ( display == EGL_NO_DISPLAY )
+		display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	return display;
+}
+
+static int offscreen_context_( struct offscreen *self )
+{
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	EGLDisplay display = offscreen_display_();
+	EGLint major, minor;
+	if ( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) )
+	{
+		log_error( "Unable to initialize EGL display (0x%x)", eglGetError() );
+		return OFFSCREEN_ERROR;
+	}
+
+	EGLConfig config;
+	EGLint config_count = 0;
+	if ( !eglChooseConfig( display, config_attribs, &config, 1, &config_count ) || config_count == 0 )
+	{
+		log_error( "No EGL config for OpenGL (0x%x)", eglGetError() );
+		eglTerminate( display );
+		return OFFSCREEN_ERROR;
+	}
+
+	eglBindAPI( EGL_OPENGL_API );
+	EGLContext context = eglCreateContext( display, config, EGL_NO_CONTEXT, context_attribs );
+	if ( context == EGL_NO_CONTEXT )
+	{
+		log_error( "Unable to create OpenGL 3.3 context (0x%x)", eglGetError() );
+		eglTerminate( display );
+		return OFFSCREEN_ERROR;
+	}
+
+	// rendering goes to our own framebuffer so no surface is needed
+	if ( !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) )
+	{
+		log_error( "Unable to make context current (0x%x)", eglGetError() );
+		eglDestroyContext( display, context );
+		eglTerminate( display );
+		return OFFSCREEN_ERROR;
+	}
+
+	if ( !gladLoadGLLoader( ( GLADloadproc )eglGetProcAddress ) )
+	{
+		log_error( "Failed to initialize opengl" );
+		eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+		eglDestroyContext( display, context );
+		eglTerminate( display );
+		return OFFSCREEN_ERROR;
+	}
+
+	self->display = display;
+	self->context = context;
+
+	return OFFSCREEN_SUCCESS;
+}
+
+#else
+
+static int offscreen_context_( struct offscreen *self )
+{
+	( void )self;
+	log_error( "Offscreen rendering is only supported with EGL" );
+	return OFFSCREEN_ERROR;
+}
+
+#endif
+
+int offscreen_init( struct offscreen *self, int w, int h )
+{
+	*self = ( struct offscreen ){ .w = w, .h = h };
+
+	if ( offscreen_context_( self ) != OFFSCREEN_SUCCESS )
+		return OFFSCREEN_ERROR;
+
+	log_debug( "Renderer   : %s", glGetString( GL_RENDERER ) );
+	log_debug( "GL Version : %s", glGetString( GL_VERSION ) );
+
+	glGenRenderbuffers( 1, &self->color );
+	glBindRenderbuffer( GL_RENDERBUFFER, self->color );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA32F, w, h );
+
+	glGenFramebuffers( 1, &self->fbo );
+	glBindFramebuffer( GL_FRAMEBUFFER, self->fbo );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, self->color );
+
+	if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		log_error( "Offscreen framebuffer is incomplete" );
+		offscreen_free( self );
+		return OFFSCREEN_ERROR;
+	}
+
+	glViewport( 0, 0, w, h );
+
+	return OFFSCREEN_SUCCESS;
+}
+
+void offscreen_free( struct offscreen *self )
+{
+	if ( self->context == NULL )
+		return;
+
+	glDeleteFramebuffers( 1, &self->fbo );
+	glDeleteRenderbuffers( 1, &self->color );
+
+#ifdef __linux__
+	eglMakeCurrent( self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+	eglDestroyContext( self->display, self->context );
+	eglTerminate( self->display );
+#endif
+
+	*self = ( struct offscreen ){ 0 };
+}
+
+void offscreen_read( const struct offscreen *self, vec3s *pixels )
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, self->fbo );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, self->w, self->h, GL_RGB, GL_FLOAT, pixels );
+
+	// gl rows start at the bottom
+	size_t row = self->w * sizeof( *pixels );
+	vec3s *tmp = malloc( row );
+	for ( int y = 0; y < self->h / 2; y++ )
+	{
+		vec3s *a = pixels + y * self->w;
+		vec3s *b = pixels + ( self->h - 1 - y ) * self->w;
+		memcpy( tmp, a, row );
+		memcpy( a, b, row );
+		memcpy( b, tmp, row );
+	}
+	free( tmp );
+}
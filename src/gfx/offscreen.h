@@ -0,0 +1,35 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+/*
+ * OpenGL 3.3 core context without a window (EGL, surfaceless when the
+ * driver allows it) rendering into a float framebuffer. Runs on Mesa
+ * llvmpipe, so the shader can be tested without a display.
+ */
+
+#include <glad/glad.h>
+#include <cglm/struct.h>
+
+#define OFFSCREEN_SUCCESS	 0
+#define OFFSCREEN_ERROR		-1
+
+struct offscreen
+{
+	// egl handles, kept opaque so egl headers stay out of the rest of the code
+	void *display;
+	void *context;
+
+	GLuint fbo;
+	GLuint color;	/* GL_RGBA32F renderbuffer */
+	int w;
+	int h;
+};
+
+// creates the context, makes it current and binds the framebuffer
+int  offscreen_init( struct offscreen *self, int w, int h );
+void offscreen_free( struct offscreen *self );
+
+// read back w * h pixels, row 0 is the top of the image (same as the cpu tracer)
+void offscreen_read( const struct offscreen *self, vec3s *pixels );
+
+#endif
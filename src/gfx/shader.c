@@ -4,7 +4,11 @@
 #include <string.h>
 #include <assert.h>
 #include <util/log.h>
+#include <util/fmath.h>
 #include <glad/glad.h>
+#include <SDL2/SDL.h>
+
+struct shader_stats shader_stats;
 
 static inline char *shader_get_log_( 
 		GLint handle,
@@ -102,6 +106,10 @@ static inline GLuint shader_link_program_( GLuint vs, GLuint fs )
 	glAttachShader( handle, vs );
 	glAttachShader( handle, fs );
 
+	// lets shader_cbuild save the linked program
+	if ( glProgramParameteri )
+		glProgramParameteri( handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+
 	// note: must bind attributes before linking
 	//// Bind vertex attributes
 	//for (size_t i = 0; i < n; i++) {
@@ -112,6 +120,106 @@ static inline GLuint shader_link_program_( GLuint vs, GLuint fs )
 	return handle;
 }
 
+static inline u32 shader_hash_( const char *name )
+{
+	// fnv-1a
+	u32 hash = 2166136261u;
+	for ( ; *name; name++ )
+		hash = ( hash ^ ( u8 )*name ) * 16777619u;
+	return hash;
+}
+
+static void shader_uniform_insert_( struct shader *self, const char *name, GLint loc )
+{
+	u32 hash = shader_hash_( name );
+	u32 mask = self->uniform_cap - 1;
+
+	for ( u32 i = hash & mask; ; i = ( i + 1 ) & mask )
+	{
+		struct shader_uniform *u = &self->uniforms[ i ];
+		if ( u->name == NULL )
+		{
+			size_t len = strlen( name ) + 1;
+			u->name = malloc( len );
+			memcpy( u->name, name, len );
+			u->hash = hash;
+			u->loc = loc;
+			self->uniform_count++;
+			return;
+		}
+
+		if ( u->hash == hash && strcmp( u->name, name ) == 0 )
+			return;
+	}
+}
+
+// enumerate active uniforms once so nothing asks the driver for locations later
+static void shader_cache_uniforms_( struct shader *self )
+{
+	GLint count = 0;
+	GLint max_len = 0;
+	glGetProgramiv( self->handle, GL_ACTIVE_UNIFORMS, &count );
+	glGetProgramiv( self->handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len );
+
+	char *name = malloc( max_len + 16 );
+	GLint max_loc = -1;
+
+	// an array registers its base name and every element, load factor <= 1 / 2
+	GLint names = 0;
+	for ( GLint i = 0; i < count; i++ )
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveUniform( self->handle, i, max_len, NULL, &size, &type, name );
+		names += size > 1 ? size + 1 : 1;
+	}
+
+	self->uniform_cap = 16;
+	while ( self->uniform_cap < ( u32 )names * 2 )
+		self->uniform_cap *= 2;
+	self->uniforms = calloc( self->uniform_cap, sizeof( *self->uniforms ) );
+
+	for ( GLint i = 0; i < count; i++ )
+	{
+		GLint size;
+		GLenum type;
+		GLsizei len;
+		glGetActiveUniform( self->handle, i, max_len, &len, &size, &type, name );
+
+		// uniforms in a block have no location
+		GLint loc = glGetUniformLocation( self->handle, name );
+		if ( loc < 0 )
+			continue;
+
+		shader_uniform_insert_( self, name, loc );
+		max_loc = max( max_loc, loc );
+
+		// "name[0]" of an array, element locations are not guaranteed to be consecutive
+		if ( size > 1 && len > 3 && strcmp( name + len - 3, "[0]" ) == 0 )
+		{
+			name[ len - 3 ] = '\0';
+			shader_uniform_insert_( self, name, loc );
+
+			char *base = malloc( len + 16 );
+			for ( GLint j = 1; j < size; j++ )
+			{
+				snprintf( base, len + 16, "%s[%d]", name, j );
+				GLint element = glGetUniformLocation( self->handle, base );
+				shader_uniform_insert_( self, base, element );
+				max_loc = max( max_loc, element );
+			}
+			free( base );
+		}
+	}
+	free( name );
+
+	// locations are small and dense in practice
+	self->shadow_len = max_loc + 1;
+	self->shadow = calloc( self->shadow_len + 1, sizeof( *self->shadow ) );
+
+	log_debug( "Cached %u uniform locations", self->uniform_count );
+}
+
 static inline int shader_build_util_( struct shader *self, const char *vstext, size_t vslen, const char *fstext, size_t fslen, const char *vspath, const char *fspath )
 {
 	if ( self == NULL )
@@ -147,6 +255,8 @@ static inline int shader_build_util_( struct shader *self, const char *vstext, s
 		return 3;
 	}
 
+	shader_cache_uniforms_( self );
+
 	return 0;
 }
 
@@ -173,8 +283,210 @@ int shader_fbuild( struct shader *self, const char *vspath, const char *fspath )
 	return result;
 }
 
+/* ======================================================== */
+/* --------------------------- */
+/* PROGRAM BINARY CACHE        */
+/* --------------------------- */
+
+#define SHADER_CACHE_MAGIC 0x42505452u	/* "RTPB" */
+
+// file layout, the binary follows the header
+struct shader_cache_header {
+	u32 magic;
+	u32 format;			/* binaryFormat of glGetProgramBinary */
+	u64 key;
+	u32 length;
+	float compile_ms;	/* what the cache saves, for the startup log */
+};
+
+static inline double shader_ms_since_( u64 start )
+{
+	return ( double )( SDL_GetPerformanceCounter() - start ) * 1000.0 / ( double )SDL_GetPerformanceFrequency();
+}
+
+static inline u64 shader_hash64_( u64 hash, const void *data, size_t len )
+{
+	// fnv-1a, the length keeps "ab" + "c" apart from "a" + "bc"
+	const u8 *bytes = data;
+	for ( size_t i = 0; i < len; i++ )
+		hash = ( hash ^ bytes[ i ] ) * 1099511628211ull;
+	for ( size_t i = 0; i < sizeof( len ); i++ )
+		hash = ( hash ^ ( u8 )( len >> ( i * 8 ) ) ) * 1099511628211ull;
+	return hash;
+}
+
+// a binary is only valid for the same sources on the same driver
+static u64 shader_cache_key_( const char *vstext, size_t vslen, const char *fstext, size_t fslen )
+{
+	const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	u64 hash = 14695981039346656037ull;
+
+	hash = shader_hash64_( hash, vstext, vslen );
+	hash = shader_hash64_( hash, fstext, fslen );
+	for ( size_t i = 0; i < sizeof( strings ) / sizeof( *strings ); i++ )
+	{
+		const char *str = ( const char * )glGetString( strings[ i ] );
+		if ( str )
+			hash = shader_hash64_( hash, str, strlen( str ) );
+	}
+
+	return hash;
+}
+
+static bool shader_cache_supported_( void )
+{
+	if ( !glGetProgramBinary || !glProgramBinary )
+		return false;
+
+	GLint formats = 0;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+	return formats > 0;
+}
+
+// 0 if the program was created from the file
+static int shader_cache_load_( struct shader *self, const char *path, u64 key, float *compile_ms )
+{
+	FILE *f = fopen( path, "rb" );
+	if ( f == NULL )
+		return 1;
+
+	struct shader_cache_header header;
+	void *binary = NULL;
+	int result = 1;
+
+	if ( fread( &header, sizeof( header ), 1, f ) != 1 || header.magic != SHADER_CACHE_MAGIC || header.key != key )
+		goto done;
+
+	binary = malloc( header.length );
+	if ( binary == NULL || fread( binary, 1, header.length, f ) != header.length )
+		goto done;
+
+	// the driver may still refuse it, e.g. after an update that kept the version string
+	*self = ( struct shader ){ 0 };
+	self->handle = glCreateProgram();
+	glProgramBinary( self->handle, header.format, binary, ( GLsizei )header.length );
+	if ( shader_get_status_( self->handle, GL_LINK_STATUS, glGetProgramiv ) == GL_FALSE )
+	{
+		glDeleteProgram( self->handle );
+		self->handle = 0;
+		goto done;
+	}
+
+	*compile_ms = header.compile_ms;
+	result = 0;
+
+done:
+	free( binary );
+	fclose( f );
+	return result;
+}
+
+static void shader_cache_store_( const struct shader *self, const char *path, u64 key, float compile_ms )
+{
+	GLint length = 0;
+	glGetProgramiv( self->handle, GL_PROGRAM_BINARY_LENGTH, &length );
+	if ( length <= 0 )
+		return;
+
+	struct shader_cache_header header = {
+		.magic = SHADER_CACHE_MAGIC,
+		.key = key,
+		.compile_ms = compile_ms
+	};
+
+	void *binary = malloc( length );
+	if ( binary == NULL )
+		return;
+
+	GLsizei written = 0;
+	glGetProgramBinary( self->handle, length, &written, &header.format, binary );
+	header.length = ( u32 )written;
+
+	FILE *f = fopen( path, "wb" );
+	if ( f == NULL || fwrite( &header, sizeof( header ), 1, f ) != 1 || fwrite( binary, 1, written, f ) != ( size_t )written )
+		log_warn( "Unable to write program binary: %s", path );
+	if ( f )
+		fclose( f );
+
+	free( binary );
+}
+
+int shader_cbuild( struct shader *self, const char *vstext, size_t vslen, const char *fstext, size_t fslen, const char *cache_path )
+{
+	if ( self == NULL )
+		return 1;
+
+	u64 start = SDL_GetPerformanceCounter();
+	bool supported = cache_path && shader_cache_supported_();
+	u64 key = supported ? shader_cache_key_( vstext, vslen, fstext, fslen ) : 0;
+
+	float compile_ms;
+	if ( supported && shader_cache_load_( self, cache_path, key, &compile_ms ) == 0 )
+	{
+		shader_cache_uniforms_( self );
+		self->cached = true;
+		log_info( "Loaded program binary %s in %.2f ms (compiling took %.2f ms)", cache_path,
+				shader_ms_since_( start ), compile_ms );
+		return 0;
+	}
+
+	// missing, stale or refused, build from source and replace it
+	int result = shader_build_util_( self, vstext, vslen, fstext, fslen, NULL, NULL );
+	if ( result != 0 )
+		return result;
+
+	compile_ms = ( float )shader_ms_since_( start );
+	log_info( "Compiled shaders in %.2f ms", compile_ms );
+
+	if ( supported )
+		shader_cache_store_( self, cache_path, key, compile_ms );
+
+	return 0;
+}
+
+/* ======================================================== */
+
+char *shader_define( const char *text, size_t len, const char *defines, size_t *out_len )
+{
+	// #version has to stay the first line
+	size_t head = 0;
+	if ( len >= 8 && strncmp( text, "#version", 8 ) == 0 )
+	{
+		while ( head < len && text[ head ] != '\n' )
+			head++;
+		if ( head < len )
+			head++;
+	}
+
+	// and compile errors should point at the lines of the file
+	const char *line = head ? "#line 2\n" : "#line 1\n";
+	size_t defines_len = strlen( defines );
+	size_t line_len = strlen( line );
+	size_t total = len + defines_len + line_len;
+
+	char *out = malloc( total + 1 );
+	if ( out == NULL )
+		return NULL;
+
+	memcpy( out, text, head );
+	memcpy( out + head, defines, defines_len );
+	memcpy( out + head + defines_len, line, line_len );
+	memcpy( out + head + defines_len + line_len, text + head, len - head );
+	out[ total ] = '\0';
+
+	if ( out_len )
+		*out_len = total;
+
+	return out;
+}
+
 void shader_free( struct shader self )
 {
+	for ( u32 i = 0; i < self.uniform_cap; i++ )
+		free( self.uniforms[ i ].name );
+	free( self.uniforms );
+	free( self.shadow );
+
 	glDeleteProgram( self.handle );
 	glDeleteShader( self.vs_handle );
 	glDeleteShader( self.fs_handle );
@@ -185,51 +497,137 @@ void shader_bind( struct shader self )
 	glUseProgram( self.handle );
 }
 
-void shader_uniform_mat4( struct shader self, char *name, mat4s m )
+GLint shader_uniform_loc( struct shader self, const char *name )
+{
+	if ( self.uniforms == NULL )
+		return -1;
+
+	u32 hash = shader_hash_( name );
+	u32 mask = self.uniform_cap - 1;
+
+	for ( u32 i = hash & mask; self.uniforms[ i ].name; i = ( i + 1 ) & mask )
+	{
+		const struct shader_uniform *u = &self.uniforms[ i ];
+		if ( u->hash == hash && strcmp( u->name, name ) == 0 )
+			return u->loc;
+	}
+
+	return -1;
+}
+
+static inline GLint shader_find_( struct shader self, const char *name )
 {
-	GLint idx = glGetUniformLocation( self.handle, name );
+	GLint idx = shader_uniform_loc( self, name );
 	if ( idx < 0 ) log_warn( "Unable to uniform variable: %s", name );
-    glUniformMatrix4fv( idx, 1, GL_FALSE, ( const GLfloat * )&m.raw );
+	return idx;
+}
+
+void shader_uniform_mat4( struct shader self, char *name, mat4s m )
+{
+	shader_uniform_mat4_loc( self, shader_find_( self, name ), m );
 }
 
 void shader_uniform_float( struct shader self, char *name, float f )
 {
-	GLint idx = glGetUniformLocation( self.handle, name );
-	if ( idx < 0 ) log_warn( "Unable to uniform variable: %s", name );
-    glUniform1f( idx, f );
+	shader_uniform_float_loc( self, shader_find_( self, name ), f );
 }
 
 void shader_uniform_vec2( struct shader self, char *name, vec2s v )
 {
-	GLint idx = glGetUniformLocation( self.handle, name );
-	if ( idx < 0 ) log_warn( "Unable to uniform variable: %s", name );
-    glUniform2f( idx, v.x, v.y );
+	shader_uniform_vec2_loc( self, shader_find_( self, name ), v );
 }
 
 void shader_uniform_vec3( struct shader self, char *name, vec3s v )
 {
-	GLint idx = glGetUniformLocation( self.handle, name );
-	if ( idx < 0 ) log_warn( "Unable to uniform variable: %s", name );
-    glUniform3f( idx, v.x, v.y, v.z );
+	shader_uniform_vec3_loc( self, shader_find_( self, name ), v );
 }
 
 void shader_uniform_vec4( struct shader self, char *name, vec4s v )
 {
-	GLint idx = glGetUniformLocation( self.handle, name );
-	if ( idx < 0 ) log_warn( "Unable to uniform variable: %s", name );
-    glUniform4f( idx, v.x, v.y, v.z, v.w );
+	shader_uniform_vec4_loc( self, shader_find_( self, name ), v );
 }
 
 void shader_uniform_int( struct shader self, char *name, int v )
 {
-	GLint idx = glGetUniformLocation( self.handle, name );
-	if ( idx < 0 ) log_warn( "Unable to uniform variable: %s", name );
-    glUniform1i( idx, v );
+	shader_uniform_int_loc( self, shader_find_( self, name ), v );
 }
 
 void shader_uniform_uint( struct shader self, char *name, unsigned int v )
 {
-	GLint idx = glGetUniformLocation( self.handle, name );
-	if ( idx < 0 ) log_warn( "Unable to uniform variable: %s", name );
-    glUniform1ui( idx, v );
+	shader_uniform_uint_loc( self, shader_find_( self, name ), v );
+}
+
+void shader_stats_frame( void )
+{
+	shader_stats.frame_uploads = shader_stats.uploads;
+	shader_stats.frame_skipped = shader_stats.skipped;
+	shader_stats.uploads = 0;
+	shader_stats.skipped = 0;
+}
+
+// true if value has to be sent to loc, -1 is ignored by gl anyway
+static inline bool shader_changed_( struct shader self, GLint loc, const void *value, size_t n )
+{
+	if ( loc < 0 )
+		return false;
+
+	struct shader_shadow *shadow = loc < self.shadow_len ? &self.shadow[ loc ] : NULL;
+	if ( shadow && shadow->valid && memcmp( shadow->value, value, n ) == 0 )
+	{
+		shader_stats.skipped++;
+		return false;
+	}
+
+	if ( shadow )
+	{
+		memcpy( shadow->value, value, n );
+		shadow->valid = true;
+	}
+
+	shader_stats.uploads++;
+	return true;
+}
+
+// setters by location, the program has to be bound
+
+void shader_uniform_mat4_loc( struct shader self, GLint loc, mat4s m )
+{
+	if ( shader_changed_( self, loc, &m, sizeof( m ) ) )
+		glUniformMatrix4fv( loc, 1, GL_FALSE, ( const GLfloat * )&m.raw );
+}
+
+void shader_uniform_float_loc( struct shader self, GLint loc, float f )
+{
+	if ( shader_changed_( self, loc, &f, sizeof( f ) ) )
+		glUniform1f( loc, f );
+}
+
+void shader_uniform_vec2_loc( struct shader self, GLint loc, vec2s v )
+{
+	if ( shader_changed_( self, loc, &v, sizeof( v ) ) )
+		glUniform2f( loc, v.x, v.y );
+}
+
+void shader_uniform_vec3_loc( struct shader self, GLint loc, vec3s v )
+{
+	if ( shader_changed_( self, loc, &v, sizeof( v ) ) )
+		glUniform3f( loc, v.x, v.y, v.z );
+}
+
+void shader_uniform_vec4_loc( struct shader self, GLint loc, vec4s v )
+{
+	if ( shader_changed_( self, loc, &v, sizeof( v ) ) )
+		glUniform4f( loc, v.x, v.y, v.z, v.w );
+}
+
+void shader_uniform_int_loc( struct shader self, GLint loc, int v )
+{
+	if ( shader_changed_( self, loc, &v, sizeof( v ) ) )
+		glUniform1i( loc, v );
+}
+
+void shader_uniform_uint_loc( struct shader self, GLint loc, unsigned int v )
+{
+	if ( shader_changed_( self, loc, &v, sizeof( v ) ) )
+		glUniform1ui( loc, v );
 }
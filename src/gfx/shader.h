@@ -3,20 +3,67 @@
 
 #include <glad/glad.h>
 #include <cglm/struct.h>
+#include <util/types.h>
+#include <stdbool.h>
 
 struct VertexAttr {
 	GLuint index;
 	const GLchar *name;
 };
 
+// last value sent to a uniform location
+struct shader_shadow {
+	u8 value[ sizeof( mat4s ) ];
+	bool valid;
+};
+
+// active uniform, filled in after linking
+struct shader_uniform {
+	char *name;
+	u32 hash;
+	GLint loc;
+};
+
 struct shader {
 	GLuint handle;
 	GLuint vs_handle;
 	GLuint fs_handle;
+	bool cached;	/* loaded from a program binary by shader_cbuild */
+
+	// open addressing table of active uniforms keyed by name hash
+	// (shared by every copy of the struct, freed by shader_free)
+	struct shader_uniform *uniforms;
+	u32 uniform_cap;
+	u32 uniform_count;
+
+	// indexed by location, uploads of unchanged values are skipped
+	struct shader_shadow *shadow;
+	GLint shadow_len;
 };
 
+// uniform upload counters
+struct shader_stats {
+	// since the last shader_stats_frame
+	u32 uploads;
+	u32 skipped;
+
+	// counts of the last finished frame
+	u32 frame_uploads;
+	u32 frame_skipped;
+};
+
+extern struct shader_stats shader_stats;
+
 int  shader_fbuild( struct shader *self, const char *vspath, const char *fspath );
 int  shader_tbuild( struct shader *self, const char *vstext, size_t vslen, const char *fstext, size_t fslen );
+
+// shader_tbuild through a program binary at cache_path, keyed by the sources and
+// the driver strings, it is rebuilt and rewritten when missing or stale (NULL for no cache)
+int  shader_cbuild( struct shader *self, const char *vstext, size_t vslen, const char *fstext, size_t fslen, const char *cache_path );
+
+// copy of text with defines ("#define NAME value\n" lines) inserted after the
+// #version line, free it when done
+char *shader_define( const char *text, size_t len, const char *defines, size_t *out_len );
 void shader_free( struct shader self );
 void shader_bind( struct shader self );
 
@@ -28,4 +75,19 @@ void shader_uniform_vec4( struct shader self, char *name, vec4s v );
 void shader_uniform_int( struct shader self, char *name, int v );
 void shader_uniform_uint( struct shader self, char *name, unsigned int v );
 
+// cached location of an active uniform, -1 if there is none
+GLint shader_uniform_loc( struct shader self, const char *name );
+
+// set by location, no lookups (locations come from shader_uniform_loc)
+void shader_uniform_mat4_loc( struct shader self, GLint loc, mat4s m );
+void shader_uniform_float_loc( struct shader self, GLint loc, float f );
+void shader_uniform_vec2_loc( struct shader self, GLint loc, vec2s v );
+void shader_uniform_vec3_loc( struct shader self, GLint loc, vec3s v );
+void shader_uniform_vec4_loc( struct shader self, GLint loc, vec4s v );
+void shader_uniform_int_loc( struct shader self, GLint loc, int v );
+void shader_uniform_uint_loc( struct shader self, GLint loc, unsigned int v );
+
+// end of frame, moves the counters to frame_uploads and frame_skipped
+void shader_stats_frame( void );
+
 #endif
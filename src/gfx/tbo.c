@@ -0,0 +1,42 @@
+#include "tbo.h"
+
+struct tbo tbo_create( GLenum format )
+{
+	struct tbo self = {
+		.format = format
+	};
+	glGenBuffers( 1, &self.buffer );
+	glGenTextures( 1, &self.texture );
+
+	// a texture buffer needs a data store before it can be attached
+	glBindBuffer( GL_TEXTURE_BUFFER, self.buffer );
+	glBufferData( GL_TEXTURE_BUFFER, 0, NULL, GL_STATIC_DRAW );
+	glBindTexture( GL_TEXTURE_BUFFER, self.texture );
+	glTexBuffer( GL_TEXTURE_BUFFER, self.format, self.buffer );
+
+	return self;
+}
+
+void tbo_free( struct tbo self )
+{
+	glDeleteTextures( 1, &self.texture );
+	glDeleteBuffers( 1, &self.buffer );
+}
+
+void tbo_bind( struct tbo self, GLuint unit )
+{
+	glActiveTexture( GL_TEXTURE0 + unit );
+	glBindTexture( GL_TEXTURE_BUFFER, self.texture );
+}
+
+void tbo_buff( struct tbo self, const void *data, size_t n )
+{
+	glBindBuffer( GL_TEXTURE_BUFFER, self.buffer );
+	glBufferData( GL_TEXTURE_BUFFER, n, data, GL_STATIC_DRAW );
+}
+
+void tbo_buff_range( struct tbo self, size_t offset, const void *data, size_t n )
+{
+	glBindBuffer( GL_TEXTURE_BUFFER, self.buffer );
+	glBufferSubData( GL_TEXTURE_BUFFER, offset, n, data );
+}
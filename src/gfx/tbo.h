@@ -0,0 +1,27 @@
+#ifndef TBO_H
+#define TBO_H
+
+/*
+ * Buffer texture (GL_TEXTURE_BUFFER), read in shaders through a
+ * samplerBuffer / usamplerBuffer with texelFetch.
+ */
+
+#include <glad/glad.h>
+#include <stddef.h>
+
+struct tbo
+{
+	GLuint buffer;
+	GLuint texture;
+	GLenum format;	/* internal format of a texel, e.g. GL_RGBA32F */
+};
+
+struct tbo tbo_create( GLenum format );
+void tbo_free( struct tbo self );
+void tbo_bind( struct tbo self, GLuint unit );
+void tbo_buff( struct tbo self, const void *data, size_t n );
+
+// replace n bytes at offset of the data store, which must already be that big
+void tbo_buff_range( struct tbo self, size_t offset, const void *data, size_t n );
+
+#endif
@@ -1,5 +1,6 @@
 #include "window.h"
 #include "render.h"
+#include "offscreen.h"
 #include <SDL2/SDL_video.h>
 #include <stdalign.h>
 #include <system/input.h>
@@ -8,6 +9,21 @@
 // global window context
 struct window window;
 
+// context and framebuffer of a headless window
+static struct offscreen offscreen;
+
+// performance counter ticks per second, set before any thread starts
+static u64 clock_frequency = 0;
+
+// simulation thread running the ticks when window.tick_thread is set
+static struct
+{
+    SDL_Thread *thread;
+    SDL_atomic_t quit;
+    SDL_atomic_t code;      /* first non-success code of a tick */
+    SDL_atomic_t ticks;     /* window.tick.count for the main thread */
+} sim;
+
 #define INIT_TIMING( r ) \
     ( struct timing ) {                             \
 		.target_rate	= ( r ),                    \
@@ -98,11 +114,176 @@ static inline int window_internal_render_( void )
         code = window.state.render();
 
     window.frame.count++;
-    SDL_GL_SwapWindow( window.handle );
-
     return code;
 }
 
+// base swap, waits for the gpu when there is nothing to swap
+static inline void window_internal_swap_( void )
+{
+    if ( window.headless )
+        glFinish();
+    else
+        SDL_GL_SwapWindow( window.handle );
+}
+
+u64 window_time_ns( void )
+{
+    if ( clock_frequency == 0 )
+        clock_frequency = SDL_GetPerformanceFrequency();
+
+    // split so counter * 1e9 cannot overflow
+    u64 counter = SDL_GetPerformanceCounter();
+    return counter / clock_frequency * 1000000000ull + counter % clock_frequency * 1000000000ull / clock_frequency;
+}
+
+// record the time since start in a phase, returns now as the start of the next
+static inline u64 window_phase_end_( enum window_phase phase, u64 start )
+{
+    u64 now = window_time_ns();
+    histogram_push( &window.phases[ phase ], now - start );
+    return now;
+}
+
+static void window_reset_( const struct window_state *state, int w, int h )
+{
+    const float default_rate = 60.0f;
+
+    window.quit = false;
+    window.initialized = false;
+    window.rel_mouse_mode = false;
+    window.tick_thread = false;
+    window.state = state != NULL ? *state : ( struct window_state ) { 0 };
+    window.frame = INIT_TIMING( default_rate );
+    window.tick = INIT_TIMING( default_rate );
+    window.w = w;
+    window.h = h;
+    window.aspect = ( float )w / ( float )h;
+    window.headless = false;
+    window.fbo = 0;
+
+    for ( int i = 0; i < WINDOW_PHASE_COUNT; i++ )
+        histogram_clear( &window.phases[ i ] );
+
+    clock_frequency = SDL_GetPerformanceFrequency();
+}
+
+// SDL_Delay sleeps whole milliseconds and often a millisecond or two more,
+// so sleep until margin before the deadline and spin the rest. The margin
+// follows the overshoot of the sleeps: up at once, down slowly.
+static void window_sleep_until_( u64 deadline, u64 *margin )
+{
+    const u64 min_margin = 200000, max_margin = 4000000;
+
+    u64 now = window_time_ns();
+    if ( deadline > now + *margin + 1000000 )
+    {
+        u64 ms = ( deadline - now - *margin ) / 1000000;
+        SDL_Delay( ( Uint32 )ms );
+
+        u64 slept = window_time_ns() - now;
+        u64 over = slept > ms * 1000000 ? slept - ms * 1000000 : 0;
+        u64 wanted = over + over / 4 + min_margin;
+        if ( wanted > *margin )
+            *margin = wanted;
+        else
+            *margin -= ( *margin - wanted ) / 16;
+
+        if ( *margin > max_margin )
+            *margin = max_margin;
+    }
+
+    while ( window_time_ns() < deadline )
+        ;
+}
+
+// intervals of the cycles in the current second, for the pacing jitter
+struct pacing_
+{
+    u32 n;
+    double sum;
+    double sumsq;
+    double min;
+    double max;
+};
+
+static void window_pacing_push_( struct pacing_ *self, double ms )
+{
+    if ( self->n == 0 || ms < self->min )
+        self->min = ms;
+    if ( self->n == 0 || ms > self->max )
+        self->max = ms;
+    self->n++;
+    self->sum += ms;
+    self->sumsq += ms * ms;
+}
+
+// deviation from target_delta (from the mean when uncapped) into the timing
+static void window_pacing_store_( struct pacing_ *self, struct timing *timing )
+{
+    if ( self->n == 0 )
+        return;
+
+    double mean = self->sum / self->n;
+    double variance = self->sumsq / self->n - mean * mean;
+    double target = timing->target_rate > 0 ? timing->target_delta : mean;
+
+    // rms deviation from the target: the spread plus the offset of the mean
+    timing->jitter = ( float )sqrt( fmax( variance, 0.0 ) + ( mean - target ) * ( mean - target ) );
+    timing->jitter_max = ( float )fmax( self->max - target, target - self->min );
+    *self = ( struct pacing_ ){ 0 };
+}
+
+// fixed time step on its own clock, a stall is not caught up with a burst
+// of more than a few ticks
+static int window_sim_run_( void *data )
+{
+    ( void )data;
+
+    u64 next = window_time_ns();
+    u64 margin = 2000000;
+    while ( !SDL_AtomicGet( &sim.quit ) )
+    {
+        window_sleep_until_( next, &margin );
+        u64 now = window_time_ns();
+
+        int code = window_internal_tick_();
+        histogram_push( &window.tick.time, window_time_ns() - now );
+        SDL_AtomicAdd( &sim.ticks, 1 );
+        if ( code != WINDOW_SUCCESS )
+        {
+            SDL_AtomicSet( &sim.code, code );
+            break;
+        }
+
+        u64 step = ( u64 )( window.tick.target_delta * 1e6 );
+        next += step;
+        if ( now > next + 4 * step )
+            next = now;
+    }
+
+    return 0;
+}
+
+static void window_sim_start_( void )
+{
+    SDL_AtomicSet( &sim.quit, 0 );
+    SDL_AtomicSet( &sim.code, WINDOW_SUCCESS );
+    SDL_AtomicSet( &sim.ticks, 0 );
+    sim.thread = SDL_CreateThread( window_sim_run_, "simulation", NULL );
+    if ( sim.thread == NULL )
+        log_warn( "Unable to create simulation thread, ticking between frames: %s", SDL_GetError() );
+}
+
+static void window_sim_stop_( void )
+{
+    if ( sim.thread == NULL )
+        return;
+
+    SDL_AtomicSet( &sim.quit, 1 );
+    SDL_WaitThread( sim.thread, NULL );
+    sim.thread = NULL;
+}
+
 int window_init( const struct window_state *state )
 {
     // skip init if already done
@@ -111,20 +292,11 @@ int window_init( const struct window_state *state )
         return WINDOW_ERROR;
     }
 
-    const float default_rate = 60.0f;
     const int window_size = 700;
     const Uint32 window_flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_OPENGL;
 
 	// init variables
-	window.quit = false;
-    window.initialized = false;
-    window.rel_mouse_mode = false;
-	window.state = state != NULL ? *state : ( struct window_state ) { 0 };
-	window.frame = INIT_TIMING( default_rate );
-	window.tick = INIT_TIMING( default_rate );
-    window.w = window_size;
-    window.h = window_size;
-    window.aspect = 1.f;
+    window_reset_( state, window_size, window_size );
 
     // Request an OpenGL 3.3 context (should be core)
     SDL_GL_SetAttribute( SDL_GL_ACCELERATED_VISUAL, 1 );
@@ -176,6 +348,78 @@ int window_init( const struct window_state *state )
     return WINDOW_SUCCESS;
 }
 
+int window_init_headless( const struct window_state *state, int w, int h )
+{
+    if ( window.initialized )
+    {
+        return WINDOW_ERROR;
+    }
+
+    window_reset_( state, w, h );
+
+    log_info( "Creating offscreen OpenGL context" );
+    if ( offscreen_init( &offscreen, w, h ) != OFFSCREEN_SUCCESS )
+    {
+        log_error( "Failed to initialize headless window" );
+        return WINDOW_ERROR;
+    }
+
+    window.headless = true;
+    window.fbo = offscreen.fbo;
+    window.initialized = true;
+    return WINDOW_SUCCESS;
+}
+
+int window_loop_frames( int frames, float *frame_ms )
+{
+    if ( !window.initialized )
+    {
+        log_error( "Window not initialized" );
+        return WINDOW_ERROR;
+    }
+
+    log_info( "Running %d frames...", frames );
+
+    int done = 0;
+    process_event_( init_ );
+
+    for ( int i = 0; i < frames && !window.quit; i++ )
+    {
+        u64 start = window_time_ns();
+        u64 t = start;
+
+        process_event_( tick_ );
+        t = window_phase_end_( WINDOW_PHASE_TICKS, t );
+        process_event_( update_ );
+        t = window_phase_end_( WINDOW_PHASE_UPDATE, t );
+        process_event_( render_ );
+        t = window_phase_end_( WINDOW_PHASE_RENDER, t );
+        window_internal_swap_();
+        t = window_phase_end_( WINDOW_PHASE_SWAP, t );
+
+        histogram_push( &window.frame.time, t - start );
+        frame_ms[ i ] = ( float )( ( t - start ) / 1e6 );
+        window.frame.delta = ( float )( ( t - start ) / 1e9 );
+        done++;
+    }
+
+soft_exit_:
+    window_dump_timings();
+    window_internal_free_();
+
+hard_exit_:
+    return done;
+}
+
+// rates and pacing in the title, refreshed every second
+static void window_report_rates_( void )
+{
+    char title[ 128 ];
+    snprintf( title, sizeof( title ), "Raytracer | %d fps | %d tps | jitter %.2f ms (max %.2f ms)",
+            window.frame.rate, window.tick.rate, window.frame.jitter, window.frame.jitter_max );
+    window_set_title( title );
+}
+
 int window_loop( void )
 {
     // sanity check
@@ -190,27 +434,37 @@ int window_loop( void )
 	// init
     process_event_( init_ );
 
+    // ticks run next to the frames from here on
+    if ( window.tick_thread && window.state.tick )
+        window_sim_start_();
+
 	// setup game loop
-    uint64_t frame_previous = SDL_GetTicks64();
+    u64 frame_previous = window_time_ns();
     float tick_time = 0;
 
     uint64_t tick_last = 0;
     uint64_t frame_last = 0;
 
-    uint64_t frame_timer = frame_previous;
+    u64 frame_timer = frame_previous;
+
+    // frames are paced against a schedule so one late frame does not shift the rest
+    u64 frame_deadline = frame_previous;
+    u64 sleep_margin = 2000000;
+    struct pacing_ pacing = { 0 };
 
 	// begin main loop
     while ( !window.quit )
     {
         // get frame timing
-        uint64_t frame_current = SDL_GetTicks64();
-        uint64_t frame_delta = frame_current - frame_previous;
+        u64 frame_current = window_time_ns();
+        u64 frame_delta = frame_current - frame_previous;
 
         // update fps & tps every second
-        if ( frame_current - frame_timer >= 1000 )
+        if ( frame_current - frame_timer >= 1000000000ull )
         {
             // get variables
-            uint64_t ticks = window.tick.count - tick_last;
+            uint64_t tick_count = sim.thread ? ( uint64_t )SDL_AtomicGet( &sim.ticks ) : window.tick.count;
+            uint64_t ticks = tick_count - tick_last;
             uint64_t frames = window.frame.count - frame_last;
 
             // store rate per second
@@ -218,43 +472,80 @@ int window_loop( void )
             window.tick.rate = ticks;
 
             // store this frame/tick
-            tick_last = window.tick.count;
+            tick_last = tick_count;
             frame_last = window.frame.count;
 
             // reset timer
             frame_timer = frame_current;
+
+            window_pacing_store_( &pacing, &window.frame );
+            window_report_rates_();
+        }
+
+        if ( window.frame.count > 0 )
+        {
+            histogram_push( &window.frame.time, frame_delta );
+            window_pacing_push_( &pacing, frame_delta / 1e6 );
         }
 
         frame_previous = frame_current;
-        tick_time += frame_delta;
+        tick_time += frame_delta / 1e6f;
+        u64 t = frame_current;
 
         // poll events
         if ( input_process_events() != 0 )
             goto soft_exit_;
-        
+        t = window_phase_end_( WINDOW_PHASE_INPUT, t );
+
+        // a tick failing on the simulation thread ends the loop like any other
+        if ( sim.thread )
+        {
+            int code = SDL_AtomicGet( &sim.code );
+            if ( code == WINDOW_HARD_EXIT )
+                goto hard_exit_;
+            if ( code != WINDOW_SUCCESS )
+                goto soft_exit_;
+        }
+
         // maintain fixed time step for each tick
-        while ( tick_time >= window.tick.target_delta )
+        while ( !sim.thread && tick_time >= window.tick.target_delta )
         {
+            u64 tick_start = window_time_ns();
             process_event_( tick_ );
+            histogram_push( &window.tick.time, window_time_ns() - tick_start );
             tick_time -= window.tick.target_delta;
         }
+        t = window_phase_end_( WINDOW_PHASE_TICKS, t );
 
         process_event_( update_ );
+        t = window_phase_end_( WINDOW_PHASE_UPDATE, t );
         process_event_( render_ );
+        t = window_phase_end_( WINDOW_PHASE_RENDER, t );
+        window_internal_swap_();
+        window_phase_end_( WINDOW_PHASE_SWAP, t );
 
         // calculate & store frame time
-        window.frame.delta = ( float ) frame_delta / 1000.0f;
+        window.frame.delta = ( float )( frame_delta / 1e9 );
 
-        // apply fps cap
-        int delay = frame_current + window.frame.target_delta - SDL_GetTicks64();
-        if ( delay > 0 )
-            SDL_Delay( delay );
+        // apply fps cap, a frame that ran late starts the schedule over
+        // instead of the next ones being rushed to catch up
+        if ( window.frame.target_rate > 0 )
+        {
+            frame_deadline += ( u64 )( window.frame.target_delta * 1e6 );
+            if ( frame_deadline < window_time_ns() )
+                frame_deadline = window_time_ns();
+            else
+                window_sleep_until_( frame_deadline, &sleep_margin );
+        }
     }
 
 soft_exit_:
+    window_sim_stop_();
+    window_dump_timings();
 	window_internal_free_();
 
 hard_exit_:
+    window_sim_stop_();
     return WINDOW_SUCCESS;
 }
 
@@ -266,6 +557,14 @@ int window_quit( void )
 
 int window_free( void )
 {
+    if ( window.headless )
+    {
+        log_info( "Closing offscreen OpenGL context" );
+        offscreen_free( &offscreen );
+        window.initialized = false;
+        return WINDOW_SUCCESS;
+    }
+
     log_info( "Closing OpenGL context" );
     SDL_GL_DeleteContext( window.context );
     log_info( "Closing SDL window" );
@@ -283,6 +582,21 @@ int window_set_target_fps( float fps )
 	return WINDOW_SUCCESS;
 }
 
+int window_set_tick_thread( bool enabled )
+{
+    if ( sim.thread )
+        return WINDOW_ERROR;
+
+    window.tick_thread = enabled;
+    return WINDOW_SUCCESS;
+}
+
+float window_tick_alpha( u64 tick_ns )
+{
+    float alpha = ( float )( ( double )( window_time_ns() - tick_ns ) / ( window.tick.target_delta * 1e6 ) );
+    return alpha < 0.0f ? 0.0f : alpha > 1.0f ? 1.0f : alpha;
+}
+
 int window_set_target_tps( float tps )
 {
 	window.tick.target_rate = tps;
@@ -291,6 +605,71 @@ int window_set_target_tps( float tps )
 	return WINDOW_SUCCESS;
 }
 
+int window_get_fps( void )
+{
+    return window.frame.rate;
+}
+
+int window_get_tps( void )
+{
+    return window.tick.rate;
+}
+
+int window_get_jitter( float *rms_ms, float *max_ms )
+{
+    *rms_ms = window.frame.jitter;
+    *max_ms = window.frame.jitter_max;
+    return WINDOW_SUCCESS;
+}
+
+u64 window_get_phase_time( enum window_phase phase, float p )
+{
+    return histogram_percentile( &window.phases[ phase ], p );
+}
+
+u64 window_get_frame_time( float p )
+{
+    return histogram_percentile( &window.frame.time, p );
+}
+
+u64 window_get_tick_time( float p )
+{
+    return histogram_percentile( &window.tick.time, p );
+}
+
+static void window_dump_histogram_( const char *name, const struct histogram *h )
+{
+    if ( h->len == 0 )
+        return;
+
+    log_info( "  %-7s %8.3f %8.3f %8.3f %8.3f", name,
+            histogram_percentile( h, 0.50f ) / 1e6, histogram_percentile( h, 0.95f ) / 1e6,
+            histogram_percentile( h, 0.99f ) / 1e6, h->max / 1e6 );
+}
+
+void window_dump_timings( void )
+{
+    static const char *names[ WINDOW_PHASE_COUNT ] = {
+        [ WINDOW_PHASE_INPUT ]  = "input",
+        [ WINDOW_PHASE_TICKS ]  = "ticks",
+        [ WINDOW_PHASE_UPDATE ] = "update",
+        [ WINDOW_PHASE_RENDER ] = "render",
+        [ WINDOW_PHASE_SWAP ]   = "swap",
+        [ WINDOW_PHASE_GPU ]    = "gpu"
+    };
+
+    log_info( "Timings of the last %u frames in ms (p50, p95, p99 and max of all %llu):",
+            window.frame.time.len, ( unsigned long long )window.frame.count );
+    for ( int i = 0; i < WINDOW_PHASE_COUNT; i++ )
+        window_dump_histogram_( names[ i ], &window.phases[ i ] );
+    window_dump_histogram_( "tick", &window.tick.time );
+    window_dump_histogram_( "frame", &window.frame.time );
+
+    if ( window.frame.target_rate > 0 )
+        log_info( "Frame pacing at %.0f fps: %.3f ms rms jitter, %.3f ms max", window.frame.target_rate,
+                window.frame.jitter, window.frame.jitter_max );
+}
+
 int window_get_size( int *w, int *h )
 {
     //SDL_GetWindowSize( window.handle, w, h );
@@ -301,6 +680,9 @@ int window_get_size( int *w, int *h )
 
 int window_set_title( const char *title )
 {
+    if ( window.headless )
+        return WINDOW_SUCCESS;
+
     SDL_SetWindowTitle( window.handle, title );
     return WINDOW_SUCCESS;
 }
@@ -308,6 +690,9 @@ int window_set_title( const char *title )
 int window_set_relative_mouse( bool state )
 {
     window.rel_mouse_mode = state;
+    if ( window.headless )
+        return WINDOW_SUCCESS;
+
     SDL_WarpMouseInWindow( window.handle, window.w / 2, window.h / 2 );
     SDL_SetRelativeMouseMode( state );
     return WINDOW_SUCCESS;
@@ -316,6 +701,9 @@ int window_set_relative_mouse( bool state )
 int window_toggle_relative_mouse( void )
 {
     window.rel_mouse_mode = !window.rel_mouse_mode;
+    if ( window.headless )
+        return WINDOW_SUCCESS;
+
     SDL_WarpMouseInWindow( window.handle, window.w / 2, window.h / 2 );
     SDL_SetRelativeMouseMode( window.rel_mouse_mode );
     return WINDOW_SUCCESS;
@@ -2,7 +2,9 @@
 #define WINDOW_H
 
 #include <util/util.h>
+#include <util/histogram.h>
 #include <SDL2/SDL.h>
+#include <glad/glad.h>
 
 #define WINDOW_SUCCESS	 0
 #define WINDOW_ERROR	-1
@@ -37,8 +39,27 @@ struct timing
 	// seconds per cycle (updated every cycle)
 	float delta;
 
+	// deviation of the cycle time from target_delta in ms (updated every second)
+	float jitter;		/* rms */
+	float jitter_max;	/* largest either way */
+
 	// # of cycles that have occurred
 	uint64_t count;
+
+	// nanoseconds per cycle, frames from start to start so the cap is included
+	struct histogram time;
+};
+
+// parts of a frame timed by the window loop
+enum window_phase
+{
+	WINDOW_PHASE_INPUT,
+	WINDOW_PHASE_TICKS,		/* the whole tick catch-up loop of a frame */
+	WINDOW_PHASE_UPDATE,
+	WINDOW_PHASE_RENDER,
+	WINDOW_PHASE_SWAP,		/* glFinish when headless */
+	WINDOW_PHASE_GPU,		/* the traced pass on the gpu, pushed by the game frames late */
+	WINDOW_PHASE_COUNT
 };
 
 // window struct
@@ -54,6 +75,9 @@ struct window
 	bool initialized;
 	bool rel_mouse_mode;
 
+	// ticks on a simulation thread of their own instead of between frames
+	bool tick_thread;
+
 	// store window state
 	struct window_state state;
 
@@ -65,6 +89,13 @@ struct window
 	int w;
 	int h;
 	float aspect;
+
+	// frames are presented to fbo, 0 is the window's and an offscreen one when headless
+	bool headless;
+	GLuint fbo;
+
+	// nanoseconds spent in each phase per frame
+	struct histogram phases[ WINDOW_PHASE_COUNT ];
 };
 
 // global window context (defined in window.c)
@@ -76,10 +107,22 @@ int window_loop( void );
 int window_quit( void );
 int window_free( void );
 
+// a w x h offscreen framebuffer instead of a window, needs no display or SDL
+int window_init_headless( const struct window_state *state, int w, int h );
+
+// window_loop for a fixed number of frames without input or frame cap, frame_ms
+// gets the time of every frame from update until the gpu finished rendering,
+// returns the number of frames run (fewer if a state quit early)
+int window_loop_frames( int frames, float *frame_ms );
+
 // window setters
 int window_set_state( const struct window_state *state );
-int window_set_target_fps( float fps );
+int window_set_target_fps( float fps );	/* 0 for no cap */
 int window_set_target_tps( float tps );
+
+// before window_loop, ticks then run concurrently with update and render so the
+// state has to hand its results over (see system/snapshot.h)
+int window_set_tick_thread( bool enabled );
 int window_set_title( const char *title );
 int window_set_relative_mouse( bool state );
 int window_toggle_relative_mouse( void );
@@ -88,5 +131,20 @@ int window_toggle_relative_mouse( void );
 int window_get_size( int *w, int *h );
 int window_get_fps( void );
 int window_get_tps( void );
+int window_get_jitter( float *rms_ms, float *max_ms );
+
+// percentile p in [0, 1] of the last frames, in nanoseconds
+u64 window_get_phase_time( enum window_phase phase, float p );
+u64 window_get_frame_time( float p );
+u64 window_get_tick_time( float p );
+
+// log p50 / p95 / p99 / max of every phase, the loops do it on exit
+void window_dump_timings( void );
+
+// monotonic clock in nanoseconds, safe on any thread
+u64 window_time_ns( void );
+
+// how far from a tick at tick_ns to the next one now is, in [0, 1]
+float window_tick_alpha( u64 tick_ns );
 
 #endif
@@ -1,7 +1,277 @@
 #include <gfx/window.h>
 #include <gfx/render.h>
+#include <gfx/capture.h>
 #include <system/system.h>
+#include <system/jobs.h>
 #include <state/state.h>
+#include <state/game.h>
+#include <trace/scene.h>
+#include <trace/tracer.h>
+#include <trace/bvh.h>
+#include <gfx/obj3d.h>
+
+// command line options
+struct options
+{
+	const char *trace_path;
+	int w;
+	int h;
+	int threads;
+	const char *kernels;
+	const char *mesh_path;
+	int samples;
+	int depth;
+	bool roulette;
+	bool denoise;
+	bool headless;
+	int frames;
+	const char *capture_pattern;
+};
+
+static int parse_options_( int argc, char *argv[], struct options *opts )
+{
+	*opts = ( struct options ) {
+		.trace_path = NULL,
+		.w = DEFAULT_WINDOW_WIDTH,
+		.h = DEFAULT_WINDOW_HEIGHT,
+		.threads = 0,
+		.kernels = NULL,
+		.mesh_path = NULL,
+		.samples = 1,
+		.depth = SCENE_MAX_DEPTH,
+		.roulette = false,
+		.denoise = false,
+		.headless = false,
+		.frames = 300,
+		.capture_pattern = NULL
+	};
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( strcmp( argv[ i ], "--trace" ) == 0 && i + 1 < argc )
+			opts->trace_path = argv[ ++i ];
+		else if ( strcmp( argv[ i ], "--size" ) == 0 && i + 1 < argc )
+		{
+			if ( sscanf( argv[ ++i ], "%dx%d", &opts->w, &opts->h ) != 2 || opts->w <= 0 || opts->h <= 0 )
+			{
+				log_error( "Invalid size: %s (expected WxH)", argv[ i ] );
+				return 1;
+			}
+		}
+		else if ( strcmp( argv[ i ], "--threads" ) == 0 && i + 1 < argc )
+			opts->threads = atoi( argv[ ++i ] );
+		else if ( strcmp( argv[ i ], "--kernels" ) == 0 && i + 1 < argc )
+			opts->kernels = argv[ ++i ];
+		else if ( strcmp( argv[ i ], "--mesh" ) == 0 && i + 1 < argc )
+			opts->mesh_path = argv[ ++i ];
+		else if ( strcmp( argv[ i ], "--depth" ) == 0 && i + 1 < argc )
+		{
+			opts->depth = atoi( argv[ ++i ] );
+			if ( opts->depth < 0 )
+			{
+				log_error( "Invalid depth: %s", argv[ i ] );
+				return 1;
+			}
+		}
+		else if ( strcmp( argv[ i ], "--roulette" ) == 0 )
+			opts->roulette = true;
+		else if ( strcmp( argv[ i ], "--denoise" ) == 0 )
+			opts->denoise = true;
+		else if ( strcmp( argv[ i ], "--capture" ) == 0 && i + 1 < argc )
+		{
+			// formats the frame numbers, so nothing but one integer conversion
+			opts->capture_pattern = argv[ ++i ];
+			if ( !capture_pattern_valid( opts->capture_pattern ) )
+			{
+				log_error( "Invalid capture pattern: %s (expected one integer conversion, like capture_%%05u.png)", argv[ i ] );
+				return 1;
+			}
+		}
+		else if ( strcmp( argv[ i ], "--headless" ) == 0 )
+			opts->headless = true;
+		else if ( strcmp( argv[ i ], "--frames" ) == 0 && i + 1 < argc )
+		{
+			opts->frames = atoi( argv[ ++i ] );
+			if ( opts->frames <= 0 )
+			{
+				log_error( "Invalid frame count: %s", argv[ i ] );
+				return 1;
+			}
+		}
+		else if ( strcmp( argv[ i ], "--samples" ) == 0 && i + 1 < argc )
+		{
+			opts->samples = atoi( argv[ ++i ] );
+			if ( opts->samples <= 0 )
+			{
+				log_error( "Invalid sample count: %s", argv[ i ] );
+				return 1;
+			}
+		}
+		else
+		{
+			log_error( "Unknown argument: %s", argv[ i ] );
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// render the default scene (or a single mesh) with the cpu backend and write it to a file
+static int trace_headless_( const struct options *opts )
+{
+	struct scene scene;
+	struct tracer tracer;
+	struct obj3d obj = { 0 };
+	struct bvh bvh = { 0 };
+
+	if ( opts->mesh_path )
+	{
+		if ( obj3d_load( &obj, opts->mesh_path ) != 0 )
+		{
+			log_error( "Unable to load mesh: %s", opts->mesh_path );
+			return 1;
+		}
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		int err = bvh_build( &bvh, obj.fv, obj.fv_len );
+		double ms = ( double )( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+		obj3d_free( &obj );
+		if ( err )
+			return 1;
+
+		log_info( "Built bvh over %zu triangles in %.2f ms (%zu nodes)", bvh.tri_count, ms, bvh.node_count );
+		scene_init_mesh( &scene, &bvh, degtorad( 45.0f ) );
+	}
+	else
+		scene_init_default( &scene, degtorad( 45.0f ) );
+
+	scene.max_depth = opts->depth;
+
+	if ( tracer_init( &tracer, opts->w, opts->h, opts->threads ) != TRACER_SUCCESS )
+	{
+		scene_free( &scene );
+		bvh_free( &bvh );
+		return 1;
+	}
+
+	// "none" traces one ray at a time with the scalar port
+	if ( opts->kernels )
+	{
+		tracer.kernels = strcmp( opts->kernels, "none" ) == 0 ? NULL : packet_kernels_find( opts->kernels );
+		if ( tracer.kernels == NULL && strcmp( opts->kernels, "none" ) != 0 )
+		{
+			log_error( "Packet kernels not supported: %s", opts->kernels );
+			tracer_free( &tracer );
+			scene_free( &scene );
+			bvh_free( &bvh );
+			return 1;
+		}
+	}
+
+	tracer.roulette = opts->roulette;
+	log_info( "Tracing %dx%d on %d threads with %s kernels", tracer.w, tracer.h, tracer.thread_count,
+			tracer.kernels ? tracer.kernels->name : "no packet" );
+	tracer_render( &tracer, &scene );
+	u64 rays = tracer.rays;
+	u64 paths = tracer.paths;
+	u64 segments = tracer.segments;
+	double seconds = tracer.seconds;
+
+	// more samples average jittered frames like the shader's accumulation mode
+	for ( int i = 1; i < opts->samples; i++ )
+	{
+		tracer_accumulate( &tracer, &scene );
+		rays += tracer.rays;
+		paths += tracer.paths;
+		segments += tracer.segments;
+		seconds += tracer.seconds;
+	}
+
+	log_info( "Traced %llu rays in %.3f s (%.2f Mrays/s, %d samples)",
+			( unsigned long long )rays, seconds, seconds > 0.0 ? rays / seconds / 1e6 : 0.0, opts->samples );
+	log_info( "Average path length %.3f (max depth %d%s)", paths ? ( double )segments / paths : 0.0,
+			opts->depth, opts->roulette ? ", russian roulette" : "" );
+
+	if ( opts->denoise )
+	{
+		struct denoise_params params;
+		denoise_params_init( &params );
+		if ( tracer_denoise( &tracer, &params ) == TRACER_SUCCESS )
+			log_info( "Denoised in %.3f s (%d passes)", tracer.denoise_seconds, params.passes );
+	}
+
+	// the process ends right after, so no encoder thread to hand it to
+	int result = tracer_write( &tracer, NULL, opts->trace_path ) == TRACER_SUCCESS ? 0 : 1;
+	tracer_free( &tracer );
+	scene_free( &scene );
+	bvh_free( &bvh );
+
+	return result;
+}
+
+static int compare_float_( const void *a, const void *b )
+{
+	float x = *( const float * )a, y = *( const float * )b;
+	return ( x > y ) - ( x < y );
+}
+
+// nearest rank percentile of sorted values
+static float percentile_( const float *sorted, int n, float p )
+{
+	int i = ( int )ceilf( p * n ) - 1;
+	return sorted[ i < 0 ? 0 : i ];
+}
+
+// run the game offscreen on a scripted camera path and report frame times
+static int bench_headless_( const struct options *opts )
+{
+	if ( opts->mesh_path )
+		game_set_mesh( opts->mesh_path );
+	game_set_camera_path( true );
+	if ( opts->capture_pattern )
+		game_set_capture( opts->capture_pattern );
+
+	if ( window_init_headless( &state.game, opts->w, opts->h ) != WINDOW_SUCCESS )
+		return 1;
+
+	// uncapped, which also keeps dynamic resolution out of the measurement
+	window_set_target_fps( 0 );
+
+	float *frame_ms = malloc( opts->frames * sizeof( float ) );
+	if ( frame_ms == NULL )
+	{
+		window_free();
+		return 1;
+	}
+
+	int result = 0;
+	int n = window_loop_frames( opts->frames, frame_ms );
+	if ( n > 1 )
+	{
+		// the first frame builds the shader variant, keep it out of the percentiles
+		log_info( "First frame took %.2f ms", frame_ms[ 0 ] );
+		float *times = frame_ms + 1;
+		n--;
+
+		double total = 0.0;
+		for ( int i = 0; i < n; i++ )
+			total += times[ i ];
+
+		qsort( times, n, sizeof( float ), compare_float_ );
+		log_info( "Rendered %d frames at %dx%d in %.1f ms (%.2f ms mean, %.1f fps)",
+				n, opts->w, opts->h, total, total / n, total > 0.0 ? n * 1000.0 / total : 0.0 );
+		log_info( "Frame time p50 %.2f ms, p90 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms",
+				percentile_( times, n, 0.50f ), percentile_( times, n, 0.90f ),
+				percentile_( times, n, 0.95f ), percentile_( times, n, 0.99f ), times[ n - 1 ] );
+	}
+	else
+		result = 1;
+
+	free( frame_ms );
+	window_free();
+	return result;
+}
 
 int main( int argc, char *argv[] )
 {
@@ -15,18 +285,49 @@ int main( int argc, char *argv[] )
 	// log arguments
 	log_debug( "Arguments: %s", buf );
 
+	struct options opts;
+	if ( parse_options_( argc, argv, &opts ) != 0 )
+		return 1;
+
+	// one pool of workers for the tracer, world generation and mesh loading
+	if ( jobs_init( opts.threads ) != JOBS_SUCCESS )
+		return 1;
+
+	// cpu reference backend does not need a window
+	if ( opts.trace_path )
+	{
+		int result = trace_headless_( &opts );
+		jobs_free();
+		return result;
+	}
+
+	// neither does the gpu benchmark
+	if ( opts.headless )
+	{
+		int result = bench_headless_( &opts );
+		jobs_free();
+		return result;
+	}
+
+	if ( opts.mesh_path )
+		game_set_mesh( opts.mesh_path );
+	if ( opts.capture_pattern )
+		game_set_capture( opts.capture_pattern );
+
 	// setup
 	system_init();
 	window_init( &state.game );
 	render_init();
 
-	// loop
+	// loop, ticks on their own thread
+	window_set_tick_thread( true );
 	window_loop();
 
 	// free memory
 	render_free();
 	window_free();
 	system_free();
+	jobs_free();
 
 	return 0;
 }
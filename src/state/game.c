@@ -4,6 +4,10 @@
 #include <SDL2/SDL.h>
 #include <util/util.h>
 #include <system/input.h>
+#include <system/snapshot.h>
+#include <system/encoder.h>
+#include <system/system.h>
+#include <data/dynarr.h>
 #include <gfx/window.h>
 #include <gfx/render.h>
 #include <gfx/shader.h>
@@ -11,12 +15,24 @@
 #include <gfx/vbo.h>
 #include <gfx/vao.h>
 #include <gfx/camera.h>
+#include <gfx/accum.h>
+#include <gfx/atrous.h>
+#include <gfx/dynres.h>
+#include <gfx/gpu_timer.h>
+#include <gfx/capture.h>
+#include <trace/scene.h>
+#include <trace/trace.h>
+#include <trace/tracer.h>
+#include <trace/denoise.h>
+#include <trace/bvh.h>
+#include <trace/variant.h>
 
 #include <cglm/cglm.h>
 #include <cglm/struct.h>
 #include <glad/glad.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../../res/shaders/raytracer/vert.h"
 #include "../../res/shaders/raytracer/frag.h"
@@ -24,9 +40,12 @@
 /* ================================== */
 /* obj stuff */
 /* ================================== */
-static struct camera camera;
-static vec3s light_pos   = {{ 0.0f, 5.0f, 0.0f }};
+static struct scene scene;
 static vec3s light_color = {{ 1.0f, 1.0f, 1.0f }};
+
+// optional mesh traced instead of the default scene
+static const char *mesh_path = NULL;
+static struct bvh mesh_bvh;
 /* ================================== */
 
 /* ================================== */
@@ -34,12 +53,73 @@ static vec3s light_color = {{ 1.0f, 1.0f, 1.0f }};
 /* ================================== */
 static struct vao vao;
 static struct vbo vbo;
+static struct scene_buffers buffers;
+
+// frames are traced into these and scaled to the window, with accumulation
+// they hold the running average of the frames since the scene last changed
+static struct accum accum;
+static bool accumulate = true;
+
+// edge-aware filter over the average, strongest while it has few frames
+static struct atrous atrous;
+static struct denoise_params denoise_params;
+static bool denoise = true;
+
+// render resolution adapting to the frame time
+static struct dynres dynres;
+static bool dynamic_res = true;
+
+// gpu time of the traced pass, read back a few frames late
+static struct gpu_timer gpu_timer;
+
+// frames read back without stalling and written on the encoder's thread,
+// which also writes the cpu reference
+static struct encoder encoder;
+static struct capture capture;
+static const char *capture_pattern = "capture_%05u.png";
+static bool capturing = false;
 /* ================================== */
 
 /* ================================== */
 /* shader */
 /* ================================== */
-static struct shader shader;
+static struct shader shader;    /* the variant of the current scene */
+static struct variant_cache variants;
+static struct variant_key variant;
+static char shader_cache_prefix[ 512 ];    /* in system_cache_dir, empty for no binaries */
+/* ================================== */
+
+/* ================================== */
+/* simulation */
+/* ================================== */
+// what a tick hands over to the frames, where it started and where it ended,
+// so frames that miss ticks still move between two consecutive ones
+struct game_snapshot
+{
+    vec3s eye;
+    vec3s light;
+    vec3s eye_before;
+    vec3s light_before;
+    u64 time;       /* window_time_ns of the tick */
+};
+
+// held keys and view direction for the ticks, set by every frame
+struct game_input
+{
+    float forward;
+    float left;
+    float up;
+    float yaw;      /* looking around is done by the frames without delay */
+    vec2s light;    /* x and z */
+};
+
+// ticks may run on their own thread, they only share these with the frames
+static struct snapshot snapshots;
+static struct game_input input_next;
+static SDL_mutex *input_lock;
+
+static struct game_snapshot sim;        /* owned by the ticks */
+static struct game_snapshot current;    /* the latest tick the frames have seen */
 /* ================================== */
 
 /* ================================== */
@@ -48,6 +128,12 @@ static struct shader shader;
 static float speed      = 10.0f;
 static float mouse_sens = 0.0009f;
 static float fov        = 45.0f;
+
+// scripted orbit around the scene for benchmarks, radians per frame
+#define GAME_PATH_STEP 0.02f
+static bool camera_path = false;
+static vec3s path_center;
+static float path_radius;
 /* ================================== */
 
 /* ================================== */
@@ -63,17 +149,255 @@ static const GLfloat vertices[] = {
 };
 /* ================================== */
 
+/* ================================== */
+/* lights */
+/* ================================== */
+#define GAME_LIGHT_BATCH 16
+static bool lights_added = false;
+/* ================================== */
+
+/* ================================== */
+/* spheres */
+/* ================================== */
+#define GAME_SPHERE_BATCH     1024
+#define GAME_SPHERE_MATERIALS 8
+static u32 *sphere_handles = NULL;     /* dynarr, of the batches in the order added */
+static int sphere_materials = -1;      /* first of the batch materials */
+/* ================================== */
+
+/* ================================== */
+/* cpu reference */
+/* ================================== */
+static const char *trace_path = "trace.ppm";
+/* ================================== */
+
+// render the current view with the cpu backend so it can be diffed against the shader
+static void game_trace_reference_( void )
+{
+    struct tracer tracer;
+    if ( tracer_init( &tracer, window.w, window.h, 0 ) != TRACER_SUCCESS )
+        return;
+
+    scene.camera.aspect = window.aspect;
+    tracer_render( &tracer, &scene );
+    tracer_write( &tracer, &encoder, trace_path );
+
+    log_info( "Queued cpu reference %s (%.3f s, %.2f Mrays/s, average path length %.3f)", trace_path,
+              tracer.seconds, tracer_rays_per_sec( &tracer ) / 1e6, tracer_path_length( &tracer ) );
+    tracer_free( &tracer );
+}
+
+// scatter a batch of small coloured lights over the ground around the camera
+static void game_add_lights_( void )
+{
+    for ( int i = 0; i < GAME_LIGHT_BATCH; i++ )
+    {
+        float x = ( float )rand() / RAND_MAX * 2.0f - 1.0f;
+        float z = ( float )rand() / RAND_MAX * 2.0f - 1.0f;
+        vec3s color = {{ ( float )rand() / RAND_MAX, ( float )rand() / RAND_MAX, ( float )rand() / RAND_MAX }};
+
+        struct scene_light light = {
+            .pos    = {{ scene.camera.eye.x + x * 20.0f, 0.5f, scene.camera.eye.z + z * 20.0f }},
+            .radius = 0.1f,
+            .color  = color,
+            .reach  = 4.0f,
+            .power  = 1.0f
+        };
+
+        if ( scene_add_light( &scene, light ) < 0 )
+        {
+            log_warn( "Scene is full at %d lights", SCENE_MAX_LIGHTS );
+            break;
+        }
+    }
+
+    lights_added = true;
+}
+
+// scatter a batch of small spheres around the camera
+static void game_add_spheres_( void )
+{
+    if ( sphere_materials < 0 )
+    {
+        for ( int i = 0; i < GAME_SPHERE_MATERIALS; i++ )
+        {
+            struct scene_material mat = {
+                .color = {{ ( float )rand() / RAND_MAX, ( float )rand() / RAND_MAX, ( float )rand() / RAND_MAX }},
+                .reflectiveness = i % 2 ? 0.5f : 0.0f
+            };
+
+            int index = scene_add_material( &scene, mat );
+            if ( i == 0 )
+                sphere_materials = index;
+        }
+
+        if ( sphere_materials < 0 )
+            return;
+    }
+
+    spheres_reserve( &scene.spheres, scene.spheres.count + GAME_SPHERE_BATCH );
+    for ( int i = 0; i < GAME_SPHERE_BATCH; i++ )
+    {
+        vec3s pos = {{
+            scene.camera.eye.x + ( ( float )rand() / RAND_MAX * 2.0f - 1.0f ) * 40.0f,
+            ( float )rand() / RAND_MAX * 4.0f - 0.5f,
+            scene.camera.eye.z + ( ( float )rand() / RAND_MAX * 2.0f - 1.0f ) * 40.0f
+        }};
+        u32 mat = ( u32 )( sphere_materials + rand() % GAME_SPHERE_MATERIALS );
+
+        u32 handle = scene_add_sphere( &scene, pos, 0.1f + ( float )rand() / RAND_MAX * 0.4f, mat );
+        if ( handle == SPHERES_NONE )
+            break;
+        dynarr_push_back( sphere_handles, handle );
+    }
+
+    log_info( "%u spheres", scene.spheres.count );
+}
+
+// remove the last batch added
+static void game_remove_spheres_( void )
+{
+    for ( int i = 0; i < GAME_SPHERE_BATCH && dynarr_size( sphere_handles ) > 0; i++ )
+    {
+        spheres_remove( &scene.spheres, sphere_handles[ dynarr_size( sphere_handles ) - 1 ] );
+        dynarr_pop_back( sphere_handles );
+    }
+
+    log_info( "%u spheres", scene.spheres.count );
+}
+
+// switch to the variant of the scene when its features changed
+static void game_select_variant_( void )
+{
+    struct variant_key key;
+    variant_key_init( &key, &scene );
+    if ( variant_key_equal( &key, &variant ) )
+        return;
+
+    const struct shader *built = variant_get( &variants, &key );
+    if ( built == NULL || scene_buffers_attach( &buffers, *built ) != 0 )
+        return;
+
+    shader = *built;
+    variant = key;
+    accum_attach( &accum, shader );
+}
+
+// resolution the shader traces at, the window's without the framebuffers
+static void game_render_size_( int *w, int *h )
+{
+    if ( accum.fbo[ 0 ] == 0 )
+    {
+        *w = window.w;
+        *h = window.h;
+        return;
+    }
+
+    dynres_size( &dynres, window.w, window.h, w, h );
+}
+
+void game_set_mesh( const char *path )
+{
+    mesh_path = path;
+}
+
+void game_set_camera_path( bool enabled )
+{
+    camera_path = enabled;
+}
+
+void game_set_capture( const char *pattern )
+{
+    capture_pattern = pattern;
+    capturing = true;
+}
+
+static void game_report_capture_( void )
+{
+    struct encoder_stats stats = encoder_stats( &encoder );
+    log_info( "Captured %u frames: %llu written, %llu dropped (%llu by the read back), queue depth %d (max %d)",
+              capture.frames, ( unsigned long long )stats.written, ( unsigned long long )( stats.dropped + capture.dropped ),
+              ( unsigned long long )capture.dropped, stats.depth, stats.max_depth );
+}
+
+// the same orbit every run, one step per frame, looking at the center
+static void game_follow_path_( struct camera *camera )
+{
+    float a = ( float )window.frame.count * GAME_PATH_STEP;
+    float height = 0.25f * path_radius;
+
+    camera->eye = ( vec3s ){{
+        path_center.x + path_radius * sinf( a ),
+        path_center.y + height,
+        path_center.z + path_radius * cosf( a )
+    }};
+    camera->yaw = a + PI;
+    camera->pitch = -atanf( height / path_radius );
+}
+
+// load the mesh and build its bvh, the scene keeps a pointer to it
+static int game_load_mesh_( void )
+{
+    struct obj3d obj;
+    if ( obj3d_load( &obj, mesh_path ) != 0 )
+    {
+        log_error( "Unable to load mesh: %s", mesh_path );
+        return 1;
+    }
+
+    int err = bvh_build( &mesh_bvh, obj.fv, obj.fv_len );
+    obj3d_free( &obj );
+    if ( err )
+        return 1;
+
+    log_info( "Built bvh over %zu triangles (%zu nodes)", mesh_bvh.tri_count, mesh_bvh.node_count );
+    return 0;
+}
+
 int game_init( void )
 {
     glEnable( GL_DEPTH_TEST );
 
+    // the shader is specialized for the scene, so the scene comes first
+    if ( mesh_path && game_load_mesh_() == 0 )
+    {
+        scene_init_mesh( &scene, &mesh_bvh, degtorad( fov ) );
+        path_center = glms_vec3_scale( glms_vec3_add( mesh_bvh.nodes[ 0 ].min, mesh_bvh.nodes[ 0 ].max ), 0.5f );
+        path_radius = glms_vec3_distance( mesh_bvh.nodes[ 0 ].min, mesh_bvh.nodes[ 0 ].max );
+    }
+    else
+    {
+        scene_init_default( &scene, degtorad( fov ) );
+        path_center = GLMS_VEC3_ZERO;
+        path_radius = 8.0f;
+    }
+
+    sim = ( struct game_snapshot ){ .eye = scene.camera.eye, .light = scene.lights[ 0 ].pos, .time = window_time_ns() };
+    sim.eye_before = sim.eye;
+    sim.light_before = sim.light;
+    current = sim;
+    input_lock = SDL_CreateMutex();
+    if ( input_lock == NULL || snapshot_init( &snapshots, &sim, sizeof( sim ) ) != SNAPSHOT_SUCCESS )
+    {
+        log_error( "Failed to create the simulation state" );
+        return WINDOW_EXIT;
+    }
+
     log_info( "Loading and compiling shaders..." );
-    if ( shader_tbuild( &shader, ( char * )vert_glsl, vert_glsl_len, ( char * )frag_glsl, frag_glsl_len ) != 0 )
+    const char *cache_dir = system_cache_dir();
+    if ( cache_dir )
+        snprintf( shader_cache_prefix, sizeof( shader_cache_prefix ), "%sraytracer", cache_dir );
+    variant_cache_init( &variants, ( char * )vert_glsl, vert_glsl_len, ( char * )frag_glsl, frag_glsl_len,
+            shader_cache_prefix[ 0 ] ? shader_cache_prefix : NULL );
+    variant_key_init( &variant, &scene );
+    const struct shader *built = variant_get( &variants, &variant );
+    if ( built == NULL )
     {
         log_error( "Failed to build shaders" );
         return WINDOW_EXIT;
     }
 
+    shader = *built;
     shader_bind( shader );
 
     // create and bind our vao
@@ -87,55 +411,36 @@ int game_init( void )
     // upload data to our gpu
     vbo_buff( vbo, ( void * )vertices, sizeof( vertices ) );
 
-    // set vao attributes
+    // set vao attributes, position is at location 0 in every variant
     GLuint pos_idx = glGetAttribLocation( shader.handle, "position" );
     vao_attr( vao, vbo, pos_idx, 3, GL_FLOAT, 0, 0 );
     
-    // init rendering details
-    camera_init( &camera, degtorad( fov ) );
-    camera.eye   = GLMS_VEC3_ZERO;
-    camera.pitch = degtorad( 0 );
-    camera.yaw   = degtorad( 0 );
-
-    // uniform objects to fragment shader
-    shader_uniform_vec3( shader, "plane.pos",  ( vec3s ){{ 0.0f, -1.0f, 0.0f }} );
-    shader_uniform_vec3( shader, "plane.norm", ( vec3s ){{ 0.0f,  1.0f, 0.0f }} );
-
-    shader_uniform_vec3( shader,  "lights[0].pos",    light_pos );
-    shader_uniform_vec3( shader,  "lights[0].color",  light_color );
-    shader_uniform_float( shader, "lights[0].radius", 1.0f );
-    shader_uniform_float( shader, "lights[0].reach",  300.0f );
-    shader_uniform_float( shader, "lights[0].power",  1.0f );
-
-    shader_uniform_uint( shader,  "objects[0].type", 1 );
-    shader_uniform_vec3( shader,  "objects[0].pos", ( vec3s ){{ 3.0f, 0.0f, 0.0f }} );
-    shader_uniform_float( shader, "objects[0].scale", 1.0f );
-    shader_uniform_vec3( shader,  "objects[0].mat.color", ( vec3s ){{ 0.0f, 1.0f, 0.0f }} );
-    shader_uniform_float( shader, "objects[0].mat.reflectiveness", 0.0f );
-
-    shader_uniform_uint( shader,  "objects[1].type", 1 );
-    shader_uniform_vec3( shader,  "objects[1].pos", ( vec3s ){{ 0.0f, 0.0f, 0.0f }} );
-    shader_uniform_float( shader, "objects[1].scale", 1.0f );
-    shader_uniform_vec3( shader,  "objects[1].mat.color", ( vec3s ){{ 0.0f, 0.0f, 1.0f }} );
-    shader_uniform_float( shader, "objects[1].mat.reflectiveness", 1.0f );
-
-    shader_uniform_uint( shader,  "objects[2].type", 1 );
-    shader_uniform_vec3( shader,  "objects[2].pos", ( vec3s ){{ -3.0f, 0.0f, 0.0f }} );
-    shader_uniform_float( shader, "objects[2].scale", 1.0f );
-    shader_uniform_vec3( shader,  "objects[2].mat.color", ( vec3s ){{ 1.0f, 0.0f, 0.0f }} );
-    shader_uniform_float( shader, "objects[2].mat.reflectiveness", 0.5f );
-
-    shader_uniform_uint( shader,  "objects[3].type", 1 );
-    shader_uniform_vec3( shader,  "objects[3].pos", ( vec3s ){{ 0.0f, 0.0f, 3.0f }} );
-    shader_uniform_float( shader, "objects[3].scale", 1.0f );
-    shader_uniform_vec3( shader,  "objects[3].mat.color", ( vec3s ){{ 1.0f, 1.0f, 1.0f }} );
-    shader_uniform_float( shader, "objects[3].mat.reflectiveness", 0.8f );
-
-    shader_uniform_uint( shader,  "objects[4].type", 1 );
-    shader_uniform_vec3( shader,  "objects[4].pos", ( vec3s ){{ 0.0f, 0.0f, -3.0f }} );
-    shader_uniform_float( shader, "objects[4].scale", 1.0f );
-    shader_uniform_vec3( shader,  "objects[4].mat.color", ( vec3s ){{ 0.8f, 0.8f, 0.8f }} );
-    shader_uniform_float( shader, "objects[4].mat.reflectiveness", 0.08f );
+    // send the scene to the shader
+    if ( scene_buffers_init( &buffers, shader ) != 0 )
+    {
+        log_error( "Failed to create scene buffers" );
+        return WINDOW_EXIT;
+    }
+
+    scene_upload_meshes( &scene, &buffers );
+
+    dynres_init( &dynres, DYNRES_MIN_SCALE, DYNRES_MAX_SCALE );
+    if ( accum_init( &accum, window.w, window.h ) != ACCUM_SUCCESS )
+        log_warn( "Accumulation and dynamic resolution are not available" );
+    accum_attach( &accum, shader );
+
+    denoise_params_init( &denoise_params );
+    if ( atrous_init( &atrous, window.w, window.h ) != ATROUS_SUCCESS )
+        log_warn( "Denoising is not available" );
+
+    gpu_timer_init( &gpu_timer );
+
+    if ( encoder_init( &encoder, ENCODER_DEPTH ) != ENCODER_SUCCESS ||
+         capture_init( &capture, &encoder, capture_pattern ) != CAPTURE_SUCCESS )
+    {
+        log_warn( "Capture is not available" );
+        capturing = false;
+    }
 
     window_set_relative_mouse( true );
 
@@ -144,14 +449,55 @@ int game_init( void )
 
 int game_free( void )
 {
+    // whatever is in flight is still written
+    if ( capture.frames > 0 )
+    {
+        capture_flush( &capture );
+        encoder_flush( &encoder );
+        game_report_capture_();
+    }
+    capture_free( &capture );
+    encoder_free( &encoder );
+    gpu_timer_free( &gpu_timer );
+    atrous_free( &atrous );
+    accum_free( &accum );
+    scene_buffers_free( &buffers );
+    bvh_free( &mesh_bvh );
+    scene_free( &scene );
+    dynarr_free( sphere_handles );
     vbo_free( vbo );
     vao_free( vao );
-    shader_free( shader );
+    variant_cache_free( &variants );
+    snapshot_free( &snapshots );
+    SDL_DestroyMutex( input_lock );
     return 0;
 }
 
+// may run on the simulation thread, touches nothing but sim and the shared state
 int game_tick( void )
 {
+    SDL_LockMutex( input_lock );
+    struct game_input in = input_next;
+    SDL_UnlockMutex( input_lock );
+
+    float step = speed * window.tick.target_delta / 1000.0f;
+    sim.eye_before = sim.eye;
+    sim.light_before = sim.light;
+
+    vec3s direction = {{
+        in.forward * sinf( in.yaw ) + in.left * cosf( in.yaw ),
+        in.up,
+        in.forward * cosf( in.yaw ) - in.left * sinf( in.yaw )
+    }};
+    sim.eye = glms_vec3_add( sim.eye, glms_vec3_scale( direction, step ) );
+
+    direction = ( vec3s ){{ in.light.x, 0.0f, in.light.y }};
+    sim.light = glms_vec3_add( sim.light, glms_vec3_scale( direction, step ) );
+
+    sim.time = window_time_ns();
+    *( struct game_snapshot * )snapshot_back( &snapshots ) = sim;
+    snapshot_publish( &snapshots );
+
     return 0;
 }
 
@@ -162,47 +508,47 @@ int game_update( void )
     /* CHARACTER MOVEMENT		   */
     /* --------------------------- */
 
-    vec3s direction = GLMS_VEC3_ZERO;;
+    struct camera *camera = &scene.camera;
+    struct scene_light *light = &scene.lights[ 0 ];
+
+    // held keys move in the ticks, see game_tick
+    struct game_input in = { 0 };
     if ( input_key_press( INPUT_KB_W ) )
     {
-        direction.x += sinf( camera.yaw );
-        direction.z += cosf( camera.yaw );
+        in.forward += 1;
     }
 
     if ( input_key_press( INPUT_KB_S ) )
     {
-        direction.x -= sinf( camera.yaw );
-        direction.z -= cosf( camera.yaw );
+        in.forward -= 1;
     }
 
     if ( input_key_press( INPUT_KB_A ) )
     {
-        direction.x += cosf( camera.yaw );
-        direction.z -= sinf( camera.yaw );
+        in.left += 1;
     }
 
     if ( input_key_press( INPUT_KB_D ) )
     {
-        direction.x -= cosf( camera.yaw );
-        direction.z += sinf( camera.yaw );
+        in.left -= 1;
     }
 
     if ( input_key_press( INPUT_KB_SPACE ) )
     {
-        direction.y += 1;
+        in.up += 1;
     }
 
     if ( input_key_press( INPUT_KB_LEFT_SHIFT ) )
     {
-        direction.y -= 1;
+        in.up -= 1;
     }
 
     if ( input_mouse_moved() )
     {
         int dx, dy;
         input_mouse_delta( &dx, &dy );
-        camera.yaw   -= ( float )dx * mouse_sens;
-        camera.pitch -= ( float )dy * mouse_sens;
+        camera->yaw   -= ( float )dx * mouse_sens;
+        camera->pitch -= ( float )dy * mouse_sens;
     }
 
     if ( input_key_down( INPUT_KB_ESCAPE ) )
@@ -210,14 +556,73 @@ int game_update( void )
         window_toggle_relative_mouse();
     }
 
-    direction = glms_vec3_scale( direction, speed * window.frame.delta );
-    camera.eye = glms_vec3_add( camera.eye, direction );
-    camera.aspect = window.aspect;
-    camera_update( &camera );
+    if ( input_key_down( INPUT_KB_P ) )
+    {
+        game_trace_reference_();
+    }
+
+    if ( input_key_down( INPUT_KB_C ) && encoder.thread )
+    {
+        capturing = !capturing;
+        if ( capturing )
+            log_info( "Capturing to %s", capture_pattern );
+        else
+        {
+            capture_flush( &capture );
+            game_report_capture_();
+        }
+    }
+
+    if ( input_key_down( INPUT_KB_R ) )
+    {
+        accumulate = !accumulate;
+        accum_reset( &accum );
+    }
+
+    if ( input_key_down( INPUT_KB_F ) )
+    {
+        denoise = !denoise;
+        log_info( "Denoising %s", denoise ? "on" : "off" );
+    }
+
+    if ( input_key_down( INPUT_KB_G ) )
+    {
+        dynamic_res = !dynamic_res;
+        dynres_init( &dynres, DYNRES_MIN_SCALE, DYNRES_MAX_SCALE );
+    }
+
+    if ( input_key_down( INPUT_KB_L ) )
+    {
+        game_add_lights_();
+    }
+
+    if ( input_key_down( INPUT_KB_B ) )
+    {
+        game_add_spheres_();
+    }
+
+    if ( input_key_down( INPUT_KB_N ) )
+    {
+        game_remove_spheres_();
+    }
 
-    shader_uniform_vec3( shader, "camera.eye", camera.eye );
-    shader_uniform_mat4( shader, "camera.view", camera.view );
-    shader_uniform_float( shader, "camera.fov", camera.fov );
+    if ( input_key_down( INPUT_KB_EQUAL ) )
+    {
+        scene.max_depth++;
+        log_info( "Reflection depth %u", scene.max_depth );
+    }
+
+    if ( input_key_down( INPUT_KB_MINUS ) && scene.max_depth > 0 )
+    {
+        scene.max_depth--;
+        log_info( "Reflection depth %u", scene.max_depth );
+    }
+
+    if ( input_key_down( INPUT_KB_H ) )
+    {
+        scene.shadows = !scene.shadows;
+        log_info( "Shadows %s", scene.shadows ? "on" : "off" );
+    }
 
     /* ======================================================== */
 
@@ -226,30 +631,51 @@ int game_update( void )
     /* LIGHT MOVEMENT		       */
     /* --------------------------- */
 
-    direction = GLMS_VEC3_ZERO;
     if ( input_key_press( INPUT_KB_LEFT ) )
     {
-        direction.x += 1;
+        in.light.x += 1;
     }
 
     if ( input_key_press( INPUT_KB_RIGHT ) )
     {
-        direction.x -= 1;
+        in.light.x -= 1;
     }
 
     if ( input_key_press( INPUT_KB_UP ) )
     {
-        direction.z += 1;
+        in.light.y += 1;
     }
 
     if ( input_key_press( INPUT_KB_DOWN ) )
     {
-        direction.z -= 1;
+        in.light.y -= 1;
     }
 
-    direction = glms_vec3_scale( direction, speed * window.frame.delta );
-    light_pos = glms_vec3_add( light_pos, direction );
-    shader_uniform_vec3( shader,  "lights[0].pos", light_pos );
+    /* ======================================================== */
+
+    /* ======================================================== */
+    /* --------------------------- */
+    /* TICK HANDOFF		           */
+    /* --------------------------- */
+
+    in.yaw = camera->yaw;
+    SDL_LockMutex( input_lock );
+    input_next = in;
+    SDL_UnlockMutex( input_lock );
+
+    // draw within the latest tick, one tick behind so there is always a next
+    // position to move toward
+    if ( snapshot_acquire( &snapshots ) )
+        current = *( const struct game_snapshot * )snapshot_front( &snapshots );
+
+    float alpha = window_tick_alpha( current.time );
+    camera->eye = glms_vec3_lerp( current.eye_before, current.eye, alpha );
+    light->pos = glms_vec3_lerp( current.light_before, current.light, alpha );
+
+    if ( camera_path )
+        game_follow_path_( camera );
+    camera->aspect = window.aspect;
+    camera_update( camera );
 
     /* ======================================================== */
 
@@ -260,65 +686,152 @@ int game_update( void )
 
     if ( input_key_down( INPUT_KB_1 ) )
     {
-        shader_uniform_vec3( shader, "lights[0].color", light_color );
+        light->color = light_color;
     }
 
     if ( input_key_down( INPUT_KB_2 ) )
     {
-        shader_uniform_vec3( shader, "lights[0].color", ( vec3s ){{ 0.4f, 0.9f, 1.0f }} );
+        light->color = ( vec3s ){{ 0.4f, 0.9f, 1.0f }};
     }
 
     if ( input_key_down( INPUT_KB_3 ) )
     {
-        shader_uniform_vec3( shader, "lights[0].color", ( vec3s ){{ 1.0f, 0.2f, 1.0f }} );
+        light->color = ( vec3s ){{ 1.0f, 0.2f, 1.0f }};
     }
 
     if ( input_key_down( INPUT_KB_4 ) )
     {
-        shader_uniform_vec3( shader, "lights[0].color", ( vec3s ){{ 0.7f, 0.6f, 0.2f }} );
+        light->color = ( vec3s ){{ 0.7f, 0.6f, 0.2f }};
     }
 
     if ( input_key_down( INPUT_KB_5 ) )
     {
-        shader_uniform_vec3( shader, "lights[0].color", ( vec3s ){{ 0.8f, 0.7f, 0.8f }} );
+        light->color = ( vec3s ){{ 0.8f, 0.7f, 0.8f }};
     }
 
     if ( input_key_down( INPUT_KB_6 ) )
     {
-        shader_uniform_float( shader, "lights[0].reach",  300.0f );
-        shader_uniform_float( shader, "lights[0].power",  1.0f );
+        light->reach = 300.0f;
+        light->power = 1.0f;
     }
 
     if ( input_key_down( INPUT_KB_7 ) )
     {
-        shader_uniform_float( shader, "lights[0].reach",  30.0f );
-        shader_uniform_float( shader, "lights[0].power",  0.8f );
+        light->reach = 30.0f;
+        light->power = 0.8f;
     }
 
     if ( input_key_down( INPUT_KB_8 ) )
     {
-        shader_uniform_float( shader, "lights[0].reach",  10.0f );
-        shader_uniform_float( shader, "lights[0].power",  0.5f );
+        light->reach = 10.0f;
+        light->power = 0.5f;
     }
 
     if ( input_key_down( INPUT_KB_9 ) )
     {
-        shader_uniform_float( shader, "lights[0].reach",  7.0f );
-        shader_uniform_float( shader, "lights[0].power",  0.3f );
+        light->reach = 7.0f;
+        light->power = 0.3f;
     }
 
     /* ======================================================== */
 
-    shader_uniform_vec2( shader, "resolution", ( vec2s ){{ window.w, window.h }} );
+    // hold the target frame rate by scaling the render resolution, only a
+    // frame traced from scratch tells what a frame costs
+    if ( dynamic_res && accum.frames <= 1 && window.frame.target_rate > 0 &&
+         dynres_update( &dynres, window.frame.delta * 1000.0f, window.frame.target_delta ) )
+        log_debug( "Render scale %.2f", dynres.scale );
+
+    game_select_variant_();
+
+    int w, h;
+    game_render_size_( &w, &h );
+
+    // the whole scene goes to the gpu in one buffer update, any change
+    // to it (camera and resolution included) starts a new average
+    if ( scene_upload( &scene, &buffers, ( vec2s ){{ w, h }} ) )
+        accum_reset( &accum );
+
+    if ( lights_added )
+    {
+        log_info( "%u lights, %.2f per %d pixel tile", scene.light_count,
+                  light_grid_lights_per_tile( &buffers.grid ), buffers.grid.tile_size );
+        lights_added = false;
+    }
 
     return 0;
 }
 
 int game_render( void )
 {
+    glBindFramebuffer( GL_FRAMEBUFFER, window.fbo );
     glClearColor( 1.f, 1.f, 1.f, 1.f );
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-    glDrawArrays( GL_TRIANGLES, 0, 6 );
+
+    int w, h;
+    game_render_size_( &w, &h );
+    if ( accum.fbo[ 0 ] && accum_resize( &accum, w, h ) != ACCUM_SUCCESS )
+    {
+        // trace straight to the window through the pixel centers from now on
+        shader_uniform_uint( shader, "accum_frames", 0 );
+        shader_uniform_vec2( shader, "jitter", GLMS_VEC2_ZERO );
+    }
+
+    if ( atrous.fbo[ 0 ] && atrous_resize( &atrous, w, h ) != ATROUS_SUCCESS )
+        log_warn( "Denoising is not available" );
+
+    // results of passes a few frames back, never waits for the current one
+    gpu_timer_poll( &gpu_timer, &window.phases[ WINDOW_PHASE_GPU ] );
+
+    if ( accum.fbo[ 0 ] == 0 )
+    {
+        glViewport( 0, 0, window.w, window.h );
+        gpu_timer_begin( &gpu_timer );
+        glDrawArrays( GL_TRIANGLES, 0, 6 );
+        gpu_timer_end( &gpu_timer );
+    }
+    else if ( accum_converged( &accum ) )
+    {
+        // nothing left to refine, show the average without tracing
+        accum_present( &accum, window.fbo, window.w, window.h );
+    }
+    else
+    {
+        if ( !accumulate )
+            accum_reset( &accum );
+
+        accum_begin( &accum, trace_jitter( accum.frames ) );
+        gpu_timer_begin( &gpu_timer );
+        glDrawArrays( GL_TRIANGLES, 0, 6 );
+        gpu_timer_end( &gpu_timer );
+        accum_end( &accum );
+
+        if ( denoise && atrous.fbo[ 0 ] )
+        {
+            atrous_apply( &atrous, accum_average( &accum ), accum.guide, &denoise_params, accum.frames );
+            atrous_present( &atrous, window.fbo, window.w, window.h );
+        }
+        else
+            accum_present( &accum, window.fbo, window.w, window.h );
+    }
+
+    if ( capturing )
+        capture_frame( &capture, window.fbo, window.w, window.h );
+
+    // report redundant uniform uploads about once a second
+    shader_stats_frame();
+    u64 report_every = window.frame.target_rate > 0 ? ( u64 )window.frame.target_rate : 60;
+    if ( window.frame.count % report_every == 0 )
+    {
+        log_debug( "Uniform uploads last frame: %u sent, %u skipped", shader_stats.frame_uploads, shader_stats.frame_skipped );
+        log_debug( "Traced pass on the gpu: p50 %.2f ms, p95 %.2f ms",
+                window_get_phase_time( WINDOW_PHASE_GPU, 0.50f ) / 1e6, window_get_phase_time( WINDOW_PHASE_GPU, 0.95f ) / 1e6 );
+        if ( capturing )
+        {
+            struct encoder_stats stats = encoder_stats( &encoder );
+            log_debug( "Capture queue depth %d (max %d), %llu dropped", stats.depth, stats.max_depth,
+                       ( unsigned long long )( stats.dropped + capture.dropped ) );
+        }
+    }
 
     return 0;
 }
@@ -1,10 +1,22 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <stdbool.h>
+
 int game_init( void );
 int game_free( void );
 int game_tick( void );
 int game_update( void );
 int game_render( void );
 
+// trace a mesh instead of the default scene, set before game_init
+void game_set_mesh( const char *path );
+
+// fly a fixed orbit around the scene instead of following input, for benchmarks
+void game_set_camera_path( bool enabled );
+
+// capture every frame to files named by the printf pattern (given the frame
+// number) from the start, the extension picks ppm or png
+void game_set_capture( const char *pattern );
+
 #endif
@@ -0,0 +1,390 @@
+#include "encoder.h"
+#include "../util/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    ENCODER_FREE,
+    ENCODER_FILLING,
+    ENCODER_QUEUED
+};
+
+// deflate stores at most this many bytes per uncompressed block
+#define ENCODER_BLOCK 65535
+// bytes the adler sums take before they have to be reduced
+#define ENCODER_ADLER_RUN 5552
+#define ENCODER_ADLER_MOD 65521
+
+// the png is a zlib stream of stored deflate blocks, no compression but
+// nothing to link and nothing for the thread to fall behind on
+struct encoder_png_
+{
+    FILE *fp;
+    u32 crc;            /* of the current chunk */
+    u32 adler_a;
+    u32 adler_b;
+    size_t fill;
+    u8 block[ ENCODER_BLOCK ];
+};
+
+static const u32 encoder_crc_nibble_[ 16 ] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static u32 encoder_crc_( u32 crc, const u8 *data, size_t len )
+{
+    for ( size_t i = 0; i < len; i++ )
+    {
+        crc ^= data[ i ];
+        crc = ( crc >> 4 ) ^ encoder_crc_nibble_[ crc & 15 ];
+        crc = ( crc >> 4 ) ^ encoder_crc_nibble_[ crc & 15 ];
+    }
+    return crc;
+}
+
+static void encoder_put_( struct encoder_png_ *png, const void *data, size_t len )
+{
+    fwrite( data, 1, len, png->fp );
+    png->crc = encoder_crc_( png->crc, data, len );
+}
+
+static void encoder_put_u32_( struct encoder_png_ *png, u32 v )
+{
+    u8 b[ 4 ] = { v >> 24, v >> 16, v >> 8, v };
+    encoder_put_( png, b, 4 );
+}
+
+static void encoder_chunk_begin_( struct encoder_png_ *png, const char *type, u32 len )
+{
+    // the length is not part of the crc
+    u8 b[ 4 ] = { len >> 24, len >> 16, len >> 8, len };
+    fwrite( b, 1, 4, png->fp );
+    png->crc = 0xffffffff;
+    encoder_put_( png, type, 4 );
+}
+
+static void encoder_chunk_end_( struct encoder_png_ *png )
+{
+    u32 crc = ~png->crc;
+    u8 b[ 4 ] = { crc >> 24, crc >> 16, crc >> 8, crc };
+    fwrite( b, 1, 4, png->fp );
+}
+
+static void encoder_block_( struct encoder_png_ *png, bool final )
+{
+    u16 len = ( u16 )png->fill;
+    u8 header[ 5 ] = { final ? 1 : 0, len & 0xff, len >> 8, ~len & 0xff, ( u16 )~len >> 8 };
+    encoder_put_( png, header, 5 );
+    encoder_put_( png, png->block, png->fill );
+    png->fill = 0;
+}
+
+static void encoder_adler_( struct encoder_png_ *png, const u8 *data, size_t len )
+{
+    u32 a = png->adler_a, b = png->adler_b;
+    while ( len > 0 )
+    {
+        size_t run = len < ENCODER_ADLER_RUN ? len : ENCODER_ADLER_RUN;
+        for ( size_t i = 0; i < run; i++ )
+        {
+            a += data[ i ];
+            b += a;
+        }
+        a %= ENCODER_ADLER_MOD;
+        b %= ENCODER_ADLER_MOD;
+        data += run;
+        len -= run;
+    }
+    png->adler_a = a;
+    png->adler_b = b;
+}
+
+// a full block is only written once more data comes, the last one is final
+static void encoder_deflate_( struct encoder_png_ *png, const u8 *data, size_t len )
+{
+    encoder_adler_( png, data, len );
+    while ( len > 0 )
+    {
+        if ( png->fill == ENCODER_BLOCK )
+            encoder_block_( png, false );
+
+        size_t n = ENCODER_BLOCK - png->fill;
+        n = len < n ? len : n;
+        memcpy( png->block + png->fill, data, n );
+        png->fill += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// row y from the top as rgb
+static void encoder_row_( const struct encoder_frame *frame, int y, u8 *rgb )
+{
+    int row = frame->bottom_up ? frame->h - 1 - y : y;
+    const u8 *src = frame->pixels + ( size_t )row * frame->w * frame->channels;
+
+    if ( frame->channels == 3 )
+    {
+        memcpy( rgb, src, ( size_t )frame->w * 3 );
+        return;
+    }
+
+    for ( int x = 0; x < frame->w; x++ )
+    {
+        rgb[ x * 3 + 0 ] = src[ x * frame->channels + 0 ];
+        rgb[ x * 3 + 1 ] = src[ x * frame->channels + 1 ];
+        rgb[ x * 3 + 2 ] = src[ x * frame->channels + 2 ];
+    }
+}
+
+static int encoder_write_ppm_( const struct encoder_frame *frame, FILE *fp, u8 *row )
+{
+    fprintf( fp, "P6\n%d %d\n255\n", frame->w, frame->h );
+    for ( int y = 0; y < frame->h; y++ )
+    {
+        encoder_row_( frame, y, row );
+        fwrite( row, 1, ( size_t )frame->w * 3, fp );
+    }
+
+    return ENCODER_SUCCESS;
+}
+
+static int encoder_write_png_( const struct encoder_frame *frame, FILE *fp, u8 *row )
+{
+    struct encoder_png_ *png = malloc( sizeof( *png ) );
+    if ( png == NULL )
+        return ENCODER_ERROR;
+    *png = ( struct encoder_png_ ){ .fp = fp, .adler_a = 1 };
+
+    static const u8 signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite( signature, 1, sizeof( signature ), fp );
+
+    // 8 bit rgb, not interlaced
+    encoder_chunk_begin_( png, "IHDR", 13 );
+    encoder_put_u32_( png, ( u32 )frame->w );
+    encoder_put_u32_( png, ( u32 )frame->h );
+    static const u8 format[ 5 ] = { 8, 2, 0, 0, 0 };
+    encoder_put_( png, format, sizeof( format ) );
+    encoder_chunk_end_( png );
+
+    // every row starts with its filter type, none
+    size_t raw = ( size_t )frame->h * ( 1 + ( size_t )frame->w * 3 );
+    size_t blocks = raw > 0 ? ( raw + ENCODER_BLOCK - 1 ) / ENCODER_BLOCK : 1;
+    size_t len = 2 + blocks * 5 + raw + 4;
+
+    encoder_chunk_begin_( png, "IDAT", ( u32 )len );
+    static const u8 zlib[ 2 ] = { 0x78, 0x01 };
+    encoder_put_( png, zlib, sizeof( zlib ) );
+
+    static const u8 filter = 0;
+    for ( int y = 0; y < frame->h; y++ )
+    {
+        encoder_row_( frame, y, row );
+        encoder_deflate_( png, &filter, 1 );
+        encoder_deflate_( png, row, ( size_t )frame->w * 3 );
+    }
+    encoder_block_( png, true );
+    encoder_put_u32_( png, png->adler_b << 16 | png->adler_a );
+    encoder_chunk_end_( png );
+
+    encoder_chunk_begin_( png, "IEND", 0 );
+    encoder_chunk_end_( png );
+
+    free( png );
+    return ENCODER_SUCCESS;
+}
+
+static bool encoder_is_png_( const char *path )
+{
+    size_t len = strlen( path );
+    return len >= 4 && strcmp( path + len - 4, ".png" ) == 0;
+}
+
+int encoder_write( const struct encoder_frame *frame, const char *path )
+{
+    FILE *fp = fopen( path, "wb" );
+    if ( fp == NULL )
+    {
+        log_error( "Unable to open %s for writing", path );
+        return ENCODER_ERROR;
+    }
+
+    u8 *row = malloc( ( size_t )frame->w * 3 );
+    int err = ENCODER_ERROR;
+    if ( row )
+        err = encoder_is_png_( path ) ? encoder_write_png_( frame, fp, row ) : encoder_write_ppm_( frame, fp, row );
+
+    free( row );
+    if ( ferror( fp ) )
+        err = ENCODER_ERROR;
+    if ( fclose( fp ) != 0 )
+        err = ENCODER_ERROR;
+
+    if ( err != ENCODER_SUCCESS )
+        log_error( "Unable to write %s", path );
+    return err;
+}
+
+static int encoder_run_( void *data )
+{
+    struct encoder *self = data;
+
+    SDL_LockMutex( self->lock );
+    for ( ;; )
+    {
+        // frames are written in the order taken, even if submitted out of it
+        struct encoder_frame *frame = &self->slots[ self->head ];
+        if ( frame->state != ENCODER_QUEUED )
+        {
+            if ( self->quit )
+                break;
+            SDL_CondWait( self->changed, self->lock );
+            continue;
+        }
+
+        // an empty path was handed back unwritten
+        bool write = frame->path[ 0 ] != '\0';
+        SDL_UnlockMutex( self->lock );
+        int err = write ? encoder_write( frame, frame->path ) : ENCODER_SUCCESS;
+        SDL_LockMutex( self->lock );
+
+        if ( write && err == ENCODER_SUCCESS )
+            self->stats.written++;
+        else if ( write )
+            self->stats.failed++;
+
+        frame->state = ENCODER_FREE;
+        self->head = ( self->head + 1 ) % self->capacity;
+        self->stats.depth--;
+        self->done++;
+        SDL_CondBroadcast( self->changed );
+    }
+    SDL_UnlockMutex( self->lock );
+
+    return 0;
+}
+
+int encoder_init( struct encoder *self, int capacity )
+{
+    *self = ( struct encoder ){ .capacity = capacity > 0 ? capacity : ENCODER_DEPTH };
+
+    self->slots = calloc( self->capacity, sizeof( *self->slots ) );
+    self->lock = SDL_CreateMutex();
+    self->changed = SDL_CreateCond();
+    if ( self->slots == NULL || self->lock == NULL || self->changed == NULL )
+    {
+        log_error( "Unable to create the encoder queue" );
+        encoder_free( self );
+        return ENCODER_ERROR;
+    }
+
+    self->thread = SDL_CreateThread( encoder_run_, "encoder", self );
+    if ( self->thread == NULL )
+    {
+        log_error( "Unable to start the encoder thread: %s", SDL_GetError() );
+        encoder_free( self );
+        return ENCODER_ERROR;
+    }
+
+    return ENCODER_SUCCESS;
+}
+
+void encoder_free( struct encoder *self )
+{
+    if ( self->thread )
+    {
+        SDL_LockMutex( self->lock );
+        self->quit = true;
+        SDL_CondBroadcast( self->changed );
+        SDL_UnlockMutex( self->lock );
+        SDL_WaitThread( self->thread, NULL );
+    }
+
+    for ( int i = 0; self->slots && i < self->capacity; i++ )
+        free( self->slots[ i ].pixels );
+    free( self->slots );
+
+    if ( self->changed )
+        SDL_DestroyCond( self->changed );
+    if ( self->lock )
+        SDL_DestroyMutex( self->lock );
+    *self = ( struct encoder ){ 0 };
+}
+
+struct encoder_frame *encoder_begin( struct encoder *self, int w, int h, int channels )
+{
+    if ( self->thread == NULL )
+        return NULL;
+
+    SDL_LockMutex( self->lock );
+    struct encoder_frame *frame = &self->slots[ self->tail ];
+    if ( frame->state != ENCODER_FREE )
+    {
+        self->stats.dropped++;
+        SDL_UnlockMutex( self->lock );
+        return NULL;
+    }
+
+    frame->state = ENCODER_FILLING;
+    self->tail = ( self->tail + 1 ) % self->capacity;
+    self->stats.depth++;
+    if ( self->stats.depth > self->stats.max_depth )
+        self->stats.max_depth = self->stats.depth;
+    SDL_UnlockMutex( self->lock );
+
+    // the slot is ours until submitted
+    size_t size = ( size_t )w * h * channels;
+    if ( size > frame->cap )
+    {
+        u8 *pixels = realloc( frame->pixels, size );
+        if ( pixels == NULL )
+        {
+            log_error( "Unable to allocate a %dx%d frame", w, h );
+            encoder_submit( self, frame, NULL );
+            return NULL;
+        }
+        frame->pixels = pixels;
+        frame->cap = size;
+    }
+
+    frame->w = w;
+    frame->h = h;
+    frame->channels = channels;
+    frame->bottom_up = false;
+    return frame;
+}
+
+// a NULL path gives the slot back without writing it
+void encoder_submit( struct encoder *self, struct encoder_frame *frame, const char *path )
+{
+    snprintf( frame->path, sizeof( frame->path ), "%s", path ? path : "" );
+
+    SDL_LockMutex( self->lock );
+    frame->state = ENCODER_QUEUED;
+    self->submitted++;
+    SDL_CondBroadcast( self->changed );
+    SDL_UnlockMutex( self->lock );
+}
+
+void encoder_flush( struct encoder *self )
+{
+    if ( self->thread == NULL )
+        return;
+
+    SDL_LockMutex( self->lock );
+    while ( self->done < self->submitted )
+        SDL_CondWait( self->changed, self->lock );
+    SDL_UnlockMutex( self->lock );
+}
+
+struct encoder_stats encoder_stats( struct encoder *self )
+{
+    SDL_LockMutex( self->lock );
+    struct encoder_stats stats = self->stats;
+    SDL_UnlockMutex( self->lock );
+    return stats;
+}
@@ -0,0 +1,83 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+/*
+ * Writes frames to image files on a thread of its own, so whoever made them
+ * (the frame capture or the cpu tracer) never waits on the disk. Frames go
+ * through a bounded queue of slots owning their pixel buffers: the producer
+ * takes a slot, fills it and submits it, the thread writes the slots in the
+ * order they were taken and frees them. When every slot is taken the frame
+ * is dropped instead of waited for.
+ */
+
+#include <SDL2/SDL.h>
+#include <util/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ENCODER_SUCCESS 0
+#define ENCODER_ERROR  -1
+
+#define ENCODER_DEPTH     4     /* default queue length */
+#define ENCODER_PATH_MAX  256
+
+// a frame to write, the pixels are 8 bit rgb or rgba (alpha is not written)
+struct encoder_frame
+{
+    u8 *pixels;
+    size_t cap;         /* bytes allocated, kept between frames */
+    int w;
+    int h;
+    int channels;       /* 3 or 4 */
+    bool bottom_up;     /* the first row is the bottom one, as read back from gl */
+    char path[ ENCODER_PATH_MAX ];
+    int state;
+};
+
+struct encoder_stats
+{
+    int depth;          /* frames taken and not written yet */
+    int max_depth;
+    u64 written;
+    u64 failed;
+    u64 dropped;        /* the queue was full */
+};
+
+struct encoder
+{
+    struct encoder_frame *slots;
+    int capacity;
+    int head;           /* next slot to write */
+    int tail;           /* next slot to take */
+    bool quit;
+
+    SDL_mutex *lock;
+    SDL_cond *changed;
+    SDL_Thread *thread;
+
+    struct encoder_stats stats;
+    u64 submitted;
+    u64 done;           /* submitted and written, failed or skipped */
+};
+
+// capacity <= 0 takes ENCODER_DEPTH
+int  encoder_init( struct encoder *self, int capacity );
+
+// writes the frames already submitted, then stops the thread
+void encoder_free( struct encoder *self );
+
+// a slot with room for a w x h frame, NULL when the queue is full (the frame
+// counts as dropped) or out of memory; every slot taken must be submitted,
+// with a NULL path to give it back unwritten
+struct encoder_frame *encoder_begin( struct encoder *self, int w, int h, int channels );
+void encoder_submit( struct encoder *self, struct encoder_frame *frame, const char *path );
+
+// waits until every submitted frame is written
+void encoder_flush( struct encoder *self );
+
+struct encoder_stats encoder_stats( struct encoder *self );
+
+// what the thread does with a frame, binary ppm unless the path ends in .png
+int  encoder_write( const struct encoder_frame *frame, const char *path );
+
+#endif
@@ -0,0 +1,514 @@
+#include "jobs.h"
+#include "../util/log.h"
+#include "../util/types.h"
+#include "../util/aligned.h"
+#include "../data/dynarr.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct job
+{
+    job_fn fn;
+    void *data;
+    struct job_counter *counter;
+};
+
+// slots are read by thieves while the owner may write them, the top index
+// decides who got the job so relaxed accesses are enough
+struct jobs_slot_
+{
+    _Atomic( job_fn ) fn;
+    _Atomic( void * ) data;
+    _Atomic( struct job_counter * ) counter;
+};
+
+// indices only grow, 64 bits so they never wrap (SDL atomics are int only)
+struct jobs_deque_
+{
+    alignas( 64 ) _Atomic int64_t top;
+    alignas( 64 ) _Atomic int64_t bottom;
+    alignas( 64 ) struct jobs_slot_ slots[ JOBS_DEQUE_SIZE ];
+};
+
+// a job held back until a counter has nothing pending
+struct jobs_waiting_
+{
+    struct job_counter *after;
+    struct job job;
+};
+
+static struct
+{
+    bool running;
+    int count;
+    struct jobs_deque_ *deques;
+    SDL_Thread *threads[ JOBS_MAX_WORKERS ];
+
+    SDL_atomic_t quit;
+    SDL_atomic_t sleeping;      /* workers about to wait on wake */
+    SDL_sem *wake;
+
+    // jobs from outside the pool and jobs waiting on a counter
+    SDL_mutex *lock;
+    struct job inject[ JOBS_INJECT_SIZE ];
+    int inject_head;
+    SDL_atomic_t inject_len;
+    struct jobs_waiting_ *waiting;
+} pool;
+
+// index of the calling thread in the pool, -1 outside
+static _Thread_local int jobs_worker_ = -1;
+static _Thread_local u32 jobs_random_ = 0;
+
+// threads outside the pool share the slot past the workers, the one holding
+// it may nest parallel_fors
+static SDL_atomic_t jobs_outside_;
+static _Thread_local int jobs_outside_depth_ = 0;
+
+/* ================================== */
+/* deque, only the owner pushes and pops */
+/* ================================== */
+
+static bool jobs_push_( struct jobs_deque_ *d, struct job job )
+{
+    int64_t b = atomic_load_explicit( &d->bottom, memory_order_relaxed );
+    int64_t t = atomic_load_explicit( &d->top, memory_order_acquire );
+    if ( b - t >= JOBS_DEQUE_SIZE )
+        return false;
+
+    struct jobs_slot_ *slot = &d->slots[ b & ( JOBS_DEQUE_SIZE - 1 ) ];
+    atomic_store_explicit( &slot->fn, job.fn, memory_order_relaxed );
+    atomic_store_explicit( &slot->data, job.data, memory_order_relaxed );
+    atomic_store_explicit( &slot->counter, job.counter, memory_order_relaxed );
+
+    atomic_thread_fence( memory_order_release );
+    atomic_store_explicit( &d->bottom, b + 1, memory_order_relaxed );
+    return true;
+}
+
+static inline struct job jobs_slot_read_( struct jobs_slot_ *slot )
+{
+    return ( struct job ) {
+        .fn = atomic_load_explicit( &slot->fn, memory_order_relaxed ),
+        .data = atomic_load_explicit( &slot->data, memory_order_relaxed ),
+        .counter = atomic_load_explicit( &slot->counter, memory_order_relaxed )
+    };
+}
+
+static bool jobs_pop_( struct jobs_deque_ *d, struct job *out )
+{
+    int64_t b = atomic_load_explicit( &d->bottom, memory_order_relaxed ) - 1;
+    atomic_store_explicit( &d->bottom, b, memory_order_relaxed );
+    atomic_thread_fence( memory_order_seq_cst );
+    int64_t t = atomic_load_explicit( &d->top, memory_order_relaxed );
+
+    if ( t > b )
+    {
+        atomic_store_explicit( &d->bottom, b + 1, memory_order_relaxed );
+        return false;
+    }
+
+    *out = jobs_slot_read_( &d->slots[ b & ( JOBS_DEQUE_SIZE - 1 ) ] );
+    if ( t < b )
+        return true;
+
+    // the last job, race the thieves for it
+    bool won = atomic_compare_exchange_strong_explicit( &d->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed );
+    atomic_store_explicit( &d->bottom, b + 1, memory_order_relaxed );
+    return won;
+}
+
+static bool jobs_steal_( struct jobs_deque_ *d, struct job *out )
+{
+    int64_t t = atomic_load_explicit( &d->top, memory_order_acquire );
+    atomic_thread_fence( memory_order_seq_cst );
+    int64_t b = atomic_load_explicit( &d->bottom, memory_order_acquire );
+    if ( t >= b )
+        return false;
+
+    *out = jobs_slot_read_( &d->slots[ t & ( JOBS_DEQUE_SIZE - 1 ) ] );
+    return atomic_compare_exchange_strong_explicit( &d->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed );
+}
+
+/* ================================== */
+/* scheduling */
+/* ================================== */
+
+static bool jobs_find_( struct job *out )
+{
+    if ( jobs_worker_ >= 0 && jobs_pop_( &pool.deques[ jobs_worker_ ], out ) )
+        return true;
+
+    if ( SDL_AtomicGet( &pool.inject_len ) > 0 )
+    {
+        bool found = false;
+        SDL_LockMutex( pool.lock );
+        int len = SDL_AtomicGet( &pool.inject_len );
+        if ( len > 0 )
+        {
+            *out = pool.inject[ pool.inject_head ];
+            pool.inject_head = ( pool.inject_head + 1 ) % JOBS_INJECT_SIZE;
+            SDL_AtomicSet( &pool.inject_len, len - 1 );
+            found = true;
+        }
+        SDL_UnlockMutex( pool.lock );
+        if ( found )
+            return true;
+    }
+
+    // every other worker once, from a random one so thieves spread out
+    jobs_random_ = jobs_random_ * 1664525u + 1013904223u;
+    int start = ( int )( ( jobs_random_ >> 8 ) % ( u32 )pool.count );
+    for ( int i = 0; i < pool.count; i++ )
+    {
+        int victim = ( start + i ) % pool.count;
+        if ( victim != jobs_worker_ && jobs_steal_( &pool.deques[ victim ], out ) )
+            return true;
+    }
+
+    return false;
+}
+
+static void jobs_submit_( struct job job );
+
+// queue every job that was waiting on counter
+static void jobs_release_( struct job_counter *counter )
+{
+    struct job ready[ 32 ];
+    int n;
+
+    do
+    {
+        n = 0;
+        SDL_LockMutex( pool.lock );
+        for ( size_t i = 0; i < dynarr_size( pool.waiting ) && n < 32; )
+        {
+            if ( pool.waiting[ i ].after == counter )
+            {
+                ready[ n++ ] = pool.waiting[ i ].job;
+                pool.waiting[ i ] = pool.waiting[ dynarr_size( pool.waiting ) - 1 ];
+                dynarr_pop_back( pool.waiting );
+            }
+            else
+                i++;
+        }
+        SDL_UnlockMutex( pool.lock );
+
+        for ( int i = 0; i < n; i++ )
+            jobs_submit_( ready[ i ] );
+    }
+    while ( n == 32 );
+}
+
+static void jobs_execute_( struct job job )
+{
+    job.fn( job.data );
+    if ( job.counter && SDL_AtomicAdd( &job.counter->pending, -1 ) == 1 )
+        jobs_release_( job.counter );
+}
+
+static void jobs_submit_( struct job job )
+{
+    if ( !pool.running )
+    {
+        jobs_execute_( job );
+        return;
+    }
+
+    bool queued = false;
+    if ( jobs_worker_ >= 0 )
+        queued = jobs_push_( &pool.deques[ jobs_worker_ ], job );
+    else
+    {
+        SDL_LockMutex( pool.lock );
+        int len = SDL_AtomicGet( &pool.inject_len );
+        if ( len < JOBS_INJECT_SIZE )
+        {
+            pool.inject[ ( pool.inject_head + len ) % JOBS_INJECT_SIZE ] = job;
+            SDL_AtomicSet( &pool.inject_len, len + 1 );
+            queued = true;
+        }
+        SDL_UnlockMutex( pool.lock );
+    }
+
+    // a full queue is no reason to wait, the job just runs here
+    if ( !queued )
+    {
+        jobs_execute_( job );
+        return;
+    }
+
+    // pairs with the increment of sleeping before a worker's last look
+    atomic_thread_fence( memory_order_seq_cst );
+    if ( SDL_AtomicGet( &pool.sleeping ) > 0 )
+        SDL_SemPost( pool.wake );
+}
+
+static int jobs_worker_run_( void *data )
+{
+    jobs_worker_ = ( int )( intptr_t )data;
+    jobs_random_ = ( u32 )jobs_worker_ * 2654435761u + 1;
+
+    while ( !SDL_AtomicGet( &pool.quit ) )
+    {
+        struct job job;
+        if ( jobs_find_( &job ) )
+        {
+            jobs_execute_( job );
+            continue;
+        }
+
+        // announce the sleep before the last look so a submit cannot slip
+        // in between unnoticed, the timeout covers anything else
+        SDL_AtomicAdd( &pool.sleeping, 1 );
+        if ( jobs_find_( &job ) )
+        {
+            SDL_AtomicAdd( &pool.sleeping, -1 );
+            jobs_execute_( job );
+            continue;
+        }
+
+        SDL_SemWaitTimeout( pool.wake, 10 );
+        SDL_AtomicAdd( &pool.sleeping, -1 );
+    }
+
+    return 0;
+}
+
+/* ================================== */
+/* public */
+/* ================================== */
+
+int jobs_init( int workers )
+{
+    if ( pool.running )
+        return JOBS_ERROR;
+
+    if ( workers <= 0 )
+        workers = SDL_GetCPUCount();
+    if ( workers > JOBS_MAX_WORKERS )
+        workers = JOBS_MAX_WORKERS;
+
+    pool.count = workers;
+    pool.inject_head = 0;
+    pool.waiting = NULL;
+    SDL_AtomicSet( &pool.quit, 0 );
+    SDL_AtomicSet( &pool.sleeping, 0 );
+    SDL_AtomicSet( &pool.inject_len, 0 );
+
+    pool.deques = aligned_malloc( alignof( struct jobs_deque_ ), workers * sizeof( struct jobs_deque_ ) );
+    pool.wake = SDL_CreateSemaphore( 0 );
+    pool.lock = SDL_CreateMutex();
+    if ( pool.deques == NULL || pool.wake == NULL || pool.lock == NULL )
+    {
+        log_error( "Unable to create the job system" );
+        aligned_free( pool.deques );
+        SDL_DestroySemaphore( pool.wake );
+        SDL_DestroyMutex( pool.lock );
+        return JOBS_ERROR;
+    }
+
+    for ( int i = 0; i < workers; i++ )
+    {
+        atomic_init( &pool.deques[ i ].top, 0 );
+        atomic_init( &pool.deques[ i ].bottom, 0 );
+    }
+
+    jobs_worker_ = 0;
+    jobs_random_ = 1;
+    pool.running = true;
+
+    for ( int i = 1; i < workers; i++ )
+    {
+        pool.threads[ i ] = SDL_CreateThread( jobs_worker_run_, "worker", ( void * )( intptr_t )i );
+        if ( pool.threads[ i ] == NULL )
+            log_warn( "Unable to create worker thread: %s", SDL_GetError() );
+    }
+
+    log_info( "Started job system with %d workers", workers );
+    return JOBS_SUCCESS;
+}
+
+void jobs_free( void )
+{
+    if ( !pool.running )
+        return;
+
+    SDL_AtomicSet( &pool.quit, 1 );
+    for ( int i = 1; i < pool.count; i++ )
+        SDL_SemPost( pool.wake );
+
+    for ( int i = 1; i < pool.count; i++ )
+    {
+        if ( pool.threads[ i ] )
+            SDL_WaitThread( pool.threads[ i ], NULL );
+        pool.threads[ i ] = NULL;
+    }
+
+    if ( dynarr_size( pool.waiting ) > 0 )
+        log_warn( "Job system stopped with %zu jobs still waiting", dynarr_size( pool.waiting ) );
+
+    dynarr_free( pool.waiting );
+    aligned_free( pool.deques );
+    SDL_DestroySemaphore( pool.wake );
+    SDL_DestroyMutex( pool.lock );
+    pool.deques = NULL;
+    pool.running = false;
+    pool.count = 0;
+    jobs_worker_ = -1;
+}
+
+bool jobs_running( void )
+{
+    return pool.running;
+}
+
+int jobs_worker_count( void )
+{
+    return pool.running ? pool.count : 1;
+}
+
+void jobs_run( job_fn fn, void *data, struct job_counter *counter )
+{
+    if ( counter )
+        SDL_AtomicAdd( &counter->pending, 1 );
+
+    jobs_submit_( ( struct job ){ .fn = fn, .data = data, .counter = counter } );
+}
+
+void jobs_run_after( struct job_counter *after, job_fn fn, void *data, struct job_counter *counter )
+{
+    if ( counter )
+        SDL_AtomicAdd( &counter->pending, 1 );
+
+    struct job job = { .fn = fn, .data = data, .counter = counter };
+    if ( !pool.running || SDL_AtomicGet( &after->pending ) == 0 )
+    {
+        jobs_submit_( job );
+        return;
+    }
+
+    // park it, then look again: the last job of after may have finished (and
+    // released the parked jobs) before this one was parked
+    SDL_LockMutex( pool.lock );
+    dynarr_push_back( pool.waiting, ( ( struct jobs_waiting_ ){ .after = after, .job = job } ) );
+    SDL_UnlockMutex( pool.lock );
+
+    if ( SDL_AtomicGet( &after->pending ) == 0 )
+        jobs_release_( after );
+}
+
+void jobs_wait( struct job_counter *counter )
+{
+    int idle = 0;
+    while ( SDL_AtomicGet( &counter->pending ) > 0 )
+    {
+        struct job job;
+        if ( pool.running && jobs_find_( &job ) )
+        {
+            jobs_execute_( job );
+            idle = 0;
+        }
+        else if ( ++idle > 64 )
+            SDL_Delay( 0 );
+    }
+}
+
+// shared by the chunks of one parallel_for
+struct jobs_for_
+{
+    parallel_fn fn;
+    void *data;
+    size_t count;
+    size_t grain;
+    SDL_atomic_t next;
+};
+
+static inline int jobs_slot_( void )
+{
+    return jobs_worker_ >= 0 ? jobs_worker_ : jobs_worker_count();
+}
+
+static void jobs_outside_claim_( void )
+{
+    if ( jobs_outside_depth_++ > 0 )
+        return;
+
+    int idle = 0;
+    while ( !SDL_AtomicCAS( &jobs_outside_, 0, 1 ) )
+    {
+        if ( ++idle > 64 )
+            SDL_Delay( 0 );
+    }
+}
+
+static void jobs_outside_release_( void )
+{
+    if ( --jobs_outside_depth_ == 0 )
+        SDL_AtomicSet( &jobs_outside_, 0 );
+}
+
+// chunks are handed out in order until none are left, whoever is free takes the next
+static void jobs_for_run_( void *data )
+{
+    struct jobs_for_ *f = data;
+    int slot = jobs_slot_();
+
+    for ( ;; )
+    {
+        size_t begin = ( size_t )SDL_AtomicAdd( &f->next, 1 ) * f->grain;
+        if ( begin >= f->count )
+            break;
+
+        size_t end = begin + f->grain < f->count ? begin + f->grain : f->count;
+        f->fn( begin, end, slot, f->data );
+    }
+}
+
+static void parallel_for_( size_t count, size_t grain, parallel_fn fn, void *data )
+{
+    int workers = jobs_worker_count();
+    if ( grain == 0 )
+        grain = count / ( workers * 4 ) > 0 ? count / ( workers * 4 ) : 1;
+
+    size_t chunks = ( count + grain - 1 ) / grain;
+    if ( !pool.running || chunks == 1 )
+    {
+        fn( 0, count, jobs_slot_(), data );
+        return;
+    }
+
+    struct jobs_for_ f = { .fn = fn, .data = data, .count = count, .grain = grain };
+    SDL_AtomicSet( &f.next, 0 );
+
+    // helpers for the other workers, the caller takes chunks too
+    struct job_counter done = { 0 };
+    size_t helpers = chunks - 1 < ( size_t )workers ? chunks - 1 : ( size_t )workers;
+    for ( size_t i = 0; i < helpers; i++ )
+        jobs_run( jobs_for_run_, &f, &done );
+
+    jobs_for_run_( &f );
+    jobs_wait( &done );
+}
+
+void parallel_for( size_t count, size_t grain, parallel_fn fn, void *data )
+{
+    if ( count == 0 )
+        return;
+
+    // the outside slot is unique too, other outside callers wait their turn
+    if ( jobs_worker_ >= 0 )
+    {
+        parallel_for_( count, grain, fn, data );
+        return;
+    }
+
+    jobs_outside_claim_();
+    parallel_for_( count, grain, fn, data );
+    jobs_outside_release_();
+}
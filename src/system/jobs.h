@@ -0,0 +1,58 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/*
+ * One pool of worker threads for the whole engine. Every worker owns a
+ * Chase-Lev deque: it pushes and pops its own jobs at the bottom without
+ * locks while idle workers steal from the top of the others. Threads outside
+ * the pool hand their jobs over through a small locked queue. Jobs are
+ * grouped by counters that can be waited on (the waiting thread runs jobs
+ * meanwhile) or that other jobs can be made to wait for.
+ */
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JOBS_SUCCESS 0
+#define JOBS_ERROR  -1
+
+#define JOBS_MAX_WORKERS    64
+#define JOBS_DEQUE_SIZE     1024    /* jobs queued per worker, a power of two */
+#define JOBS_INJECT_SIZE    256     /* jobs queued by threads outside the pool */
+
+typedef void ( *job_fn )( void *data );
+
+// a chunk [begin, end) of a parallel_for, slot is in [0, jobs_worker_count()]
+// and unique among the chunks running at once, so it can index per thread
+// results; the last one is for callers outside the pool, which run their
+// parallel_fors one at a time
+typedef void ( *parallel_fn )( size_t begin, size_t end, int slot, void *data );
+
+// jobs still to finish, zero initialize
+struct job_counter
+{
+    SDL_atomic_t pending;
+};
+
+// workers <= 0 uses every core, the calling thread becomes worker 0 and only
+// runs jobs while it waits on a counter
+int  jobs_init( int workers );
+void jobs_free( void );
+
+bool jobs_running( void );
+int  jobs_worker_count( void );     /* 1 when the pool is not running */
+
+// without a running pool jobs run right away on the calling thread
+void jobs_run( job_fn fn, void *data, struct job_counter *counter );
+
+// fn is queued once after has no jobs pending
+void jobs_run_after( struct job_counter *after, job_fn fn, void *data, struct job_counter *counter );
+
+// runs queued jobs until counter has none pending
+void jobs_wait( struct job_counter *counter );
+
+// fn over [0, count) in chunks of grain (0 picks one), returns when all ran
+void parallel_for( size_t count, size_t grain, parallel_fn fn, void *data );
+
+#endif
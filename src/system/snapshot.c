@@ -0,0 +1,62 @@
+#include "snapshot.h"
+#include "../util/log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_FRESH  4
+#define SNAPSHOT_INDEX  3
+
+int snapshot_init( struct snapshot *self, const void *initial, size_t size )
+{
+    *self = ( struct snapshot ){ .size = size, .back = 0, .front = 1 };
+    SDL_AtomicSet( &self->shared, 2 );
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        self->slots[ i ] = malloc( size );
+        if ( self->slots[ i ] == NULL )
+        {
+            log_error( "Unable to allocate snapshot of %zu bytes", size );
+            snapshot_free( self );
+            return SNAPSHOT_ERROR;
+        }
+        memcpy( self->slots[ i ], initial, size );
+    }
+
+    return SNAPSHOT_SUCCESS;
+}
+
+void snapshot_free( struct snapshot *self )
+{
+    for ( int i = 0; i < 3; i++ )
+        free( self->slots[ i ] );
+    *self = ( struct snapshot ){ 0 };
+}
+
+void *snapshot_back( struct snapshot *self )
+{
+    return self->slots[ self->back ];
+}
+
+void snapshot_publish( struct snapshot *self )
+{
+    // the atomic exchange orders the writes to the slot before it
+    int old = SDL_AtomicSet( &self->shared, self->back | SNAPSHOT_FRESH );
+    self->back = old & SNAPSHOT_INDEX;
+}
+
+bool snapshot_acquire( struct snapshot *self )
+{
+    if ( !( SDL_AtomicGet( &self->shared ) & SNAPSHOT_FRESH ) )
+        return false;
+
+    // a publish in between only makes the slot we get newer
+    int old = SDL_AtomicSet( &self->shared, self->front );
+    self->front = old & SNAPSHOT_INDEX;
+    return true;
+}
+
+const void *snapshot_front( const struct snapshot *self )
+{
+    return self->slots[ self->front ];
+}
@@ -0,0 +1,40 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*
+ * Triple buffer handing state from one writer thread to one reader thread
+ * without locks. The writer fills its back slot and publishes it, the reader
+ * takes the latest published slot when it wants one. Neither ever waits for
+ * the other, the reader just skips snapshots it was too slow to see.
+ */
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SNAPSHOT_SUCCESS 0
+#define SNAPSHOT_ERROR  -1
+
+struct snapshot
+{
+    void *slots[ 3 ];
+    size_t size;
+
+    SDL_atomic_t shared;    /* slot between the two, SNAPSHOT_FRESH if unread */
+    int back;               /* owned by the writer */
+    int front;              /* owned by the reader */
+};
+
+// every slot starts as a copy of initial (size bytes)
+int snapshot_init( struct snapshot *self, const void *initial, size_t size );
+void snapshot_free( struct snapshot *self );
+
+// writer: the slot to fill, then publish it
+void *snapshot_back( struct snapshot *self );
+void snapshot_publish( struct snapshot *self );
+
+// reader: moves to the latest published slot, returns false if there was none
+bool snapshot_acquire( struct snapshot *self );
+const void *snapshot_front( const struct snapshot *self );
+
+#endif
@@ -3,6 +3,18 @@
 #include "../util/log.h"
 #include <SDL2/SDL.h>
 
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <direct.h>
+#define SYSTEM_SEPARATOR '\\'
+#else
+#include <sys/stat.h>
+#define SYSTEM_SEPARATOR '/'
+#endif
+
 int system_init( void )
 {
     log_info( "Initializing SDL subsystems" );
@@ -27,3 +39,61 @@ int system_free( void )
     SDL_Quit();
     return SYSTEM_SUCCESS;
 }
+
+// every directory along path, only the last one has to end up existing (the
+// others may be a drive or not ours to create)
+static bool system_mkdirs_( char *path )
+{
+    for ( char *c = path + 1; ; c++ )
+    {
+        if ( *c != SYSTEM_SEPARATOR && *c != '\0' )
+            continue;
+
+        char end = *c;
+        *c = '\0';
+#ifdef _WIN32
+        int err = _mkdir( path );
+#else
+        int err = mkdir( path, 0755 );
+#endif
+        *c = end;
+
+        if ( end == '\0' )
+            return err == 0 || errno == EEXIST;
+    }
+}
+
+const char *system_cache_dir( void )
+{
+    static char dir[ 512 ];
+    if ( dir[ 0 ] )
+        return dir;
+
+    const char *base, *sub;
+#ifdef _WIN32
+    base = getenv( "LOCALAPPDATA" );
+    sub = "";
+#else
+    base = getenv( "XDG_CACHE_HOME" );
+    sub = "";
+    if ( base == NULL || base[ 0 ] == '\0' )
+    {
+        base = getenv( "HOME" );
+        sub = "/.cache";
+    }
+#endif
+    if ( base == NULL || base[ 0 ] == '\0' )
+        return NULL;
+
+    int len = snprintf( dir, sizeof( dir ), "%s%s%craytracer", base, sub, SYSTEM_SEPARATOR );
+    if ( len < 0 || ( size_t )len + 1 >= sizeof( dir ) || !system_mkdirs_( dir ) )
+    {
+        log_warn( "No cache directory at %s", dir );
+        dir[ 0 ] = '\0';
+        return NULL;
+    }
+
+    dir[ len ] = SYSTEM_SEPARATOR;
+    dir[ len + 1 ] = '\0';
+    return dir;
+}
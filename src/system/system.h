@@ -7,4 +7,9 @@
 int system_init( void );
 int system_free( void );
 
+// directory for files the game can rebuild, with a trailing separator and
+// created when missing: $XDG_CACHE_HOME/raytracer/ (~/.cache/raytracer/
+// without it), %LOCALAPPDATA%\raytracer\ on windows; NULL if there is none
+const char *system_cache_dir( void );
+
 #endif
@@ -0,0 +1,496 @@
+#include "bvh.h"
+
+#include <util/log.h>
+#include <util/fmath.h>
+#include <util/aligned.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BVH_NODE_ALIGN 64
+
+// state used while building
+struct bvh_builder_
+{
+    struct bvh *bvh;
+    u32 *idx;           /* triangle indices being partitioned */
+    vec3s *cent;        /* centroid of each triangle */
+    vec3s *bmin;        /* bounds of each triangle */
+    vec3s *bmax;
+};
+
+struct bvh_bin_
+{
+    vec3s min;
+    vec3s max;
+    u32 count;
+};
+
+static inline float bvh_axis_( vec3s v, int axis )
+{
+    return v.raw[ axis ];
+}
+
+static inline float bvh_area_( vec3s min, vec3s max )
+{
+    vec3s e = glms_vec3_sub( max, min );
+    return 2.0f * ( e.x * e.y + e.y * e.z + e.z * e.x );
+}
+
+/* ======================================================== */
+/* --------------------------- */
+/* BUILD                       */
+/* --------------------------- */
+
+// partial sort so idx[ first + k ] holds the k-th smallest centroid on axis
+static void bvh_select_( struct bvh_builder_ *b, u32 first, u32 count, u32 k, int axis )
+{
+    u32 lo = first;
+    u32 hi = first + count - 1;
+    u32 target = first + k;
+
+    while ( lo < hi )
+    {
+        float pivot = bvh_axis_( b->cent[ b->idx[ ( lo + hi ) / 2 ] ], axis );
+        u32 i = lo;
+        u32 j = hi;
+
+        while ( i <= j )
+        {
+            while ( bvh_axis_( b->cent[ b->idx[ i ] ], axis ) < pivot ) i++;
+            while ( bvh_axis_( b->cent[ b->idx[ j ] ], axis ) > pivot ) j--;
+            if ( i <= j )
+            {
+                u32 tmp = b->idx[ i ];
+                b->idx[ i ] = b->idx[ j ];
+                b->idx[ j ] = tmp;
+                i++;
+                if ( j == 0 ) break;
+                j--;
+            }
+        }
+
+        if ( target <= j ) hi = j;
+        else if ( target >= i ) lo = i;
+        else break;
+    }
+}
+
+// find the cheapest binned split, returns its cost or FLT_MAX if there is none
+static float bvh_find_split_( struct bvh_builder_ *b, u32 first, u32 count, vec3s cmin, vec3s cmax, int *out_axis, int *out_bin )
+{
+    float best = FLT_MAX;
+
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+        float lo = bvh_axis_( cmin, axis );
+        float extent = bvh_axis_( cmax, axis ) - lo;
+        if ( extent <= 0.0f )
+            continue;
+
+        struct bvh_bin_ bins[ BVH_BINS ];
+        for ( int i = 0; i < BVH_BINS; i++ )
+        {
+            bins[ i ].min = ( vec3s ){{ FLT_MAX, FLT_MAX, FLT_MAX }};
+            bins[ i ].max = ( vec3s ){{ -FLT_MAX, -FLT_MAX, -FLT_MAX }};
+            bins[ i ].count = 0;
+        }
+
+        float scale = BVH_BINS / extent;
+        for ( u32 i = first; i < first + count; i++ )
+        {
+            u32 t = b->idx[ i ];
+            int bin = min( BVH_BINS - 1, ( int )( ( bvh_axis_( b->cent[ t ], axis ) - lo ) * scale ) );
+            bins[ bin ].min = glms_vec3_minv( bins[ bin ].min, b->bmin[ t ] );
+            bins[ bin ].max = glms_vec3_maxv( bins[ bin ].max, b->bmax[ t ] );
+            bins[ bin ].count++;
+        }
+
+        // sweep from the right and store the cost of everything right of each plane
+        float right_cost[ BVH_BINS ];
+        vec3s rmin = bins[ BVH_BINS - 1 ].min;
+        vec3s rmax = bins[ BVH_BINS - 1 ].max;
+        u32 rcount = 0;
+        for ( int i = BVH_BINS - 1; i > 0; i-- )
+        {
+            rmin = glms_vec3_minv( rmin, bins[ i ].min );
+            rmax = glms_vec3_maxv( rmax, bins[ i ].max );
+            rcount += bins[ i ].count;
+            right_cost[ i ] = rcount ? bvh_area_( rmin, rmax ) * rcount : 0.0f;
+        }
+
+        // sweep from the left and combine
+        vec3s lmin = bins[ 0 ].min;
+        vec3s lmax = bins[ 0 ].max;
+        u32 lcount = 0;
+        for ( int i = 1; i < BVH_BINS; i++ )
+        {
+            lmin = glms_vec3_minv( lmin, bins[ i - 1 ].min );
+            lmax = glms_vec3_maxv( lmax, bins[ i - 1 ].max );
+            lcount += bins[ i - 1 ].count;
+            if ( lcount == 0 || lcount == count )
+                continue;
+
+            float cost = bvh_area_( lmin, lmax ) * lcount + right_cost[ i ];
+            if ( cost < best )
+            {
+                best = cost;
+                *out_axis = axis;
+                *out_bin = i;
+            }
+        }
+    }
+
+    return best;
+}
+
+// move triangles left of the split to the front, returns the left count
+static u32 bvh_partition_( struct bvh_builder_ *b, u32 first, u32 count, vec3s cmin, vec3s cmax, int axis, int split )
+{
+    float lo = bvh_axis_( cmin, axis );
+    float scale = BVH_BINS / ( bvh_axis_( cmax, axis ) - lo );
+    u32 i = first;
+    u32 j = first + count;
+
+    while ( i < j )
+    {
+        int bin = min( BVH_BINS - 1, ( int )( ( bvh_axis_( b->cent[ b->idx[ i ] ], axis ) - lo ) * scale ) );
+        if ( bin < split )
+        {
+            i++;
+        }
+        else
+        {
+            u32 tmp = b->idx[ i ];
+            b->idx[ i ] = b->idx[ --j ];
+            b->idx[ j ] = tmp;
+        }
+    }
+
+    return i - first;
+}
+
+static void bvh_build_node_( struct bvh_builder_ *b, u32 node_idx, u32 first, u32 count, int depth )
+{
+    struct bvh *bvh = b->bvh;
+    vec3s min = {{ FLT_MAX, FLT_MAX, FLT_MAX }};
+    vec3s max = {{ -FLT_MAX, -FLT_MAX, -FLT_MAX }};
+    vec3s cmin = min;
+    vec3s cmax = max;
+
+    for ( u32 i = first; i < first + count; i++ )
+    {
+        u32 t = b->idx[ i ];
+        min = glms_vec3_minv( min, b->bmin[ t ] );
+        max = glms_vec3_maxv( max, b->bmax[ t ] );
+        cmin = glms_vec3_minv( cmin, b->cent[ t ] );
+        cmax = glms_vec3_maxv( cmax, b->cent[ t ] );
+    }
+
+    struct bvh_node *node = &bvh->nodes[ node_idx ];
+    node->min = min;
+    node->max = max;
+
+    // a leaf until proven otherwise
+    node->offset = first;
+    node->count = count;
+    node->axis = 0;
+
+    if ( count <= 2 || depth >= BVH_STACK_SIZE - 1 )
+        return;
+
+    int axis = 0;
+    int split = 0;
+    u32 left = 0;
+    vec3s extent = glms_vec3_sub( cmax, cmin );
+    int widest = extent.x > extent.y ? ( extent.x > extent.z ? 0 : 2 ) : ( extent.y > extent.z ? 1 : 2 );
+
+    // fall back to a median split when the remaining depth could not hold the triangles otherwise
+    int remaining = BVH_STACK_SIZE - 1 - depth;
+    bool median = remaining < 32 && count > ( ( u64 )BVH_LEAF_MAX << remaining );
+
+    if ( !median )
+    {
+        float cost = bvh_find_split_( b, first, count, cmin, cmax, &axis, &split );
+
+        // surface area heuristic, traversal and intersection cost of 1
+        float leaf_cost = ( float )count;
+        float split_cost = 1.0f + cost / bvh_area_( min, max );
+
+        if ( cost == FLT_MAX || split_cost >= leaf_cost )
+        {
+            if ( count <= BVH_LEAF_MAX )
+                return;
+            median = true;
+        }
+        else
+        {
+            left = bvh_partition_( b, first, count, cmin, cmax, axis, split );
+            median = left == 0 || left == count;
+        }
+    }
+
+    if ( median )
+    {
+        axis = widest;
+        left = count / 2;
+        bvh_select_( b, first, count, left, axis );
+    }
+
+    // first child follows its parent, the second comes after the first's subtree
+    u32 left_idx = bvh->node_count++;
+    bvh_build_node_( b, left_idx, first, left, depth + 1 );
+
+    u32 right_idx = bvh->node_count++;
+    bvh_build_node_( b, right_idx, first + left, count - left, depth + 1 );
+
+    node = &bvh->nodes[ node_idx ];
+    node->offset = right_idx;
+    node->count = 0;
+    node->axis = axis;
+}
+
+int bvh_build( struct bvh *self, const struct vert *fv, size_t fv_len )
+{
+    if ( self == NULL || fv == NULL )
+        return 1;
+
+    *self = ( struct bvh ){ 0 };
+    size_t n = fv_len / 3;
+    if ( n == 0 || n > UINT32_MAX / 2 )
+        return 2;
+
+    struct bvh_builder_ b = {
+        .bvh  = self,
+        .idx  = malloc( n * sizeof( *b.idx ) ),
+        .cent = malloc( n * sizeof( *b.cent ) ),
+        .bmin = malloc( n * sizeof( *b.bmin ) ),
+        .bmax = malloc( n * sizeof( *b.bmax ) )
+    };
+
+    self->nodes = aligned_malloc( BVH_NODE_ALIGN, ( 2 * n - 1 ) * sizeof( *self->nodes ) );
+    self->tris = malloc( n * 3 * sizeof( *self->tris ) );
+    self->tri_index = malloc( n * sizeof( *self->tri_index ) );
+
+    int result = 0;
+    if ( !b.idx || !b.cent || !b.bmin || !b.bmax || !self->nodes || !self->tris || !self->tri_index )
+    {
+        log_error( "Unable to allocate bvh for %zu triangles", n );
+        bvh_free( self );
+        result = 3;
+        goto cleanup_;
+    }
+
+    for ( size_t i = 0; i < n; i++ )
+    {
+        const struct vert *t = &fv[ i * 3 ];
+        b.idx[ i ] = i;
+        b.bmin[ i ] = glms_vec3_minv( t[ 0 ].vp, glms_vec3_minv( t[ 1 ].vp, t[ 2 ].vp ) );
+        b.bmax[ i ] = glms_vec3_maxv( t[ 0 ].vp, glms_vec3_maxv( t[ 1 ].vp, t[ 2 ].vp ) );
+        b.cent[ i ] = glms_vec3_scale( glms_vec3_add( b.bmin[ i ], b.bmax[ i ] ), 0.5f );
+    }
+
+    self->node_count = 1;
+    bvh_build_node_( &b, 0, 0, n, 0 );
+
+    // store triangles in leaf order
+    self->tri_count = n;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        self->tri_index[ i ] = b.idx[ i ];
+        memcpy( &self->tris[ i * 3 ], &fv[ b.idx[ i ] * 3 ], 3 * sizeof( *fv ) );
+    }
+
+cleanup_:
+    free( b.idx );
+    free( b.cent );
+    free( b.bmin );
+    free( b.bmax );
+
+    return result;
+}
+
+void bvh_free( struct bvh *self )
+{
+    aligned_free( self->nodes );
+    free( self->tris );
+    free( self->tri_index );
+    *self = ( struct bvh ){ 0 };
+}
+
+/* ======================================================== */
+
+/* ======================================================== */
+/* --------------------------- */
+/* TRAVERSAL                   */
+/* --------------------------- */
+
+// slab test, nan from 0 * inf is ignored by fminf and fmaxf
+static inline bool bvh_hit_box_( const struct bvh_node *node, vec3s orig, vec3s inv, float tmax )
+{
+    float tx1 = ( node->min.x - orig.x ) * inv.x;
+    float tx2 = ( node->max.x - orig.x ) * inv.x;
+    float ty1 = ( node->min.y - orig.y ) * inv.y;
+    float ty2 = ( node->max.y - orig.y ) * inv.y;
+    float tz1 = ( node->min.z - orig.z ) * inv.z;
+    float tz2 = ( node->max.z - orig.z ) * inv.z;
+
+    float tnear = fmaxf( fmaxf( fminf( tx1, tx2 ), fminf( ty1, ty2 ) ), fminf( tz1, tz2 ) );
+    float tfar  = fminf( fminf( fmaxf( tx1, tx2 ), fmaxf( ty1, ty2 ) ), fmaxf( tz1, tz2 ) );
+
+    return tfar >= fmaxf( tnear, 0.0f ) && tnear < tmax;
+}
+
+// closest hit, or with any set the first hit found in any order
+static inline bool bvh_traverse_( const struct bvh *self, struct ray ray, float tmax, struct bvh_hit *hit, bool any )
+{
+    if ( self->node_count == 0 )
+        return false;
+
+    vec3s inv = {{ 1.0f / ray.dir.x, 1.0f / ray.dir.y, 1.0f / ray.dir.z }};
+    u32 stack[ BVH_STACK_SIZE ];
+    int sp = 0;
+    u32 idx = 0;
+    bool found = false;
+
+    for ( ;; )
+    {
+        const struct bvh_node *node = &self->nodes[ idx ];
+
+        if ( bvh_hit_box_( node, ray.orig, inv, tmax ) )
+        {
+            if ( node->count == 0 )
+            {
+                // visit the child on the near side of the split first
+                u32 near = idx + 1;
+                u32 far = node->offset;
+                if ( ray.dir.raw[ node->axis ] < 0.0f )
+                {
+                    near = node->offset;
+                    far = idx + 1;
+                }
+
+                stack[ sp++ ] = far;
+                idx = near;
+                continue;
+            }
+
+            for ( u32 i = node->offset; i < node->offset + node->count; i++ )
+            {
+                float dist, u, v;
+                if ( trace_intersect_tri( ray, &self->tris[ i * 3 ], &dist, &u, &v ) && dist < tmax )
+                {
+                    if ( any )
+                        return true;
+
+                    tmax = dist;
+                    *hit = ( struct bvh_hit ){ .dist = dist, .u = u, .v = v, .tri = i };
+                    found = true;
+                }
+            }
+        }
+
+        if ( sp == 0 )
+            break;
+        idx = stack[ --sp ];
+    }
+
+    return found;
+}
+
+bool bvh_intersect( const struct bvh *self, struct ray ray, float tmax, struct bvh_hit *hit )
+{
+    return bvh_traverse_( self, ray, tmax, hit, false );
+}
+
+bool bvh_occluded( const struct bvh *self, struct ray ray, float tmax )
+{
+    return bvh_traverse_( self, ray, tmax, NULL, true );
+}
+
+// with any set lanes drop out at their first hit and it stops once all have
+static inline void bvh_traverse_packet_( const struct bvh *self, const struct packet_kernels *k, struct ray_packet *p, i32 base, bool any )
+{
+    if ( self->node_count == 0 || p->active == 0 )
+        return;
+
+    float ix[ PACKET_SIZE ], iy[ PACKET_SIZE ], iz[ PACKET_SIZE ];
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+    {
+        ix[ i ] = 1.0f / p->dx[ i ];
+        iy[ i ] = 1.0f / p->dy[ i ];
+        iz[ i ] = 1.0f / p->dz[ i ];
+    }
+
+    // packets are coherent, order children by the first active lane
+    int lead = __builtin_ctz( p->active );
+    float dir[ 3 ] = { p->dx[ lead ], p->dy[ lead ], p->dz[ lead ] };
+
+    u32 active = p->active;
+    u32 stack[ BVH_STACK_SIZE ];
+    int sp = 0;
+    u32 idx = 0;
+
+    for ( ;; )
+    {
+        const struct bvh_node *node = &self->nodes[ idx ];
+
+        // lanes that enter this node, the rest are masked out of the leaf tests
+        u32 mask = 0;
+        for ( u32 bits = active; bits; bits &= bits - 1 )
+        {
+            int i = __builtin_ctz( bits );
+            vec3s orig = {{ p->ox[ i ], p->oy[ i ], p->oz[ i ] }};
+            vec3s inv = {{ ix[ i ], iy[ i ], iz[ i ] }};
+            if ( bvh_hit_box_( node, orig, inv, p->t[ i ] ) )
+                mask |= 1u << i;
+        }
+
+        if ( mask )
+        {
+            if ( node->count == 0 )
+            {
+                u32 near = idx + 1;
+                u32 far = node->offset;
+                if ( dir[ node->axis ] < 0.0f )
+                {
+                    near = node->offset;
+                    far = idx + 1;
+                }
+
+                stack[ sp++ ] = far;
+                idx = near;
+                continue;
+            }
+
+            p->active = mask;
+            for ( u32 i = node->offset; i < node->offset + node->count; i++ )
+                k->hit_tri( p, &self->tris[ i * 3 ], base + ( i32 )i );
+
+            if ( any )
+                active &= ~packet_hits( p );
+
+            p->active = active;
+            if ( active == 0 )
+                break;
+        }
+
+        if ( sp == 0 )
+            break;
+        idx = stack[ --sp ];
+    }
+}
+
+void bvh_intersect_packet( const struct bvh *self, const struct packet_kernels *k, struct ray_packet *p, i32 base )
+{
+    bvh_traverse_packet_( self, k, p, base, false );
+}
+
+void bvh_occluded_packet( const struct bvh *self, const struct packet_kernels *k, struct ray_packet *p )
+{
+    bvh_traverse_packet_( self, k, p, 0, true );
+}
+
+/* ======================================================== */
@@ -0,0 +1,66 @@
+#ifndef BVH_H
+#define BVH_H
+
+/*
+ * Bounding volume hierarchy over a triangle soup (obj3d.fv). Built top down
+ * with a binned surface area heuristic into a flat node array in depth
+ * first order: the first child of an interior node always follows it
+ * directly, only the index of the second child is stored.
+ */
+
+#include "trace.h"
+#include "packet.h"
+#include <util/types.h>
+#include <stdbool.h>
+
+#define BVH_BINS         16
+#define BVH_LEAF_MAX     8
+#define BVH_STACK_SIZE   32   /* also the max depth of the tree */
+
+// 32 bytes, two nodes per cache line
+struct bvh_node
+{
+    vec3s min;
+    u32 offset;     /* leaf: first triangle, interior: second child */
+    vec3s max;
+    u16 count;      /* triangles in a leaf, 0 for interior nodes */
+    u16 axis;       /* split axis of an interior node */
+};
+
+struct bvh
+{
+    // cache aligned node array, nodes[ 0 ] is the root
+    struct bvh_node *nodes;
+    size_t node_count;
+
+    // triangles reordered so every leaf is contiguous (3 verts each)
+    struct vert *tris;
+    u32 *tri_index;     /* original triangle of each reordered triangle */
+    size_t tri_count;
+};
+
+struct bvh_hit
+{
+    float dist;
+    float u;
+    float v;
+    u32 tri;            /* index into bvh.tris */
+};
+
+// fv holds fv_len / 3 triangles, returns 0 on success
+int  bvh_build( struct bvh *self, const struct vert *fv, size_t fv_len );
+void bvh_free( struct bvh *self );
+
+// closest hit nearer than tmax
+bool bvh_intersect( const struct bvh *self, struct ray ray, float tmax, struct bvh_hit *hit );
+
+// true at the first hit nearer than tmax, for shadow rays
+bool bvh_occluded( const struct bvh *self, struct ray ray, float tmax );
+
+// closest hit of every active lane, hits get id base + triangle
+void bvh_intersect_packet( const struct bvh *self, const struct packet_kernels *k, struct ray_packet *p, i32 base );
+
+// any hit nearer than p->t, lanes that hit are cleared from p->active
+void bvh_occluded_packet( const struct bvh *self, const struct packet_kernels *k, struct ray_packet *p );
+
+#endif
@@ -0,0 +1,152 @@
+#include "denoise.h"
+
+#include <system/jobs.h>
+#include <util/log.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// taps weighted below e^-20 are skipped
+#define DENOISE_MAX_EXPONENT 20.0f
+
+// B3 spline taps by distance from the center, 1/16 ( 1 4 6 4 1 ) on each axis
+static const float denoise_kernel_[ 3 ] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+// one pass from src to dst, split into rows
+struct denoise_job_
+{
+    const vec3s *src;
+    vec3s *dst;
+    const struct trace_guide *guide;
+    int w;
+    int h;
+    int step;
+    float inv_color;    /* 1 / sigma^2 */
+    float inv_normal;
+    float sigma_depth;
+};
+
+// same as weight() in res/shaders/atrous/frag.glsl, plain floats since this
+// runs 25 times per pixel and pass
+static inline float denoise_weight_( const struct denoise_job_ *job, vec3s c, const struct trace_guide *g,
+                                     vec3s qc, const struct trace_guide *qg )
+{
+    float dr = c.x - qc.x, dg = c.y - qc.y, db = c.z - qc.z;
+    float nx = g->normal.x - qg->normal.x, ny = g->normal.y - qg->normal.y, nz = g->normal.z - qg->normal.z;
+    float dz = ( g->depth - qg->depth ) / ( job->sigma_depth * g->depth + TRACE_EPSILON );
+
+    float e = ( dr * dr + dg * dg + db * db ) * job->inv_color + ( nx * nx + ny * ny + nz * nz ) * job->inv_normal + dz * dz;
+
+    // tiny weights are denormals which are slow to sum and do not change the result
+    return e < DENOISE_MAX_EXPONENT ? expf( -e ) : 0.0f;
+}
+
+static void denoise_rows_( size_t begin, size_t end, int slot, void *data )
+{
+    ( void )slot;
+    const struct denoise_job_ *job = data;
+
+    for ( int y = ( int )begin; y < ( int )end; y++ )
+    {
+        for ( int x = 0; x < job->w; x++ )
+        {
+            int p = y * job->w + x;
+            vec3s c = job->src[ p ];
+            float r = 0.0f, g = 0.0f, b = 0.0f, weights = 0.0f;
+
+            for ( int ky = -2; ky <= 2; ky++ )
+            {
+                int qy = y + ky * job->step;
+                if ( qy < 0 || qy >= job->h )
+                    continue;
+
+                for ( int kx = -2; kx <= 2; kx++ )
+                {
+                    int qx = x + kx * job->step;
+                    if ( qx < 0 || qx >= job->w )
+                        continue;
+
+                    int q = qy * job->w + qx;
+                    vec3s qc = job->src[ q ];
+                    float w = denoise_kernel_[ abs( kx ) ] * denoise_kernel_[ abs( ky ) ] *
+                              denoise_weight_( job, c, &job->guide[ p ], qc, &job->guide[ q ] );
+
+                    r += qc.x * w;
+                    g += qc.y * w;
+                    b += qc.z * w;
+                    weights += w;
+                }
+            }
+
+            // the center always has some weight
+            job->dst[ p ] = ( vec3s ){{ r / weights, g / weights, b / weights }};
+        }
+    }
+}
+
+void denoise_params_init( struct denoise_params *self )
+{
+    *self = ( struct denoise_params ){
+        .passes       = DENOISE_PASSES,
+        .sigma_color  = DENOISE_SIGMA_COLOR,
+        .sigma_normal = DENOISE_SIGMA_NORMAL,
+        .sigma_depth  = DENOISE_SIGMA_DEPTH
+    };
+}
+
+float denoise_sigma_color( const struct denoise_params *self, u32 frames )
+{
+    return self->sigma_color / sqrtf( ( float )( frames > 1 ? frames : 1 ) );
+}
+
+int denoise_image( vec3s *pixels, const struct trace_guide *guide, int w, int h,
+                   const struct denoise_params *params, u32 frames, int thread_count )
+{
+    if ( pixels == NULL || guide == NULL || params == NULL || w <= 0 || h <= 0 )
+        return DENOISE_ERROR;
+
+    if ( params->passes <= 0 )
+        return DENOISE_SUCCESS;
+
+    vec3s *scratch = malloc( ( size_t )w * h * sizeof( *scratch ) );
+    if ( scratch == NULL )
+    {
+        log_error( "Unable to allocate %dx%d denoise buffer", w, h );
+        return DENOISE_ERROR;
+    }
+
+    struct denoise_job_ job = {
+        .src         = pixels,
+        .dst         = scratch,
+        .guide       = guide,
+        .w           = w,
+        .h           = h,
+        .inv_normal  = 1.0f / ( params->sigma_normal * params->sigma_normal ),
+        .sigma_depth = params->sigma_depth
+    };
+
+    float sigma_color = denoise_sigma_color( params, frames );
+    for ( int pass = 0; pass < params->passes; pass++ )
+    {
+        job.step = 1 << pass;
+        job.inv_color = 1.0f / ( sigma_color * sigma_color );
+
+        if ( thread_count == 1 )
+            denoise_rows_( 0, ( size_t )h, 0, &job );
+        else
+            parallel_for( ( size_t )h, 4, denoise_rows_, &job );
+
+        // the output of a pass is the input of the next
+        job.src = job.dst;
+        job.dst = job.dst == scratch ? pixels : scratch;
+        sigma_color *= 0.5f;
+    }
+
+    if ( job.src != pixels )
+        memcpy( pixels, job.src, ( size_t )w * h * sizeof( *pixels ) );
+
+    free( scratch );
+
+    return DENOISE_SUCCESS;
+}
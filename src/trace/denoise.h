@@ -0,0 +1,45 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+/*
+ * Edge-aware a-trous wavelet filter (Dammertz et al. 2010) for frames with
+ * few samples per pixel. Every pass blurs with a 5x5 B3 spline kernel whose
+ * taps are spread 1, 2, 4 .. pixels apart, weighted down where the color,
+ * the normal or the depth of the first hit (trace_guide) differs from the
+ * center pixel so edges stay sharp. The GPU pass in res/shaders/atrous
+ * computes the same weights, keep the two in sync.
+ */
+
+#include "trace.h"
+#include <util/types.h>
+#include <cglm/struct.h>
+
+#define DENOISE_SUCCESS  0
+#define DENOISE_ERROR   -1
+
+// defaults of denoise_params_init
+#define DENOISE_PASSES        5
+#define DENOISE_SIGMA_COLOR   0.45f
+#define DENOISE_SIGMA_NORMAL  0.3f
+#define DENOISE_SIGMA_DEPTH   0.2f
+
+struct denoise_params
+{
+    int passes;             /* 0 leaves the image as it is */
+    float sigma_color;      /* of a single sample, halved after every pass */
+    float sigma_normal;
+    float sigma_depth;      /* relative to the depth of the center pixel */
+};
+
+void denoise_params_init( struct denoise_params *self );
+
+// sigma_color for an average over frames samples, its noise falls with their square root
+float denoise_sigma_color( const struct denoise_params *self, u32 frames );
+
+// filter a w x h image that averages frames samples in place, guided by the
+// first hit of every pixel, thread_count 1 runs on the calling thread only
+// and anything else on the job system (system/jobs.h)
+int denoise_image( vec3s *pixels, const struct trace_guide *guide, int w, int h,
+                   const struct denoise_params *params, u32 frames, int thread_count );
+
+#endif
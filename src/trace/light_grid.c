@@ -0,0 +1,166 @@
+#include "light_grid.h"
+#include "scene.h"
+#include "trace.h"
+
+#include <util/log.h>
+#include <math.h>
+#include <stdlib.h>
+
+// span of tiles a light overlaps along one axis, empty if first > last
+struct light_grid_span_
+{
+    int first;
+    int last;
+};
+
+// the planes through the eye and the tile edges at e0 and e1 (view plane
+// offsets along the axis) against a sphere at c (c_axis, c_depth) in view space
+static struct light_grid_span_ light_grid_span_( float c_axis, float c_depth, float r, int tiles,
+        int tile_size, int pixels, float half_dim, float pixel_size )
+{
+    struct light_grid_span_ span = { .first = tiles, .last = -1 };
+
+    for ( int i = 0; i < tiles; i++ )
+    {
+        float e0 = -half_dim + ( float )( i * tile_size ) * pixel_size;
+        float e1 = -half_dim + ( float )( ( i + 1 ) * tile_size < pixels ? ( i + 1 ) * tile_size : pixels ) * pixel_size;
+
+        // signed distances to the planes, positive inside the tile
+        float d0 = ( c_axis + e0 * c_depth ) / sqrtf( 1.0f + e0 * e0 );
+        float d1 = ( -c_axis - e1 * c_depth ) / sqrtf( 1.0f + e1 * e1 );
+
+        if ( d0 >= -r && d1 >= -r )
+        {
+            if ( span.first > i )
+                span.first = i;
+            span.last = i;
+        }
+    }
+
+    return span;
+}
+
+static int light_grid_reserve_( struct light_grid *self, size_t len )
+{
+    if ( len <= self->cap )
+        return 0;
+
+    size_t cap = self->cap ? self->cap : 1024;
+    while ( cap < len )
+        cap *= 2;
+
+    u32 *data = realloc( self->data, cap * sizeof( *data ) );
+    if ( data == NULL )
+    {
+        log_error( "Unable to allocate a light grid of %zu entries", len );
+        return 1;
+    }
+
+    self->data = data;
+    self->cap = cap;
+    return 0;
+}
+
+int light_grid_build( struct light_grid *self, const struct scene *scene, int w, int h )
+{
+    struct trace_context ctx;
+    trace_context_init( &ctx, scene, w, h );
+
+    self->tile_size = LIGHT_GRID_TILE;
+    self->tiles_x = ( w + LIGHT_GRID_TILE - 1 ) / LIGHT_GRID_TILE;
+    self->tiles_y = ( h + LIGHT_GRID_TILE - 1 ) / LIGHT_GRID_TILE;
+
+    size_t tile_count = ( size_t )self->tiles_x * self->tiles_y;
+    u32 light_count = scene->light_count;
+    struct light_grid_span_ ( *spans )[ 2 ] = malloc( ( light_count + 1 ) * sizeof( *spans ) );
+    if ( spans == NULL || light_grid_reserve_( self, tile_count * 2 ) )
+    {
+        free( spans );
+        return 1;
+    }
+
+    // first count the lights of every tile
+    for ( size_t t = 0; t < tile_count; t++ )
+        self->data[ t * 2 + 1 ] = 0;
+
+    size_t total = 0;
+    for ( u32 l = 0; l < light_count; l++ )
+    {
+        const struct scene_light *light = &scene->lights[ l ];
+        vec3s d = glms_vec3_sub( light->pos, scene->camera.eye );
+        vec3s c = {{ glms_vec3_dot( d, ctx.cam_u ), glms_vec3_dot( d, ctx.cam_v ), glms_vec3_dot( d, ctx.cam_w ) }};
+
+        // a little larger so hits right at the reach are not culled by rounding
+        float r = light->reach * 1.001f;
+
+        spans[ l ][ 0 ] = spans[ l ][ 1 ] = ( struct light_grid_span_ ){ .first = 1, .last = 0 };
+
+        // entirely behind the camera, which looks down -w
+        if ( c.z >= r )
+            continue;
+
+        spans[ l ][ 0 ] = light_grid_span_( c.x, c.z, r, self->tiles_x, LIGHT_GRID_TILE, w, ctx.window_dim.x * 0.5f, ctx.pixel_size.x );
+        spans[ l ][ 1 ] = light_grid_span_( c.y, c.z, r, self->tiles_y, LIGHT_GRID_TILE, h, ctx.window_dim.y * 0.5f, ctx.pixel_size.y );
+
+        for ( int ty = spans[ l ][ 1 ].first; ty <= spans[ l ][ 1 ].last; ty++ )
+        {
+            for ( int tx = spans[ l ][ 0 ].first; tx <= spans[ l ][ 0 ].last; tx++ )
+            {
+                self->data[ ( ty * self->tiles_x + tx ) * 2 + 1 ]++;
+                total++;
+            }
+        }
+    }
+
+    if ( light_grid_reserve_( self, tile_count * 2 + total ) )
+    {
+        free( spans );
+        return 1;
+    }
+
+    // then lay the lists out after the headers
+    u32 offset = ( u32 )( tile_count * 2 );
+    for ( size_t t = 0; t < tile_count; t++ )
+    {
+        self->data[ t * 2 ] = offset;
+        offset += self->data[ t * 2 + 1 ];
+        self->data[ t * 2 + 1 ] = 0;
+    }
+
+    // and fill them in light order, every list ends up sorted
+    for ( u32 l = 0; l < light_count; l++ )
+    {
+        for ( int ty = spans[ l ][ 1 ].first; ty <= spans[ l ][ 1 ].last; ty++ )
+        {
+            for ( int tx = spans[ l ][ 0 ].first; tx <= spans[ l ][ 0 ].last; tx++ )
+            {
+                u32 *header = &self->data[ ( ty * self->tiles_x + tx ) * 2 ];
+                self->data[ header[ 0 ] + header[ 1 ]++ ] = l;
+            }
+        }
+    }
+
+    self->len = tile_count * 2 + total;
+    free( spans );
+
+    return 0;
+}
+
+void light_grid_free( struct light_grid *self )
+{
+    free( self->data );
+    *self = ( struct light_grid ){ 0 };
+}
+
+const u32 *light_grid_lights( const struct light_grid *self, int x, int y, u32 *count )
+{
+    const u32 *header = &self->data[ ( ( y / self->tile_size ) * self->tiles_x + x / self->tile_size ) * 2 ];
+    *count = header[ 1 ];
+    return &self->data[ header[ 0 ] ];
+}
+
+float light_grid_lights_per_tile( const struct light_grid *self )
+{
+    size_t tile_count = ( size_t )self->tiles_x * self->tiles_y;
+    return tile_count ? ( float )( self->len - tile_count * 2 ) / ( float )tile_count : 0.0f;
+}
@@ -0,0 +1,40 @@
+#ifndef LIGHT_GRID_H
+#define LIGHT_GRID_H
+
+/*
+ * Tiled light culling. The screen is split into LIGHT_GRID_TILE pixel
+ * tiles and every tile gets the list of lights whose reach overlaps the
+ * frustum of the tile, so the shader only shades the lights that can reach
+ * a primary hit. Laid out for the light_tiles buffer of frag.glsl: an
+ * ( offset, count ) pair for every tile followed by the light indices.
+ */
+
+#include <util/types.h>
+#include <stddef.h>
+
+#define LIGHT_GRID_TILE 16
+
+struct scene;
+
+struct light_grid
+{
+    int tile_size;
+    int tiles_x;    /* tiles are numbered from the bottom left like gl_FragCoord */
+    int tiles_y;
+
+    u32 *data;
+    size_t len;     /* u32s used in data */
+    size_t cap;
+};
+
+// cull the lights of the scene for a w x h frame, returns 0 on success
+int  light_grid_build( struct light_grid *self, const struct scene *scene, int w, int h );
+void light_grid_free( struct light_grid *self );
+
+// lights of the tile holding pixel ( x, y ), y counts from the bottom
+const u32 *light_grid_lights( const struct light_grid *self, int x, int y, u32 *count );
+
+// average list length over all tiles
+float light_grid_lights_per_tile( const struct light_grid *self );
+
+#endif
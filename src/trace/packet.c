@@ -0,0 +1,465 @@
+#include "packet.h"
+#include "bvh.h"
+
+#include <util/fmath.h>
+#include <math.h>
+#include <string.h>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define PACKET_X86
+#include <immintrin.h>
+#endif
+
+// primitive id of the ground plane
+#define PACKET_PLANE_ID  0
+
+// spheres are numbered by slot from here on, then the triangles of one mesh
+// after the other
+#define PACKET_SPHERE_ID 1
+
+/* ======================================================== */
+/* --------------------------- */
+/* KERNELS                     */
+/* --------------------------- */
+
+/* scalar fallback, one lane at a time */
+#define PK_NAME             "scalar"
+#define PK_FN( n )          packet_scalar_##n
+#define PK_WIDTH            1
+#define PK_LANES            0x1u
+#define PK_F                float
+#define PK_I                i32
+#define PK_M                int
+#define PK_LOAD( p )        ( *( p ) )
+#define PK_LOADI( p )       ( *( p ) )
+#define PK_STORE( p, v )    ( *( p ) = ( v ) )
+#define PK_STOREI( p, v )   ( *( p ) = ( v ) )
+#define PK_SET1( x )        ( x )
+#define PK_SET1I( x )       ( x )
+#define PK_ADD( a, b )      ( ( a ) + ( b ) )
+#define PK_SUB( a, b )      ( ( a ) - ( b ) )
+#define PK_MUL( a, b )      ( ( a ) * ( b ) )
+#define PK_DIV( a, b )      ( ( a ) / ( b ) )
+#define PK_SQRT( a )        sqrtf( a )
+#define PK_ABS( a )         fabsf( a )
+#define PK_LT( a, b )       ( ( a ) < ( b ) )
+#define PK_GT( a, b )       ( ( a ) > ( b ) )
+#define PK_GE( a, b )       ( ( a ) >= ( b ) )
+#define PK_MAND( a, b )     ( ( a ) && ( b ) )
+#define PK_SELECT( m, a, b )  ( ( m ) ? ( a ) : ( b ) )
+#define PK_SELECTI( m, a, b ) ( ( m ) ? ( a ) : ( b ) )
+#define PK_BITS( m )        ( ( u32 )( m ) )
+#define PK_FROM_BITS( b )   ( ( b ) != 0 )
+#define PK_LEAVE()          ( ( void )0 )
+#include "packet_kernel.h"
+
+#ifdef PACKET_X86
+
+/* sse2, 4 lanes */
+#pragma GCC push_options
+#pragma GCC target( "sse2" )
+#define PK_NAME             "sse"
+#define PK_FN( n )          packet_sse_##n
+#define PK_WIDTH            4
+#define PK_LANES            0xfu
+#define PK_F                __m128
+#define PK_I                __m128
+#define PK_M                __m128
+#define PK_LOAD( p )        _mm_load_ps( p )
+#define PK_LOADI( p )       _mm_load_ps( ( const float * )( p ) )
+#define PK_STORE( p, v )    _mm_store_ps( p, v )
+#define PK_STOREI( p, v )   _mm_store_ps( ( float * )( p ), v )
+#define PK_SET1( x )        _mm_set1_ps( x )
+#define PK_SET1I( x )       _mm_castsi128_ps( _mm_set1_epi32( x ) )
+#define PK_ADD( a, b )      _mm_add_ps( a, b )
+#define PK_SUB( a, b )      _mm_sub_ps( a, b )
+#define PK_MUL( a, b )      _mm_mul_ps( a, b )
+#define PK_DIV( a, b )      _mm_div_ps( a, b )
+#define PK_SQRT( a )        _mm_sqrt_ps( a )
+#define PK_ABS( a )         _mm_andnot_ps( _mm_set1_ps( -0.0f ), a )
+#define PK_LT( a, b )       _mm_cmplt_ps( a, b )
+#define PK_GT( a, b )       _mm_cmpgt_ps( a, b )
+#define PK_GE( a, b )       _mm_cmpge_ps( a, b )
+#define PK_MAND( a, b )     _mm_and_ps( a, b )
+#define PK_SELECT( m, a, b )  _mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) )
+#define PK_SELECTI( m, a, b ) PK_SELECT( m, a, b )
+#define PK_BITS( m )        ( ( u32 )_mm_movemask_ps( m ) )
+#define PK_FROM_BITS( b )   _mm_castsi128_ps( _mm_cmpeq_epi32( \
+                                _mm_and_si128( _mm_set1_epi32( ( int )( b ) ), _mm_setr_epi32( 1, 2, 4, 8 ) ), \
+                                _mm_setr_epi32( 1, 2, 4, 8 ) ) )
+#define PK_LEAVE()          ( ( void )0 )
+#include "packet_kernel.h"
+#pragma GCC pop_options
+
+/* avx2, 8 lanes */
+#pragma GCC push_options
+#pragma GCC target( "avx2" )
+#define PK_NAME             "avx2"
+#define PK_FN( n )          packet_avx2_##n
+#define PK_WIDTH            8
+#define PK_LANES            0xffu
+#define PK_F                __m256
+#define PK_I                __m256
+#define PK_M                __m256
+#define PK_LOAD( p )        _mm256_load_ps( p )
+#define PK_LOADI( p )       _mm256_load_ps( ( const float * )( p ) )
+#define PK_STORE( p, v )    _mm256_store_ps( p, v )
+#define PK_STOREI( p, v )   _mm256_store_ps( ( float * )( p ), v )
+#define PK_SET1( x )        _mm256_set1_ps( x )
+#define PK_SET1I( x )       _mm256_castsi256_ps( _mm256_set1_epi32( x ) )
+#define PK_ADD( a, b )      _mm256_add_ps( a, b )
+#define PK_SUB( a, b )      _mm256_sub_ps( a, b )
+#define PK_MUL( a, b )      _mm256_mul_ps( a, b )
+#define PK_DIV( a, b )      _mm256_div_ps( a, b )
+#define PK_SQRT( a )        _mm256_sqrt_ps( a )
+#define PK_ABS( a )         _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), a )
+#define PK_LT( a, b )       _mm256_cmp_ps( a, b, _CMP_LT_OQ )
+#define PK_GT( a, b )       _mm256_cmp_ps( a, b, _CMP_GT_OQ )
+#define PK_GE( a, b )       _mm256_cmp_ps( a, b, _CMP_GE_OQ )
+#define PK_MAND( a, b )     _mm256_and_ps( a, b )
+#define PK_SELECT( m, a, b )  _mm256_blendv_ps( b, a, m )
+#define PK_SELECTI( m, a, b ) PK_SELECT( m, a, b )
+#define PK_BITS( m )        ( ( u32 )_mm256_movemask_ps( m ) )
+#define PK_FROM_BITS( b )   _mm256_castsi256_ps( _mm256_cmpeq_epi32( \
+                                _mm256_and_si256( _mm256_set1_epi32( ( int )( b ) ), _mm256_setr_epi32( 1, 2, 4, 8, 16, 32, 64, 128 ) ), \
+                                _mm256_setr_epi32( 1, 2, 4, 8, 16, 32, 64, 128 ) ) )
+/* the compiler only clears the upper halves itself when optimizing, sse code
+   after a dirty ymm state (expf and friends) runs many times slower */
+#define PK_LEAVE()          _mm256_zeroupper()
+#include "packet_kernel.h"
+#pragma GCC pop_options
+
+/* avx512, 16 lanes */
+#pragma GCC push_options
+#pragma GCC target( "avx512f" )
+#define PK_NAME             "avx512"
+#define PK_FN( n )          packet_avx512_##n
+#define PK_WIDTH            16
+#define PK_LANES            0xffffu
+#define PK_F                __m512
+#define PK_I                __m512
+#define PK_M                __mmask16
+#define PK_LOAD( p )        _mm512_load_ps( p )
+#define PK_LOADI( p )       _mm512_load_ps( ( const float * )( p ) )
+#define PK_STORE( p, v )    _mm512_store_ps( p, v )
+#define PK_STOREI( p, v )   _mm512_store_ps( ( float * )( p ), v )
+#define PK_SET1( x )        _mm512_set1_ps( x )
+#define PK_SET1I( x )       _mm512_castsi512_ps( _mm512_set1_epi32( x ) )
+#define PK_ADD( a, b )      _mm512_add_ps( a, b )
+#define PK_SUB( a, b )      _mm512_sub_ps( a, b )
+#define PK_MUL( a, b )      _mm512_mul_ps( a, b )
+#define PK_DIV( a, b )      _mm512_div_ps( a, b )
+#define PK_SQRT( a )        _mm512_sqrt_ps( a )
+#define PK_ABS( a )         _mm512_abs_ps( a )
+#define PK_LT( a, b )       _mm512_cmp_ps_mask( a, b, _CMP_LT_OQ )
+#define PK_GT( a, b )       _mm512_cmp_ps_mask( a, b, _CMP_GT_OQ )
+#define PK_GE( a, b )       _mm512_cmp_ps_mask( a, b, _CMP_GE_OQ )
+#define PK_MAND( a, b )     ( ( __mmask16 )( ( a ) & ( b ) ) )
+#define PK_SELECT( m, a, b )  _mm512_mask_blend_ps( m, b, a )
+#define PK_SELECTI( m, a, b ) PK_SELECT( m, a, b )
+#define PK_BITS( m )        ( ( u32 )( m ) )
+#define PK_FROM_BITS( b )   ( ( __mmask16 )( b ) )
+#define PK_LEAVE()          _mm256_zeroupper()
+#include "packet_kernel.h"
+#pragma GCC pop_options
+
+#endif
+
+const struct packet_kernels *packet_kernels_find( const char *name )
+{
+    if ( strcmp( name, "scalar" ) == 0 )
+        return &packet_scalar_kernels;
+
+#ifdef PACKET_X86
+    __builtin_cpu_init();
+
+    if ( strcmp( name, "sse" ) == 0 && __builtin_cpu_supports( "sse2" ) )
+        return &packet_sse_kernels;
+
+    if ( strcmp( name, "avx2" ) == 0 && __builtin_cpu_supports( "avx2" ) )
+        return &packet_avx2_kernels;
+
+    if ( strcmp( name, "avx512" ) == 0 && __builtin_cpu_supports( "avx512f" ) )
+        return &packet_avx512_kernels;
+#endif
+
+    return NULL;
+}
+
+const struct packet_kernels *packet_kernels( void )
+{
+    static const char *order[] = { "avx512", "avx2", "sse", "scalar" };
+
+    for ( size_t i = 0; i < sizeof( order ) / sizeof( *order ); i++ )
+    {
+        const struct packet_kernels *k = packet_kernels_find( order[ i ] );
+        if ( k )
+            return k;
+    }
+
+    return &packet_scalar_kernels;
+}
+
+/* ======================================================== */
+
+/* ======================================================== */
+/* --------------------------- */
+/* PACKET TRACING              */
+/* --------------------------- */
+
+void packet_set_ray( struct ray_packet *p, int lane, struct ray ray )
+{
+    p->ox[ lane ] = ray.orig.x;
+    p->oy[ lane ] = ray.orig.y;
+    p->oz[ lane ] = ray.orig.z;
+    p->dx[ lane ] = ray.dir.x;
+    p->dy[ lane ] = ray.dir.y;
+    p->dz[ lane ] = ray.dir.z;
+}
+
+struct ray packet_get_ray( const struct ray_packet *p, int lane )
+{
+    return ( struct ray ) {
+        .orig = {{ p->ox[ lane ], p->oy[ lane ], p->oz[ lane ] }},
+        .dir  = {{ p->dx[ lane ], p->dy[ lane ], p->dz[ lane ] }}
+    };
+}
+
+void packet_reset( struct ray_packet *p, u32 active )
+{
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+    {
+        p->t[ i ] = TRACE_RENDER_DISTANCE;
+        p->u[ i ] = 0.0f;
+        p->v[ i ] = 0.0f;
+        p->id[ i ] = -1;
+    }
+
+    p->active = active;
+}
+
+void packet_raycast( struct trace_context *ctx, const struct packet_kernels *k, struct ray_packet *p )
+{
+    const struct scene *scene = ctx->scene;
+
+    ctx->rays += __builtin_popcount( p->active );
+
+    k->hit_spheres( p, &scene->spheres, PACKET_SPHERE_ID, false );
+    k->hit_plane( p, &scene->plane, PACKET_PLANE_ID );
+
+    i32 base = PACKET_SPHERE_ID + ( i32 )scene->spheres.count;
+    for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+    {
+        const struct bvh *bvh = scene->meshes[ i ].bvh;
+        if ( bvh == NULL )
+            continue;
+
+        bvh_intersect_packet( bvh, k, p, base );
+        base += ( i32 )bvh->tri_count;
+    }
+}
+
+u32 packet_occluded( struct trace_context *ctx, const struct packet_kernels *k, struct ray_packet *p )
+{
+    const struct scene *scene = ctx->scene;
+    const u32 active = p->active;
+
+    ctx->rays += __builtin_popcount( active );
+
+    // lanes leave the packet at their first hit
+    k->hit_spheres( p, &scene->spheres, PACKET_SPHERE_ID, true );
+    p->active &= ~packet_hits( p );
+
+    if ( p->active )
+    {
+        k->hit_plane( p, &scene->plane, PACKET_PLANE_ID );
+        p->active &= ~packet_hits( p );
+    }
+
+    for ( int i = 0; i < SCENE_MAX_MESHES && p->active; i++ )
+    {
+        if ( scene->meshes[ i ].bvh )
+            bvh_occluded_packet( scene->meshes[ i ].bvh, k, p );
+    }
+
+    u32 occluded = active & ~p->active;
+    p->active = active;
+    return occluded;
+}
+
+// rebuild the hitdata trace_raycast would have returned for a lane
+static inline struct hitdata packet_hitdata_( const struct trace_context *ctx, const struct ray_packet *p, int lane )
+{
+    struct hitdata hitdata = { .hit = false };
+    i32 id = p->id[ lane ];
+
+    if ( !( p->active & ( 1u << lane ) ) || id < 0 )
+        return hitdata;
+
+    struct ray ray = packet_get_ray( p, lane );
+
+    hitdata.hit = true;
+    hitdata.dist = p->t[ lane ];
+    hitdata.hit_point = glms_vec3_add( ray.orig, glms_vec3_scale( ray.dir, hitdata.dist ) );
+
+    if ( id == PACKET_PLANE_ID )
+    {
+        hitdata.normal = ctx->scene->plane.norm;
+        hitdata.mat.color = ( vec3s ){{ 0.5f, 0.5f, 0.5f }};
+        hitdata.mat.reflectiveness = 0.0f;
+    }
+    else if ( id >= PACKET_SPHERE_ID + ( i32 )ctx->scene->spheres.count )
+    {
+        i32 tri = id - PACKET_SPHERE_ID - ( i32 )ctx->scene->spheres.count;
+        for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+        {
+            const struct scene_mesh *mesh = &ctx->scene->meshes[ i ];
+            if ( mesh->bvh == NULL )
+                continue;
+
+            if ( ( size_t )tri < mesh->bvh->tri_count )
+            {
+                hitdata = trace_tri_hitdata( ray, &mesh->bvh->tris[ tri * 3 ], p->t[ lane ], p->u[ lane ], p->v[ lane ] );
+                hitdata.mat = mesh->mat;
+                break;
+            }
+
+            tri -= ( i32 )mesh->bvh->tri_count;
+        }
+    }
+    else
+    {
+        const struct spheres *spheres = &ctx->scene->spheres;
+        u32 slot = ( u32 )( id - PACKET_SPHERE_ID );
+        hitdata.normal = glms_vec3_normalize( glms_vec3_sub( hitdata.hit_point, spheres_center( spheres, slot ) ) );
+        hitdata.mat = ctx->scene->materials[ spheres->mat[ slot ] ];
+    }
+
+    return hitdata;
+}
+
+// same as trace_raycast_to_light with one shadow packet per light
+static void packet_raycast_to_light_( struct trace_context *ctx, const struct packet_kernels *k,
+        const struct hitdata hits[ PACKET_SIZE ], vec3s out[ PACKET_SIZE ] )
+{
+    struct ray_packet shadow = { 0 };
+
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+        out[ i ] = GLMS_VEC3_ZERO;
+
+    for ( u32 l = 0; l < ctx->scene->light_count; l++ )
+    {
+        const struct scene_light *light = &ctx->scene->lights[ l ];
+        u32 lit = 0;
+
+        // the shadow ray of each lane ends at the light
+        packet_reset( &shadow, 0 );
+        for ( int i = 0; i < PACKET_SIZE; i++ )
+        {
+            if ( !hits[ i ].hit )
+                continue;
+
+            float light_dist = glms_vec3_distance( light->pos, hits[ i ].hit_point );
+            if ( light_dist > light->reach )
+                continue;
+
+            struct ray rtl;
+            rtl.dir = glms_vec3_normalize( glms_vec3_sub( light->pos, hits[ i ].hit_point ) );
+            rtl.orig = hits[ i ].hit_point;
+            packet_set_ray( &shadow, i, rtl );
+            shadow.t[ i ] = light_dist;
+            lit |= 1u << i;
+        }
+
+        if ( lit == 0 )
+            continue;
+
+        /* no color if anything is between the hit point and the light */
+        shadow.active = lit;
+        if ( ctx->scene->shadows )
+            lit &= ~packet_occluded( ctx, k, &shadow );
+
+        for ( int i = 0; i < PACKET_SIZE; i++ )
+        {
+            if ( !( lit & ( 1u << i ) ) )
+                continue;
+
+            vec3s dir = {{ shadow.dx[ i ], shadow.dy[ i ], shadow.dz[ i ] }};
+            float diffuse = clamp( glms_vec3_dot( hits[ i ].normal, dir ), 0.0f, 1.0f );
+            float intensity = light->power * diffuse * glms_vec3_dot( hits[ i ].normal, dir );
+
+            out[ i ] = glms_vec3_add( out[ i ], glms_vec3_scale( glms_vec3_mul( light->color, hits[ i ].mat.color ), intensity ) );
+        }
+    }
+}
+
+void packet_compute_color( struct trace_context *ctx, const struct packet_kernels *k, struct ray_packet *p, vec3s out[ PACKET_SIZE ], struct trace_guide guide[ PACKET_SIZE ] )
+{
+    struct hitdata hits[ PACKET_SIZE ];
+    vec3s light[ PACKET_SIZE ];
+    float weight[ PACKET_SIZE ];
+    float throughput[ PACKET_SIZE ];
+    float length[ PACKET_SIZE ];
+    u32 guiding = guide ? p->active : 0;
+
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+    {
+        out[ i ] = GLMS_VEC3_ZERO;
+        throughput[ i ] = 1.0f;
+        length[ i ] = 0.0f;
+    }
+
+    ctx->paths += __builtin_popcount( p->active );
+
+    // lanes leave the packet when their path ends, the rest bounce on
+    for ( u32 depth = 0; p->active; depth++ )
+    {
+        u32 bounce = 0;
+
+        packet_raycast( ctx, k, p );
+        ctx->segments += __builtin_popcount( p->active );
+
+        for ( int i = 0; i < PACKET_SIZE; i++ )
+        {
+            hits[ i ] = packet_hitdata_( ctx, p, i );
+
+            // same as trace_compute_color, the guide follows mirrors
+            if ( ( guiding & ( 1u << i ) ) && ( hits[ i ].hit || depth == 0 ) )
+            {
+                length[ i ] += hits[ i ].dist;
+                guide[ i ] = trace_guide( &hits[ i ], length[ i ] );
+            }
+            if ( !hits[ i ].hit || hits[ i ].mat.reflectiveness <= TRACE_GUIDE_REFLECTIVENESS )
+                guiding &= ~( 1u << i );
+
+            if ( !hits[ i ].hit )
+                continue;
+
+            struct trace_bounce b = trace_bounce( ctx, &hits[ i ], depth, throughput[ i ] );
+            weight[ i ] = b.light;
+            throughput[ i ] = b.next;
+            if ( b.next <= 0.0f )
+                continue;
+
+            /* reflected ray */
+            struct ray ray = packet_get_ray( p, i );
+            struct ray rr;
+            rr.dir = glms_vec3_sub( ray.dir, glms_vec3_scale( hits[ i ].normal, 2.0f * glms_vec3_dot( hits[ i ].normal, ray.dir ) ) );
+            rr.orig = hits[ i ].hit_point;
+            packet_set_ray( p, i, rr );
+            bounce |= 1u << i;
+        }
+
+        packet_raycast_to_light_( ctx, k, hits, light );
+
+        for ( int i = 0; i < PACKET_SIZE; i++ )
+        {
+            if ( hits[ i ].hit )
+                out[ i ] = glms_vec3_add( out[ i ], glms_vec3_scale( light[ i ], weight[ i ] ) );
+        }
+
+        packet_reset( p, bounce );
+    }
+}
+
+/* ======================================================== */
@@ -0,0 +1,82 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+/*
+ * SIMD ray packet kernels for the CPU tracer. A packet holds PACKET_SIZE
+ * coherent rays in SoA form which the kernels test against one primitive at
+ * a time, 4 (sse), 8 (avx2) or 16 (avx512) lanes per instruction. Lanes that
+ * are not set in the active mask are left untouched.
+ */
+
+#include "trace.h"
+#include <util/types.h>
+#include <stdalign.h>
+
+#define PACKET_SIZE 16
+#define PACKET_DIM  4   /* packets cover PACKET_DIM x PACKET_DIM pixels */
+#define PACKET_ALL  ( ( u32 )( ( 1ull << PACKET_SIZE ) - 1 ) )
+
+struct ray_packet
+{
+    alignas( 64 ) float ox[ PACKET_SIZE ];
+    alignas( 64 ) float oy[ PACKET_SIZE ];
+    alignas( 64 ) float oz[ PACKET_SIZE ];
+    alignas( 64 ) float dx[ PACKET_SIZE ];
+    alignas( 64 ) float dy[ PACKET_SIZE ];
+    alignas( 64 ) float dz[ PACKET_SIZE ];
+
+    // closest hit so far (distance, triangle barycentrics and primitive id)
+    alignas( 64 ) float t[ PACKET_SIZE ];
+    alignas( 64 ) float u[ PACKET_SIZE ];
+    alignas( 64 ) float v[ PACKET_SIZE ];
+    alignas( 64 ) i32 id[ PACKET_SIZE ];
+
+    // bit i set if lane i is still being traced
+    u32 active;
+};
+
+struct packet_kernels
+{
+    const char *name;
+    int width;
+
+    void ( *hit_sphere )( struct ray_packet *p, vec3s center, float radius, i32 id );
+
+    // every sphere, the closest gets id base + its slot (any takes the first closer than t)
+    void ( *hit_spheres )( struct ray_packet *p, const struct spheres *spheres, i32 base, bool any );
+    void ( *hit_plane )( struct ray_packet *p, const struct scene_plane *plane, i32 id );
+    void ( *hit_tri )( struct ray_packet *p, const struct vert tri[ 3 ], i32 id );
+};
+
+// best kernels supported by this cpu
+const struct packet_kernels *packet_kernels( void );
+
+// kernels by name ("scalar", "sse", "avx2", "avx512"), NULL if unsupported
+const struct packet_kernels *packet_kernels_find( const char *name );
+
+void packet_set_ray( struct ray_packet *p, int lane, struct ray ray );
+struct ray packet_get_ray( const struct ray_packet *p, int lane );
+
+// clear hits of every lane and set which lanes are active
+void packet_reset( struct ray_packet *p, u32 active );
+
+// closest hit of every active lane against the whole scene
+void packet_raycast( struct trace_context *ctx, const struct packet_kernels *k, struct ray_packet *p );
+
+// lanes with any hit nearer than their p->t, stops once every lane hit something
+u32 packet_occluded( struct trace_context *ctx, const struct packet_kernels *k, struct ray_packet *p );
+
+// active lanes that hit something
+static inline u32 packet_hits( const struct ray_packet *p )
+{
+    u32 hits = 0;
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+        hits |= ( u32 )( p->id[ i ] >= 0 ) << i;
+    return hits & p->active;
+}
+
+// same as trace_compute_color for every active lane, the packet is used for
+// the reflected rays so its rays are lost
+void packet_compute_color( struct trace_context *ctx, const struct packet_kernels *k, struct ray_packet *p, vec3s out[ PACKET_SIZE ], struct trace_guide guide[ PACKET_SIZE ] );
+
+#endif
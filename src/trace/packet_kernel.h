@@ -0,0 +1,299 @@
+/*
+ * Packet intersection kernels written against the PK_* lane macros. This file
+ * is included by packet.c once per instruction set, right after the macros
+ * for that instruction set are defined. Do not include it anywhere else.
+ *
+ * Every kernel must produce the same result as its counterpart in trace.c
+ * and end with PK_LEAVE().
+ */
+
+static void PK_FN( hit_sphere )( struct ray_packet *p, vec3s center, float radius, i32 id )
+{
+    const PK_F zero = PK_SET1( 0.0f );
+    const PK_F two  = PK_SET1( 2.0f );
+    const PK_F four = PK_SET1( 4.0f );
+    const PK_F cx   = PK_SET1( center.x );
+    const PK_F cy   = PK_SET1( center.y );
+    const PK_F cz   = PK_SET1( center.z );
+    const PK_F r2   = PK_SET1( radius * radius );
+    const PK_I vid  = PK_SET1I( id );
+
+    for ( int i = 0; i < PACKET_SIZE; i += PK_WIDTH )
+    {
+        u32 lanes = ( p->active >> i ) & PK_LANES;
+        if ( lanes == 0 )
+            continue;
+
+        PK_F dx = PK_LOAD( p->dx + i );
+        PK_F dy = PK_LOAD( p->dy + i );
+        PK_F dz = PK_LOAD( p->dz + i );
+
+        /* offset from center */
+        PK_F ocx = PK_SUB( PK_LOAD( p->ox + i ), cx );
+        PK_F ocy = PK_SUB( PK_LOAD( p->oy + i ), cy );
+        PK_F ocz = PK_SUB( PK_LOAD( p->oz + i ), cz );
+
+        PK_F a = PK_ADD( PK_ADD( PK_MUL( dx, dx ), PK_MUL( dy, dy ) ), PK_MUL( dz, dz ) );
+        PK_F b = PK_MUL( two, PK_ADD( PK_ADD( PK_MUL( ocx, dx ), PK_MUL( ocy, dy ) ), PK_MUL( ocz, dz ) ) );
+        PK_F c = PK_SUB( PK_ADD( PK_ADD( PK_MUL( ocx, ocx ), PK_MUL( ocy, ocy ) ), PK_MUL( ocz, ocz ) ), r2 );
+        PK_F discriminant = PK_SUB( PK_MUL( b, b ), PK_MUL( PK_MUL( four, a ), c ) );
+
+        /* lanes with a negative discriminant get nan and fail every compare */
+        PK_F dist = PK_DIV( PK_SUB( PK_SUB( zero, b ), PK_SQRT( discriminant ) ), PK_MUL( two, a ) );
+        PK_F t = PK_LOAD( p->t + i );
+
+        PK_M m = PK_FROM_BITS( lanes );
+        m = PK_MAND( m, PK_GE( discriminant, zero ) );
+        m = PK_MAND( m, PK_GE( dist, zero ) );
+        m = PK_MAND( m, PK_LT( dist, t ) );
+        if ( PK_BITS( m ) == 0 )
+            continue;
+
+        PK_STORE( p->t + i, PK_SELECT( m, dist, t ) );
+        PK_STOREI( p->id + i, PK_SELECTI( m, vid, PK_LOADI( p->id + i ) ) );
+    }
+
+    PK_LEAVE();
+}
+
+/*
+ * One ray at a time against PK_WIDTH spheres per instruction, straight off the
+ * SoA arrays. Every sphere lane keeps the first closest of its slots, the
+ * lanes are merged at the end so the result is that of testing the spheres in
+ * order. With any a ray stops at its first hit nearer than its t.
+ */
+static void PK_FN( hit_spheres )( struct ray_packet *p, const struct spheres *spheres, i32 base, bool any )
+{
+    const PK_F zero = PK_SET1( 0.0f );
+    const PK_F two  = PK_SET1( 2.0f );
+    const PK_F none = PK_SET1( -1.0f );
+    const PK_F step = PK_SET1( ( float )PK_WIDTH );
+    alignas( 64 ) float first[ PK_WIDTH ];
+    alignas( 64 ) float lane_t[ PK_WIDTH ];
+    alignas( 64 ) float lane_slot[ PK_WIDTH ];
+
+    // slot of every sphere lane, exact as a float up to 2^24 spheres
+    for ( int j = 0; j < PK_WIDTH; j++ )
+        first[ j ] = ( float )j;
+
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+    {
+        if ( !( p->active & ( 1u << i ) ) )
+            continue;
+
+        const PK_F ox = PK_SET1( p->ox[ i ] );
+        const PK_F oy = PK_SET1( p->oy[ i ] );
+        const PK_F oz = PK_SET1( p->oz[ i ] );
+        const PK_F dx = PK_SET1( p->dx[ i ] );
+        const PK_F dy = PK_SET1( p->dy[ i ] );
+        const PK_F dz = PK_SET1( p->dz[ i ] );
+
+        /* the same for every sphere */
+        PK_F a = PK_ADD( PK_ADD( PK_MUL( dx, dx ), PK_MUL( dy, dy ) ), PK_MUL( dz, dz ) );
+        PK_F four_a = PK_MUL( PK_SET1( 4.0f ), a );
+        PK_F two_a = PK_MUL( two, a );
+
+        PK_F t = PK_SET1( p->t[ i ] );
+        PK_F slot = none;
+        PK_F idx = PK_LOAD( first );
+        bool hit = false;
+
+        // the arrays are padded with spheres that never hit
+        for ( u32 s = 0; s < spheres->count; s += PK_WIDTH )
+        {
+            /* offset from center */
+            PK_F ocx = PK_SUB( ox, PK_LOAD( spheres->x + s ) );
+            PK_F ocy = PK_SUB( oy, PK_LOAD( spheres->y + s ) );
+            PK_F ocz = PK_SUB( oz, PK_LOAD( spheres->z + s ) );
+            PK_F r = PK_LOAD( spheres->radius + s );
+
+            PK_F b = PK_MUL( two, PK_ADD( PK_ADD( PK_MUL( ocx, dx ), PK_MUL( ocy, dy ) ), PK_MUL( ocz, dz ) ) );
+            PK_F c = PK_SUB( PK_ADD( PK_ADD( PK_MUL( ocx, ocx ), PK_MUL( ocy, ocy ) ), PK_MUL( ocz, ocz ) ), PK_MUL( r, r ) );
+            PK_F discriminant = PK_SUB( PK_MUL( b, b ), PK_MUL( four_a, c ) );
+            PK_F dist = PK_DIV( PK_SUB( PK_SUB( zero, b ), PK_SQRT( discriminant ) ), two_a );
+
+            PK_M m = PK_GE( discriminant, zero );
+            m = PK_MAND( m, PK_GE( dist, zero ) );
+            m = PK_MAND( m, PK_LT( dist, t ) );
+            if ( PK_BITS( m ) != 0 )
+            {
+                t = PK_SELECT( m, dist, t );
+                slot = PK_SELECT( m, idx, slot );
+                hit = true;
+                if ( any )
+                    break;
+            }
+
+            idx = PK_ADD( idx, step );
+        }
+
+        if ( !hit )
+            continue;
+
+        PK_STORE( lane_t, t );
+        PK_STORE( lane_slot, slot );
+
+        // closest of the lanes, the lower slot on a tie
+        int best = -1;
+        for ( int j = 0; j < PK_WIDTH; j++ )
+        {
+            if ( lane_slot[ j ] < 0.0f )
+                continue;
+
+            if ( best < 0 || lane_t[ j ] < lane_t[ best ] || ( lane_t[ j ] == lane_t[ best ] && lane_slot[ j ] < lane_slot[ best ] ) )
+                best = j;
+        }
+
+        p->t[ i ] = lane_t[ best ];
+        p->id[ i ] = base + ( i32 )lane_slot[ best ];
+    }
+
+    PK_LEAVE();
+}
+
+static void PK_FN( hit_plane )( struct ray_packet *p, const struct scene_plane *plane, i32 id )
+{
+    const PK_F eps = PK_SET1( TRACE_EPSILON );
+    const PK_F nx  = PK_SET1( plane->norm.x );
+    const PK_F ny  = PK_SET1( plane->norm.y );
+    const PK_F nz  = PK_SET1( plane->norm.z );
+    const PK_F px  = PK_SET1( plane->pos.x );
+    const PK_F py  = PK_SET1( plane->pos.y );
+    const PK_F pz  = PK_SET1( plane->pos.z );
+    const PK_I vid = PK_SET1I( id );
+
+    for ( int i = 0; i < PACKET_SIZE; i += PK_WIDTH )
+    {
+        u32 lanes = ( p->active >> i ) & PK_LANES;
+        if ( lanes == 0 )
+            continue;
+
+        PK_F denom = PK_ADD( PK_ADD( PK_MUL( nx, PK_LOAD( p->dx + i ) ), PK_MUL( ny, PK_LOAD( p->dy + i ) ) ), PK_MUL( nz, PK_LOAD( p->dz + i ) ) );
+
+        PK_F qx = PK_SUB( px, PK_LOAD( p->ox + i ) );
+        PK_F qy = PK_SUB( py, PK_LOAD( p->oy + i ) );
+        PK_F qz = PK_SUB( pz, PK_LOAD( p->oz + i ) );
+        PK_F dist = PK_DIV( PK_ADD( PK_ADD( PK_MUL( qx, nx ), PK_MUL( qy, ny ) ), PK_MUL( qz, nz ) ), denom );
+        PK_F t = PK_LOAD( p->t + i );
+
+        PK_M m = PK_FROM_BITS( lanes );
+        m = PK_MAND( m, PK_GT( PK_ABS( denom ), eps ) );
+        m = PK_MAND( m, PK_GE( dist, eps ) );
+        m = PK_MAND( m, PK_LT( dist, t ) );
+        if ( PK_BITS( m ) == 0 )
+            continue;
+
+        PK_STORE( p->t + i, PK_SELECT( m, dist, t ) );
+        PK_STOREI( p->id + i, PK_SELECTI( m, vid, PK_LOADI( p->id + i ) ) );
+    }
+
+    PK_LEAVE();
+}
+
+static void PK_FN( hit_tri )( struct ray_packet *p, const struct vert tri[ 3 ], i32 id )
+{
+    vec3s edge_ab = glms_vec3_sub( tri[ 1 ].vp, tri[ 0 ].vp );
+    vec3s edge_ac = glms_vec3_sub( tri[ 2 ].vp, tri[ 0 ].vp );
+    vec3s normal  = glms_vec3_cross( edge_ab, edge_ac );
+
+    const PK_F zero = PK_SET1( 0.0f );
+    const PK_F one  = PK_SET1( 1.0f );
+    const PK_F eps  = PK_SET1( TRACE_EPSILON );
+    const PK_F abx  = PK_SET1( edge_ab.x );
+    const PK_F aby  = PK_SET1( edge_ab.y );
+    const PK_F abz  = PK_SET1( edge_ab.z );
+    const PK_F acx  = PK_SET1( edge_ac.x );
+    const PK_F acy  = PK_SET1( edge_ac.y );
+    const PK_F acz  = PK_SET1( edge_ac.z );
+    const PK_F nx   = PK_SET1( normal.x );
+    const PK_F ny   = PK_SET1( normal.y );
+    const PK_F nz   = PK_SET1( normal.z );
+    const PK_F ax   = PK_SET1( tri[ 0 ].vp.x );
+    const PK_F ay   = PK_SET1( tri[ 0 ].vp.y );
+    const PK_F az   = PK_SET1( tri[ 0 ].vp.z );
+    const PK_I vid  = PK_SET1I( id );
+
+    for ( int i = 0; i < PACKET_SIZE; i += PK_WIDTH )
+    {
+        u32 lanes = ( p->active >> i ) & PK_LANES;
+        if ( lanes == 0 )
+            continue;
+
+        PK_F dx = PK_LOAD( p->dx + i );
+        PK_F dy = PK_LOAD( p->dy + i );
+        PK_F dz = PK_LOAD( p->dz + i );
+
+        PK_F aox = PK_SUB( PK_LOAD( p->ox + i ), ax );
+        PK_F aoy = PK_SUB( PK_LOAD( p->oy + i ), ay );
+        PK_F aoz = PK_SUB( PK_LOAD( p->oz + i ), az );
+
+        /* dao = cross( ao, dir ) */
+        PK_F daox = PK_SUB( PK_MUL( aoy, dz ), PK_MUL( aoz, dy ) );
+        PK_F daoy = PK_SUB( PK_MUL( aoz, dx ), PK_MUL( aox, dz ) );
+        PK_F daoz = PK_SUB( PK_MUL( aox, dy ), PK_MUL( aoy, dx ) );
+
+        PK_F det = PK_SUB( zero, PK_ADD( PK_ADD( PK_MUL( dx, nx ), PK_MUL( dy, ny ) ), PK_MUL( dz, nz ) ) );
+        PK_F inv_det = PK_DIV( one, det );
+
+        PK_F dist = PK_MUL( PK_ADD( PK_ADD( PK_MUL( aox, nx ), PK_MUL( aoy, ny ) ), PK_MUL( aoz, nz ) ), inv_det );
+        PK_F u = PK_MUL( PK_ADD( PK_ADD( PK_MUL( acx, daox ), PK_MUL( acy, daoy ) ), PK_MUL( acz, daoz ) ), inv_det );
+        PK_F v = PK_MUL( PK_SUB( zero, PK_ADD( PK_ADD( PK_MUL( abx, daox ), PK_MUL( aby, daoy ) ), PK_MUL( abz, daoz ) ) ), inv_det );
+        PK_F w = PK_SUB( PK_SUB( one, u ), v );
+        PK_F t = PK_LOAD( p->t + i );
+
+        PK_M m = PK_FROM_BITS( lanes );
+        m = PK_MAND( m, PK_GE( det, eps ) );
+        m = PK_MAND( m, PK_GE( dist, zero ) );
+        m = PK_MAND( m, PK_GE( u, zero ) );
+        m = PK_MAND( m, PK_GE( v, zero ) );
+        m = PK_MAND( m, PK_GE( w, zero ) );
+        m = PK_MAND( m, PK_LT( dist, t ) );
+        if ( PK_BITS( m ) == 0 )
+            continue;
+
+        PK_STORE( p->t + i, PK_SELECT( m, dist, t ) );
+        PK_STORE( p->u + i, PK_SELECT( m, u, PK_LOAD( p->u + i ) ) );
+        PK_STORE( p->v + i, PK_SELECT( m, v, PK_LOAD( p->v + i ) ) );
+        PK_STOREI( p->id + i, PK_SELECTI( m, vid, PK_LOADI( p->id + i ) ) );
+    }
+
+    PK_LEAVE();
+}
+
+static const struct packet_kernels PK_FN( kernels ) = {
+    .name       = PK_NAME,
+    .width      = PK_WIDTH,
+    .hit_sphere = PK_FN( hit_sphere ),
+    .hit_spheres = PK_FN( hit_spheres ),
+    .hit_plane  = PK_FN( hit_plane ),
+    .hit_tri    = PK_FN( hit_tri )
+};
+
+#undef PK_NAME
+#undef PK_FN
+#undef PK_WIDTH
+#undef PK_LANES
+#undef PK_F
+#undef PK_I
+#undef PK_M
+#undef PK_LOAD
+#undef PK_LOADI
+#undef PK_STORE
+#undef PK_STOREI
+#undef PK_SET1
+#undef PK_SET1I
+#undef PK_ADD
+#undef PK_SUB
+#undef PK_MUL
+#undef PK_DIV
+#undef PK_SQRT
+#undef PK_ABS
+#undef PK_LT
+#undef PK_GT
+#undef PK_GE
+#undef PK_MAND
+#undef PK_SELECT
+#undef PK_SELECTI
+#undef PK_BITS
+#undef PK_FROM_BITS
+#undef PK_LEAVE
@@ -0,0 +1,437 @@
+#include "scene.h"
+#include "bvh.h"
+
+#include <gfx/accum.h>
+#include <util/log.h>
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// both are uploaded as is, one node is two texels and one vertex is two texels
+_Static_assert( sizeof( struct bvh_node ) == 32, "bvh_node must be two RGBA32UI texels" );
+_Static_assert( sizeof( struct vert ) == 32, "vert must be two RGBA32F texels" );
+
+// std140 offsets of scene_block
+_Static_assert( sizeof( struct scene_block_camera ) == 80, "std140 camera_t is 80 bytes" );
+_Static_assert( sizeof( struct scene_block_plane ) == 32, "std140 plane_t is 32 bytes" );
+_Static_assert( sizeof( struct scene_block_light ) == 48, "std140 light_t is 48 bytes" );
+_Static_assert( sizeof( struct scene_block_material ) == 16, "std140 material_t is 16 bytes" );
+_Static_assert( sizeof( struct scene_block_mesh ) == 32, "std140 mesh_t is 32 bytes" );
+_Static_assert( sizeof( struct scene_block_sphere ) == 16, "a sphere is one RGBA32F texel" );
+_Static_assert( offsetof( struct scene_block, light_count ) == 128, "std140 light_count is at 128" );
+_Static_assert( offsetof( struct scene_block, sphere_count ) == 144, "std140 sphere_count is at 144" );
+_Static_assert( offsetof( struct scene_block, meshes ) == 160, "std140 meshes start at 160" );
+
+// a sphere with a material of its own
+static void scene_sphere_( struct scene *self, vec3s pos, float radius, vec3s color, float reflectiveness )
+{
+    int mat = scene_add_material( self, ( struct scene_material ){ .color = color, .reflectiveness = reflectiveness } );
+    if ( mat >= 0 )
+        scene_add_sphere( self, pos, radius, ( u32 )mat );
+}
+
+void scene_init_default( struct scene *self, float fov )
+{
+    *self = ( struct scene ){ 0 };
+
+    camera_init( &self->camera, fov );
+    self->camera.eye   = GLMS_VEC3_ZERO;
+    self->camera.pitch = 0.0f;
+    self->camera.yaw   = 0.0f;
+    camera_update( &self->camera );
+
+    self->plane.pos  = ( vec3s ){{ 0.0f, -1.0f, 0.0f }};
+    self->plane.norm = ( vec3s ){{ 0.0f,  1.0f, 0.0f }};
+    self->max_depth  = SCENE_MAX_DEPTH;
+    self->shadows    = true;
+
+    scene_add_light( self, ( struct scene_light ) {
+        .pos    = {{ 0.0f, 5.0f, 0.0f }},
+        .radius = 1.0f,
+        .color  = {{ 1.0f, 1.0f, 1.0f }},
+        .reach  = 300.0f,
+        .power  = 1.0f
+    } );
+
+    scene_sphere_( self, ( vec3s ){{  3.0f, 0.0f,  0.0f }}, 1.0f, ( vec3s ){{ 0.0f, 1.0f, 0.0f }}, 0.0f );
+    scene_sphere_( self, ( vec3s ){{  0.0f, 0.0f,  0.0f }}, 1.0f, ( vec3s ){{ 0.0f, 0.0f, 1.0f }}, 1.0f );
+    scene_sphere_( self, ( vec3s ){{ -3.0f, 0.0f,  0.0f }}, 1.0f, ( vec3s ){{ 1.0f, 0.0f, 0.0f }}, 0.5f );
+    scene_sphere_( self, ( vec3s ){{  0.0f, 0.0f,  3.0f }}, 1.0f, ( vec3s ){{ 1.0f, 1.0f, 1.0f }}, 0.8f );
+    scene_sphere_( self, ( vec3s ){{  0.0f, 0.0f, -3.0f }}, 1.0f, ( vec3s ){{ 0.8f, 0.8f, 0.8f }}, 0.08f );
+}
+
+void scene_free( struct scene *self )
+{
+    spheres_free( &self->spheres );
+}
+
+void scene_init_mesh( struct scene *self, const struct bvh *bvh, float fov )
+{
+    scene_init_default( self, fov );
+    spheres_clear( &self->spheres );
+    self->material_count = 0;
+
+    // bounds of the whole mesh are the bounds of the root node
+    vec3s min = bvh->nodes[ 0 ].min;
+    vec3s max = bvh->nodes[ 0 ].max;
+    vec3s center = glms_vec3_scale( glms_vec3_add( min, max ), 0.5f );
+    float dia = glms_vec3_distance( min, max );
+
+    // look at the mesh from the front and slightly above
+    float dist = dia / ( 2.0f * tanf( fov / 2.0f ) );
+    self->camera.eye   = ( vec3s ){{ center.x, center.y + 0.25f * dist, center.z - dist }};
+    self->camera.pitch = -atanf( 0.25f );
+    self->camera.yaw   = 0.0f;
+    camera_update( &self->camera );
+
+    self->plane.pos = ( vec3s ){{ 0.0f, min.y, 0.0f }};
+    self->lights[ 0 ].pos = ( vec3s ){{ center.x + 0.5f * dia, max.y + dia, center.z - 0.5f * dia }};
+
+    scene_add_mesh( self, bvh, ( struct scene_material ){ .color = {{ 0.8f, 0.8f, 0.8f }}, .reflectiveness = 0.0f } );
+}
+
+int scene_add_mesh( struct scene *self, const struct bvh *bvh, struct scene_material mat )
+{
+    for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+    {
+        if ( self->meshes[ i ].bvh )
+            continue;
+
+        self->meshes[ i ] = ( struct scene_mesh ){ .bvh = bvh, .mat = mat };
+        return i;
+    }
+
+    return -1;
+}
+
+int scene_add_light( struct scene *self, struct scene_light light )
+{
+    if ( self->light_count >= SCENE_MAX_LIGHTS )
+        return -1;
+
+    self->lights[ self->light_count ] = light;
+    return ( int )self->light_count++;
+}
+
+int scene_add_material( struct scene *self, struct scene_material mat )
+{
+    if ( self->material_count >= SCENE_MAX_MATERIALS )
+        return -1;
+
+    self->materials[ self->material_count ] = mat;
+    return ( int )self->material_count++;
+}
+
+u32 scene_add_sphere( struct scene *self, vec3s center, float radius, u32 mat )
+{
+    if ( mat >= self->material_count )
+    {
+        log_error( "Sphere has no material %u", mat );
+        return SPHERES_NONE;
+    }
+
+    return spheres_add( &self->spheres, center, radius, mat );
+}
+
+int scene_buffers_init( struct scene_buffers *self, struct shader shader )
+{
+    self->block = vbo_create( GL_UNIFORM_BUFFER, true );
+    self->last_valid = false;
+    vbo_buff( self->block, NULL, sizeof( struct scene_block ) );
+    glBindBufferBase( GL_UNIFORM_BUFFER, SCENE_BLOCK_BINDING, self->block.handle );
+
+    // tbo_create binds to the active unit, so create them all before binding any
+    self->nodes = tbo_create( GL_RGBA32UI );
+    self->tris = tbo_create( GL_RGBA32F );
+    self->lights = tbo_create( GL_RGBA32F );
+    self->tiles = tbo_create( GL_R32UI );
+    self->spheres = tbo_create( GL_RGBA32F );
+    self->sphere_mats = tbo_create( GL_R32UI );
+    self->grid = ( struct light_grid ){ 0 };
+    self->last_spheres = NULL;
+    self->last_sphere_mats = NULL;
+    self->sphere_count = 0;
+    self->sphere_cap = 0;
+
+    tbo_bind( self->nodes, SCENE_UNIT_NODES );
+    tbo_bind( self->tris, SCENE_UNIT_TRIS );
+    tbo_bind( self->lights, SCENE_UNIT_LIGHTS );
+    tbo_bind( self->tiles, SCENE_UNIT_TILES );
+    tbo_bind( self->spheres, SCENE_UNIT_SPHERES );
+    tbo_bind( self->sphere_mats, SCENE_UNIT_SPHERE_MATS );
+
+    int err = scene_buffers_attach( self, shader );
+    if ( err )
+        scene_buffers_free( self );
+
+    return err;
+}
+
+int scene_buffers_attach( struct scene_buffers *self, struct shader shader )
+{
+    ( void )self;
+
+    GLuint index = glGetUniformBlockIndex( shader.handle, "scene_block" );
+    if ( index == GL_INVALID_INDEX )
+    {
+        log_error( "Shader has no scene_block uniform block" );
+        return 1;
+    }
+
+    // catch a shader and a scene built with different limits
+    GLint size;
+    glGetActiveUniformBlockiv( shader.handle, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size );
+    if ( ( size_t )size != sizeof( struct scene_block ) )
+    {
+        log_error( "scene_block is %d bytes in the shader but %zu in scene.h", size, sizeof( struct scene_block ) );
+        return 2;
+    }
+
+    shader_bind( shader );
+    glUniformBlockBinding( shader.handle, index, SCENE_BLOCK_BINDING );
+    shader_uniform_int( shader, "mesh_nodes", SCENE_UNIT_NODES );
+    shader_uniform_int( shader, "mesh_tris", SCENE_UNIT_TRIS );
+    shader_uniform_int( shader, "scene_lights", SCENE_UNIT_LIGHTS );
+    shader_uniform_int( shader, "light_tiles", SCENE_UNIT_TILES );
+    shader_uniform_int( shader, "scene_spheres", SCENE_UNIT_SPHERES );
+    shader_uniform_int( shader, "sphere_materials", SCENE_UNIT_SPHERE_MATS );
+
+    // samplers of different types may not share a unit, even when unused
+    shader_uniform_int( shader, "accum", ACCUM_UNIT );
+
+    return 0;
+}
+
+void scene_buffers_free( struct scene_buffers *self )
+{
+    vbo_free( self->block );
+    tbo_free( self->nodes );
+    tbo_free( self->tris );
+    tbo_free( self->lights );
+    tbo_free( self->tiles );
+    tbo_free( self->spheres );
+    tbo_free( self->sphere_mats );
+    light_grid_free( &self->grid );
+    free( self->last_spheres );
+    free( self->last_sphere_mats );
+}
+
+static inline struct scene_block_material scene_pack_material_( struct scene_material mat )
+{
+    return ( struct scene_block_material ){ .color = mat.color, .reflectiveness = mat.reflectiveness };
+}
+
+void scene_pack( const struct scene *self, vec2s resolution, struct scene_block *block )
+{
+    *block = ( struct scene_block ){ 0 };
+
+    block->camera.view = self->camera.view;
+    block->camera.eye  = self->camera.eye;
+    block->camera.fov  = self->camera.fov;
+    block->plane.pos   = self->plane.pos;
+    block->plane.norm  = self->plane.norm;
+    block->resolution  = resolution;
+    block->max_depth   = self->max_depth;
+    block->light_count = self->light_count;
+    block->shadows     = self->shadows;
+    block->sphere_count = self->spheres.count;
+
+    for ( u32 i = 0; i < self->material_count; i++ )
+        block->materials[ i ] = scene_pack_material_( self->materials[ i ] );
+
+    // same order as the buffers in scene_upload_meshes
+    u32 node_offset = 0;
+    u32 tri_offset = 0;
+    for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+    {
+        const struct scene_mesh *mesh = &self->meshes[ i ];
+        if ( mesh->bvh == NULL )
+            continue;
+
+        block->meshes[ block->mesh_count++ ] = ( struct scene_block_mesh ) {
+            .node_offset = node_offset,
+            .tri_offset  = tri_offset,
+            .mat         = scene_pack_material_( mesh->mat )
+        };
+
+        node_offset += mesh->bvh->node_count;
+        tri_offset += mesh->bvh->tri_count;
+    }
+}
+
+void scene_pack_lights( const struct scene *self, struct scene_block_light *lights )
+{
+    for ( u32 i = 0; i < self->light_count; i++ )
+    {
+        const struct scene_light *light = &self->lights[ i ];
+        lights[ i ] = ( struct scene_block_light ) {
+            .pos    = light->pos,
+            .radius = light->radius,
+            .color  = light->color,
+            .reach  = light->reach,
+            .power  = light->power
+        };
+    }
+}
+
+// send the slots that differ from what the buffers hold, returns true if any did
+static bool scene_upload_spheres_( const struct scene *self, struct scene_buffers *buffers )
+{
+    const struct spheres *spheres = &self->spheres;
+    if ( buffers->last_valid && buffers->sphere_version == spheres->version )
+        return false;
+
+    u32 count = spheres->count;
+    bool resized = count > buffers->sphere_cap;
+    if ( resized )
+    {
+        u32 cap = spheres->cap;
+        struct scene_block_sphere *last = realloc( buffers->last_spheres, cap * sizeof( *last ) );
+        if ( last )
+            buffers->last_spheres = last;
+        u32 *mats = realloc( buffers->last_sphere_mats, cap * sizeof( *mats ) );
+        if ( mats )
+            buffers->last_sphere_mats = mats;
+        if ( last == NULL || mats == NULL )
+        {
+            log_error( "Unable to allocate %u spheres for upload", cap );
+            return false;
+        }
+
+        tbo_buff( buffers->spheres, NULL, cap * sizeof( *last ) );
+        tbo_buff( buffers->sphere_mats, NULL, cap * sizeof( *mats ) );
+        buffers->sphere_cap = cap;
+    }
+
+    // one range from the first to the last changed slot
+    u32 begin = count;
+    u32 end = 0;
+    for ( u32 i = 0; i < count; i++ )
+    {
+        struct scene_block_sphere sphere = {
+            .center = {{ spheres->x[ i ], spheres->y[ i ], spheres->z[ i ] }},
+            .radius = spheres->radius[ i ]
+        };
+
+        if ( !resized && memcmp( &buffers->last_spheres[ i ], &sphere, sizeof( sphere ) ) == 0
+                && buffers->last_sphere_mats[ i ] == spheres->mat[ i ] )
+            continue;
+
+        buffers->last_spheres[ i ] = sphere;
+        buffers->last_sphere_mats[ i ] = spheres->mat[ i ];
+        begin = i < begin ? i : begin;
+        end = i + 1;
+    }
+
+    if ( begin < end )
+    {
+        tbo_buff_range( buffers->spheres, begin * sizeof( *buffers->last_spheres ),
+                buffers->last_spheres + begin, ( end - begin ) * sizeof( *buffers->last_spheres ) );
+        tbo_buff_range( buffers->sphere_mats, begin * sizeof( *buffers->last_sphere_mats ),
+                buffers->last_sphere_mats + begin, ( end - begin ) * sizeof( *buffers->last_sphere_mats ) );
+    }
+
+    bool changed = begin < end || count != buffers->sphere_count;
+    buffers->sphere_count = count;
+    buffers->sphere_version = spheres->version;
+    return changed;
+}
+
+bool scene_upload( const struct scene *self, struct scene_buffers *buffers, vec2s resolution )
+{
+    struct scene_block block;
+    struct scene_block_light lights[ SCENE_MAX_LIGHTS ];
+    scene_pack( self, resolution, &block );
+    scene_pack_lights( self, lights );
+
+    // the tiles only depend on the camera, the resolution and the lights
+    size_t lights_size = self->light_count * sizeof( *lights );
+    bool lights_changed = !buffers->last_valid || buffers->last.light_count != self->light_count
+            || memcmp( buffers->last_lights, lights, lights_size ) != 0;
+    bool tiles_changed = lights_changed || memcmp( &buffers->last.camera, &block.camera, sizeof( block.camera ) ) != 0
+            || buffers->last.resolution.x != block.resolution.x || buffers->last.resolution.y != block.resolution.y;
+
+    if ( tiles_changed )
+    {
+        if ( light_grid_build( &buffers->grid, self, ( int )resolution.x, ( int )resolution.y ) == 0 )
+            tbo_buff( buffers->tiles, buffers->grid.data, buffers->grid.len * sizeof( *buffers->grid.data ) );
+        else
+            buffers->grid = ( struct light_grid ){ .data = buffers->grid.data, .cap = buffers->grid.cap };
+    }
+
+    block.tile_size = ( u32 )buffers->grid.tile_size;
+    block.tiles_x   = ( u32 )buffers->grid.tiles_x;
+
+    bool spheres_changed = scene_upload_spheres_( self, buffers );
+
+    // counted with the other uniform uploads
+    if ( !tiles_changed && !spheres_changed && memcmp( &buffers->last, &block, sizeof( block ) ) == 0 )
+    {
+        shader_stats.skipped++;
+        return false;
+    }
+
+    if ( lights_changed )
+    {
+        memcpy( buffers->last_lights, lights, lights_size );
+        tbo_buff( buffers->lights, lights, lights_size );
+    }
+
+    buffers->last = block;
+    buffers->last_valid = true;
+    shader_stats.uploads++;
+
+    vbo_bind( buffers->block );
+    glBufferSubData( GL_UNIFORM_BUFFER, 0, sizeof( block ), &block );
+
+    return true;
+}
+
+void scene_upload_meshes( const struct scene *self, struct scene_buffers *buffers )
+{
+    size_t node_count = 0;
+    size_t tri_count = 0;
+
+    for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+    {
+        const struct bvh *bvh = self->meshes[ i ].bvh;
+        if ( bvh == NULL )
+            continue;
+
+        node_count += bvh->node_count;
+        tri_count += bvh->tri_count;
+    }
+
+    struct bvh_node *nodes = malloc( node_count * sizeof( *nodes ) + 1 );
+    struct vert *tris = malloc( tri_count * 3 * sizeof( *tris ) + 1 );
+    if ( nodes == NULL || tris == NULL )
+    {
+        log_error( "Unable to allocate %zu nodes and %zu triangles for upload", node_count, tri_count );
+        free( nodes );
+        free( tris );
+        return;
+    }
+
+    // node and triangle indices stay relative to their mesh, the shader adds the offsets
+    node_count = 0;
+    tri_count = 0;
+    for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+    {
+        const struct bvh *bvh = self->meshes[ i ].bvh;
+        if ( bvh == NULL )
+            continue;
+
+        memcpy( nodes + node_count, bvh->nodes, bvh->node_count * sizeof( *nodes ) );
+        memcpy( tris + tri_count * 3, bvh->tris, bvh->tri_count * 3 * sizeof( *tris ) );
+        node_count += bvh->node_count;
+        tri_count += bvh->tri_count;
+    }
+
+    tbo_buff( buffers->nodes, nodes, node_count * sizeof( *nodes ) );
+    tbo_buff( buffers->tris, tris, tri_count * 3 * sizeof( *tris ) );
+    free( nodes );
+    free( tris );
+}
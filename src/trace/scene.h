@@ -0,0 +1,228 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+/*
+ * Scene description shared by the GPU raytracer (uploaded as the scene_block
+ * uniform block of res/shaders/raytracer/frag.glsl) and the CPU reference
+ * tracer. Every struct here mirrors the struct of the same name in the
+ * fragment shader.
+ */
+
+#include "light_grid.h"
+#include "spheres.h"
+
+#include <gfx/camera.h>
+#include <gfx/shader.h>
+#include <gfx/tbo.h>
+#include <gfx/vbo.h>
+#include <util/types.h>
+#include <cglm/cglm.h>
+#include <cglm/struct.h>
+
+// must match MAX_MATERIAL_COUNT in frag.glsl
+#define SCENE_MAX_MATERIALS 256
+
+// lights live in the scene_lights buffer, not in the uniform block
+#define SCENE_MAX_LIGHTS  256
+
+// must match MAX_MESH_COUNT in frag.glsl
+#define SCENE_MAX_MESHES  4
+
+// reflection bounces after the primary hit of a new scene
+#define SCENE_MAX_DEPTH   4
+
+// texture units of the mesh and light buffers in frag.glsl, ACCUM_UNIT is 2
+#define SCENE_UNIT_NODES  0
+#define SCENE_UNIT_TRIS   1
+#define SCENE_UNIT_LIGHTS 3
+#define SCENE_UNIT_TILES  4
+#define SCENE_UNIT_SPHERES     5
+#define SCENE_UNIT_SPHERE_MATS 6
+
+// uniform buffer binding of scene_block in frag.glsl
+#define SCENE_BLOCK_BINDING 0
+
+struct scene_material
+{
+    vec3s color;
+    float reflectiveness;
+};
+
+/* point lighting */
+struct scene_light
+{
+    vec3s pos;
+    float radius;
+    vec3s color;
+    float reach;
+    float power;
+};
+
+struct scene_plane
+{
+    vec3s pos;
+    vec3s norm;
+};
+
+struct bvh;
+
+struct scene_mesh
+{
+    const struct bvh *bvh;  /* NULL if the slot is unused */
+    struct scene_material mat;
+};
+
+struct scene
+{
+    struct camera camera;
+    struct spheres spheres;     /* their mat indexes materials */
+    struct scene_material materials[ SCENE_MAX_MATERIALS ];
+    u32 material_count;
+    struct scene_light lights[ SCENE_MAX_LIGHTS ];
+    u32 light_count;
+    struct scene_plane plane;
+    struct scene_mesh meshes[ SCENE_MAX_MESHES ];
+
+    // reflection bounces traced after the primary hit
+    u32 max_depth;
+
+    // shadow rays toward the lights, unlit where occluded
+    bool shadows;
+};
+
+/*
+ * std140 mirror of the scene_block uniform block in frag.glsl. A vec3 takes
+ * 16 bytes so every one is followed by a 4 byte member or padding.
+ */
+struct scene_block_material
+{
+    vec3s color;
+    float reflectiveness;
+};
+
+struct scene_block_camera
+{
+    mat4s view;
+    vec3s eye;
+    float fov;
+};
+
+struct scene_block_plane
+{
+    vec3s pos;
+    float pad0_;
+    vec3s norm;
+    float pad1_;
+};
+
+// also the layout of a light in scene_lights, 3 RGBA32F texels
+struct scene_block_light
+{
+    vec3s pos;
+    float radius;
+    vec3s color;
+    float reach;
+    float power;
+    float pad_[ 3 ];
+};
+
+// a texel of scene_spheres, its material index is in sphere_materials
+struct scene_block_sphere
+{
+    vec3s center;
+    float radius;
+};
+
+struct scene_block_mesh
+{
+    u32 node_offset;
+    u32 tri_offset;
+    u32 pad_[ 2 ];
+    struct scene_block_material mat;
+};
+
+struct scene_block
+{
+    struct scene_block_camera camera;
+    struct scene_block_plane plane;
+    vec2s resolution;
+    u32 mesh_count;
+    u32 max_depth;
+    u32 light_count;
+    u32 tile_size;      /* light tiles, see light_grid.h */
+    u32 tiles_x;
+    u32 shadows;
+    u32 sphere_count;
+    u32 pad_[ 3 ];
+    struct scene_block_mesh meshes[ SCENE_MAX_MESHES ];
+    struct scene_block_material materials[ SCENE_MAX_MATERIALS ];
+};
+
+// gpu side of the scene
+struct scene_buffers
+{
+    struct vbo block;   /* GL_UNIFORM_BUFFER holding a scene_block */
+    struct scene_block last;    /* what block holds, unchanged scenes are not sent */
+    bool last_valid;
+
+    // bvh nodes and triangles of every mesh, packed one mesh after the other
+    struct tbo nodes;   /* GL_RGBA32UI, 2 texels per node   */
+    struct tbo tris;    /* GL_RGBA32F, 6 texels per triangle */
+
+    // lights and the lights of every screen tile, rebuilt when the scene changes
+    struct tbo lights;  /* GL_RGBA32F, a scene_block_light per light */
+    struct tbo tiles;   /* GL_R32UI, the data of grid */
+    struct light_grid grid;
+    struct scene_block_light last_lights[ SCENE_MAX_LIGHTS ];
+
+    // a texel per sphere and its material, only the changed slots are resent
+    struct tbo spheres;         /* GL_RGBA32F, a scene_block_sphere per sphere */
+    struct tbo sphere_mats;     /* GL_R32UI */
+    struct scene_block_sphere *last_spheres;
+    u32 *last_sphere_mats;
+    u32 sphere_count;
+    u32 sphere_cap;             /* spheres the buffers have room for */
+    u32 sphere_version;
+};
+
+// the five sphere scene the game starts with, free it before another init
+void scene_init_default( struct scene *self, float fov );
+void scene_free( struct scene *self );
+
+// a single mesh on the ground plane with the camera looking at it
+void scene_init_mesh( struct scene *self, const struct bvh *bvh, float fov );
+
+// returns the mesh slot or -1 if the scene is full
+int scene_add_mesh( struct scene *self, const struct bvh *bvh, struct scene_material mat );
+
+// returns the light index or -1 if the scene is full
+int scene_add_light( struct scene *self, struct scene_light light );
+
+// returns the material index or -1 if the scene is full
+int scene_add_material( struct scene *self, struct scene_material mat );
+
+// returns the sphere handle (see spheres.h) or SPHERES_NONE, mat is a material index
+u32 scene_add_sphere( struct scene *self, vec3s center, float radius, u32 mat );
+
+// create the buffers and attach them to the raytracer shader, returns 0 on success
+int  scene_buffers_init( struct scene_buffers *self, struct shader shader );
+void scene_buffers_free( struct scene_buffers *self );
+
+// point another raytracer program (e.g. a variant.h one) at the buffers, binds it
+int  scene_buffers_attach( struct scene_buffers *self, struct shader shader );
+
+// fill the uniform block from the scene
+void scene_pack( const struct scene *self, vec2s resolution, struct scene_block *block );
+
+// fill the scene_lights texels, one scene_block_light per light of the scene
+void scene_pack_lights( const struct scene *self, struct scene_block_light *lights );
+
+// send camera, plane, materials and meshes (one glBufferSubData, none if
+// nothing changed since the last upload), the spheres that changed and the
+// lights with their tiles, returns true if anything changed
+bool scene_upload( const struct scene *self, struct scene_buffers *buffers, vec2s resolution );
+
+// send bvh nodes and triangles of the meshes, only needed when meshes change
+void scene_upload_meshes( const struct scene *self, struct scene_buffers *buffers );
+
+#endif
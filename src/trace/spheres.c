@@ -0,0 +1,179 @@
+#include "spheres.h"
+
+#include <data/dynarr.h>
+#include <util/log.h>
+#include <util/aligned.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// arrays in the order they sit in the single allocation
+#define SPHERES_ARRAYS 6
+
+static inline void spheres_pad_( struct spheres *self, u32 begin, u32 end )
+{
+    for ( u32 i = begin; i < end; i++ )
+    {
+        self->x[ i ] = NAN;
+        self->y[ i ] = NAN;
+        self->z[ i ] = NAN;
+        self->radius[ i ] = 0.0f;
+        self->mat[ i ] = 0;
+        self->handle[ i ] = SPHERES_NONE;
+    }
+}
+
+// every array is cap floats (or u32s) long, a multiple of SPHERES_ALIGN bytes
+static int spheres_grow_( struct spheres *self, u32 cap )
+{
+    cap = ( cap + SPHERES_BLOCK - 1 ) / SPHERES_BLOCK * SPHERES_BLOCK;
+
+    size_t array = ( size_t )cap * sizeof( float );
+    char *block = aligned_malloc( SPHERES_ALIGN, array * SPHERES_ARRAYS );
+    if ( block == NULL )
+    {
+        log_error( "Unable to allocate %u spheres", cap );
+        return SPHERES_ERROR;
+    }
+
+    float *x = ( float * )( block + 0 * array );
+    float *y = ( float * )( block + 1 * array );
+    float *z = ( float * )( block + 2 * array );
+    float *radius = ( float * )( block + 3 * array );
+    u32 *mat = ( u32 * )( block + 4 * array );
+    u32 *handle = ( u32 * )( block + 5 * array );
+
+    if ( self->count > 0 )
+    {
+        memcpy( x, self->x, self->count * sizeof( *x ) );
+        memcpy( y, self->y, self->count * sizeof( *y ) );
+        memcpy( z, self->z, self->count * sizeof( *z ) );
+        memcpy( radius, self->radius, self->count * sizeof( *radius ) );
+        memcpy( mat, self->mat, self->count * sizeof( *mat ) );
+        memcpy( handle, self->handle, self->count * sizeof( *handle ) );
+    }
+
+    // x is the start of the allocation
+    aligned_free( self->x );
+    self->x = x;
+    self->y = y;
+    self->z = z;
+    self->radius = radius;
+    self->mat = mat;
+    self->handle = handle;
+    self->cap = cap;
+
+    spheres_pad_( self, self->count, cap );
+    return SPHERES_SUCCESS;
+}
+
+void spheres_free( struct spheres *self )
+{
+    aligned_free( self->x );
+    dynarr_free( self->slots );
+    dynarr_free( self->free_handles );
+    *self = ( struct spheres ){ 0 };
+}
+
+void spheres_clear( struct spheres *self )
+{
+    if ( self->cap > 0 )
+        spheres_pad_( self, 0, self->count );
+
+    self->count = 0;
+    self->version++;
+
+    if ( self->slots )
+        dynarr_clear( self->slots );
+    if ( self->free_handles )
+        dynarr_clear( self->free_handles );
+}
+
+int spheres_reserve( struct spheres *self, u32 count )
+{
+    if ( count <= self->cap )
+        return SPHERES_SUCCESS;
+
+    return spheres_grow_( self, count );
+}
+
+u32 spheres_add( struct spheres *self, vec3s center, float radius, u32 mat )
+{
+    if ( self->count == self->cap && spheres_grow_( self, self->cap + self->cap / 2 + SPHERES_BLOCK ) != SPHERES_SUCCESS )
+        return SPHERES_NONE;
+
+    u32 handle;
+    if ( dynarr_size( self->free_handles ) > 0 )
+    {
+        handle = self->free_handles[ dynarr_size( self->free_handles ) - 1 ];
+        dynarr_pop_back( self->free_handles );
+    }
+    else
+    {
+        handle = ( u32 )dynarr_size( self->slots );
+        dynarr_push_back( self->slots, SPHERES_NONE );
+    }
+
+    u32 slot = self->count++;
+    self->x[ slot ] = center.x;
+    self->y[ slot ] = center.y;
+    self->z[ slot ] = center.z;
+    self->radius[ slot ] = radius;
+    self->mat[ slot ] = mat;
+    self->handle[ slot ] = handle;
+    self->slots[ handle ] = slot;
+    self->version++;
+
+    return handle;
+}
+
+u32 spheres_slot( const struct spheres *self, u32 handle )
+{
+    if ( handle >= dynarr_size( self->slots ) )
+        return SPHERES_NONE;
+
+    return self->slots[ handle ];
+}
+
+bool spheres_remove( struct spheres *self, u32 handle )
+{
+    u32 slot = spheres_slot( self, handle );
+    if ( slot == SPHERES_NONE )
+        return false;
+
+    // the last sphere fills the hole
+    u32 last = --self->count;
+    if ( slot != last )
+    {
+        self->x[ slot ] = self->x[ last ];
+        self->y[ slot ] = self->y[ last ];
+        self->z[ slot ] = self->z[ last ];
+        self->radius[ slot ] = self->radius[ last ];
+        self->mat[ slot ] = self->mat[ last ];
+        self->handle[ slot ] = self->handle[ last ];
+        self->slots[ self->handle[ slot ] ] = slot;
+    }
+
+    spheres_pad_( self, last, last + 1 );
+    self->slots[ handle ] = SPHERES_NONE;
+    dynarr_push_back( self->free_handles, handle );
+    self->version++;
+
+    return true;
+}
+
+bool spheres_set( struct spheres *self, u32 handle, vec3s center, float radius )
+{
+    u32 slot = spheres_slot( self, handle );
+    if ( slot == SPHERES_NONE )
+        return false;
+
+    self->x[ slot ] = center.x;
+    self->y[ slot ] = center.y;
+    self->z[ slot ] = center.z;
+    self->radius[ slot ] = radius;
+    self->version++;
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef SPHERES_H
+#define SPHERES_H
+
+/*
+ * The spheres of a scene in SoA form: centers, radii and material indices
+ * each live in their own array, aligned and padded to whole SPHERES_BLOCKs
+ * so a kernel loads a block of spheres per instruction. Padding slots have a
+ * nan center and never hit. Removing a sphere moves the last one into its
+ * slot, so slots change while handles stay the same.
+ */
+
+#include <util/types.h>
+#include <cglm/struct.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SPHERES_SUCCESS 0
+#define SPHERES_ERROR  -1
+
+#define SPHERES_ALIGN 64
+#define SPHERES_BLOCK 16    /* slots are allocated in blocks, the widest kernel */
+#define SPHERES_NONE  ( ( u32 )-1 )
+
+// zero initialized it is empty
+struct spheres
+{
+    float *x;
+    float *y;
+    float *z;
+    float *radius;
+    u32 *mat;           /* material of the scene */
+    u32 *handle;        /* of the sphere in each slot */
+    u32 count;
+    u32 cap;            /* slots of every array, a multiple of SPHERES_BLOCK */
+
+    // slot of every handle, SPHERES_NONE once removed (removed handles are reused)
+    u32 *slots;         /* dynarr */
+    u32 *free_handles;  /* dynarr */
+
+    // bumped by every change
+    u32 version;
+};
+
+void spheres_free( struct spheres *self );
+
+// removes every sphere, keeps the memory
+void spheres_clear( struct spheres *self );
+
+// room for count spheres without another allocation
+int  spheres_reserve( struct spheres *self, u32 count );
+
+// returns the handle of the sphere or SPHERES_NONE if out of memory
+u32  spheres_add( struct spheres *self, vec3s center, float radius, u32 mat );
+
+// false if the handle is not in use
+bool spheres_remove( struct spheres *self, u32 handle );
+bool spheres_set( struct spheres *self, u32 handle, vec3s center, float radius );
+
+// slot of a handle, SPHERES_NONE if not in use
+u32  spheres_slot( const struct spheres *self, u32 handle );
+
+static inline vec3s spheres_center( const struct spheres *self, u32 slot )
+{
+    return ( vec3s ){{ self->x[ slot ], self->y[ slot ], self->z[ slot ] }};
+}
+
+#endif
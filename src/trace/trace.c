@@ -0,0 +1,439 @@
+#include "trace.h"
+#include "bvh.h"
+
+#include <util/fmath.h>
+#include <math.h>
+#include <string.h>
+
+static inline vec3s trace_reflect_( vec3s i, vec3s n )
+{
+    return glms_vec3_sub( i, glms_vec3_scale( n, 2.0f * glms_vec3_dot( n, i ) ) );
+}
+
+static inline struct hitdata trace_miss_( void )
+{
+    return ( struct hitdata ){ .hit = false };
+}
+
+void trace_context_init( struct trace_context *ctx, const struct scene *scene, int w, int h )
+{
+    const mat4s view = scene->camera.view;
+
+    *ctx = ( struct trace_context ){ 0 };
+    ctx->scene = scene;
+    ctx->resolution = ( vec2s ){{ ( float )w, ( float )h }};
+
+    ctx->cam_u = ( vec3s ){{ view.raw[ 0 ][ 0 ], view.raw[ 1 ][ 0 ], view.raw[ 2 ][ 0 ] }};
+    ctx->cam_v = ( vec3s ){{ view.raw[ 0 ][ 1 ], view.raw[ 1 ][ 1 ], view.raw[ 2 ][ 1 ] }};
+    ctx->cam_w = ( vec3s ){{ view.raw[ 0 ][ 2 ], view.raw[ 1 ][ 2 ], view.raw[ 2 ][ 2 ] }};
+
+    float height = 2.0f * tanf( scene->camera.fov / 2.0f );
+    float aspect = ctx->resolution.x / ctx->resolution.y;
+    float width = height * aspect;
+
+    ctx->window_dim = ( vec2s ){{ width, height }};
+    ctx->pixel_size = ( vec2s ){{ width / ctx->resolution.x, height / ctx->resolution.y }};
+}
+
+// radical inverse of i in the given base
+static float trace_halton_( u32 i, u32 base )
+{
+    float f = 1.0f;
+    float r = 0.0f;
+
+    while ( i > 0 )
+    {
+        f /= ( float )base;
+        r += f * ( float )( i % base );
+        i /= base;
+    }
+
+    return r;
+}
+
+vec2s trace_jitter( u32 frame )
+{
+    if ( frame == 0 )
+        return GLMS_VEC2_ZERO;
+
+    // halton ( 2, 3 ) covers the pixel evenly for any number of frames
+    return ( vec2s ){{ trace_halton_( frame, 2 ) - 0.5f, trace_halton_( frame, 3 ) - 0.5f }};
+}
+
+/* ======================================================== */
+/* --------------------------- */
+/* COLLISION / INTERSECTION    */
+/* --------------------------- */
+
+bool trace_intersect_tri( struct ray ray, const struct vert tri[ 3 ], float *out_dist, float *out_u, float *out_v )
+{
+    vec3s edge_ab = glms_vec3_sub( tri[ 1 ].vp, tri[ 0 ].vp );
+    vec3s edge_ac = glms_vec3_sub( tri[ 2 ].vp, tri[ 0 ].vp );
+    vec3s normal_vector = glms_vec3_cross( edge_ab, edge_ac );
+
+    vec3s ao = glms_vec3_sub( ray.orig, tri[ 0 ].vp );
+    vec3s dao = glms_vec3_cross( ao, ray.dir );
+
+    float det = -glms_vec3_dot( ray.dir, normal_vector );
+    float inv_det = 1.0f / det;
+
+    // calculate dist to triangle & barycentric coordinates of intersection point
+    float dist = glms_vec3_dot( ao, normal_vector ) * inv_det;
+    float u = glms_vec3_dot( edge_ac, dao ) * inv_det;
+    float v = -glms_vec3_dot( edge_ab, dao ) * inv_det;
+    float w = 1.0f - u - v;
+
+    *out_dist = dist;
+    *out_u = u;
+    *out_v = v;
+
+    return det >= TRACE_EPSILON && dist >= 0.0f && u >= 0.0f && v >= 0.0f && w >= 0.0f;
+}
+
+struct hitdata trace_tri_hitdata( struct ray ray, const struct vert tri[ 3 ], float dist, float u, float v )
+{
+    float w = 1.0f - u - v;
+
+    vec3s normal = glms_vec3_scale( tri[ 0 ].vn, w );
+    normal = glms_vec3_add( normal, glms_vec3_scale( tri[ 1 ].vn, u ) );
+    normal = glms_vec3_add( normal, glms_vec3_scale( tri[ 2 ].vn, v ) );
+
+    struct hitdata hitdata = trace_miss_();
+    hitdata.hit       = true;
+    hitdata.hit_point = glms_vec3_add( ray.orig, glms_vec3_scale( ray.dir, dist ) );
+    hitdata.normal    = glms_vec3_normalize( normal );
+    hitdata.dist      = dist;
+    return hitdata;
+}
+
+struct hitdata trace_hit_tri( struct ray ray, const struct vert tri[ 3 ] )
+{
+    float dist, u, v;
+
+    if ( !trace_intersect_tri( ray, tri, &dist, &u, &v ) )
+        return trace_miss_();
+
+    return trace_tri_hitdata( ray, tri, dist, u, v );
+}
+
+// distance to the sphere, shared by the closest and any hit paths
+static inline bool trace_sphere_dist_( struct ray ray, vec3s center, float radius, float *out_dist )
+{
+    /* offset from center */
+    vec3s oc = glms_vec3_sub( ray.orig, center );
+
+    /* solving for dist results in a quadratic equation with coefficients */
+    float a = glms_vec3_dot( ray.dir, ray.dir );
+    float b = 2.0f * glms_vec3_dot( oc, ray.dir );
+    float c = glms_vec3_dot( oc, oc ) - radius * radius;
+    float discriminant = b * b - 4.0f * a * c;
+
+    /* sphere does not intersect */
+    if ( discriminant < 0.0f )
+        return false;
+
+    *out_dist = ( -b - sqrtf( discriminant ) ) / ( 2.0f * a );
+
+    /* intersection is behind */
+    return *out_dist >= 0.0f;
+}
+
+static inline bool trace_plane_dist_( struct ray ray, const struct scene_plane *plane, float *out_dist )
+{
+    float denom = glms_vec3_dot( plane->norm, ray.dir );
+
+    if ( fabsf( denom ) <= TRACE_EPSILON )
+        return false;
+
+    *out_dist = glms_vec3_dot( glms_vec3_sub( plane->pos, ray.orig ), plane->norm ) / denom;
+    return *out_dist >= TRACE_EPSILON;
+}
+
+struct hitdata trace_hit_sphere( struct ray ray, vec3s center, float radius )
+{
+    struct hitdata hitdata = trace_miss_();
+    float dist;
+
+    if ( !trace_sphere_dist_( ray, center, radius, &dist ) )
+        return hitdata;
+
+    /* ray intersects with sphere */
+    hitdata.hit = true;
+    hitdata.dist = dist;
+    hitdata.hit_point = glms_vec3_add( ray.orig, glms_vec3_scale( ray.dir, dist ) );
+    hitdata.normal = glms_vec3_normalize( glms_vec3_sub( hitdata.hit_point, center ) );
+
+    return hitdata;
+}
+
+struct hitdata trace_hit_plane( struct ray ray, const struct scene_plane *plane )
+{
+    struct hitdata hitdata = trace_miss_();
+    float dist;
+
+    if ( !trace_plane_dist_( ray, plane, &dist ) )
+        return hitdata;
+
+    hitdata.hit = true;
+    hitdata.dist = dist;
+    hitdata.hit_point = glms_vec3_add( ray.orig, glms_vec3_scale( ray.dir, dist ) );
+    hitdata.normal = plane->norm;
+
+    /* preassigned values for plane (same as the shader) */
+    hitdata.mat.color = ( vec3s ){{ 0.5f, 0.5f, 0.5f }};
+    hitdata.mat.reflectiveness = 0.0f;
+
+    return hitdata;
+}
+
+struct hitdata trace_hit_spheres( struct ray ray, const struct scene *scene, float max_dist )
+{
+    const struct spheres *spheres = &scene->spheres;
+    u32 closest = SPHERES_NONE;
+    float dist;
+
+    // the material and normal are only needed for the closest
+    for ( u32 i = 0; i < spheres->count; i++ )
+    {
+        if ( trace_sphere_dist_( ray, spheres_center( spheres, i ), spheres->radius[ i ], &dist ) && dist < max_dist )
+        {
+            max_dist = dist;
+            closest = i;
+        }
+    }
+
+    if ( closest == SPHERES_NONE )
+        return trace_miss_();
+
+    struct hitdata hitdata = trace_hit_sphere( ray, spheres_center( spheres, closest ), spheres->radius[ closest ] );
+    hitdata.mat = scene->materials[ spheres->mat[ closest ] ];
+    return hitdata;
+}
+
+/* ======================================================== */
+
+/* ======================================================== */
+/* --------------------------- */
+/* RAY CAST                    */
+/* --------------------------- */
+
+struct ray trace_camera_ray( const struct trace_context *ctx, vec2s pixel )
+{
+    struct ray self;
+    self.orig = ctx->scene->camera.eye;
+
+    vec2s delta = {{
+        -0.5f * ctx->window_dim.x + pixel.x * ctx->pixel_size.x,
+        -0.5f * ctx->window_dim.y + pixel.y * ctx->pixel_size.y
+    }};
+
+    self.dir = glms_vec3_scale( ctx->cam_w, -1.0f );
+    self.dir = glms_vec3_add( self.dir, glms_vec3_scale( ctx->cam_v, delta.y ) );
+    self.dir = glms_vec3_add( self.dir, glms_vec3_scale( ctx->cam_u, delta.x ) );
+    self.dir = glms_vec3_normalize( self.dir );
+
+    return self;
+}
+
+struct hitdata trace_raycast( struct trace_context *ctx, struct ray ray )
+{
+    const struct scene *scene = ctx->scene;
+    struct hitdata hitdata = trace_miss_();
+    float min_dist = TRACE_RENDER_DISTANCE;
+
+    ctx->rays++;
+
+    /* sphere collision */
+    struct hitdata tmp = trace_hit_spheres( ray, scene, min_dist );
+    if ( tmp.hit )
+    {
+        hitdata = tmp;
+        min_dist = tmp.dist;
+    }
+
+    /* plane collision */
+    tmp = trace_hit_plane( ray, &scene->plane );
+    if ( tmp.hit && tmp.dist < min_dist )
+    {
+        hitdata = tmp;
+        min_dist = tmp.dist;
+    }
+
+    /* mesh collision */
+    for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+    {
+        const struct scene_mesh *mesh = &scene->meshes[ i ];
+        struct bvh_hit hit;
+
+        if ( mesh->bvh && bvh_intersect( mesh->bvh, ray, min_dist, &hit ) )
+        {
+            hitdata = trace_tri_hitdata( ray, &mesh->bvh->tris[ hit.tri * 3 ], hit.dist, hit.u, hit.v );
+            hitdata.mat = mesh->mat;
+            min_dist = hit.dist;
+        }
+    }
+
+    return hitdata;
+}
+
+bool trace_occluded( struct trace_context *ctx, struct ray ray, float max_dist )
+{
+    const struct scene *scene = ctx->scene;
+    float dist;
+
+    ctx->rays++;
+
+    const struct spheres *spheres = &scene->spheres;
+    for ( u32 i = 0; i < spheres->count; i++ )
+    {
+        if ( trace_sphere_dist_( ray, spheres_center( spheres, i ), spheres->radius[ i ], &dist ) && dist < max_dist )
+            return true;
+    }
+
+    if ( trace_plane_dist_( ray, &scene->plane, &dist ) && dist < max_dist )
+        return true;
+
+    for ( int i = 0; i < SCENE_MAX_MESHES; i++ )
+    {
+        const struct bvh *bvh = scene->meshes[ i ].bvh;
+        if ( bvh && bvh_occluded( bvh, ray, max_dist ) )
+            return true;
+    }
+
+    return false;
+}
+
+/* ======================================================== */
+
+/* ======================================================== */
+/* --------------------------- */
+/* COMPUTE LIGHT               */
+/* --------------------------- */
+
+vec3s trace_raycast_to_light( struct trace_context *ctx, const struct hitdata *hitdata )
+{
+    vec3s color = GLMS_VEC3_ZERO;
+
+    if ( !hitdata->hit )
+        return color;
+
+    /* get color from the light sources, the reach check does what the light tiles of the shader do */
+    for ( u32 i = 0; i < ctx->scene->light_count; i++ )
+    {
+        const struct scene_light *light = &ctx->scene->lights[ i ];
+
+        float light_dist = glms_vec3_distance( light->pos, hitdata->hit_point );
+        if ( light_dist > light->reach )
+            continue;
+
+        /* ray to light */
+        struct ray rtl;
+        rtl.dir = glms_vec3_normalize( glms_vec3_sub( light->pos, hitdata->hit_point ) );
+        rtl.orig = hitdata->hit_point;
+
+        /* no color if anything is between the hit point and the light */
+        if ( ctx->scene->shadows && trace_occluded( ctx, rtl, light_dist ) )
+            continue;
+
+        float diffuse = clamp( glms_vec3_dot( hitdata->normal, rtl.dir ), 0.0f, 1.0f );
+        float intensity = light->power * diffuse * glms_vec3_dot( hitdata->normal, rtl.dir );
+
+        color = glms_vec3_add( color, glms_vec3_scale( glms_vec3_mul( light->color, hitdata->mat.color ), intensity ) );
+    }
+
+    return color;
+}
+
+// uniform in [ 0, 1 ), the same for the same hit so packets match single rays
+static float trace_random_( const struct trace_context *ctx, const struct hitdata *hitdata, u32 depth )
+{
+    u32 bits[ 3 ];
+    memcpy( bits, hitdata->hit_point.raw, sizeof( bits ) );
+
+    u32 h = ctx->seed * 0x9e3779b9u ^ depth;
+    for ( int i = 0; i < 3; i++ )
+    {
+        h ^= bits[ i ];
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+    }
+
+    return ( float )( h >> 8 ) / ( float )( 1u << 24 );
+}
+
+struct trace_bounce trace_bounce( const struct trace_context *ctx, const struct hitdata *hitdata, u32 depth, float throughput )
+{
+    float r = hitdata->mat.reflectiveness;
+    float next = throughput * r;
+
+    /* the last hit of a path gets all of the direct light */
+    struct trace_bounce last = { .light = throughput, .next = 0.0f };
+
+    if ( depth >= ctx->scene->max_depth || r <= TRACE_MIN_REFLECTIVENESS )
+        return last;
+
+    if ( next < TRACE_MIN_THROUGHPUT )
+    {
+        if ( !ctx->roulette )
+            return last;
+
+        // survivors carry the weight of the paths that were cut
+        float p = next / TRACE_MIN_THROUGHPUT;
+        if ( trace_random_( ctx, hitdata, depth ) >= p )
+            return ( struct trace_bounce ){ .light = throughput * ( 1.0f - r ), .next = 0.0f };
+        next = TRACE_MIN_THROUGHPUT;
+    }
+
+    return ( struct trace_bounce ){ .light = throughput * ( 1.0f - r ), .next = next };
+}
+
+struct trace_guide trace_guide( const struct hitdata *hitdata, float depth )
+{
+    if ( !hitdata->hit )
+        return ( struct trace_guide ){ .normal = GLMS_VEC3_ZERO, .depth = TRACE_RENDER_DISTANCE };
+
+    return ( struct trace_guide ){ .normal = hitdata->normal, .depth = depth };
+}
+
+vec3s trace_compute_color( struct trace_context *ctx, struct ray ray, struct trace_guide *guide )
+{
+    vec3s color = GLMS_VEC3_ZERO;
+    float throughput = 1.0f;
+    float length = 0.0f;
+    bool guiding = guide != NULL;
+
+    ctx->paths++;
+
+    for ( u32 depth = 0; throughput > 0.0f; depth++ )
+    {
+        struct hitdata hitdata = trace_raycast( ctx, ray );
+        ctx->segments++;
+
+        // mirrors show what they reflect, the guide follows the reflection
+        // unless it leaves the scene (the outline of the mirror stays)
+        if ( guiding && ( hitdata.hit || depth == 0 ) )
+        {
+            length += hitdata.dist;
+            *guide = trace_guide( &hitdata, length );
+        }
+        guiding = guiding && hitdata.hit && hitdata.mat.reflectiveness > TRACE_GUIDE_REFLECTIVENESS;
+
+        if ( !hitdata.hit )
+            break;
+
+        struct trace_bounce bounce = trace_bounce( ctx, &hitdata, depth, throughput );
+        color = glms_vec3_add( color, glms_vec3_scale( trace_raycast_to_light( ctx, &hitdata ), bounce.light ) );
+        throughput = bounce.next;
+
+        /* reflected ray */
+        ray.dir = trace_reflect_( ray.dir, hitdata.normal );
+        ray.orig = hitdata.hit_point;
+    }
+
+    return color;
+}
+
+/* ======================================================== */
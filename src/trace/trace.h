@@ -0,0 +1,114 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Scalar C port of res/shaders/raytracer/frag.glsl. Each function mirrors the
+ * GLSL function of the same name so the CPU tracer can be used as a golden
+ * reference for the shader. Keep the two in sync.
+ */
+
+#include "scene.h"
+#include <gfx/obj3d.h>
+#include <util/types.h>
+#include <stdbool.h>
+
+#define TRACE_EPSILON         1e-4f
+#define TRACE_RENDER_DISTANCE 100000000.0f
+
+// reflections are skipped below these, same as frag.glsl
+#define TRACE_MIN_REFLECTIVENESS 1e-3f
+#define TRACE_MIN_THROUGHPUT     0.01f
+
+// the guide of a path moves on to the reflection above this, same as frag.glsl
+#define TRACE_GUIDE_REFLECTIVENESS 0.5f
+
+struct ray
+{
+    vec3s orig;
+    vec3s dir;
+};
+
+struct hitdata
+{
+    bool hit;
+    float dist;
+    vec3s hit_point;
+    vec3s normal;
+    struct scene_material mat;
+};
+
+// surface a camera path shows, what the denoiser is guided by (see denoise.h):
+// the first hit, or what it reflects if it is more mirror than surface
+struct trace_guide
+{
+    vec3s normal;   /* zero on a miss */
+    float depth;    /* length of the path up to the surface, TRACE_RENDER_DISTANCE on a miss */
+};
+
+// per thread state for tracing a single frame
+struct trace_context
+{
+    const struct scene *scene;
+    vec2s resolution;
+
+    // camera basis taken from the view matrix (same as camera_raycast)
+    vec3s cam_u;
+    vec3s cam_v;
+    vec3s cam_w;
+    vec2s pixel_size;
+    vec2s window_dim;
+
+    // sub pixel offset of every camera ray (the shader's jitter uniform)
+    vec2s jitter;
+
+    // russian roulette instead of cutting paths off at TRACE_MIN_THROUGHPUT,
+    // unbiased when averaged but no longer matches the shader
+    bool roulette;
+    u32 seed;
+
+    // number of rays cast with this context
+    u64 rays;
+
+    // camera paths and the closest hit rays cast along them
+    u64 paths;
+    u64 segments;
+};
+
+// what is left of a path after a hit
+struct trace_bounce
+{
+    float light;    /* weight of the direct light at the hit */
+    float next;     /* throughput of the reflected ray, 0 ends the path */
+};
+
+void trace_context_init( struct trace_context *ctx, const struct scene *scene, int w, int h );
+
+// intersection
+bool trace_intersect_tri( struct ray ray, const struct vert tri[ 3 ], float *dist, float *u, float *v );
+struct hitdata trace_tri_hitdata( struct ray ray, const struct vert tri[ 3 ], float dist, float u, float v );
+struct hitdata trace_hit_tri( struct ray ray, const struct vert tri[ 3 ] );
+struct hitdata trace_hit_sphere( struct ray ray, vec3s center, float radius );
+struct hitdata trace_hit_plane( struct ray ray, const struct scene_plane *plane );
+
+// closest sphere of the scene nearer than max_dist
+struct hitdata trace_hit_spheres( struct ray ray, const struct scene *scene, float max_dist );
+
+// sub pixel offset in [ -0.5, 0.5 ) of an accumulated frame, frame 0 is the pixel center
+vec2s trace_jitter( u32 frame );
+
+// ray cast
+struct ray trace_camera_ray( const struct trace_context *ctx, vec2s pixel );
+struct hitdata trace_raycast( struct trace_context *ctx, struct ray ray );
+
+// true if anything is hit closer than max_dist, stops at the first hit
+bool trace_occluded( struct trace_context *ctx, struct ray ray, float max_dist );
+
+// compute light
+vec3s trace_raycast_to_light( struct trace_context *ctx, const struct hitdata *hitdata );
+struct trace_bounce trace_bounce( const struct trace_context *ctx, const struct hitdata *hitdata, u32 depth, float throughput );
+struct trace_guide trace_guide( const struct hitdata *hitdata, float depth );
+
+// guide is set to the surface the path shows unless it is NULL
+vec3s trace_compute_color( struct trace_context *ctx, struct ray ray, struct trace_guide *guide );
+
+#endif
@@ -0,0 +1,276 @@
+#include "tracer.h"
+#include "trace.h"
+
+#include <SDL2/SDL.h>
+#include <system/jobs.h>
+#include <util/log.h>
+#include <util/fmath.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// shared by every chunk of tiles during a single tracer_render call
+struct tracer_job_
+{
+    struct tracer *self;
+    const struct scene *scene;
+    int tiles_x;
+    vec2s jitter;
+    float weight;       /* of the new frame in the running average */
+    struct tracer_stats_ *stats;   /* one per job slot */
+};
+
+// rays cast by one thread, cache line sized so threads do not share one
+struct tracer_stats_
+{
+    u64 rays;
+    u64 paths;
+    u64 segments;
+    u64 pad_[ 5 ];
+};
+
+// gl_FragCoord has its origin at the bottom left pixel center
+static inline vec2s tracer_frag_coord_( const struct tracer *self, const struct trace_context *ctx, int x, int y )
+{
+    return ( vec2s ){{ x + 0.5f + ctx->jitter.x, ( self->h - 1 - y ) + 0.5f + ctx->jitter.y }};
+}
+
+// same blend as the end of the shader's main
+static inline void tracer_store_( struct tracer *self, float weight, int x, int y, vec3s color )
+{
+    vec3s *pixel = &self->pixels[ y * self->w + x ];
+    *pixel = weight < 1.0f ? glms_vec3_lerp( *pixel, color, weight ) : color;
+}
+
+static inline struct trace_guide *tracer_guide_( struct tracer *self, int x, int y )
+{
+    return &self->guide[ y * self->w + x ];
+}
+
+// trace a PACKET_DIM x PACKET_DIM block of pixels as one packet
+static inline void tracer_render_block_( struct tracer *self, struct trace_context *ctx, float weight, int x0, int y0 )
+{
+    struct ray_packet p = { 0 };
+    vec3s colors[ PACKET_SIZE ];
+    struct trace_guide guide[ PACKET_SIZE ];
+    u32 active = 0;
+
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+    {
+        int x = x0 + i % PACKET_DIM;
+        int y = y0 + i / PACKET_DIM;
+        if ( x >= self->w || y >= self->h )
+            continue;
+
+        packet_set_ray( &p, i, trace_camera_ray( ctx, tracer_frag_coord_( self, ctx, x, y ) ) );
+        active |= 1u << i;
+    }
+
+    packet_reset( &p, active );
+    packet_compute_color( ctx, self->kernels, &p, colors, guide );
+
+    for ( int i = 0; i < PACKET_SIZE; i++ )
+    {
+        if ( !( active & ( 1u << i ) ) )
+            continue;
+
+        int x = x0 + i % PACKET_DIM;
+        int y = y0 + i / PACKET_DIM;
+        tracer_store_( self, weight, x, y, colors[ i ] );
+        *tracer_guide_( self, x, y ) = guide[ i ];
+    }
+}
+
+static inline void tracer_render_tile_( struct tracer *self, struct trace_context *ctx, float weight, int tx, int ty )
+{
+    int x0 = tx * self->tile_size;
+    int y0 = ty * self->tile_size;
+    int x1 = min( x0 + self->tile_size, self->w );
+    int y1 = min( y0 + self->tile_size, self->h );
+
+    if ( self->kernels )
+    {
+        for ( int y = y0; y < y1; y += PACKET_DIM )
+            for ( int x = x0; x < x1; x += PACKET_DIM )
+                tracer_render_block_( self, ctx, weight, x, y );
+        return;
+    }
+
+    for ( int y = y0; y < y1; y++ )
+    {
+        for ( int x = x0; x < x1; x++ )
+        {
+            struct ray ray = trace_camera_ray( ctx, tracer_frag_coord_( self, ctx, x, y ) );
+            tracer_store_( self, weight, x, y, trace_compute_color( ctx, ray, tracer_guide_( self, x, y ) ) );
+        }
+    }
+}
+
+static void tracer_render_tiles_( size_t begin, size_t end, int slot, void *data )
+{
+    struct tracer_job_ *job = data;
+    struct tracer *self = job->self;
+
+    struct trace_context ctx;
+    trace_context_init( &ctx, job->scene, self->w, self->h );
+    ctx.jitter = job->jitter;
+    ctx.roulette = self->roulette;
+    ctx.seed = self->frames;
+
+    for ( size_t tile = begin; tile < end; tile++ )
+        tracer_render_tile_( self, &ctx, job->weight, ( int )tile % job->tiles_x, ( int )tile / job->tiles_x );
+
+    job->stats[ slot ].rays += ctx.rays;
+    job->stats[ slot ].paths += ctx.paths;
+    job->stats[ slot ].segments += ctx.segments;
+}
+
+int tracer_init( struct tracer *self, int w, int h, int thread_count )
+{
+    if ( self == NULL || w <= 0 || h <= 0 )
+        return TRACER_ERROR;
+
+    *self = ( struct tracer ){ 0 };
+    self->w = w;
+    self->h = h;
+    self->tile_size = TRACER_TILE_SIZE;
+    self->thread_count = thread_count == 1 ? 1 : jobs_worker_count();
+    self->kernels = packet_kernels();
+    self->pixels = calloc( ( size_t )w * h, sizeof( *self->pixels ) );
+    self->guide = calloc( ( size_t )w * h, sizeof( *self->guide ) );
+
+    if ( self->pixels == NULL || self->guide == NULL )
+    {
+        log_error( "Unable to allocate %dx%d tracer framebuffer", w, h );
+        tracer_free( self );
+        return TRACER_ERROR;
+    }
+
+    return TRACER_SUCCESS;
+}
+
+void tracer_free( struct tracer *self )
+{
+    free( self->pixels );
+    free( self->guide );
+    self->pixels = NULL;
+    self->guide = NULL;
+}
+
+int tracer_render( struct tracer *self, const struct scene *scene )
+{
+    if ( self == NULL )
+        return TRACER_ERROR;
+
+    self->frames = 0;
+    return tracer_accumulate( self, scene );
+}
+
+int tracer_accumulate( struct tracer *self, const struct scene *scene )
+{
+    if ( self == NULL || self->pixels == NULL || scene == NULL )
+        return TRACER_ERROR;
+
+    int tiles_x = ( self->w + self->tile_size - 1 ) / self->tile_size;
+    int tiles_y = ( self->h + self->tile_size - 1 ) / self->tile_size;
+    struct tracer_job_ job = {
+        .self    = self,
+        .scene   = scene,
+        .tiles_x = tiles_x,
+        .jitter  = trace_jitter( self->frames ),
+        .weight  = 1.0f / ( float )( self->frames + 1 ),
+        .stats   = calloc( jobs_worker_count() + 1, sizeof( struct tracer_stats_ ) )
+    };
+
+    if ( job.stats == NULL )
+        return TRACER_ERROR;
+
+    u64 start = SDL_GetPerformanceCounter();
+
+    // a tile at a time, tiles differ too much in cost for bigger chunks
+    if ( self->thread_count == 1 )
+        tracer_render_tiles_( 0, ( size_t )tiles_x * tiles_y, 0, &job );
+    else
+        parallel_for( ( size_t )tiles_x * tiles_y, 1, tracer_render_tiles_, &job );
+
+    self->rays = 0;
+    self->paths = 0;
+    self->segments = 0;
+    for ( int i = 0; i <= jobs_worker_count(); i++ )
+    {
+        self->rays += job.stats[ i ].rays;
+        self->paths += job.stats[ i ].paths;
+        self->segments += job.stats[ i ].segments;
+    }
+
+    self->seconds = ( double )( SDL_GetPerformanceCounter() - start ) / ( double )SDL_GetPerformanceFrequency();
+    self->frames++;
+
+    free( job.stats );
+
+    return TRACER_SUCCESS;
+}
+
+int tracer_denoise( struct tracer *self, const struct denoise_params *params )
+{
+    if ( self == NULL || self->pixels == NULL || self->frames == 0 )
+        return TRACER_ERROR;
+
+    u64 start = SDL_GetPerformanceCounter();
+    if ( denoise_image( self->pixels, self->guide, self->w, self->h, params, self->frames, self->thread_count ) != DENOISE_SUCCESS )
+        return TRACER_ERROR;
+
+    self->denoise_seconds = ( double )( SDL_GetPerformanceCounter() - start ) / ( double )SDL_GetPerformanceFrequency();
+
+    return TRACER_SUCCESS;
+}
+
+// same conversion as writing to a normalized framebuffer
+static void tracer_convert_( const struct tracer *self, u8 *rgb )
+{
+    for ( int i = 0; i < self->w * self->h; i++ )
+    {
+        vec3s c = self->pixels[ i ];
+        rgb[ i * 3 + 0 ] = ( u8 )( clamp( c.x, 0.0f, 1.0f ) * 255.0f + 0.5f );
+        rgb[ i * 3 + 1 ] = ( u8 )( clamp( c.y, 0.0f, 1.0f ) * 255.0f + 0.5f );
+        rgb[ i * 3 + 2 ] = ( u8 )( clamp( c.z, 0.0f, 1.0f ) * 255.0f + 0.5f );
+    }
+}
+
+int tracer_write( const struct tracer *self, struct encoder *encoder, const char *path )
+{
+    if ( encoder )
+    {
+        struct encoder_frame *frame = encoder_begin( encoder, self->w, self->h, 3 );
+        if ( frame == NULL )
+        {
+            log_warn( "Encoder queue is full, %s not written", path );
+            return TRACER_ERROR;
+        }
+
+        tracer_convert_( self, frame->pixels );
+        encoder_submit( encoder, frame, path );
+        return TRACER_SUCCESS;
+    }
+
+    struct encoder_frame frame = { .w = self->w, .h = self->h, .channels = 3 };
+    frame.pixels = malloc( ( size_t )self->w * self->h * 3 );
+    if ( frame.pixels == NULL )
+        return TRACER_ERROR;
+
+    tracer_convert_( self, frame.pixels );
+    int err = encoder_write( &frame, path );
+    free( frame.pixels );
+
+    return err == ENCODER_SUCCESS ? TRACER_SUCCESS : TRACER_ERROR;
+}
+
+double tracer_rays_per_sec( const struct tracer *self )
+{
+    return self->seconds > 0.0 ? ( double )self->rays / self->seconds : 0.0;
+}
+
+double tracer_path_length( const struct tracer *self )
+{
+    return self->paths > 0 ? ( double )self->segments / ( double )self->paths : 0.0;
+}
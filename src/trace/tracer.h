@@ -0,0 +1,78 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+/*
+ * Headless, multi-threaded CPU reference backend for the raytracer. Splits
+ * the framebuffer into tiles which are traced by the workers of the job
+ * system (system/jobs.h), either with SIMD ray packets (packet.h) or one ray
+ * at a time with the scalar port in trace.h.
+ */
+
+#include "scene.h"
+#include "packet.h"
+#include "denoise.h"
+#include <system/encoder.h>
+#include <util/types.h>
+#include <cglm/struct.h>
+
+#define TRACER_SUCCESS  0
+#define TRACER_ERROR   -1
+
+#define TRACER_TILE_SIZE 16
+
+struct tracer
+{
+    int w;
+    int h;
+    int tile_size;
+    int thread_count;
+
+    // packet kernels to trace with, NULL traces one ray at a time
+    const struct packet_kernels *kernels;
+
+    // end paths with russian roulette, see trace_context
+    bool roulette;
+
+    // linear rgb, row 0 is the top of the image
+    vec3s *pixels;
+
+    // first hit of every pixel in the last frame, guides tracer_denoise
+    struct trace_guide *guide;
+
+    // frames averaged into pixels, see tracer_accumulate
+    u32 frames;
+
+    // stats of the last render
+    u64 rays;
+    u64 paths;
+    u64 segments;
+    double seconds;
+    double denoise_seconds;
+};
+
+// thread_count 1 traces on the calling thread only, anything else on every
+// worker of the job system (just the calling thread when it is not running)
+int  tracer_init( struct tracer *self, int w, int h, int thread_count );
+void tracer_free( struct tracer *self );
+
+// trace a single frame through the pixel centers
+int  tracer_render( struct tracer *self, const struct scene *scene );
+
+// trace one more jittered frame and blend it into the running average of
+// pixels, same as the shader's accumulation mode (call tracer_render to reset)
+int  tracer_accumulate( struct tracer *self, const struct scene *scene );
+
+// filter the noise out of pixels in place once the last frame is traced,
+// the number of frames tells how much noise there is
+int  tracer_denoise( struct tracer *self, const struct denoise_params *params );
+
+// queues pixels on the encoder's thread, or writes them right away without
+// one, ppm or png by the extension of path
+int  tracer_write( const struct tracer *self, struct encoder *encoder, const char *path );
+
+double tracer_rays_per_sec( const struct tracer *self );
+
+// average number of closest hit rays per camera ray, 1 without reflections
+double tracer_path_length( const struct tracer *self );
+
+#endif
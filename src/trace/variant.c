@@ -0,0 +1,175 @@
+#include "variant.h"
+
+#include <util/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void variant_key_init( struct variant_key *self, const struct scene *scene )
+{
+    *self = ( struct variant_key ){ 0 };
+
+    // the number of spheres changes too often to be built in
+    self->spheres = scene->spheres.count > 0;
+
+    // scene_pack packs the used mesh slots to the front
+    for ( u32 i = 0; i < SCENE_MAX_MESHES; i++ )
+        self->mesh_count += scene->meshes[ i ].bvh != NULL;
+
+    self->max_depth = scene->max_depth;
+    self->shadows = scene->shadows;
+}
+
+bool variant_key_equal( const struct variant_key *a, const struct variant_key *b )
+{
+    return a->mesh_count == b->mesh_count
+        && a->max_depth == b->max_depth
+        && a->spheres == b->spheres
+        && a->shadows == b->shadows;
+}
+
+int variant_defines( const struct variant_key *self, char *buf, size_t len )
+{
+    return snprintf( buf, len,
+        "#define MESH_COUNT %uu\n"
+        "#define MAX_DEPTH %uu\n"
+        "#define HAS_SPHERES %s\n"
+        "#define SHADOWS %s\n",
+        self->mesh_count, self->max_depth,
+        self->spheres ? "true" : "false", self->shadows ? "true" : "false" );
+}
+
+void variant_cache_init( struct variant_cache *self, const char *vstext, size_t vslen,
+        const char *fstext, size_t fslen, const char *binary_prefix )
+{
+    *self = ( struct variant_cache ) {
+        .vstext = vstext,
+        .vslen = vslen,
+        .fstext = fstext,
+        .fslen = fslen,
+        .binary_prefix = binary_prefix,
+        .binary_max = VARIANT_BINARY_MAX
+    };
+}
+
+void variant_cache_free( struct variant_cache *self )
+{
+    for ( u32 i = 0; i < self->count; i++ )
+        shader_free( self->entries[ i ].shader );
+    self->count = 0;
+}
+
+static inline u32 variant_hash_( const char *text )
+{
+    // fnv-1a
+    u32 hash = 2166136261u;
+    for ( ; *text; text++ )
+        hash = ( hash ^ ( u8 )*text ) * 16777619u;
+    return hash;
+}
+
+// puts hash first in <prefix>.index, the binaries on disk from the most
+// recently used one, and removes the ones past binary_max; a binary whose
+// sources changed is rewritten under its name by shader_cbuild
+static void variant_binary_used_( const struct variant_cache *self, u32 hash )
+{
+    char path[ 512 ];
+    snprintf( path, sizeof( path ), "%s.index", self->binary_prefix );
+
+    u32 *hashes = malloc( ( self->binary_max + 1 ) * sizeof( *hashes ) );
+    if ( hashes == NULL )
+        return;
+
+    u32 count = 0;
+    hashes[ count++ ] = hash;
+
+    FILE *f = fopen( path, "r" );
+    if ( f )
+    {
+        unsigned int h;
+        while ( count <= self->binary_max && fscanf( f, "%x", &h ) == 1 )
+        {
+            if ( h != hash )
+                hashes[ count++ ] = h;
+        }
+        fclose( f );
+    }
+
+    for ( ; count > self->binary_max; count-- )
+    {
+        char binary[ 512 ];
+        snprintf( binary, sizeof( binary ), "%s.%08x.glbin", self->binary_prefix, hashes[ count - 1 ] );
+        remove( binary );
+    }
+
+    f = fopen( path, "w" );
+    if ( f )
+    {
+        for ( u32 i = 0; i < count; i++ )
+            fprintf( f, "%08x\n", hashes[ i ] );
+        fclose( f );
+    }
+    free( hashes );
+}
+
+// a free slot, or the least recently used one after freeing its program
+static struct variant *variant_slot_( struct variant_cache *self )
+{
+    if ( self->count < VARIANT_CACHE_SIZE )
+        return &self->entries[ self->count++ ];
+
+    struct variant *oldest = &self->entries[ 0 ];
+    for ( u32 i = 1; i < self->count; i++ )
+    {
+        if ( self->entries[ i ].last_used < oldest->last_used )
+            oldest = &self->entries[ i ];
+    }
+
+    shader_free( oldest->shader );
+    return oldest;
+}
+
+const struct shader *variant_get( struct variant_cache *self, const struct variant_key *key )
+{
+    self->tick++;
+
+    for ( u32 i = 0; i < self->count; i++ )
+    {
+        struct variant *v = &self->entries[ i ];
+        if ( variant_key_equal( &v->key, key ) )
+        {
+            v->last_used = self->tick;
+            return &v->shader;
+        }
+    }
+
+    char defines[ 256 ];
+    variant_defines( key, defines, sizeof( defines ) );
+
+    size_t fslen;
+    char *fstext = shader_define( self->fstext, self->fslen, defines, &fslen );
+    if ( fstext == NULL )
+        return NULL;
+
+    char path[ 512 ];
+    u32 hash = variant_hash_( defines );
+    if ( self->binary_prefix )
+        snprintf( path, sizeof( path ), "%s.%08x.glbin", self->binary_prefix, hash );
+
+    struct shader shader;
+    int err = shader_cbuild( &shader, self->vstext, self->vslen, fstext, fslen, self->binary_prefix ? path : NULL );
+    free( fstext );
+    if ( err )
+    {
+        log_error( "Unable to build the shader variant:\n%s", defines );
+        return NULL;
+    }
+
+    log_debug( "Built shader variant:\n%s", defines );
+    if ( self->binary_prefix )
+        variant_binary_used_( self, hash );
+
+    struct variant *v = variant_slot_( self );
+    *v = ( struct variant ){ .key = *key, .shader = shader, .last_used = self->tick };
+    return &v->shader;
+}
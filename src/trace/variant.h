@@ -0,0 +1,68 @@
+#ifndef VARIANT_H
+#define VARIANT_H
+
+/*
+ * Raytracer programs specialized for a scene. The features a scene uses
+ * (spheres or none, meshes, reflection depth, shadows) are injected into
+ * frag.glsl as #defines, so the driver can unroll the loops and drop the
+ * branches the scene never takes. Programs are kept per feature set,
+ * switching back to a scene seen before costs nothing.
+ */
+
+#include "scene.h"
+#include <gfx/shader.h>
+#include <util/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// programs kept at once, the least recently used one goes first
+#define VARIANT_CACHE_SIZE 16
+
+// program binaries kept on disk, across runs and so across scenes too; the
+// ones used least recently are removed first
+#define VARIANT_BINARY_MAX 32
+
+struct variant_key
+{
+    u32 mesh_count;
+    u32 max_depth;
+    bool spheres;
+    bool shadows;
+};
+
+struct variant
+{
+    struct variant_key key;
+    struct shader shader;
+    u32 last_used;
+};
+
+struct variant_cache
+{
+    const char *vstext;
+    size_t vslen;
+    const char *fstext;
+    size_t fslen;
+    const char *binary_prefix;  /* program binaries go to <prefix>.<hash>.glbin, NULL for none */
+    u32 binary_max;             /* VARIANT_BINARY_MAX, listed in <prefix>.index */
+
+    struct variant entries[ VARIANT_CACHE_SIZE ];
+    u32 count;
+    u32 tick;
+};
+
+void variant_key_init( struct variant_key *self, const struct scene *scene );
+bool variant_key_equal( const struct variant_key *a, const struct variant_key *b );
+
+// the #define lines of a key, returns the length like snprintf
+int variant_defines( const struct variant_key *self, char *buf, size_t len );
+
+// the sources are not copied and must outlive the cache
+void variant_cache_init( struct variant_cache *self, const char *vstext, size_t vslen,
+        const char *fstext, size_t fslen, const char *binary_prefix );
+void variant_cache_free( struct variant_cache *self );
+
+// program for the key, built on first use, NULL if it does not build
+const struct shader *variant_get( struct variant_cache *self, const struct variant_key *key );
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ALIGNED_H
+#define ALIGNED_H
+
+/*
+ * Aligned allocations that also build on Windows, where aligned_alloc is
+ * missing and such blocks have to go back through _aligned_free.
+ */
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// n is rounded up to a multiple of align (a power of two), as aligned_alloc wants
+static inline void *aligned_malloc( size_t align, size_t n )
+{
+    n = ( n + align - 1 ) / align * align;
+#ifdef _WIN32
+    return _aligned_malloc( n, align );
+#else
+    return aligned_alloc( align, n );
+#endif
+}
+
+// only for blocks from aligned_malloc, NULL is fine
+static inline void aligned_free( void *p )
+{
+#ifdef _WIN32
+    _aligned_free( p );
+#else
+    free( p );
+#endif
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "histogram.h"
+
+#include <math.h>
+#include <string.h>
+
+void histogram_clear( struct histogram *self )
+{
+    memset( self, 0, sizeof( *self ) );
+}
+
+u32 histogram_bucket( u64 ns )
+{
+    const u64 limit = ( ( u64 )1 << HISTOGRAM_MAX_BITS ) - 1;
+    if ( ns > limit )
+        ns = limit;
+
+    // exact below one sub-bucket per value
+    if ( ns < HISTOGRAM_SUB_BUCKETS )
+        return ( u32 )ns;
+
+    // top bit picks the power of two, the next HISTOGRAM_SUB_BITS the bucket in it
+    u32 e = 63 - __builtin_clzll( ns );
+    u32 sub = ( u32 )( ns >> ( e - HISTOGRAM_SUB_BITS ) ) & ( HISTOGRAM_SUB_BUCKETS - 1 );
+    return ( e - HISTOGRAM_SUB_BITS + 1 ) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+u64 histogram_bucket_min( u32 bucket )
+{
+    if ( bucket < HISTOGRAM_SUB_BUCKETS )
+        return bucket;
+
+    u32 e = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    u64 sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    return ( HISTOGRAM_SUB_BUCKETS + sub ) << ( e - HISTOGRAM_SUB_BITS );
+}
+
+void histogram_push( struct histogram *self, u64 ns )
+{
+    if ( self->len == HISTOGRAM_WINDOW )
+        self->counts[ self->window[ self->next ] ]--;
+    else
+        self->len++;
+
+    u32 bucket = histogram_bucket( ns );
+    self->counts[ bucket ]++;
+    self->window[ self->next ] = ( u16 )bucket;
+    self->next = ( self->next + 1 ) % HISTOGRAM_WINDOW;
+
+    self->total++;
+    self->last = ns;
+    if ( ns > self->max )
+        self->max = ns;
+}
+
+u64 histogram_percentile( const struct histogram *self, float p )
+{
+    if ( self->len == 0 )
+        return 0;
+
+    // nearest rank, counted from the smallest bucket
+    u32 rank = ( u32 )ceilf( p * self->len );
+    if ( rank < 1 )
+        rank = 1;
+    if ( rank > self->len )
+        rank = self->len;
+
+    u32 seen = 0;
+    for ( u32 i = 0; i < HISTOGRAM_BUCKETS; i++ )
+    {
+        seen += self->counts[ i ];
+        if ( seen >= rank )
+        {
+            // the middle of the top bucket can lie above every sample
+            u64 min = histogram_bucket_min( i );
+            u64 mid = min + ( histogram_bucket_min( i + 1 ) - min ) / 2;
+            return mid < self->max ? mid : self->max;
+        }
+    }
+
+    return 0;
+}
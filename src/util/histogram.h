@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/*
+ * Rolling histogram of durations in nanoseconds. Buckets are log-linear:
+ * every power of two is split into HISTOGRAM_SUB_BUCKETS, so a bucket is at
+ * most 1/16th of its value wide and percentiles are within ~3%. Only the
+ * last HISTOGRAM_WINDOW samples are counted, pushing one evicts the oldest.
+ */
+
+#include "types.h"
+
+#define HISTOGRAM_WINDOW        512
+#define HISTOGRAM_SUB_BITS      4
+#define HISTOGRAM_SUB_BUCKETS   ( 1 << HISTOGRAM_SUB_BITS )
+#define HISTOGRAM_MAX_BITS      40      /* ~18 minutes, longer samples are clamped */
+#define HISTOGRAM_BUCKETS       ( ( HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1 ) * HISTOGRAM_SUB_BUCKETS )
+
+struct histogram
+{
+    u16 counts[ HISTOGRAM_BUCKETS ];
+    u16 window[ HISTOGRAM_WINDOW ];    /* bucket of each sample in the window */
+    u32 next;
+    u32 len;                           /* samples in the window */
+
+    u64 total;                         /* samples ever pushed */
+    u64 last;
+    u64 max;                           /* of all samples ever pushed */
+};
+
+void histogram_clear( struct histogram *self );
+void histogram_push( struct histogram *self, u64 ns );
+
+// p in [0, 1], the middle of the bucket holding the nearest rank (at most
+// the max), 0 if empty
+u64 histogram_percentile( const struct histogram *self, float p );
+
+// bucket of a value and the smallest value of a bucket
+u32 histogram_bucket( u64 ns );
+u64 histogram_bucket_min( u32 bucket );
+
+#endif
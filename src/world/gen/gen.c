@@ -2,19 +2,29 @@
 #include "../world.h"
 #include "../chunk.h"
 #include "../tile/tile.h"
+#include "../../system/jobs.h"
 
 /*
  * temp world gen
  */
 
-void gen_world( struct world *world )
+static void gen_chunks_( size_t begin, size_t end, int slot, void *data )
 {
-    for ( size_t i = 0; i < world->chunks_count; i++ )
+    struct world *world = data;
+    ( void )slot;
+
+    for ( size_t i = begin; i < end; i++ )
     {
         gen_chunk( &world->chunks[ i ] );
     }
 }
 
+// chunks are independent, each one is a job
+void gen_world( struct world *world )
+{
+    parallel_for( world->chunks_count, 1, gen_chunks_, world );
+}
+
 void gen_chunk( struct chunk *chunk )
 {
     for ( int i = 0; i < CHUNK_VOLUME; i++ )
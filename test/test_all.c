@@ -2,6 +2,18 @@
 #include "test_dynarr.c"
 #include "test_obj3d.c"
 #include "test_kdtree.c"
+#include "test_dynres.c"
+#include "test_histogram.c"
+#include "test_snapshot.c"
+#include "test_encoder.c"
+#include "test_spheres.c"
+#include "test_jobs.c"
+#include "test_light_grid.c"
+#include "test_trace.c"
+#include "test_denoise.c"
+#include "test_bvh.c"
+#include "test_golden.c"
+#include "test_gpu.c"
 #define INSTANTIATE_MAIN
 
 #ifdef INSTANTIATE_MAIN
@@ -0,0 +1,243 @@
+#include "utest.h"
+#include <trace/bvh.h>
+#include <trace/tracer.h>
+#include <gfx/obj3d.h>
+#include <util/fmath.h>
+
+static const char *bvh_test_objects[] = { "res/objects/teapot.obj", "res/objects/rayman.obj" };
+
+// closest hit by testing every triangle
+static bool bvh_test_brute_force( const struct obj3d *obj, struct ray ray, float *dist )
+{
+	bool found = false;
+	*dist = TRACE_RENDER_DISTANCE;
+
+	for ( size_t i = 0; i < obj->fv_len / 3; i++ )
+	{
+		float t, u, v;
+		if ( trace_intersect_tri( ray, &obj->fv[ i * 3 ], &t, &u, &v ) && t < *dist )
+		{
+			*dist = t;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+// checks child order and bounds below a node, returns the depth of the subtree
+static int bvh_test_check_node( const struct bvh *bvh, u32 idx, u32 *tri_seen )
+{
+	const struct bvh_node *node = &bvh->nodes[ idx ];
+
+	if ( node->count )
+	{
+		for ( u32 i = node->offset; i < node->offset + node->count; i++ )
+		{
+			tri_seen[ bvh->tri_index[ i ] ]++;
+			for ( int j = 0; j < 3; j++ )
+			{
+				vec3s p = bvh->tris[ i * 3 + j ].vp;
+				if ( p.x < node->min.x || p.y < node->min.y || p.z < node->min.z ||
+					 p.x > node->max.x || p.y > node->max.y || p.z > node->max.z )
+					return -1;
+			}
+		}
+		return 1;
+	}
+
+	// the first child directly follows its parent
+	u32 children[ 2 ] = { idx + 1, node->offset };
+	if ( node->offset <= idx + 1 || node->offset >= bvh->node_count )
+		return -1;
+
+	int depth = 0;
+	for ( int c = 0; c < 2; c++ )
+	{
+		const struct bvh_node *child = &bvh->nodes[ children[ c ] ];
+		if ( child->min.x < node->min.x || child->min.y < node->min.y || child->min.z < node->min.z ||
+			 child->max.x > node->max.x || child->max.y > node->max.y || child->max.z > node->max.z )
+			return -1;
+
+		int d = bvh_test_check_node( bvh, children[ c ], tri_seen );
+		if ( d < 0 )
+			return -1;
+		depth = max( depth, d );
+	}
+
+	return depth + 1;
+}
+
+UTEST( bvh, layout )
+{
+	for ( size_t o = 0; o < sizeof( bvh_test_objects ) / sizeof( *bvh_test_objects ); o++ )
+	{
+		struct obj3d obj;
+		struct bvh bvh;
+
+		ASSERT_EQ( obj3d_load( &obj, bvh_test_objects[ o ] ), 0 );
+		ASSERT_EQ( bvh_build( &bvh, obj.fv, obj.fv_len ), 0 );
+
+		EXPECT_EQ( bvh.tri_count, obj.fv_len / 3 );
+		EXPECT_LT( bvh.node_count, 2 * bvh.tri_count );
+		EXPECT_TRUE( ( uintptr_t )bvh.nodes % 64 == 0 );
+
+		u32 *tri_seen = calloc( bvh.tri_count, sizeof( *tri_seen ) );
+		int depth = bvh_test_check_node( &bvh, 0, tri_seen );
+		EXPECT_GT( depth, 0 );
+		EXPECT_LE( depth, BVH_STACK_SIZE );
+
+		// every triangle is in exactly one leaf
+		size_t once = 0;
+		for ( size_t i = 0; i < bvh.tri_count; i++ )
+			once += tri_seen[ i ] == 1;
+		EXPECT_EQ( once, bvh.tri_count );
+
+		free( tri_seen );
+		bvh_free( &bvh );
+		obj3d_free( &obj );
+	}
+}
+
+UTEST( bvh, matches_brute_force )
+{
+	for ( size_t o = 0; o < sizeof( bvh_test_objects ) / sizeof( *bvh_test_objects ); o++ )
+	{
+		struct obj3d obj;
+		struct bvh bvh;
+
+		ASSERT_EQ( obj3d_load( &obj, bvh_test_objects[ o ] ), 0 );
+		ASSERT_EQ( bvh_build( &bvh, obj.fv, obj.fv_len ), 0 );
+
+		vec3s center = glms_vec3_scale( glms_vec3_add( bvh.nodes[ 0 ].min, bvh.nodes[ 0 ].max ), 0.5f );
+		float dia = glms_vec3_distance( bvh.nodes[ 0 ].min, bvh.nodes[ 0 ].max );
+
+		// rays from a sphere around the mesh aimed somewhere near its center
+		srand( 4321 );
+		int hits = 0;
+		for ( int n = 0; n < 2000; n++ )
+		{
+			vec3s r = glms_vec3_normalize( ( vec3s ){{
+				( float )rand() / RAND_MAX - 0.5f,
+				( float )rand() / RAND_MAX - 0.5f,
+				( float )rand() / RAND_MAX - 0.5f
+			}} );
+			vec3s target = glms_vec3_add( center, ( vec3s ){{
+				( ( float )rand() / RAND_MAX - 0.5f ) * dia * 0.5f,
+				( ( float )rand() / RAND_MAX - 0.5f ) * dia * 0.5f,
+				( ( float )rand() / RAND_MAX - 0.5f ) * dia * 0.5f
+			}} );
+
+			struct ray ray;
+			ray.orig = glms_vec3_add( center, glms_vec3_scale( r, dia ) );
+			ray.dir = glms_vec3_normalize( glms_vec3_sub( target, ray.orig ) );
+
+			float dist;
+			struct bvh_hit hit;
+			bool expected = bvh_test_brute_force( &obj, ray, &dist );
+			bool found = bvh_intersect( &bvh, ray, TRACE_RENDER_DISTANCE, &hit );
+
+			EXPECT_EQ( found, expected );
+			if ( found && expected )
+			{
+				EXPECT_EQ( hit.dist, dist );
+				hits++;
+			}
+		}
+
+		// make sure the rays actually hit something
+		EXPECT_GT( hits, 100 );
+
+		bvh_free( &bvh );
+		obj3d_free( &obj );
+	}
+}
+
+UTEST( bvh, occluded_matches_intersect )
+{
+	struct obj3d obj;
+	struct bvh bvh;
+	const struct packet_kernels *k = packet_kernels();
+
+	ASSERT_EQ( obj3d_load( &obj, "res/objects/teapot.obj" ), 0 );
+	ASSERT_EQ( bvh_build( &bvh, obj.fv, obj.fv_len ), 0 );
+	obj3d_free( &obj );
+
+	vec3s center = glms_vec3_scale( glms_vec3_add( bvh.nodes[ 0 ].min, bvh.nodes[ 0 ].max ), 0.5f );
+	float dia = glms_vec3_distance( bvh.nodes[ 0 ].min, bvh.nodes[ 0 ].max );
+
+	// shadow rays from around the mesh ending somewhere before or after it
+	srand( 1234 );
+	int occluded = 0;
+	for ( int n = 0; n < 200; n++ )
+	{
+		struct ray_packet p = { 0 };
+		bool expected[ PACKET_SIZE ];
+
+		packet_reset( &p, PACKET_ALL );
+		for ( int i = 0; i < PACKET_SIZE; i++ )
+		{
+			vec3s r = glms_vec3_normalize( ( vec3s ){{
+				( float )rand() / RAND_MAX - 0.5f,
+				( float )rand() / RAND_MAX - 0.5f,
+				( float )rand() / RAND_MAX - 0.5f
+			}} );
+
+			struct ray ray;
+			ray.orig = glms_vec3_add( center, glms_vec3_scale( r, dia ) );
+			ray.dir = glms_vec3_normalize( glms_vec3_sub( center, ray.orig ) );
+			float tmax = dia * 1.5f * ( float )rand() / RAND_MAX;
+
+			struct bvh_hit hit;
+			expected[ i ] = bvh_intersect( &bvh, ray, tmax, &hit );
+			EXPECT_EQ( bvh_occluded( &bvh, ray, tmax ), expected[ i ] );
+			occluded += expected[ i ];
+
+			packet_set_ray( &p, i, ray );
+			p.t[ i ] = tmax;
+		}
+
+		// lanes that hit are dropped from the packet
+		bvh_occluded_packet( &bvh, k, &p );
+		for ( int i = 0; i < PACKET_SIZE; i++ )
+			EXPECT_EQ( ( bool )( p.active & ( 1u << i ) ), !expected[ i ] );
+	}
+
+	EXPECT_GT( occluded, 200 );
+	EXPECT_LT( occluded, 200 * PACKET_SIZE - 200 );
+
+	bvh_free( &bvh );
+}
+
+UTEST( bvh, packets_match_single_ray )
+{
+	struct obj3d obj;
+	struct bvh bvh;
+	struct scene scene;
+	struct tracer single;
+	struct tracer packet;
+
+	ASSERT_EQ( obj3d_load( &obj, "res/objects/teapot.obj" ), 0 );
+	ASSERT_EQ( bvh_build( &bvh, obj.fv, obj.fv_len ), 0 );
+	obj3d_free( &obj );
+
+	scene_init_mesh( &scene, &bvh, degtorad( 45.0f ) );
+	ASSERT_EQ( tracer_init( &single, 67, 43, 1 ), TRACER_SUCCESS );
+	ASSERT_EQ( tracer_init( &packet, 67, 43, 1 ), TRACER_SUCCESS );
+	single.kernels = NULL;
+
+	tracer_render( &single, &scene );
+	tracer_render( &packet, &scene );
+
+	EXPECT_EQ( single.rays, packet.rays );
+	EXPECT_EQ( memcmp( single.pixels, packet.pixels, 67 * 43 * sizeof( *single.pixels ) ), 0 );
+
+	tracer_free( &single );
+	tracer_free( &packet );
+	scene_free( &scene );
+	bvh_free( &bvh );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
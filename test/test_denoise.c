@@ -0,0 +1,112 @@
+#include "utest.h"
+#include <trace/denoise.h>
+#include <trace/tracer.h>
+#include <system/jobs.h>
+#include <util/fmath.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static float denoise_test_rmse( const vec3s *a, const vec3s *b, int n )
+{
+	double err = 0.0;
+	for ( int i = 0; i < n; i++ )
+	{
+		vec3s d = glms_vec3_sub( a[ i ], b[ i ] );
+		err += glms_vec3_dot( d, d );
+	}
+	return ( float )sqrt( err / ( n * 3 ) );
+}
+
+UTEST( denoise, keeps_edges )
+{
+	enum { w = 32, h = 32 };
+	vec3s *pixels = malloc( w * h * sizeof( *pixels ) );
+	struct trace_guide *guide = malloc( w * h * sizeof( *guide ) );
+	ASSERT_TRUE( pixels && guide );
+
+	// a dark wall facing the camera on the left, a bright floor on the right
+	for ( int i = 0; i < w * h; i++ )
+	{
+		bool left = i % w < w / 2;
+		pixels[ i ] = left ? ( vec3s ){{ 0.1f, 0.1f, 0.1f }} : ( vec3s ){{ 0.9f, 0.8f, 0.7f }};
+		guide[ i ].normal = left ? ( vec3s ){{ 0.0f, 0.0f, -1.0f }} : ( vec3s ){{ 0.0f, 1.0f, 0.0f }};
+		guide[ i ].depth = left ? 4.0f : 8.0f;
+	}
+
+	struct denoise_params params;
+	denoise_params_init( &params );
+	ASSERT_EQ( denoise_image( pixels, guide, w, h, &params, 1, 1 ), DENOISE_SUCCESS );
+
+	// nothing bleeds across, not even right next to the edge
+	for ( int i = 0; i < w * h; i++ )
+	{
+		float expected = i % w < w / 2 ? 0.1f : 0.9f;
+		EXPECT_TRUE( fltcmp( pixels[ i ].x, expected, 1e-4f ) );
+	}
+
+	free( pixels );
+	free( guide );
+}
+
+UTEST( denoise, one_sample_render_against_16 )
+{
+	enum { w = 96, h = 64, n = w * h };
+	struct scene scene;
+	struct tracer tracer;
+	struct denoise_params params;
+
+	ASSERT_EQ( jobs_init( 4 ), JOBS_SUCCESS );
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	ASSERT_EQ( tracer_init( &tracer, w, h, 0 ), TRACER_SUCCESS );
+	tracer.roulette = true;
+
+	// what 16 accumulated samples converge to
+	tracer_render( &tracer, &scene );
+	for ( int i = 1; i < 16; i++ )
+		tracer_accumulate( &tracer, &scene );
+	vec3s *accumulated = malloc( n * sizeof( *accumulated ) );
+	vec3s *one = malloc( n * sizeof( *one ) );
+	vec3s *threaded = malloc( n * sizeof( *threaded ) );
+	ASSERT_TRUE( accumulated && one && threaded );
+	memcpy( accumulated, tracer.pixels, n * sizeof( *accumulated ) );
+
+	// a single sample with its first hits, mostly aliased at the outlines
+	tracer_render( &tracer, &scene );
+	memcpy( one, tracer.pixels, n * sizeof( *one ) );
+	float noisy = denoise_test_rmse( one, accumulated, n );
+
+	// blurring across the outlines of the spheres and the horizon would take
+	// the image further from the accumulated one than the aliasing it has
+	denoise_params_init( &params );
+	memcpy( threaded, one, n * sizeof( *threaded ) );
+	ASSERT_EQ( denoise_image( threaded, tracer.guide, w, h, &params, 1, 0 ), DENOISE_SUCCESS );
+
+	tracer.thread_count = 1;
+	ASSERT_EQ( tracer_denoise( &tracer, &params ), TRACER_SUCCESS );
+	float denoised = denoise_test_rmse( tracer.pixels, accumulated, n );
+	EXPECT_LT( denoised, noisy * 1.1f );
+
+	// rows are split between the workers, the result is the same
+	EXPECT_EQ( memcmp( threaded, tracer.pixels, n * sizeof( *threaded ) ), 0 );
+
+	// the normals and depths are what keeps them, color alone does worse
+	params.sigma_normal = params.sigma_depth = 1e6f;
+	memcpy( tracer.pixels, one, n * sizeof( *one ) );
+	ASSERT_EQ( tracer_denoise( &tracer, &params ), TRACER_SUCCESS );
+	float unguided = denoise_test_rmse( tracer.pixels, accumulated, n );
+	EXPECT_LT( denoised, unguided * 0.9f );
+	printf( "1 spp off the 16 spp render by %.4f, denoised %.4f, without guides %.4f\n", noisy, denoised, unguided );
+
+	free( accumulated );
+	free( one );
+	free( threaded );
+	tracer_free( &tracer );
+	scene_free( &scene );
+	jobs_free();
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
@@ -0,0 +1,62 @@
+#include "utest.h"
+#include <gfx/dynres.h>
+
+#define DYNRES_TEST_TARGET ( 1000.0f / 60.0f )
+
+// feed the same frame time n times, returns how often the scale changed
+static int dynres_test_feed( struct dynres *self, float ratio, int n )
+{
+	int changes = 0;
+	for ( int i = 0; i < n; i++ )
+		changes += dynres_update( self, DYNRES_TEST_TARGET * ratio, DYNRES_TEST_TARGET );
+	return changes;
+}
+
+UTEST( dynres, holds_within_band )
+{
+	struct dynres d;
+	dynres_init( &d, 0.25f, 1.0f );
+	EXPECT_EQ( d.scale, 1.0f );
+
+	// a single spike or frames between the thresholds change nothing
+	EXPECT_EQ( dynres_test_feed( &d, 3.0f, DYNRES_DOWN_FRAMES - 1 ), 0 );
+	EXPECT_EQ( dynres_test_feed( &d, 1.1f, 1000 ), 0 );
+	EXPECT_EQ( dynres_test_feed( &d, 3.0f, DYNRES_DOWN_FRAMES - 1 ), 0 );
+	EXPECT_EQ( d.scale, 1.0f );
+
+	int w, h;
+	dynres_size( &d, 1280, 720, &w, &h );
+	EXPECT_EQ( w, 1280 );
+	EXPECT_EQ( h, 720 );
+}
+
+UTEST( dynres, drops_and_recovers )
+{
+	struct dynres d;
+	dynres_init( &d, 0.25f, 1.0f );
+
+	// twice the budget halves the pixels
+	EXPECT_EQ( dynres_test_feed( &d, 2.0f, DYNRES_DOWN_FRAMES ), 1 );
+	EXPECT_NEAR( d.scale, 0.7071f, 0.001f );
+
+	// never below the minimum
+	dynres_test_feed( &d, 10.0f, DYNRES_DOWN_FRAMES * 10 );
+	EXPECT_EQ( d.scale, 0.25f );
+
+	int w, h;
+	dynres_size( &d, 1280, 720, &w, &h );
+	EXPECT_EQ( w, 320 );
+	EXPECT_EQ( h, 180 );
+
+	// back up one step per run of frames within budget, never above the maximum
+	EXPECT_EQ( dynres_test_feed( &d, 1.0f, DYNRES_UP_FRAMES - 1 ), 0 );
+	EXPECT_EQ( dynres_test_feed( &d, 1.0f, 1 ), 1 );
+	EXPECT_NEAR( d.scale, 0.25f + DYNRES_STEP, 0.001f );
+
+	dynres_test_feed( &d, 1.0f, DYNRES_UP_FRAMES * 100 );
+	EXPECT_EQ( d.scale, 1.0f );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
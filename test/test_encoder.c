@@ -0,0 +1,206 @@
+#include "utest.h"
+#include <system/encoder.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// big enough for the png to take two deflate blocks
+#define ENCODER_TEST_W 200
+#define ENCODER_TEST_H 120
+
+static u8 *encoder_test_read( const char *path, size_t *len )
+{
+	FILE *f = fopen( path, "rb" );
+	if ( f == NULL )
+		return NULL;
+
+	fseek( f, 0, SEEK_END );
+	*len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	u8 *data = malloc( *len );
+	*len = fread( data, 1, *len, f );
+	fclose( f );
+	return data;
+}
+
+static u32 encoder_test_u32( const u8 *p )
+{
+	return ( u32 )p[ 0 ] << 24 | ( u32 )p[ 1 ] << 16 | ( u32 )p[ 2 ] << 8 | p[ 3 ];
+}
+
+static u32 encoder_test_crc( const u8 *data, size_t len )
+{
+	u32 crc = 0xffffffff;
+	for ( size_t i = 0; i < len; i++ )
+	{
+		crc ^= data[ i ];
+		for ( int k = 0; k < 8; k++ )
+			crc = crc & 1 ? ( crc >> 1 ) ^ 0xedb88320 : crc >> 1;
+	}
+	return ~crc;
+}
+
+// rgba, stored bottom row first like a gl read back
+static void encoder_test_fill( struct encoder_frame *frame )
+{
+	frame->bottom_up = true;
+	for ( int y = 0; y < frame->h; y++ )
+	{
+		for ( int x = 0; x < frame->w; x++ )
+		{
+			u8 *p = frame->pixels + ( ( size_t )( frame->h - 1 - y ) * frame->w + x ) * 4;
+			p[ 0 ] = ( u8 )x;
+			p[ 1 ] = ( u8 )y;
+			p[ 2 ] = ( u8 )( x ^ y );
+			p[ 3 ] = 0x7f;
+		}
+	}
+}
+
+static bool encoder_test_pixel( const u8 *rgb, int x, int y )
+{
+	return rgb[ 0 ] == ( u8 )x && rgb[ 1 ] == ( u8 )y && rgb[ 2 ] == ( u8 )( x ^ y );
+}
+
+UTEST( encoder, writes_ppm_and_png )
+{
+	const char *ppm = "test_encoder.ppm";
+	const char *png = "test_encoder.png";
+	struct encoder encoder;
+	ASSERT_EQ( encoder_init( &encoder, 2 ), ENCODER_SUCCESS );
+
+	struct encoder_frame *frame = encoder_begin( &encoder, ENCODER_TEST_W, ENCODER_TEST_H, 4 );
+	ASSERT_TRUE( frame != NULL );
+	encoder_test_fill( frame );
+	encoder_submit( &encoder, frame, ppm );
+
+	frame = encoder_begin( &encoder, ENCODER_TEST_W, ENCODER_TEST_H, 4 );
+	ASSERT_TRUE( frame != NULL );
+	encoder_test_fill( frame );
+	encoder_submit( &encoder, frame, png );
+
+	encoder_flush( &encoder );
+	struct encoder_stats stats = encoder_stats( &encoder );
+	EXPECT_EQ( stats.written, 2u );
+	EXPECT_EQ( stats.failed, 0u );
+	EXPECT_EQ( stats.depth, 0 );
+	encoder_free( &encoder );
+
+	// top row first, alpha dropped
+	size_t len;
+	u8 *data = encoder_test_read( ppm, &len );
+	ASSERT_TRUE( data != NULL );
+	char header[ 32 ];
+	int header_len = snprintf( header, sizeof( header ), "P6\n%d %d\n255\n", ENCODER_TEST_W, ENCODER_TEST_H );
+	ASSERT_EQ( len, header_len + ( size_t )ENCODER_TEST_W * ENCODER_TEST_H * 3 );
+	EXPECT_EQ( memcmp( data, header, header_len ), 0 );
+
+	int wrong = 0;
+	for ( int y = 0; y < ENCODER_TEST_H; y++ )
+		for ( int x = 0; x < ENCODER_TEST_W; x++ )
+			wrong += !encoder_test_pixel( data + header_len + ( ( size_t )y * ENCODER_TEST_W + x ) * 3, x, y );
+	EXPECT_EQ( wrong, 0 );
+	free( data );
+	remove( ppm );
+
+	// walk the chunks checking their crcs, then undo the stored blocks
+	data = encoder_test_read( png, &len );
+	ASSERT_TRUE( data != NULL );
+	ASSERT_GT( len, 8u );
+	EXPECT_EQ( memcmp( data, "\x89PNG\r\n\x1a\n", 8 ), 0 );
+
+	size_t raw_len = ( size_t )ENCODER_TEST_H * ( 1 + ENCODER_TEST_W * 3 );
+	u8 *raw = malloc( raw_len );
+	size_t raw_fill = 0;
+	int blocks = 0;
+	bool ended = false;
+	for ( size_t at = 8; at + 12 <= len && !ended; )
+	{
+		u32 chunk = encoder_test_u32( data + at );
+		ASSERT_LE( at + 12 + chunk, len );
+		const u8 *type = data + at + 4;
+		EXPECT_EQ( encoder_test_crc( type, chunk + 4 ), encoder_test_u32( type + 4 + chunk ) );
+
+		if ( memcmp( type, "IHDR", 4 ) == 0 )
+		{
+			EXPECT_EQ( encoder_test_u32( type + 4 ), ( u32 )ENCODER_TEST_W );
+			EXPECT_EQ( encoder_test_u32( type + 8 ), ( u32 )ENCODER_TEST_H );
+			EXPECT_EQ( type[ 12 ], 8 );
+			EXPECT_EQ( type[ 13 ], 2 );
+		}
+		else if ( memcmp( type, "IDAT", 4 ) == 0 )
+		{
+			const u8 *z = type + 4;
+			bool final = false;
+			for ( size_t i = 2; !final && i + 5 <= chunk; blocks++ )
+			{
+				final = z[ i ] & 1;
+				size_t n = z[ i + 1 ] | z[ i + 2 ] << 8;
+				EXPECT_EQ( ( n ^ 0xffff ), ( size_t )( z[ i + 3 ] | z[ i + 4 ] << 8 ) );
+				ASSERT_LE( raw_fill + n, raw_len );
+				memcpy( raw + raw_fill, z + i + 5, n );
+				raw_fill += n;
+				i += 5 + n;
+			}
+			EXPECT_TRUE( final );
+		}
+		else
+			ended = memcmp( type, "IEND", 4 ) == 0;
+
+		at += 12 + chunk;
+	}
+	EXPECT_TRUE( ended );
+	EXPECT_EQ( blocks, 2 );
+	ASSERT_EQ( raw_fill, raw_len );
+
+	wrong = 0;
+	for ( int y = 0; y < ENCODER_TEST_H; y++ )
+	{
+		const u8 *row = raw + ( size_t )y * ( 1 + ENCODER_TEST_W * 3 );
+		wrong += row[ 0 ] != 0;
+		for ( int x = 0; x < ENCODER_TEST_W; x++ )
+			wrong += !encoder_test_pixel( row + 1 + x * 3, x, y );
+	}
+	EXPECT_EQ( wrong, 0 );
+
+	free( raw );
+	free( data );
+	remove( png );
+}
+
+UTEST( encoder, drops_when_full )
+{
+	struct encoder encoder;
+	ASSERT_EQ( encoder_init( &encoder, 2 ), ENCODER_SUCCESS );
+
+	// slots still being filled hold up the queue
+	struct encoder_frame *a = encoder_begin( &encoder, 4, 4, 3 );
+	struct encoder_frame *b = encoder_begin( &encoder, 4, 4, 3 );
+	ASSERT_TRUE( a != NULL && b != NULL );
+	EXPECT_TRUE( encoder_begin( &encoder, 4, 4, 3 ) == NULL );
+
+	struct encoder_stats stats = encoder_stats( &encoder );
+	EXPECT_EQ( stats.depth, 2 );
+	EXPECT_EQ( stats.max_depth, 2 );
+	EXPECT_EQ( stats.dropped, 1u );
+
+	// handed back unwritten, out of order
+	encoder_submit( &encoder, b, NULL );
+	encoder_submit( &encoder, a, NULL );
+	encoder_flush( &encoder );
+
+	stats = encoder_stats( &encoder );
+	EXPECT_EQ( stats.depth, 0 );
+	EXPECT_EQ( stats.written, 0u );
+	EXPECT_EQ( stats.failed, 0u );
+	EXPECT_TRUE( encoder_begin( &encoder, 4, 4, 3 ) != NULL );
+
+	// the slot taken last is not submitted, free still returns
+	encoder_free( &encoder );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
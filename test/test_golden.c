@@ -0,0 +1,279 @@
+#include "utest.h"
+#include <trace/bvh.h>
+#include <trace/tracer.h>
+#include <gfx/obj3d.h>
+#include <util/fmath.h>
+
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Renders fixed scenes with the cpu tracer and compares them to the images
+ * under test/golden. Render times are kept next to the images as a ratio to
+ * a calibration render timed in the same run, so they hold across machines
+ * and builds; rendering a lot slower fails like a wrong image does. Run with
+ * GOLDEN_UPDATE=1 to write new references and ratios after an intended change.
+ */
+
+#define GOLDEN_DIR	"test/golden/"
+#define GOLDEN_W	128
+#define GOLDEN_H	96
+#define GOLDEN_FOV	45.0f
+
+// a pixel is off when a channel is further than this from the reference,
+// some are allowed for float differences between packet kernels and compilers
+#define GOLDEN_TOLERANCE	2
+#define GOLDEN_MAX_OFF		( GOLDEN_W * GOLDEN_H / 500 )
+
+// the best of the runs is timed on one thread, and may take this many times
+// the recorded ratio to the calibration before it fails
+#define GOLDEN_RUNS		5
+#define GOLDEN_SLACK	2.0
+
+// spheres in a grid for the calibration render, on a side
+#define GOLDEN_CAL_GRID	4
+
+static u8 *golden_read_ppm( const char *path, int w, int h )
+{
+	FILE *f = fopen( path, "rb" );
+	if ( f == NULL )
+		return NULL;
+
+	int fw, fh, max;
+	u8 *rgb = NULL;
+	if ( fscanf( f, "P6 %d %d %d", &fw, &fh, &max ) == 3 && fw == w && fh == h && max == 255 && fgetc( f ) != EOF )
+	{
+		rgb = malloc( ( size_t )w * h * 3 );
+		if ( fread( rgb, 1, ( size_t )w * h * 3, f ) != ( size_t )w * h * 3 )
+		{
+			free( rgb );
+			rgb = NULL;
+		}
+	}
+
+	fclose( f );
+	return rgb;
+}
+
+// nearest of the grid spheres along the ray, -1 on a miss
+static int golden_cal_hit( const float o[ 3 ], const float d[ 3 ], float *t )
+{
+	int hit = -1;
+	*t = 1e30f;
+	for ( int i = 0; i < GOLDEN_CAL_GRID * GOLDEN_CAL_GRID; i++ )
+	{
+		float c[ 3 ] = { ( float )( i % GOLDEN_CAL_GRID ) - 1.5f, ( float )( i / GOLDEN_CAL_GRID ) - 1.5f, 6.0f };
+		float oc[ 3 ] = { o[ 0 ] - c[ 0 ], o[ 1 ] - c[ 1 ], o[ 2 ] - c[ 2 ] };
+		float b = oc[ 0 ] * d[ 0 ] + oc[ 1 ] * d[ 1 ] + oc[ 2 ] * d[ 2 ];
+		float disc = b * b - ( oc[ 0 ] * oc[ 0 ] + oc[ 1 ] * oc[ 1 ] + oc[ 2 ] * oc[ 2 ] - 0.16f );
+		if ( disc < 0.0f )
+			continue;
+
+		float ti = -b - sqrtf( disc );
+		if ( ti > 1e-3f && ti < *t )
+		{
+			*t = ti;
+			hit = i;
+		}
+	}
+	return hit;
+}
+
+// a small ray caster of its own, shaded with a shadow ray, that stays the same
+// as the tracer changes; its best time in ms is what the render times are
+// measured against, taken once per run
+static double golden_calibration_ms( void )
+{
+	static double best = 0.0;
+	if ( best > 0.0 )
+		return best;
+
+	for ( int run = 0; run < GOLDEN_RUNS; run++ )
+	{
+		u64 start = SDL_GetPerformanceCounter();
+		volatile float sum = 0.0f;
+		for ( int y = 0; y < GOLDEN_H; y++ )
+		{
+			for ( int x = 0; x < GOLDEN_W; x++ )
+			{
+				float o[ 3 ] = { 0.0f, 0.0f, 0.0f };
+				float d[ 3 ] = { ( x - GOLDEN_W * 0.5f ) / GOLDEN_H, ( y - GOLDEN_H * 0.5f ) / GOLDEN_H, 1.0f };
+				float len = sqrtf( d[ 0 ] * d[ 0 ] + d[ 1 ] * d[ 1 ] + d[ 2 ] * d[ 2 ] );
+				d[ 0 ] /= len; d[ 1 ] /= len; d[ 2 ] /= len;
+
+				float t;
+				if ( golden_cal_hit( o, d, &t ) < 0 )
+					continue;
+
+				float p[ 3 ] = { d[ 0 ] * t, d[ 1 ] * t, d[ 2 ] * t };
+				float l[ 3 ] = { 0.48f, 0.6f, -0.64f };
+				float shadow;
+				sum = sum + ( golden_cal_hit( p, l, &shadow ) < 0 ? 1.0f : 0.25f );
+			}
+		}
+
+		double ms = ( double )( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+		if ( run == 0 || ms < best )
+			best = ms;
+	}
+	return best;
+}
+
+// renders the scene and compares it to its reference, off is the number of
+// pixels beyond the tolerance (-1 without a reference), ratio the best render
+// time over the calibration one and budget the recorded ratio times the slack
+static void golden_check( const char *name, const struct scene *scene, int *off, double *ratio, double *budget )
+{
+	char image_path[ 256 ], ratio_path[ 256 ];
+	snprintf( image_path, sizeof( image_path ), GOLDEN_DIR "%s.ppm", name );
+	snprintf( ratio_path, sizeof( ratio_path ), GOLDEN_DIR "%s.ratio", name );
+
+	*off = -1;
+	*ratio = 0.0;
+	*budget = 0.0;
+
+	struct tracer tracer;
+	if ( tracer_init( &tracer, GOLDEN_W, GOLDEN_H, 1 ) != TRACER_SUCCESS )
+		return;
+
+	double ms = 0.0;
+	for ( int i = 0; i < GOLDEN_RUNS; i++ )
+	{
+		tracer_render( &tracer, scene );
+		if ( i == 0 || tracer.seconds * 1000.0 < ms )
+			ms = tracer.seconds * 1000.0;
+	}
+
+	double calibration = golden_calibration_ms();
+	*ratio = ms / calibration;
+
+	const char *update = getenv( "GOLDEN_UPDATE" );
+	if ( update && update[ 0 ] == '1' )
+	{
+		FILE *f = fopen( ratio_path, "w" );
+		if ( f && tracer_write( &tracer, NULL, image_path ) == TRACER_SUCCESS )
+		{
+			fprintf( f, "%.3f\n", *ratio );
+			*off = 0;
+			*budget = *ratio * GOLDEN_SLACK;
+		}
+		if ( f )
+			fclose( f );
+		tracer_free( &tracer );
+		return;
+	}
+
+	FILE *f = fopen( ratio_path, "r" );
+	if ( f )
+	{
+		if ( fscanf( f, "%lf", budget ) == 1 )
+			*budget *= GOLDEN_SLACK;
+		fclose( f );
+	}
+
+	u8 *reference = golden_read_ppm( image_path, GOLDEN_W, GOLDEN_H );
+	if ( reference )
+	{
+		// same conversion as the written images
+		*off = 0;
+		for ( int i = 0; i < GOLDEN_W * GOLDEN_H; i++ )
+		{
+			vec3s c = tracer.pixels[ i ];
+			float rgb[ 3 ] = { c.x, c.y, c.z };
+			bool wrong = false;
+			for ( int k = 0; k < 3; k++ )
+			{
+				int v = ( int )( clamp( rgb[ k ], 0.0f, 1.0f ) * 255.0f + 0.5f );
+				wrong |= abs( v - reference[ i * 3 + k ] ) > GOLDEN_TOLERANCE;
+			}
+			*off += wrong;
+		}
+		free( reference );
+	}
+
+	// left in the working directory to diff against the reference
+	if ( *off < 0 || *off > GOLDEN_MAX_OFF )
+	{
+		char out_path[ 256 ];
+		snprintf( out_path, sizeof( out_path ), "golden_%s.ppm", name );
+		tracer_write( &tracer, NULL, out_path );
+		printf( "%s: %d pixels off the reference, wrote %s\n", name, *off, out_path );
+	}
+
+	printf( "%s: best render %.2f ms, %.3f times the calibration (%.2f ms), budget %.3f\n", name, ms, *ratio, calibration, *budget );
+	tracer_free( &tracer );
+}
+
+// a single mesh the way the game shows it
+static bool golden_mesh_scene( const char *path, struct scene *scene, struct bvh *bvh )
+{
+	struct obj3d obj;
+	if ( obj3d_load( &obj, path ) != 0 )
+		return false;
+
+	int err = bvh_build( bvh, obj.fv, obj.fv_len );
+	obj3d_free( &obj );
+	if ( err )
+		return false;
+
+	scene_init_mesh( scene, bvh, degtorad( GOLDEN_FOV ) );
+	return true;
+}
+
+UTEST( golden, spheres )
+{
+	struct scene scene;
+	int off;
+	double ratio, budget;
+
+	scene_init_default( &scene, degtorad( GOLDEN_FOV ) );
+	golden_check( "spheres", &scene, &off, &ratio, &budget );
+	scene_free( &scene );
+
+	EXPECT_GE( off, 0 );
+	EXPECT_LE( off, GOLDEN_MAX_OFF );
+	EXPECT_GT( budget, 0.0 );
+	EXPECT_LE( ratio, budget );
+}
+
+UTEST( golden, teapot )
+{
+	struct scene scene;
+	struct bvh bvh = { 0 };
+	int off;
+	double ratio, budget;
+
+	ASSERT_TRUE( golden_mesh_scene( "res/objects/teapot.obj", &scene, &bvh ) );
+	golden_check( "teapot", &scene, &off, &ratio, &budget );
+	scene_free( &scene );
+	bvh_free( &bvh );
+
+	EXPECT_GE( off, 0 );
+	EXPECT_LE( off, GOLDEN_MAX_OFF );
+	EXPECT_GT( budget, 0.0 );
+	EXPECT_LE( ratio, budget );
+}
+
+UTEST( golden, rayman )
+{
+	struct scene scene;
+	struct bvh bvh = { 0 };
+	int off;
+	double ratio, budget;
+
+	ASSERT_TRUE( golden_mesh_scene( "res/objects/rayman.obj", &scene, &bvh ) );
+	golden_check( "rayman", &scene, &off, &ratio, &budget );
+	scene_free( &scene );
+	bvh_free( &bvh );
+
+	EXPECT_GE( off, 0 );
+	EXPECT_LE( off, GOLDEN_MAX_OFF );
+	EXPECT_GT( budget, 0.0 );
+	EXPECT_LE( ratio, budget );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
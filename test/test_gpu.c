@@ -0,0 +1,776 @@
+#include "utest.h"
+#include <gfx/accum.h>
+#include <gfx/atrous.h>
+#include <gfx/capture.h>
+#include <gfx/gpu_timer.h>
+#include <gfx/offscreen.h>
+#include <gfx/shader.h>
+#include <gfx/vao.h>
+#include <gfx/vbo.h>
+#include <trace/bvh.h>
+#include <trace/trace.h>
+#include <trace/tracer.h>
+#include <trace/variant.h>
+#include <util/fmath.h>
+
+#define GPU_TEST_W 96
+#define GPU_TEST_H 72
+
+// a pixel is off when a channel differs by more than this
+#define GPU_TEST_TOLERANCE ( 2.0f / 255.0f )
+
+static const GLfloat gpu_test_quad[] = {
+	-1.0f, -1.0f, 0.0f,
+	 1.0f, -1.0f, 0.0f,
+	 1.0f,  1.0f, 0.0f,
+	 1.0f,  1.0f, 0.0f,
+	-1.0f,  1.0f, 0.0f,
+	-1.0f, -1.0f, 0.0f
+};
+
+static char *gpu_test_read( const char *path, size_t *len )
+{
+	FILE *f = fopen( path, "rb" );
+	if ( f == NULL )
+		return NULL;
+
+	fseek( f, 0, SEEK_END );
+	*len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	char *text = malloc( *len + 1 );
+	*len = fread( text, 1, *len, f );
+	text[ *len ] = '\0';
+	fclose( f );
+	return text;
+}
+
+// the raytracer, specialized for the scene like the game does or generic
+static bool gpu_test_shader( struct shader *shader, struct variant_cache *variants, const struct scene *scene, bool specialize )
+{
+	if ( !specialize )
+		return shader_fbuild( shader, "res/shaders/raytracer/vert.glsl", "res/shaders/raytracer/frag.glsl" ) == 0;
+
+	size_t vslen, fslen;
+	char *vs = gpu_test_read( "res/shaders/raytracer/vert.glsl", &vslen );
+	char *fs = gpu_test_read( "res/shaders/raytracer/frag.glsl", &fslen );
+	struct variant_key key;
+	const struct shader *built = NULL;
+
+	if ( vs && fs )
+	{
+		variant_cache_init( variants, vs, vslen, fs, fslen, NULL );
+		variant_key_init( &key, scene );
+		built = variant_get( variants, &key );
+	}
+
+	// nothing else is built from them
+	free( vs );
+	free( fs );
+	if ( built == NULL )
+		return false;
+
+	*shader = *built;
+	return true;
+}
+
+// render the scene with the raytracer shader, more than one frame averages
+// them with progressive accumulation and denoise filters the average (NULL
+// for none), returns false if there is no gl
+static bool gpu_test_render( struct scene *scene, int frames, bool specialize, const struct denoise_params *denoise, vec3s *pixels )
+{
+	struct offscreen off;
+	struct shader shader;
+	struct variant_cache variants = { 0 };
+	struct scene_buffers buffers;
+
+	if ( offscreen_init( &off, GPU_TEST_W, GPU_TEST_H ) != OFFSCREEN_SUCCESS )
+		return false;
+
+	if ( !gpu_test_shader( &shader, &variants, scene, specialize ) )
+	{
+		offscreen_free( &off );
+		return false;
+	}
+	shader_bind( shader );
+
+	struct vao vao = vao_create();
+	struct vbo vbo = vbo_create( GL_ARRAY_BUFFER, false );
+	vbo_buff( vbo, ( void * )gpu_test_quad, sizeof( gpu_test_quad ) );
+	vao_attr( vao, vbo, glGetAttribLocation( shader.handle, "position" ), 3, GL_FLOAT, 0, 0 );
+
+	scene->camera.aspect = ( float )GPU_TEST_W / GPU_TEST_H;
+	if ( scene_buffers_init( &buffers, shader ) != 0 )
+	{
+		if ( specialize )
+			variant_cache_free( &variants );
+		else
+			shader_free( shader );
+		offscreen_free( &off );
+		return false;
+	}
+
+	scene_upload_meshes( scene, &buffers );
+	scene_upload( scene, &buffers, ( vec2s ){{ GPU_TEST_W, GPU_TEST_H }} );
+
+	if ( frames > 1 || denoise )
+	{
+		struct accum accum;
+		accum_init( &accum, GPU_TEST_W, GPU_TEST_H );
+		accum_attach( &accum, shader );
+		for ( int i = 0; i < frames; i++ )
+		{
+			accum_begin( &accum, trace_jitter( accum.frames ) );
+			glDrawArrays( GL_TRIANGLES, 0, 6 );
+			accum_end( &accum );
+		}
+
+		struct atrous atrous;
+		if ( denoise && atrous_init( &atrous, GPU_TEST_W, GPU_TEST_H ) == ATROUS_SUCCESS )
+		{
+			atrous_apply( &atrous, accum_average( &accum ), accum.guide, denoise, accum.frames );
+			atrous_present( &atrous, off.fbo, GPU_TEST_W, GPU_TEST_H );
+			atrous_free( &atrous );
+		}
+		else
+			accum_present( &accum, off.fbo, GPU_TEST_W, GPU_TEST_H );
+		accum_free( &accum );
+	}
+	else
+		glDrawArrays( GL_TRIANGLES, 0, 6 );
+
+	offscreen_read( &off, pixels );
+
+	scene_buffers_free( &buffers );
+	vbo_free( vbo );
+	vao_free( vao );
+	if ( specialize )
+		variant_cache_free( &variants );
+	else
+		shader_free( shader );
+	offscreen_free( &off );
+
+	return true;
+}
+
+// number of pixels that differ between the shader and the cpu tracer
+static int gpu_test_compare( struct scene *scene, int frames, bool specialize, int *out_total )
+{
+	struct tracer tracer;
+	vec3s *gpu = malloc( GPU_TEST_W * GPU_TEST_H * sizeof( *gpu ) );
+
+	if ( !gpu_test_render( scene, frames, specialize, NULL, gpu ) )
+	{
+		free( gpu );
+		return -1;
+	}
+
+	tracer_init( &tracer, GPU_TEST_W, GPU_TEST_H, 1 );
+	tracer_render( &tracer, scene );
+	for ( int i = 1; i < frames; i++ )
+		tracer_accumulate( &tracer, scene );
+
+	int off = 0;
+	for ( int i = 0; i < GPU_TEST_W * GPU_TEST_H; i++ )
+	{
+		vec3s d = glms_vec3_sub( gpu[ i ], tracer.pixels[ i ] );
+		if ( fabsf( d.x ) > GPU_TEST_TOLERANCE || fabsf( d.y ) > GPU_TEST_TOLERANCE || fabsf( d.z ) > GPU_TEST_TOLERANCE )
+			off++;
+	}
+
+	tracer_free( &tracer );
+	free( gpu );
+
+	*out_total = GPU_TEST_W * GPU_TEST_H;
+	return off;
+}
+
+UTEST( gpu, spheres_match_cpu )
+{
+	struct scene scene;
+	int total;
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	int off = gpu_test_compare( &scene, 1, false, &total );
+	scene_free( &scene );
+	if ( off < 0 )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	// edges may land on the other side of a primitive
+	EXPECT_LE( off, total / 100 );
+}
+
+UTEST( gpu, mesh_matches_cpu )
+{
+	struct obj3d obj;
+	struct bvh bvh;
+	struct scene scene;
+	int total;
+
+	ASSERT_EQ( obj3d_load( &obj, "res/objects/teapot.obj" ), 0 );
+	ASSERT_EQ( bvh_build( &bvh, obj.fv, obj.fv_len ), 0 );
+	obj3d_free( &obj );
+
+	scene_init_mesh( &scene, &bvh, degtorad( 45.0f ) );
+	int off = gpu_test_compare( &scene, 1, false, &total );
+	scene_free( &scene );
+	bvh_free( &bvh );
+	if ( off < 0 )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	EXPECT_LE( off, total / 100 );
+}
+
+UTEST( gpu, accumulation_matches_cpu )
+{
+	struct scene scene;
+	int total;
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	int off = gpu_test_compare( &scene, 8, false, &total );
+	scene_free( &scene );
+	if ( off < 0 )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	EXPECT_LE( off, total / 100 );
+}
+
+UTEST( gpu, denoise_matches_cpu )
+{
+	struct scene scene;
+	struct tracer tracer;
+	struct denoise_params params;
+	vec3s *gpu = malloc( GPU_TEST_W * GPU_TEST_H * sizeof( *gpu ) );
+
+	// the guides of both have to match too, or the weights would not
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	denoise_params_init( &params );
+	if ( !gpu_test_render( &scene, 1, false, &params, gpu ) )
+	{
+		free( gpu );
+		scene_free( &scene );
+		UTEST_SKIP( "No offscreen OpenGL context" );
+	}
+
+	ASSERT_EQ( tracer_init( &tracer, GPU_TEST_W, GPU_TEST_H, 1 ), TRACER_SUCCESS );
+	tracer_render( &tracer, &scene );
+	ASSERT_EQ( tracer_denoise( &tracer, &params ), TRACER_SUCCESS );
+
+	int off = 0;
+	for ( int i = 0; i < GPU_TEST_W * GPU_TEST_H; i++ )
+	{
+		vec3s d = glms_vec3_sub( gpu[ i ], tracer.pixels[ i ] );
+		if ( fabsf( d.x ) > GPU_TEST_TOLERANCE || fabsf( d.y ) > GPU_TEST_TOLERANCE || fabsf( d.z ) > GPU_TEST_TOLERANCE )
+			off++;
+	}
+	EXPECT_LE( off, GPU_TEST_W * GPU_TEST_H / 100 );
+
+	tracer_free( &tracer );
+	scene_free( &scene );
+	free( gpu );
+}
+
+UTEST( gpu, variants_match_cpu )
+{
+	struct scene scene;
+	int total;
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	int off = gpu_test_compare( &scene, 1, true, &total );
+	if ( off < 0 )
+	{
+		scene_free( &scene );
+		UTEST_SKIP( "No offscreen OpenGL context" );
+	}
+	EXPECT_LE( off, total / 100 );
+
+	// fewer spheres and bounces, no shadows
+	EXPECT_TRUE( spheres_remove( &scene.spheres, 3 ) );
+	EXPECT_TRUE( spheres_remove( &scene.spheres, 4 ) );
+	scene.max_depth = 1;
+	scene.shadows = false;
+	EXPECT_LE( gpu_test_compare( &scene, 1, true, &total ), total / 100 );
+
+	// the generic shader reads the same from the uniform block
+	EXPECT_LE( gpu_test_compare( &scene, 1, false, &total ), total / 100 );
+
+	// and a scene without spheres leaves them out
+	spheres_clear( &scene.spheres );
+	EXPECT_LE( gpu_test_compare( &scene, 1, true, &total ), total / 100 );
+	scene_free( &scene );
+}
+
+UTEST( gpu, variant_cache )
+{
+	struct offscreen off;
+	struct variant_cache variants;
+	struct variant_key key;
+	struct scene scene;
+	size_t vslen, fslen;
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	variant_key_init( &key, &scene );
+	EXPECT_EQ( key.mesh_count, 0u );
+	EXPECT_TRUE( key.spheres );
+	scene_free( &scene );
+
+	char defines[ 256 ];
+	variant_defines( &key, defines, sizeof( defines ) );
+	EXPECT_TRUE( strstr( defines, "#define MAX_DEPTH 4u\n" ) != NULL );
+
+	if ( offscreen_init( &off, 4, 4 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	char *vs = gpu_test_read( "res/shaders/raytracer/vert.glsl", &vslen );
+	char *fs = gpu_test_read( "res/shaders/raytracer/frag.glsl", &fslen );
+	ASSERT_TRUE( vs && fs );
+	variant_cache_init( &variants, vs, vslen, fs, fslen, NULL );
+
+	// built once per feature set
+	const struct shader *a = variant_get( &variants, &key );
+	ASSERT_TRUE( a != NULL );
+	EXPECT_TRUE( variant_get( &variants, &key ) == a );
+
+	key.shadows = false;
+	const struct shader *b = variant_get( &variants, &key );
+	ASSERT_TRUE( b != NULL );
+	EXPECT_NE( b->handle, a->handle );
+	EXPECT_EQ( variants.count, 2u );
+
+	variant_cache_free( &variants );
+	free( vs );
+	free( fs );
+	offscreen_free( &off );
+}
+
+UTEST( gpu, variant_binaries )
+{
+	const char *prefix = "test_variant";
+	struct offscreen off;
+	struct variant_cache variants;
+	struct variant_key key = { .max_depth = 1, .spheres = true };
+	size_t vslen, fslen;
+
+	if ( offscreen_init( &off, 4, 4 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	GLint formats = 0;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+	if ( formats == 0 )
+	{
+		offscreen_free( &off );
+		UTEST_SKIP( "No program binary formats" );
+	}
+
+	char *vs = gpu_test_read( "res/shaders/raytracer/vert.glsl", &vslen );
+	char *fs = gpu_test_read( "res/shaders/raytracer/frag.glsl", &fslen );
+	ASSERT_TRUE( vs && fs );
+	variant_cache_init( &variants, vs, vslen, fs, fslen, prefix );
+	variants.binary_max = 2;
+
+	// three feature sets, the binary of the first one is the oldest
+	char paths[ 3 ][ 64 ];
+	for ( int i = 0; i < 3; i++ )
+	{
+		char defines[ 256 ];
+		key.max_depth = 1 + i;
+		variant_defines( &key, defines, sizeof( defines ) );
+
+		u32 hash = 2166136261u;
+		for ( const char *c = defines; *c; c++ )
+			hash = ( hash ^ ( u8 )*c ) * 16777619u;
+		snprintf( paths[ i ], sizeof( paths[ i ] ), "%s.%08x.glbin", prefix, hash );
+
+		EXPECT_TRUE( variant_get( &variants, &key ) != NULL );
+	}
+
+	FILE *f[ 3 ];
+	for ( int i = 0; i < 3; i++ )
+		f[ i ] = fopen( paths[ i ], "rb" );
+	EXPECT_TRUE( f[ 0 ] == NULL );
+	EXPECT_TRUE( f[ 1 ] != NULL );
+	EXPECT_TRUE( f[ 2 ] != NULL );
+	for ( int i = 0; i < 3; i++ )
+	{
+		if ( f[ i ] )
+			fclose( f[ i ] );
+		remove( paths[ i ] );
+	}
+
+	char index[ 64 ];
+	snprintf( index, sizeof( index ), "%s.index", prefix );
+	remove( index );
+
+	variant_cache_free( &variants );
+	free( vs );
+	free( fs );
+	offscreen_free( &off );
+}
+
+UTEST( gpu, many_lights_match_cpu )
+{
+	struct scene scene;
+	int total;
+
+	// a grid of small coloured lights, primary hits only shade their tile's lights
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	for ( int i = 0; i < 64; i++ )
+	{
+		scene_add_light( &scene, ( struct scene_light ) {
+			.pos    = {{ -7.0f + ( i % 8 ) * 2.0f, -0.5f + ( i % 3 ) * 0.75f, -7.0f + ( i / 8 ) * 2.0f }},
+			.radius = 0.1f,
+			.color  = {{ ( i % 4 ) / 3.0f, ( i % 5 ) / 4.0f, ( i % 7 ) / 6.0f }},
+			.reach  = 1.5f + ( i % 3 ) * 0.5f,
+			.power  = 0.5f
+		} );
+	}
+
+	int off = gpu_test_compare( &scene, 1, false, &total );
+	scene_free( &scene );
+	if ( off < 0 )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	EXPECT_LE( off, total / 100 );
+}
+
+UTEST( gpu, many_spheres_match_cpu )
+{
+	struct scene scene;
+	int total;
+
+	// a field of small spheres in front of the default ones, not a multiple of a block
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	srand( 42 );
+	for ( int i = 0; i < 3001; i++ )
+	{
+		vec3s pos = {{ ( float )rand() / RAND_MAX * 16.0f - 8.0f, ( float )rand() / RAND_MAX * 3.0f - 0.8f,
+		               ( float )rand() / RAND_MAX * 10.0f - 4.0f }};
+		u32 mat = ( u32 )( i % 5 );
+		ASSERT_NE( scene_add_sphere( &scene, pos, 0.02f + ( float )rand() / RAND_MAX * 0.08f, mat ), SPHERES_NONE );
+	}
+
+	int off = gpu_test_compare( &scene, 1, false, &total );
+	if ( off < 0 )
+	{
+		scene_free( &scene );
+		UTEST_SKIP( "No offscreen OpenGL context" );
+	}
+
+	// more edges than the default scene
+	EXPECT_LE( off, total / 50 );
+	scene_free( &scene );
+}
+
+static const char gpu_test_vs[] =
+	"#version 330 core\n"
+	"in vec3 position;\n"
+	"uniform mat4 transform;\n"
+	"void main() { gl_Position = transform * vec4( position, 1.0 ); }\n";
+
+static const char gpu_test_fs[] =
+	"#version 330 core\n"
+	"out vec4 out_color;\n"
+	"uniform float weights[ 4 ];\n"
+	"uniform vec3 color;\n"
+	"uniform float unused;\n"
+	"void main() { out_color = vec4( color * ( weights[ 0 ] + weights[ 3 ] ), 1.0 ); }\n";
+
+UTEST( gpu, uniform_locations )
+{
+	struct offscreen off;
+	struct shader shader;
+
+	if ( offscreen_init( &off, 4, 4 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	ASSERT_EQ( shader_tbuild( &shader, gpu_test_vs, sizeof( gpu_test_vs ) - 1, gpu_test_fs, sizeof( gpu_test_fs ) - 1 ), 0 );
+
+	const char *names[] = { "transform", "color", "weights", "weights[0]", "weights[3]" };
+	for ( size_t i = 0; i < sizeof( names ) / sizeof( *names ); i++ )
+	{
+		GLint loc = shader_uniform_loc( shader, names[ i ] );
+		EXPECT_GE( loc, 0 );
+		EXPECT_EQ( loc, glGetUniformLocation( shader.handle, names[ i ] ) );
+	}
+
+	// optimized out or never declared
+	EXPECT_EQ( shader_uniform_loc( shader, "unused" ), -1 );
+	EXPECT_EQ( shader_uniform_loc( shader, "weights[4]" ), -1 );
+	EXPECT_EQ( shader_uniform_loc( shader, "position" ), -1 );
+
+	// setting by location ends up in the program
+	float weight = 0.0f;
+	shader_bind( shader );
+	shader_uniform_float_loc( shader, shader_uniform_loc( shader, "weights[3]" ), 0.25f );
+	glGetUniformfv( shader.handle, glGetUniformLocation( shader.handle, "weights[3]" ), &weight );
+	EXPECT_EQ( weight, 0.25f );
+
+	shader_free( shader );
+	offscreen_free( &off );
+}
+
+UTEST( gpu, skips_unchanged_uniforms )
+{
+	struct offscreen off;
+	struct shader shader;
+	struct scene_buffers buffers;
+	struct scene scene;
+
+	if ( offscreen_init( &off, 4, 4 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	ASSERT_EQ( shader_fbuild( &shader, "res/shaders/raytracer/vert.glsl", "res/shaders/raytracer/frag.glsl" ), 0 );
+	shader_bind( shader );
+	ASSERT_EQ( scene_buffers_init( &buffers, shader ), 0 );
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	shader_stats_frame();
+
+	// same sampler unit as scene_buffers_init already set
+	GLint loc = shader_uniform_loc( shader, "mesh_nodes" );
+	shader_uniform_int_loc( shader, loc, SCENE_UNIT_NODES );
+	EXPECT_EQ( shader_stats.uploads, 0u );
+	EXPECT_EQ( shader_stats.skipped, 1u );
+
+	shader_uniform_int_loc( shader, loc, SCENE_UNIT_TRIS );
+	shader_uniform_int_loc( shader, loc, SCENE_UNIT_NODES );
+	EXPECT_EQ( shader_stats.uploads, 2u );
+
+	// the whole block only goes out when something in it changed
+	scene_upload( &scene, &buffers, ( vec2s ){{ 4.0f, 4.0f }} );
+	scene_upload( &scene, &buffers, ( vec2s ){{ 4.0f, 4.0f }} );
+	EXPECT_EQ( shader_stats.uploads, 3u );
+	EXPECT_EQ( shader_stats.skipped, 2u );
+
+	scene.lights[ 0 ].color.x = 0.5f;
+	scene_upload( &scene, &buffers, ( vec2s ){{ 4.0f, 4.0f }} );
+	EXPECT_EQ( shader_stats.uploads, 4u );
+
+	shader_stats_frame();
+	EXPECT_EQ( shader_stats.frame_uploads, 4u );
+	EXPECT_EQ( shader_stats.frame_skipped, 2u );
+	EXPECT_EQ( shader_stats.uploads, 0u );
+
+	scene_buffers_free( &buffers );
+	scene_free( &scene );
+	shader_free( shader );
+	offscreen_free( &off );
+}
+
+// what the gpu holds of the spheres after a scene_upload
+static void gpu_test_read_spheres( const struct scene_buffers *buffers, u32 count, struct scene_block_sphere *spheres, u32 *mats )
+{
+	glBindBuffer( GL_TEXTURE_BUFFER, buffers->spheres.buffer );
+	glGetBufferSubData( GL_TEXTURE_BUFFER, 0, count * sizeof( *spheres ), spheres );
+	glBindBuffer( GL_TEXTURE_BUFFER, buffers->sphere_mats.buffer );
+	glGetBufferSubData( GL_TEXTURE_BUFFER, 0, count * sizeof( *mats ), mats );
+}
+
+UTEST( gpu, sphere_uploads )
+{
+	struct offscreen off;
+	struct shader shader;
+	struct scene_buffers buffers;
+	struct scene scene;
+	static struct scene_block_sphere spheres[ 256 ];
+	static u32 mats[ 256 ];
+
+	if ( offscreen_init( &off, 4, 4 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	ASSERT_EQ( shader_fbuild( &shader, "res/shaders/raytracer/vert.glsl", "res/shaders/raytracer/frag.glsl" ), 0 );
+	ASSERT_EQ( scene_buffers_init( &buffers, shader ), 0 );
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	for ( int i = 0; i < 200; i++ )
+		scene_add_sphere( &scene, ( vec3s ){{ ( float )i, 1.0f, 2.0f }}, 0.5f, ( u32 )( i % 5 ) );
+
+	EXPECT_TRUE( scene_upload( &scene, &buffers, ( vec2s ){{ 4.0f, 4.0f }} ) );
+	EXPECT_FALSE( scene_upload( &scene, &buffers, ( vec2s ){{ 4.0f, 4.0f }} ) );
+
+	// a move and a removal (the last sphere takes the removed one's slot)
+	spheres_set( &scene.spheres, 10, ( vec3s ){{ -1.0f, -2.0f, -3.0f }}, 0.25f );
+	spheres_remove( &scene.spheres, 20 );
+	EXPECT_TRUE( scene_upload( &scene, &buffers, ( vec2s ){{ 4.0f, 4.0f }} ) );
+
+	u32 count = scene.spheres.count;
+	ASSERT_EQ( count, 204u );
+	gpu_test_read_spheres( &buffers, count, spheres, mats );
+
+	int wrong = 0;
+	for ( u32 i = 0; i < count; i++ )
+	{
+		wrong += spheres[ i ].center.x != scene.spheres.x[ i ] || spheres[ i ].center.y != scene.spheres.y[ i ]
+			|| spheres[ i ].center.z != scene.spheres.z[ i ] || spheres[ i ].radius != scene.spheres.radius[ i ];
+		wrong += mats[ i ] != scene.spheres.mat[ i ];
+	}
+	EXPECT_EQ( wrong, 0 );
+	EXPECT_EQ( buffers.sphere_count, count );
+
+	scene_buffers_free( &buffers );
+	scene_free( &scene );
+	shader_free( shader );
+	offscreen_free( &off );
+}
+
+UTEST( gpu, program_binary_cache )
+{
+	const char *path = "test_program.glbin";
+	struct offscreen off;
+	struct shader shader;
+
+	if ( offscreen_init( &off, 4, 4 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	remove( path );
+	ASSERT_EQ( shader_cbuild( &shader, gpu_test_vs, sizeof( gpu_test_vs ) - 1, gpu_test_fs, sizeof( gpu_test_fs ) - 1, path ), 0 );
+	EXPECT_FALSE( shader.cached );
+	GLint loc = shader_uniform_loc( shader, "weights[3]" );
+	shader_free( shader );
+
+	GLint formats = 0;
+	glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+	if ( formats == 0 )
+	{
+		offscreen_free( &off );
+		UTEST_SKIP( "No program binary formats" );
+	}
+
+	// the second build loads what the first one saved
+	ASSERT_EQ( shader_cbuild( &shader, gpu_test_vs, sizeof( gpu_test_vs ) - 1, gpu_test_fs, sizeof( gpu_test_fs ) - 1, path ), 0 );
+	EXPECT_TRUE( shader.cached );
+	EXPECT_EQ( shader_uniform_loc( shader, "weights[3]" ), loc );
+	shader_free( shader );
+
+	// other sources miss the cache
+	ASSERT_EQ( shader_cbuild( &shader, gpu_test_vs, sizeof( gpu_test_vs ) - 1, gpu_test_fs, sizeof( gpu_test_fs ) - 2, path ), 0 );
+	EXPECT_FALSE( shader.cached );
+	shader_free( shader );
+
+	remove( path );
+	offscreen_free( &off );
+}
+
+UTEST( gpu, timer_queries )
+{
+	struct offscreen off;
+	struct gpu_timer timer;
+	static struct histogram times;
+
+	if ( offscreen_init( &off, 4, 4 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	gpu_timer_init( &timer );
+	histogram_clear( &times );
+
+	// a full ring skips frames instead of waiting for results
+	for ( int i = 0; i < GPU_TIMER_QUERIES + 2; i++ )
+	{
+		gpu_timer_begin( &timer );
+		glClear( GL_COLOR_BUFFER_BIT );
+		gpu_timer_end( &timer );
+	}
+	EXPECT_EQ( timer.pending, ( u32 )GPU_TIMER_QUERIES );
+	EXPECT_EQ( timer.skipped, 2u );
+
+	// once the gpu caught up every result is read, oldest first
+	glFinish();
+	int read = 0;
+	for ( int tries = 0; tries < 1000 && read < GPU_TIMER_QUERIES; tries++ )
+		read += gpu_timer_poll( &timer, &times );
+	EXPECT_EQ( read, GPU_TIMER_QUERIES );
+	EXPECT_EQ( timer.pending, 0u );
+	EXPECT_EQ( times.total, ( u64 )GPU_TIMER_QUERIES );
+	EXPECT_EQ( gpu_timer_poll( &timer, &times ), 0 );
+
+	gpu_timer_free( &timer );
+	offscreen_free( &off );
+}
+
+UTEST( gpu, capture_frames )
+{
+	const int frames = 5;
+	struct offscreen off;
+	struct encoder encoder;
+	struct capture capture;
+
+	if ( offscreen_init( &off, 8, 6 ) != OFFSCREEN_SUCCESS )
+		UTEST_SKIP( "No offscreen OpenGL context" );
+
+	ASSERT_EQ( encoder_init( &encoder, 8 ), ENCODER_SUCCESS );
+	// the pattern becomes a printf format, anything but one integer conversion is refused
+	EXPECT_FALSE( capture_pattern_valid( "frame.ppm" ) );
+	EXPECT_FALSE( capture_pattern_valid( "frame_%s.ppm" ) );
+	EXPECT_FALSE( capture_pattern_valid( "frame_%u_%u.ppm" ) );
+	EXPECT_FALSE( capture_pattern_valid( "frame_%n%u.ppm" ) );
+	EXPECT_FALSE( capture_pattern_valid( "frame_%lu.ppm" ) );
+	EXPECT_FALSE( capture_pattern_valid( "frame_%" ) );
+	EXPECT_TRUE( capture_pattern_valid( "100%%_%05u.png" ) );
+	EXPECT_TRUE( capture_pattern_valid( "frame_%-4d.ppm" ) );
+	const char *bad = "frame_%s.ppm";
+	EXPECT_EQ( capture_init( &capture, &encoder, bad ), CAPTURE_ERROR );
+
+	const char *pattern = "test_capture_%u.ppm";
+	ASSERT_EQ( capture_init( &capture, &encoder, pattern ), CAPTURE_SUCCESS );
+
+	// the bottom rows red and the top ones blue, green numbers the frame
+	glEnable( GL_SCISSOR_TEST );
+	for ( int i = 0; i < frames; i++ )
+	{
+		glScissor( 0, 0, 8, 2 );
+		glClearColor( 1.0f, i * 40 / 255.0f, 0.0f, 1.0f );
+		glClear( GL_COLOR_BUFFER_BIT );
+		glScissor( 0, 2, 8, 4 );
+		glClearColor( 0.0f, i * 40 / 255.0f, 1.0f, 1.0f );
+		glClear( GL_COLOR_BUFFER_BIT );
+		capture_frame( &capture, off.fbo, 8, 6 );
+	}
+	glDisable( GL_SCISSOR_TEST );
+
+	capture_flush( &capture );
+	encoder_flush( &encoder );
+	struct encoder_stats stats = encoder_stats( &encoder );
+	EXPECT_EQ( capture.frames, ( u32 )frames );
+	EXPECT_EQ( stats.written + stats.dropped + capture.dropped, ( u64 )frames );
+	EXPECT_GE( stats.written, 1u );
+
+	// frames may be dropped when the gpu falls behind, what was written is whole
+	int found = 0, wrong = 0;
+	for ( int i = 0; i < frames; i++ )
+	{
+		char path[ 64 ];
+		snprintf( path, sizeof( path ), "test_capture_%u.ppm", i );
+		size_t len;
+		char *data = gpu_test_read( path, &len );
+		if ( data == NULL )
+			continue;
+
+		const char *header = "P6\n8 6\n255\n";
+		size_t header_len = strlen( header );
+		found++;
+		if ( len != header_len + 8 * 6 * 3 || memcmp( data, header, header_len ) != 0 )
+		{
+			wrong++;
+			free( data );
+			remove( path );
+			continue;
+		}
+
+		const u8 *rgb = ( const u8 * )data + header_len;
+		for ( int p = 0; p < 8 * 6; p++ )
+		{
+			bool top = p / 8 < 4;
+			wrong += rgb[ p * 3 + 0 ] != ( top ? 0 : 255 ) || rgb[ p * 3 + 1 ] != i * 40 || rgb[ p * 3 + 2 ] != ( top ? 255 : 0 );
+		}
+		free( data );
+		remove( path );
+	}
+	EXPECT_EQ( ( u64 )found, stats.written );
+	EXPECT_EQ( wrong, 0 );
+
+	capture_free( &capture );
+	encoder_free( &encoder );
+	offscreen_free( &off );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
@@ -0,0 +1,54 @@
+#include "utest.h"
+#include <util/histogram.h>
+#include <math.h>
+
+UTEST( histogram, buckets )
+{
+	// buckets are contiguous and every value lands in the one starting below it
+	for ( u32 b = 0; b + 1 < HISTOGRAM_BUCKETS; b++ )
+	{
+		u64 min = histogram_bucket_min( b );
+		u64 next = histogram_bucket_min( b + 1 );
+		ASSERT_LT( min, next );
+		EXPECT_EQ( histogram_bucket( min ), b );
+		EXPECT_EQ( histogram_bucket( next - 1 ), b );
+
+		// no wider than 1/16th of the values in it
+		EXPECT_LE( ( next - min ) * HISTOGRAM_SUB_BUCKETS, next > HISTOGRAM_SUB_BUCKETS ? min : HISTOGRAM_SUB_BUCKETS );
+	}
+
+	EXPECT_EQ( histogram_bucket( ~( u64 )0 ), ( u32 )HISTOGRAM_BUCKETS - 1 );
+}
+
+UTEST( histogram, percentiles )
+{
+	static struct histogram h;
+	histogram_clear( &h );
+	EXPECT_EQ( histogram_percentile( &h, 0.5f ), 0u );
+
+	// 1..100 ms
+	for ( u64 i = 1; i <= 100; i++ )
+		histogram_push( &h, i * 1000000 );
+
+	const float ps[] = { 0.5f, 0.95f, 0.99f };
+	for ( int i = 0; i < 3; i++ )
+	{
+		double expected = ps[ i ] * 100.0 * 1e6;
+		double got = ( double )histogram_percentile( &h, ps[ i ] );
+		EXPECT_LT( fabs( got - expected ) / expected, 1.0 / HISTOGRAM_SUB_BUCKETS );
+	}
+	EXPECT_LE( histogram_percentile( &h, 1.0f ), h.max );
+	EXPECT_EQ( h.max, 100000000u );
+
+	// a full window of fast samples pushes the slow ones out, the max stays
+	for ( int i = 0; i < HISTOGRAM_WINDOW; i++ )
+		histogram_push( &h, 1000 );
+	EXPECT_EQ( h.len, ( u32 )HISTOGRAM_WINDOW );
+	EXPECT_LT( histogram_percentile( &h, 1.0f ), 1100u );
+	EXPECT_EQ( h.max, 100000000u );
+	EXPECT_EQ( h.total, 100u + HISTOGRAM_WINDOW );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
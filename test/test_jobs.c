@@ -0,0 +1,191 @@
+#include "utest.h"
+#include <system/jobs.h>
+
+#define JOBS_TEST_COUNT		100000
+
+struct jobs_test_for
+{
+	SDL_atomic_t *hits;
+	SDL_atomic_t bad_slots;
+};
+
+static void jobs_test_mark( size_t begin, size_t end, int slot, void *data )
+{
+	struct jobs_test_for *t = data;
+	if ( slot < 0 || slot > jobs_worker_count() )
+		SDL_AtomicAdd( &t->bad_slots, 1 );
+
+	for ( size_t i = begin; i < end; i++ )
+		SDL_AtomicAdd( &t->hits[ i ], 1 );
+}
+
+// a parallel_for inside a chunk of another one
+static void jobs_test_nested( size_t begin, size_t end, int slot, void *data )
+{
+	struct jobs_test_for *t = data;
+	( void )slot;
+
+	for ( size_t i = begin; i < end; i++ )
+	{
+		struct jobs_test_for inner = { .hits = t->hits + i * 100 };
+		SDL_AtomicSet( &inner.bad_slots, 0 );
+		parallel_for( 100, 7, jobs_test_mark, &inner );
+		SDL_AtomicAdd( &t->bad_slots, SDL_AtomicGet( &inner.bad_slots ) );
+	}
+}
+
+static int jobs_test_count_hits( SDL_atomic_t *hits, int n )
+{
+	int wrong = 0;
+	for ( int i = 0; i < n; i++ )
+		wrong += SDL_AtomicGet( &hits[ i ] ) != 1;
+	return wrong;
+}
+
+UTEST( jobs, parallel_for_covers_once )
+{
+	SDL_atomic_t *hits = calloc( JOBS_TEST_COUNT, sizeof( *hits ) );
+	ASSERT_TRUE( hits != NULL );
+	ASSERT_EQ( jobs_init( 4 ), JOBS_SUCCESS );
+	EXPECT_EQ( jobs_worker_count(), 4 );
+
+	struct jobs_test_for t = { .hits = hits };
+	SDL_AtomicSet( &t.bad_slots, 0 );
+	parallel_for( JOBS_TEST_COUNT, 0, jobs_test_mark, &t );
+	EXPECT_EQ( jobs_test_count_hits( hits, JOBS_TEST_COUNT ), 0 );
+
+	memset( hits, 0, JOBS_TEST_COUNT * sizeof( *hits ) );
+	parallel_for( JOBS_TEST_COUNT / 100, 3, jobs_test_nested, &t );
+	EXPECT_EQ( jobs_test_count_hits( hits, JOBS_TEST_COUNT ), 0 );
+	EXPECT_EQ( SDL_AtomicGet( &t.bad_slots ), 0 );
+
+	jobs_free();
+	EXPECT_EQ( jobs_worker_count(), 1 );
+	free( hits );
+}
+
+struct jobs_test_order
+{
+	SDL_atomic_t first_done;
+	SDL_atomic_t early;
+};
+
+static void jobs_test_first( void *data )
+{
+	struct jobs_test_order *t = data;
+	SDL_Delay( 1 );
+	SDL_AtomicAdd( &t->first_done, 1 );
+}
+
+static void jobs_test_second( void *data )
+{
+	struct jobs_test_order *t = data;
+	if ( SDL_AtomicGet( &t->first_done ) != 16 )
+		SDL_AtomicAdd( &t->early, 1 );
+}
+
+UTEST( jobs, run_after_waits_for_counter )
+{
+	ASSERT_EQ( jobs_init( 4 ), JOBS_SUCCESS );
+
+	struct jobs_test_order t;
+	SDL_AtomicSet( &t.first_done, 0 );
+	SDL_AtomicSet( &t.early, 0 );
+
+	struct job_counter first = { 0 };
+	struct job_counter second = { 0 };
+	for ( int i = 0; i < 16; i++ )
+		jobs_run( jobs_test_first, &t, &first );
+	for ( int i = 0; i < 8; i++ )
+		jobs_run_after( &first, jobs_test_second, &t, &second );
+
+	jobs_wait( &second );
+	EXPECT_EQ( SDL_AtomicGet( &first.pending ), 0 );
+	EXPECT_EQ( SDL_AtomicGet( &t.first_done ), 16 );
+	EXPECT_EQ( SDL_AtomicGet( &t.early ), 0 );
+
+	jobs_free();
+}
+
+static int jobs_test_outside( void *data )
+{
+	struct jobs_test_for *t = data;
+	parallel_for( JOBS_TEST_COUNT, 64, jobs_test_mark, t );
+	return 0;
+}
+
+UTEST( jobs, submit_from_outside_pool )
+{
+	SDL_atomic_t *hits = calloc( JOBS_TEST_COUNT, sizeof( *hits ) );
+	ASSERT_TRUE( hits != NULL );
+	ASSERT_EQ( jobs_init( 3 ), JOBS_SUCCESS );
+
+	// the outside thread gets the extra slot past the workers
+	struct jobs_test_for t = { .hits = hits };
+	SDL_AtomicSet( &t.bad_slots, 0 );
+	SDL_Thread *thread = SDL_CreateThread( jobs_test_outside, "outside", &t );
+	ASSERT_TRUE( thread != NULL );
+	SDL_WaitThread( thread, NULL );
+
+	EXPECT_EQ( jobs_test_count_hits( hits, JOBS_TEST_COUNT ), 0 );
+	EXPECT_EQ( SDL_AtomicGet( &t.bad_slots ), 0 );
+
+	jobs_free();
+	free( hits );
+}
+
+// counts chunks that find their slot already in use
+struct jobs_test_slots
+{
+	SDL_atomic_t *hits;
+	SDL_atomic_t busy[ JOBS_MAX_WORKERS + 1 ];
+	SDL_atomic_t shared;
+};
+
+static void jobs_test_claim( size_t begin, size_t end, int slot, void *data )
+{
+	struct jobs_test_slots *t = data;
+	if ( SDL_AtomicAdd( &t->busy[ slot ], 1 ) != 0 )
+		SDL_AtomicAdd( &t->shared, 1 );
+
+	for ( size_t i = begin; i < end; i++ )
+		SDL_AtomicAdd( &t->hits[ i ], 1 );
+
+	SDL_AtomicAdd( &t->busy[ slot ], -1 );
+}
+
+static int jobs_test_outside_claim( void *data )
+{
+	parallel_for( JOBS_TEST_COUNT, 16, jobs_test_claim, data );
+	return 0;
+}
+
+UTEST( jobs, outside_callers_take_turns )
+{
+	struct jobs_test_slots *t = calloc( 1, sizeof( *t ) );
+	ASSERT_TRUE( t != NULL );
+	t->hits = calloc( JOBS_TEST_COUNT, sizeof( *t->hits ) );
+	ASSERT_TRUE( t->hits != NULL );
+	ASSERT_EQ( jobs_init( 3 ), JOBS_SUCCESS );
+
+	// both want the slot past the workers at the same time
+	SDL_Thread *a = SDL_CreateThread( jobs_test_outside_claim, "outside a", t );
+	SDL_Thread *b = SDL_CreateThread( jobs_test_outside_claim, "outside b", t );
+	ASSERT_TRUE( a != NULL && b != NULL );
+	SDL_WaitThread( a, NULL );
+	SDL_WaitThread( b, NULL );
+
+	int wrong = 0;
+	for ( int i = 0; i < JOBS_TEST_COUNT; i++ )
+		wrong += SDL_AtomicGet( &t->hits[ i ] ) != 2;
+	EXPECT_EQ( wrong, 0 );
+	EXPECT_EQ( SDL_AtomicGet( &t->shared ), 0 );
+
+	jobs_free();
+	free( t->hits );
+	free( t );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
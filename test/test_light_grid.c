@@ -0,0 +1,98 @@
+#include "utest.h"
+#include <trace/light_grid.h>
+#include <trace/trace.h>
+#include <util/fmath.h>
+
+#define LIGHT_GRID_TEST_W 96
+#define LIGHT_GRID_TEST_H 72
+
+// small lights scattered over the default scene, the same every run
+static void light_grid_test_scatter( struct scene *scene, int n )
+{
+	u32 state = 12345u;
+	for ( int i = 0; i < n; i++ )
+	{
+		float r[ 4 ];
+		for ( int j = 0; j < 4; j++ )
+		{
+			state = state * 1664525u + 1013904223u;
+			r[ j ] = ( float )( state >> 8 ) / ( float )( 1u << 24 );
+		}
+
+		scene_add_light( scene, ( struct scene_light ) {
+			.pos    = {{ r[ 0 ] * 16.0f - 8.0f, r[ 1 ] * 2.0f - 0.5f, r[ 2 ] * 16.0f - 8.0f }},
+			.radius = 0.1f,
+			.color  = {{ r[ 1 ], r[ 2 ], r[ 3 ] }},
+			.reach  = 1.0f + r[ 3 ] * 2.0f,
+			.power  = 1.0f
+		} );
+	}
+}
+
+UTEST( light_grid, conservative )
+{
+	struct scene scene;
+	struct light_grid grid = { 0 };
+	struct trace_context ctx;
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	scene.camera.aspect = ( float )LIGHT_GRID_TEST_W / LIGHT_GRID_TEST_H;
+	light_grid_test_scatter( &scene, 64 );
+
+	ASSERT_EQ( light_grid_build( &grid, &scene, LIGHT_GRID_TEST_W, LIGHT_GRID_TEST_H ), 0 );
+	trace_context_init( &ctx, &scene, LIGHT_GRID_TEST_W, LIGHT_GRID_TEST_H );
+
+	// most lights are culled from most tiles
+	EXPECT_LT( light_grid_lights_per_tile( &grid ), 16.0f );
+
+	// every light that reaches a primary hit is in the list of its tile,
+	// jittered samples included
+	int missing = 0;
+	for ( u32 frame = 0; frame < 4; frame++ )
+	{
+		vec2s jitter = trace_jitter( frame );
+		for ( int y = 0; y < LIGHT_GRID_TEST_H; y++ )
+		{
+			for ( int x = 0; x < LIGHT_GRID_TEST_W; x++ )
+			{
+				vec2s pixel = {{ x + 0.5f + jitter.x, y + 0.5f + jitter.y }};
+				struct hitdata hit = trace_raycast( &ctx, trace_camera_ray( &ctx, pixel ) );
+				if ( !hit.hit )
+					continue;
+
+				u32 count;
+				const u32 *lights = light_grid_lights( &grid, x, y, &count );
+				for ( u32 l = 0; l < scene.light_count; l++ )
+				{
+					if ( glms_vec3_distance( scene.lights[ l ].pos, hit.hit_point ) > scene.lights[ l ].reach )
+						continue;
+
+					bool found = false;
+					for ( u32 i = 0; i < count; i++ )
+						found |= lights[ i ] == l;
+					missing += !found;
+				}
+			}
+		}
+	}
+	EXPECT_EQ( missing, 0 );
+
+	// lists are in light order so the shader sums them like the cpu tracer
+	for ( int y = 0; y < LIGHT_GRID_TEST_H; y += LIGHT_GRID_TILE )
+	{
+		for ( int x = 0; x < LIGHT_GRID_TEST_W; x += LIGHT_GRID_TILE )
+		{
+			u32 count;
+			const u32 *lights = light_grid_lights( &grid, x, y, &count );
+			for ( u32 i = 1; i < count; i++ )
+				EXPECT_LT( lights[ i - 1 ], lights[ i ] );
+		}
+	}
+
+	light_grid_free( &grid );
+	scene_free( &scene );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
@@ -1,6 +1,11 @@
 #include "utest.h"
 #include <gfx/obj3d.h>
+#include <data/dynarr.h>
 #include <util/fmath.h>
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <string.h>
 
 struct obj3d_test_fixture
 {
@@ -146,6 +151,177 @@ UTEST_F( obj3d_test_fixture, validate_properties )
 	EXPECT_EQ( sizeof( struct vert ), sizeof( float ) * 8 );
 }
 
+static const char *obj3d_test_objects[] = {
+	"res/objects/cube.obj", "res/objects/deadpool.obj", "res/objects/rayman.obj", "res/objects/sphere.obj",
+	"res/objects/square.obj", "res/objects/teapot.obj", "res/objects/wolf.obj"
+};
+
+// the way the loader parsed before its tokenizer, fgets and sscanf on every
+// line and face vertex, kept to check the tokenizer against and to time it
+static size_t obj3d_test_sscanf_load( const char *path, struct vert **fv )
+{
+	FILE *fp = fopen( path, "r" );
+	if ( fp == NULL )
+		return 0;
+
+	vec3s *vp = NULL;
+	vec2s *vt = NULL;
+	vec3s *vn = NULL;
+	char buffer[ 1024 ];
+	while ( fgets( buffer, sizeof( buffer ), fp ) )
+	{
+		char lexeme[ 64 ];
+		if ( sscanf( buffer, "%63s", lexeme ) != 1 )
+			continue;
+
+		if ( strcmp( lexeme, "v" ) == 0 )
+		{
+			vec3s tmp;
+			sscanf( buffer, "%*s %f %f %f", &tmp.x, &tmp.y, &tmp.z );
+			dynarr_push_back( vp, tmp );
+		}
+		else if ( strcmp( lexeme, "vt" ) == 0 )
+		{
+			vec2s tmp;
+			sscanf( buffer, "%*s %f %f", &tmp.x, &tmp.y );
+			dynarr_push_back( vt, tmp );
+		}
+		else if ( strcmp( lexeme, "vn" ) == 0 )
+		{
+			vec3s tmp;
+			sscanf( buffer, "%*s %f %f %f", &tmp.x, &tmp.y, &tmp.z );
+			dynarr_push_back( vn, tmp );
+		}
+		else if ( strcmp( lexeme, "f" ) == 0 )
+		{
+			struct vert verts[ 64 ];
+			int count = 0, n;
+			char token[ 64 ];
+			for ( char *itr = buffer + 1; count < 64 && sscanf( itr, "%63s%n", token, &n ) == 1; itr += n )
+			{
+				int a, b, c;
+				sscanf( token, "%d/%d/%d", &a, &b, &c );
+				verts[ count++ ] = ( struct vert ){ .vp = vp[ a - 1 ], .vt = vt[ b - 1 ], .vn = vn[ c - 1 ] };
+			}
+
+			for ( int i = 0; i <= count - 3; i++ )
+			{
+				dynarr_push_back( *fv, verts[ 0 ] );
+				dynarr_push_back( *fv, verts[ 1 + i ] );
+				dynarr_push_back( *fv, verts[ 2 + i ] );
+			}
+		}
+	}
+
+	fclose( fp );
+	dynarr_free( vp );
+	dynarr_free( vt );
+	dynarr_free( vn );
+	return dynarr_size( *fv );
+}
+
+static double obj3d_test_ms( Uint64 start )
+{
+	return ( double )( SDL_GetPerformanceCounter() - start ) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+UTEST( obj3d, matches_sscanf_loader )
+{
+	for ( size_t i = 0; i < sizeof( obj3d_test_objects ) / sizeof( *obj3d_test_objects ); i++ )
+	{
+		const char *path = obj3d_test_objects[ i ];
+		struct vert *fv = NULL;
+		struct obj3d obj;
+
+		// best of a few runs each
+		double sscanf_ms = 0.0, load_ms = 0.0;
+		size_t len = 0;
+		for ( int run = 0; run < 3; run++ )
+		{
+			dynarr_free( fv );
+			fv = NULL;
+			Uint64 start = SDL_GetPerformanceCounter();
+			len = obj3d_test_sscanf_load( path, &fv );
+			double ms = obj3d_test_ms( start );
+			sscanf_ms = run == 0 || ms < sscanf_ms ? ms : sscanf_ms;
+
+			if ( run > 0 )
+				obj3d_free( &obj );
+			start = SDL_GetPerformanceCounter();
+			ASSERT_EQ( obj3d_load( &obj, path ), 0 );
+			ms = obj3d_test_ms( start );
+			load_ms = run == 0 || ms < load_ms ? ms : load_ms;
+		}
+
+		// the same floats to the bit, strtof rounds correctly too; the times are
+		// only logged, a loaded machine would make comparing them flaky
+		ASSERT_EQ( obj.fv_len, len );
+		EXPECT_EQ( memcmp( obj.fv, fv, len * sizeof( *fv ) ), 0 );
+		printf( "%s: %.2f ms with sscanf, %.2f ms tokenized (%.1fx)\n", path, sscanf_ms, load_ms,
+				load_ms > 0.0 ? sscanf_ms / load_ms : 0.0 );
+
+		obj3d_free( &obj );
+		dynarr_free( fv );
+	}
+}
+
+UTEST( obj3d, tokenizer_edge_cases )
+{
+	const char *path = "test_obj3d_edge.obj";
+	FILE *fp = fopen( path, "wb" );
+	ASSERT_TRUE( fp != NULL );
+
+	// tabs, crlf, exponents, trailing whitespace, missing attributes and relative
+	// indices, and attributes declared after the faces like a second object does
+	fputs( "# comment\r\n"
+		   "v\t1.5e1 -2.5E-1 +3\r\n"
+		   "v .5 -0 7.\n"
+		   "v 1 2 3\n"
+		   "vt 0.25 0.75\n"
+		   "vn 0 0 -1\n"
+		   "f 1/1/1 2/1/1 3/1/1 \t\r\n"
+		   "f 1//1 2//1 3//1\n"
+		   "f -3 -2 -1\n"
+		   "f 1/1 2/1 9/1\n"
+		   "vt 0.5 0.25\n"
+		   "vn 1 0 0", fp );
+	fclose( fp );
+
+	struct obj3d obj;
+	ASSERT_EQ( obj3d_load( &obj, path ), 0 );
+	remove( path );
+
+	ASSERT_EQ( obj.vp_len, ( size_t )3 );
+	EXPECT_EQ( obj.vp[ 0 ].x, 15.0f );
+	EXPECT_EQ( obj.vp[ 0 ].y, -0.25f );
+	EXPECT_EQ( obj.vp[ 0 ].z, 3.0f );
+	EXPECT_EQ( obj.vp[ 1 ].x, 0.5f );
+	EXPECT_EQ( obj.vp[ 1 ].z, 7.0f );
+
+	// one triangle per face, the trailing whitespace is not a vertex
+	ASSERT_EQ( obj.fv_len, ( size_t )12 );
+	EXPECT_EQ( obj.fv[ 2 ].vp.z, 3.0f );
+	EXPECT_EQ( obj.fv[ 2 ].vt.y, 0.75f );
+	EXPECT_EQ( obj.fv[ 2 ].vn.z, -1.0f );
+
+	// v//vn has no texture coordinates, not even ones declared later, -1 is
+	// the last vertex so far
+	EXPECT_EQ( obj.fv[ 3 ].vt.x, 0.0f );
+	EXPECT_EQ( obj.fv[ 3 ].vt.y, 0.0f );
+	EXPECT_EQ( obj.fv[ 6 ].vt.x, 0.0f );
+	EXPECT_EQ( obj.fv[ 6 ].vn.x, 0.0f );
+	EXPECT_EQ( obj.fv[ 3 ].vn.z, -1.0f );
+	EXPECT_EQ( obj.fv[ 6 ].vp.x, 15.0f );
+	EXPECT_EQ( obj.fv[ 8 ].vp.y, 2.0f );
+	EXPECT_EQ( obj.fv[ 8 ].vn.z, 0.0f );
+
+	// an index past the end is a zero vertex, not a read out of bounds
+	EXPECT_EQ( obj.fv[ 11 ].vp.x, 0.0f );
+	EXPECT_EQ( obj.fv[ 11 ].vt.y, 0.75f );
+
+	obj3d_free( &obj );
+}
+
 #ifdef INSTANTIATE_MAIN
 UTEST_MAIN()
 #endif
@@ -0,0 +1,81 @@
+#include "utest.h"
+#include <system/snapshot.h>
+
+#define SNAPSHOT_TEST_WORDS		1024
+#define SNAPSHOT_TEST_COUNT		20000
+
+// every word holds the number of the snapshot, a torn read mixes two
+struct snapshot_test_state
+{
+	int words[ SNAPSHOT_TEST_WORDS ];
+};
+
+static int snapshot_test_writer( void *data )
+{
+	struct snapshot *snapshots = data;
+	for ( int n = 1; n <= SNAPSHOT_TEST_COUNT; n++ )
+	{
+		struct snapshot_test_state *back = snapshot_back( snapshots );
+		for ( int i = 0; i < SNAPSHOT_TEST_WORDS; i++ )
+			back->words[ i ] = n;
+		snapshot_publish( snapshots );
+	}
+	return 0;
+}
+
+UTEST( snapshot, single_thread )
+{
+	struct snapshot snapshots;
+	int initial = 7;
+	ASSERT_EQ( snapshot_init( &snapshots, &initial, sizeof( int ) ), SNAPSHOT_SUCCESS );
+
+	EXPECT_FALSE( snapshot_acquire( &snapshots ) );
+	EXPECT_EQ( *( const int * )snapshot_front( &snapshots ), 7 );
+
+	// only the latest of several publishes is seen, and only once
+	for ( int n = 1; n <= 3; n++ )
+	{
+		*( int * )snapshot_back( &snapshots ) = n;
+		snapshot_publish( &snapshots );
+	}
+	EXPECT_TRUE( snapshot_acquire( &snapshots ) );
+	EXPECT_EQ( *( const int * )snapshot_front( &snapshots ), 3 );
+	EXPECT_FALSE( snapshot_acquire( &snapshots ) );
+	EXPECT_EQ( *( const int * )snapshot_front( &snapshots ), 3 );
+
+	snapshot_free( &snapshots );
+}
+
+UTEST( snapshot, concurrent )
+{
+	static struct snapshot_test_state initial;
+	struct snapshot snapshots;
+	ASSERT_EQ( snapshot_init( &snapshots, &initial, sizeof( initial ) ), SNAPSHOT_SUCCESS );
+
+	SDL_Thread *writer = SDL_CreateThread( snapshot_test_writer, "writer", &snapshots );
+	ASSERT_TRUE( writer != NULL );
+
+	// snapshots arrive whole and in order
+	int last = 0, torn = 0, backwards = 0;
+	while ( last < SNAPSHOT_TEST_COUNT )
+	{
+		if ( !snapshot_acquire( &snapshots ) )
+			continue;
+
+		const struct snapshot_test_state *front = snapshot_front( &snapshots );
+		for ( int i = 1; i < SNAPSHOT_TEST_WORDS; i++ )
+			torn += front->words[ i ] != front->words[ 0 ];
+		backwards += front->words[ 0 ] <= last;
+		last = front->words[ 0 ];
+	}
+
+	SDL_WaitThread( writer, NULL );
+	EXPECT_EQ( torn, 0 );
+	EXPECT_EQ( backwards, 0 );
+
+	snapshot_free( &snapshots );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
@@ -0,0 +1,105 @@
+#include "utest.h"
+#include <trace/spheres.h>
+#include <trace/scene.h>
+#include <trace/tracer.h>
+#include <trace/packet.h>
+#include <util/fmath.h>
+#include <math.h>
+#include <stdint.h>
+
+UTEST( spheres, add_remove )
+{
+	struct spheres spheres = { 0 };
+	u32 handles[ 100 ];
+
+	for ( u32 i = 0; i < 100; i++ )
+	{
+		handles[ i ] = spheres_add( &spheres, ( vec3s ){{ ( float )i, 0.0f, 0.0f }}, 1.0f, i % 3 );
+		ASSERT_EQ( handles[ i ], i );
+	}
+	EXPECT_EQ( spheres.count, 100u );
+
+	// whole blocks, every array aligned
+	u32 blocks = spheres.cap / SPHERES_BLOCK;
+	EXPECT_EQ( blocks * SPHERES_BLOCK, spheres.cap );
+	const float *arrays[] = { spheres.x, spheres.y, spheres.z, spheres.radius };
+	for ( int i = 0; i < 4; i++ )
+	{
+		uintptr_t address = ( uintptr_t )arrays[ i ];
+		uintptr_t aligned = address / SPHERES_ALIGN * SPHERES_ALIGN;
+		EXPECT_EQ( aligned, address );
+	}
+
+	// the last sphere moves into the hole, its handle follows it
+	u32 version = spheres.version;
+	EXPECT_TRUE( spheres_remove( &spheres, 10 ) );
+	EXPECT_FALSE( spheres_remove( &spheres, 10 ) );
+	EXPECT_GT( spheres.version, version );
+	EXPECT_EQ( spheres.count, 99u );
+	EXPECT_EQ( spheres_slot( &spheres, 10 ), SPHERES_NONE );
+	EXPECT_EQ( spheres_slot( &spheres, 99 ), 10u );
+	EXPECT_EQ( spheres.x[ 10 ], 99.0f );
+	EXPECT_EQ( spheres.mat[ 10 ], 0u );
+
+	// the padding never hits
+	for ( u32 i = spheres.count; i < spheres.cap; i++ )
+		EXPECT_TRUE( isnan( spheres.x[ i ] ) );
+
+	// handles are reused
+	EXPECT_EQ( spheres_add( &spheres, ( vec3s ){{ 5.0f, 5.0f, 5.0f }}, 2.0f, 1 ), 10u );
+	EXPECT_TRUE( spheres_set( &spheres, 10, ( vec3s ){{ 1.0f, 2.0f, 3.0f }}, 0.5f ) );
+	EXPECT_EQ( spheres_center( &spheres, spheres_slot( &spheres, 10 ) ).z, 3.0f );
+
+	for ( u32 i = 0; i < 100; i++ )
+		EXPECT_EQ( spheres.handle[ spheres_slot( &spheres, i ) ], i );
+
+	spheres_clear( &spheres );
+	EXPECT_EQ( spheres.count, 0u );
+	EXPECT_EQ( spheres_slot( &spheres, 0 ), SPHERES_NONE );
+	spheres_free( &spheres );
+}
+
+static const char *spheres_test_kernels[] = { "scalar", "sse", "avx2", "avx512" };
+
+UTEST( spheres, packets_match_single_ray )
+{
+	struct scene scene;
+	struct tracer single;
+	struct tracer packet;
+
+	// enough spheres to shadow each other, some removed again
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	srand( 7 );
+	for ( int i = 0; i < 1000; i++ )
+	{
+		vec3s pos = {{ ( float )rand() / RAND_MAX * 12.0f - 6.0f, ( float )rand() / RAND_MAX * 3.0f - 0.9f,
+		               ( float )rand() / RAND_MAX * 12.0f - 6.0f }};
+		scene_add_sphere( &scene, pos, 0.05f + ( float )rand() / RAND_MAX * 0.2f, ( u32 )( i % 5 ) );
+	}
+	for ( u32 i = 5; i < 1000; i += 7 )
+		spheres_remove( &scene.spheres, i );
+
+	ASSERT_EQ( tracer_init( &single, 67, 43, 1 ), TRACER_SUCCESS );
+	ASSERT_EQ( tracer_init( &packet, 67, 43, 1 ), TRACER_SUCCESS );
+	single.kernels = NULL;
+	tracer_render( &single, &scene );
+
+	for ( size_t k = 0; k < sizeof( spheres_test_kernels ) / sizeof( *spheres_test_kernels ); k++ )
+	{
+		packet.kernels = packet_kernels_find( spheres_test_kernels[ k ] );
+		if ( packet.kernels == NULL )
+			continue;
+
+		tracer_render( &packet, &scene );
+		EXPECT_EQ( single.rays, packet.rays );
+		EXPECT_EQ( memcmp( single.pixels, packet.pixels, 67 * 43 * sizeof( *single.pixels ) ), 0 );
+	}
+
+	tracer_free( &single );
+	tracer_free( &packet );
+	scene_free( &scene );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif
@@ -0,0 +1,312 @@
+#include "utest.h"
+#include <trace/trace.h>
+#include <trace/tracer.h>
+#include <trace/packet.h>
+#include <system/jobs.h>
+#include <util/fmath.h>
+
+UTEST( trace, hit_sphere )
+{
+	struct ray ray = { .orig = {{ 0.0f, 0.0f, -5.0f }}, .dir = {{ 0.0f, 0.0f, 1.0f }} };
+	struct hitdata hit = trace_hit_sphere( ray, GLMS_VEC3_ZERO, 1.0f );
+
+	ASSERT_TRUE( hit.hit );
+	EXPECT_TRUE( fltcmp( hit.dist, 4.0f, 0.0001f ) );
+	EXPECT_TRUE( fltcmp( hit.normal.z, -1.0f, 0.0001f ) );
+
+	// sphere behind the ray
+	ray.dir.z = -1.0f;
+	hit = trace_hit_sphere( ray, GLMS_VEC3_ZERO, 1.0f );
+	EXPECT_FALSE( hit.hit );
+}
+
+UTEST( trace, hit_plane )
+{
+	struct scene_plane plane = { .pos = {{ 0.0f, -1.0f, 0.0f }}, .norm = {{ 0.0f, 1.0f, 0.0f }} };
+	struct ray ray = { .orig = {{ 0.0f, 1.0f, 0.0f }}, .dir = {{ 0.0f, -1.0f, 0.0f }} };
+	struct hitdata hit = trace_hit_plane( ray, &plane );
+
+	ASSERT_TRUE( hit.hit );
+	EXPECT_TRUE( fltcmp( hit.dist, 2.0f, 0.0001f ) );
+
+	// parallel to the plane
+	ray.dir = ( vec3s ){{ 1.0f, 0.0f, 0.0f }};
+	hit = trace_hit_plane( ray, &plane );
+	EXPECT_FALSE( hit.hit );
+}
+
+UTEST( trace, hit_tri )
+{
+	struct vert tri[ 3 ] = {
+		{ .vp = {{ -1.0f, -1.0f, 0.0f }}, .vn = {{ 0.0f, 0.0f, -1.0f }} },
+		{ .vp = {{  1.0f, -1.0f, 0.0f }}, .vn = {{ 0.0f, 0.0f, -1.0f }} },
+		{ .vp = {{  0.0f,  1.0f, 0.0f }}, .vn = {{ 0.0f, 0.0f, -1.0f }} }
+	};
+
+	// back faces are culled
+	struct ray ray = { .orig = {{ 0.0f, 0.0f, -2.0f }}, .dir = {{ 0.0f, 0.0f, 1.0f }} };
+	struct hitdata hit = trace_hit_tri( ray, tri );
+	EXPECT_FALSE( hit.hit );
+
+	ray = ( struct ray ){ .orig = {{ 0.0f, 0.0f, 2.0f }}, .dir = {{ 0.0f, 0.0f, -1.0f }} };
+	hit = trace_hit_tri( ray, tri );
+	ASSERT_TRUE( hit.hit );
+	EXPECT_TRUE( fltcmp( hit.dist, 2.0f, 0.0001f ) );
+
+	// outside of the edges
+	ray.orig.x = 2.0f;
+	hit = trace_hit_tri( ray, tri );
+	EXPECT_FALSE( hit.hit );
+}
+
+UTEST( trace, threads_match_single_thread )
+{
+	struct scene scene;
+	struct tracer single;
+	struct tracer multi;
+
+	// the tiles of the threaded tracer run on the job system
+	ASSERT_EQ( jobs_init( 4 ), JOBS_SUCCESS );
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	ASSERT_EQ( tracer_init( &single, 67, 43, 1 ), TRACER_SUCCESS );
+	ASSERT_EQ( tracer_init( &multi, 67, 43, 4 ), TRACER_SUCCESS );
+
+	tracer_render( &single, &scene );
+	tracer_render( &multi, &scene );
+
+	EXPECT_EQ( single.rays, multi.rays );
+	EXPECT_EQ( memcmp( single.pixels, multi.pixels, 67 * 43 * sizeof( *single.pixels ) ), 0 );
+
+	tracer_free( &single );
+	tracer_free( &multi );
+	scene_free( &scene );
+	jobs_free();
+}
+
+static const char *trace_test_kernels[] = { "scalar", "sse", "avx2", "avx512" };
+
+UTEST( trace, packet_kernels_match_scalar )
+{
+	struct scene scene;
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	const u32 count = scene.spheres.count;
+
+	struct vert tri[ 3 ] = {
+		{ .vp = {{ -4.0f, -1.0f, 6.0f }}, .vn = {{ 0.0f, 0.0f, -1.0f }} },
+		{ .vp = {{  0.0f,  4.0f, 6.0f }}, .vn = {{ 0.0f, 0.0f, -1.0f }} },
+		{ .vp = {{  4.0f, -1.0f, 6.0f }}, .vn = {{ 0.0f, 0.0f, -1.0f }} }
+	};
+
+	for ( size_t k = 0; k < sizeof( trace_test_kernels ) / sizeof( *trace_test_kernels ); k++ )
+	{
+		const struct packet_kernels *kernels = packet_kernels_find( trace_test_kernels[ k ] );
+		if ( kernels == NULL )
+			continue;
+
+		srand( 1234 );
+		for ( int n = 0; n < 64; n++ )
+		{
+			struct ray_packet p = { 0 };
+			struct ray rays[ PACKET_SIZE ];
+
+			for ( int i = 0; i < PACKET_SIZE; i++ )
+			{
+				rays[ i ].orig = ( vec3s ){{ 0.0f, 0.5f, -6.0f }};
+				rays[ i ].dir = glms_vec3_normalize( ( vec3s ){{
+					( float )rand() / RAND_MAX - 0.5f,
+					( float )rand() / RAND_MAX - 0.5f,
+					1.0f
+				}} );
+				packet_set_ray( &p, i, rays[ i ] );
+			}
+
+			// odd lanes are terminated and must not be touched
+			packet_reset( &p, 0x5555u );
+			for ( u32 i = 0; i < count; i++ )
+				kernels->hit_sphere( &p, spheres_center( &scene.spheres, i ), scene.spheres.radius[ i ], ( i32 )i );
+			kernels->hit_plane( &p, &scene.plane, ( i32 )count );
+			kernels->hit_tri( &p, tri, ( i32 )count + 1 );
+
+			for ( int i = 0; i < PACKET_SIZE; i++ )
+			{
+				if ( i % 2 )
+				{
+					EXPECT_EQ( p.id[ i ], -1 );
+					continue;
+				}
+
+				int id = -1;
+				float t = TRACE_RENDER_DISTANCE;
+				for ( int j = 0; j < ( int )count + 2; j++ )
+				{
+					struct hitdata hit;
+					if ( j < ( int )count )
+						hit = trace_hit_sphere( rays[ i ], spheres_center( &scene.spheres, j ), scene.spheres.radius[ j ] );
+					else if ( j == ( int )count )
+						hit = trace_hit_plane( rays[ i ], &scene.plane );
+					else
+						hit = trace_hit_tri( rays[ i ], tri );
+
+					if ( hit.hit && hit.dist < t )
+					{
+						id = j;
+						t = hit.dist;
+					}
+				}
+
+				EXPECT_EQ( p.id[ i ], id );
+				EXPECT_EQ( p.t[ i ], t );
+			}
+
+			// all spheres at once gives the same hits
+			struct ray_packet q = p;
+			packet_reset( &q, 0x5555u );
+			kernels->hit_spheres( &q, &scene.spheres, 0, false );
+			kernels->hit_plane( &q, &scene.plane, ( i32 )count );
+			kernels->hit_tri( &q, tri, ( i32 )count + 1 );
+			EXPECT_EQ( memcmp( q.id, p.id, sizeof( p.id ) ), 0 );
+			EXPECT_EQ( memcmp( q.t, p.t, sizeof( p.t ) ), 0 );
+		}
+	}
+
+	scene_free( &scene );
+}
+
+UTEST( trace, packets_match_single_ray )
+{
+	struct scene scene;
+	struct tracer single;
+	struct tracer packet;
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	ASSERT_EQ( tracer_init( &single, 67, 43, 1 ), TRACER_SUCCESS );
+	ASSERT_EQ( tracer_init( &packet, 67, 43, 1 ), TRACER_SUCCESS );
+	single.kernels = NULL;
+
+	tracer_render( &single, &scene );
+
+	for ( size_t k = 0; k < sizeof( trace_test_kernels ) / sizeof( *trace_test_kernels ); k++ )
+	{
+		packet.kernels = packet_kernels_find( trace_test_kernels[ k ] );
+		if ( packet.kernels == NULL )
+			continue;
+
+		tracer_render( &packet, &scene );
+		EXPECT_EQ( single.rays, packet.rays );
+		EXPECT_EQ( memcmp( single.pixels, packet.pixels, 67 * 43 * sizeof( *single.pixels ) ), 0 );
+	}
+
+	tracer_free( &single );
+	tracer_free( &packet );
+	scene_free( &scene );
+}
+
+UTEST( trace, bounces )
+{
+	struct scene scene;
+	struct tracer single;
+	struct tracer packet;
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	ASSERT_EQ( tracer_init( &single, 67, 43, 1 ), TRACER_SUCCESS );
+	ASSERT_EQ( tracer_init( &packet, 67, 43, 1 ), TRACER_SUCCESS );
+	single.kernels = NULL;
+
+	// primary rays only
+	scene.max_depth = 0;
+	tracer_render( &single, &scene );
+	EXPECT_EQ( tracer_path_length( &single ), 1.0 );
+
+	// the mirrors add bounces up to the max depth
+	scene.max_depth = 1;
+	tracer_render( &single, &scene );
+	double one = tracer_path_length( &single );
+	scene.max_depth = 4;
+	tracer_render( &single, &scene );
+	EXPECT_GT( one, 1.0 );
+	EXPECT_GT( tracer_path_length( &single ), one );
+	EXPECT_LE( tracer_path_length( &single ), 5.0 );
+
+	// nothing is reflected off materials that do not reflect
+	for ( u32 i = 0; i < scene.material_count; i++ )
+		scene.materials[ i ].reflectiveness = 0.0f;
+	tracer_render( &single, &scene );
+	EXPECT_EQ( tracer_path_length( &single ), 1.0 );
+
+	// weak reflections end in russian roulette after the second bounce,
+	// it only depends on the hit so packets still match single rays
+	for ( u32 i = 0; i < scene.material_count; i++ )
+		scene.materials[ i ].reflectiveness = 0.05f;
+	single.roulette = true;
+	packet.roulette = true;
+	tracer_render( &single, &scene );
+	tracer_render( &packet, &scene );
+	EXPECT_EQ( single.segments, packet.segments );
+	EXPECT_EQ( memcmp( single.pixels, packet.pixels, 67 * 43 * sizeof( *single.pixels ) ), 0 );
+
+	tracer_free( &single );
+	tracer_free( &packet );
+	scene_free( &scene );
+}
+
+// mean absolute difference to a box filtered render at 4x the resolution
+static float trace_test_aliasing( const struct tracer *tracer, const struct tracer *ref )
+{
+	float err = 0.0f;
+	for ( int y = 0; y < tracer->h; y++ )
+	{
+		for ( int x = 0; x < tracer->w; x++ )
+		{
+			vec3s sum = GLMS_VEC3_ZERO;
+			for ( int j = 0; j < 4; j++ )
+				for ( int i = 0; i < 4; i++ )
+					sum = glms_vec3_add( sum, ref->pixels[ ( y * 4 + j ) * ref->w + x * 4 + i ] );
+
+			vec3s d = glms_vec3_sub( glms_vec3_scale( sum, 1.0f / 16.0f ), tracer->pixels[ y * tracer->w + x ] );
+			err += fabsf( d.x ) + fabsf( d.y ) + fabsf( d.z );
+		}
+	}
+
+	return err / ( tracer->w * tracer->h );
+}
+
+UTEST( trace, accumulate_converges )
+{
+	struct scene scene;
+	struct tracer tracer;
+	struct tracer ref;
+
+	// frame 0 goes through the pixel centers, the rest stay inside the pixel
+	EXPECT_EQ( trace_jitter( 0 ).x, 0.0f );
+	EXPECT_EQ( trace_jitter( 0 ).y, 0.0f );
+	for ( u32 i = 1; i < 64; i++ )
+	{
+		vec2s j = trace_jitter( i );
+		EXPECT_TRUE( j.x >= -0.5f && j.x < 0.5f && j.y >= -0.5f && j.y < 0.5f );
+	}
+
+	scene_init_default( &scene, degtorad( 45.0f ) );
+	ASSERT_EQ( tracer_init( &tracer, 67, 43, 0 ), TRACER_SUCCESS );
+	ASSERT_EQ( tracer_init( &ref, 67 * 4, 43 * 4, 0 ), TRACER_SUCCESS );
+	tracer_render( &ref, &scene );
+
+	tracer_render( &tracer, &scene );
+	EXPECT_EQ( tracer.frames, 1u );
+	float single = trace_test_aliasing( &tracer, &ref );
+
+	for ( int i = 1; i < 16; i++ )
+		tracer_accumulate( &tracer, &scene );
+	EXPECT_EQ( tracer.frames, 16u );
+	float accumulated = trace_test_aliasing( &tracer, &ref );
+
+	// edges get antialiased
+	EXPECT_LT( accumulated, single * 0.5f );
+
+	tracer_free( &tracer );
+	tracer_free( &ref );
+	scene_free( &scene );
+}
+
+#ifdef INSTANTIATE_MAIN
+UTEST_MAIN()
+#endif